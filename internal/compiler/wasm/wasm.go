@@ -64,6 +64,9 @@ const (
 	opaValueCompare      = "opa_value_compare"
 	opaValueGet          = "opa_value_get"
 	opaValueIter         = "opa_value_iter"
+	opaValueCursor       = "opa_value_cursor"
+	opaValueCursorNext   = "opa_value_cursor_next"
+	opaValueCursorValue  = "opa_value_cursor_value"
 	opaValueLength       = "opa_value_length"
 	opaValueMerge        = "opa_value_merge"
 	opaValueShallowCopy  = "opa_value_shallow_copy"
@@ -123,6 +126,7 @@ var builtinsFunctions = map[string]string{
 	ast.Base64UrlEncode.Name:            "opa_base64_url_encode",
 	ast.Base64UrlDecode.Name:            "opa_base64_url_decode",
 	ast.NetCIDRContains.Name:            "opa_cidr_contains",
+	ast.NetCIDRContainsMatches.Name:     "opa_cidr_contains_matches",
 	ast.NetCIDROverlap.Name:             "opa_cidr_contains",
 	ast.NetCIDRIntersects.Name:          "opa_cidr_intersects",
 	ast.Equal.Name:                      "opa_cmp_eq",
@@ -132,6 +136,8 @@ var builtinsFunctions = map[string]string{
 	ast.LessThanEq.Name:                 "opa_cmp_lte",
 	ast.NotEqual.Name:                   "opa_cmp_neq",
 	ast.GlobMatch.Name:                  "opa_glob_match",
+	ast.HexEncode.Name:                  "opa_hex_encode",
+	ast.HexDecode.Name:                  "opa_hex_decode",
 	ast.JSONMarshal.Name:                "opa_json_marshal",
 	ast.JSONUnmarshal.Name:              "opa_json_unmarshal",
 	ast.ObjectFilter.Name:               "builtin_object_filter",
@@ -148,6 +154,7 @@ var builtinsFunctions = map[string]string{
 	ast.StartsWith.Name:                 "opa_strings_startswith",
 	ast.EndsWith.Name:                   "opa_strings_endswith",
 	ast.Split.Name:                      "opa_strings_split",
+	ast.Sprintf.Name:                    "opa_strings_sprintf",
 	ast.Replace.Name:                    "opa_strings_replace",
 	ast.ReplaceN.Name:                   "opa_strings_replace_n",
 	ast.Trim.Name:                       "opa_strings_trim",
@@ -164,6 +171,9 @@ var builtinsFunctions = map[string]string{
 	ast.RegexMatch.Name:                 "opa_regex_match",
 	ast.RegexMatchDeprecated.Name:       "opa_regex_match",
 	ast.RegexFindAllStringSubmatch.Name: "opa_regex_find_all_string_submatch",
+	ast.RegexSplit.Name:                 "opa_regex_split",
+	ast.URLQueryEncode.Name:             "opa_urlquery_encode",
+	ast.URLQueryDecode.Name:             "opa_urlquery_decode",
 	ast.JSONRemove.Name:                 "builtin_json_remove",
 	ast.JSONFilter.Name:                 "builtin_json_filter",
 }
@@ -175,6 +185,7 @@ var builtinsUsingRE2 = [...]string{
 	builtinsFunctions[ast.RegexMatch.Name],
 	builtinsFunctions[ast.RegexMatchDeprecated.Name],
 	builtinsFunctions[ast.RegexFindAllStringSubmatch.Name],
+	builtinsFunctions[ast.RegexSplit.Name],
 	builtinsFunctions[ast.GlobMatch.Name],
 }
 
@@ -208,6 +219,8 @@ type Compiler struct {
 	opaBoolAddrs          map[ir.Bool]uint32 // addresses of interned opa_boolean_t
 	fileAddrs             []uint32           // null-terminated string constant addresses, used for file names
 	funcs                 map[string]uint32  // maps imported and exported function names to function indices
+	memoizeBase           uint32             // lowest policy function index; memoization keys are rebased to zero
+	memoizeCount          int32              // size of the memoization table passed to opa_memoize_init
 
 	nextLocal uint32
 	locals    map[ir.Local]uint32
@@ -488,11 +501,12 @@ func (c *Compiler) writeInternedOPAValues(buf *bytes.Buffer) error {
 	c.opaStringAddrs = make([]uint32, len(c.policy.Static.Strings))
 	for i, s := range c.policy.Static.Strings {
 		c.opaStringAddrs[i] = uint32(buf.Len()) + uint32(c.stringOffset)
-		size := 12
+		size := 16
 		b := make([]byte, size)
 		binary.LittleEndian.PutUint16(b[0:], uint16(opaTypeStringInterned))
 		binary.LittleEndian.PutUint32(b[4:], uint32(len(s.Value)))
 		binary.LittleEndian.PutUint32(b[8:], c.stringAddrs[i])
+		// b[12:16] is the lazily computed hash field, zero until first use.
 		n, err := buf.Write(b)
 		if err != nil {
 			return fmt.Errorf("write interned strings: %w", err)
@@ -631,6 +645,27 @@ func (c *Compiler) compileEntrypointDecls() error {
 
 // compileFuncs compiles the policy functions and emits them into the module.
 func (c *Compiler) compileFuncs() error {
+	// Policy functions were declared together, so their indices are a dense
+	// range; rebasing them to zero gives the memoization table its keys and
+	// its size.
+	var minIdx, maxIdx uint32
+	for i, fn := range c.policy.Funcs.Funcs {
+		idx, ok := c.funcs[fn.Name]
+		if !ok {
+			return fmt.Errorf("unknown function: %v", fn.Name)
+		}
+		if i == 0 || idx < minIdx {
+			minIdx = idx
+		}
+		if i == 0 || idx > maxIdx {
+			maxIdx = idx
+		}
+	}
+	if len(c.policy.Funcs.Funcs) > 0 {
+		c.memoizeBase = minIdx
+		c.memoizeCount = int32(maxIdx-minIdx) + 1
+	}
+
 	for _, fn := range c.policy.Funcs.Funcs {
 		if err := c.compileFunc(fn); err != nil {
 			return fmt.Errorf("func %v: %w", fn.Name, err)
@@ -657,7 +692,8 @@ func (c *Compiler) compilePlans() error {
 	c.lctx = c.genLocal()
 	c.lrs = c.genLocal()
 
-	// Initialize memoization.
+	// Initialize memoization, sized to the policy's function count.
+	c.appendInstr(instruction.I32Const{Value: c.memoizeCount})
 	c.appendInstr(instruction.Call{Index: c.function(opaMemoizeInit)})
 
 	// Initialize the input and data locals.
@@ -760,7 +796,7 @@ func (c *Compiler) compileFunc(fn *ir.Func) error {
 
 	// memoization: get
 	if memoize {
-		c.appendInstr(instruction.I32Const{Value: int32(idx)})
+		c.appendInstr(instruction.I32Const{Value: int32(idx - c.memoizeBase)})
 		c.appendInstr(instruction.Call{Index: c.function(opaMemoizeGet)})
 		c.appendInstr(instruction.TeeLocal{Index: c.local(fn.Return)})
 		c.appendInstr(instruction.If{Instrs: []instruction.Instruction{
@@ -785,7 +821,7 @@ func (c *Compiler) compileFunc(fn *ir.Func) error {
 			// before the return:
 			for _, instr := range instrs {
 				if _, ok := instr.(instruction.Return); ok && memoize {
-					c.appendInstr(instruction.I32Const{Value: int32(idx)})
+					c.appendInstr(instruction.I32Const{Value: int32(idx - c.memoizeBase)})
 					c.appendInstr(instruction.GetLocal{Index: c.local(fn.Return)})
 					c.appendInstr(instruction.Call{Index: c.function(opaMemoizeInsert)})
 				}
@@ -1142,9 +1178,11 @@ func (c *Compiler) compileBlock(block *ir.Block) ([]instruction.Instruction, err
 
 func (c *Compiler) compileScan(scan *ir.ScanStmt, result *[]instruction.Instruction) error {
 	var instrs = *result
-	instrs = append(instrs, instruction.I32Const{Value: 0})
-	instrs = append(instrs, instruction.SetLocal{Index: c.local(scan.Key)})
-	body, err := c.compileScanBlock(scan)
+	lcursor := c.genLocal()
+	instrs = append(instrs, instruction.GetLocal{Index: c.local(scan.Source)})
+	instrs = append(instrs, instruction.Call{Index: c.function(opaValueCursor)})
+	instrs = append(instrs, instruction.SetLocal{Index: lcursor})
+	body, err := c.compileScanBlock(scan, lcursor)
 	if err != nil {
 		return err
 	}
@@ -1157,13 +1195,12 @@ func (c *Compiler) compileScan(scan *ir.ScanStmt, result *[]instruction.Instruct
 	return nil
 }
 
-func (c *Compiler) compileScanBlock(scan *ir.ScanStmt) ([]instruction.Instruction, error) {
+func (c *Compiler) compileScanBlock(scan *ir.ScanStmt, lcursor uint32) ([]instruction.Instruction, error) {
 	var instrs []instruction.Instruction
 
 	// Execute iterator.
-	instrs = append(instrs, instruction.GetLocal{Index: c.local(scan.Source)})
-	instrs = append(instrs, instruction.GetLocal{Index: c.local(scan.Key)})
-	instrs = append(instrs, instruction.Call{Index: c.function(opaValueIter)})
+	instrs = append(instrs, instruction.GetLocal{Index: lcursor})
+	instrs = append(instrs, instruction.Call{Index: c.function(opaValueCursorNext)})
 
 	// Check for emptiness.
 	instrs = append(instrs, instruction.TeeLocal{Index: c.local(scan.Key)})
@@ -1171,9 +1208,8 @@ func (c *Compiler) compileScanBlock(scan *ir.ScanStmt) ([]instruction.Instructio
 	instrs = append(instrs, instruction.BrIf{Index: 1})
 
 	// Load value.
-	instrs = append(instrs, instruction.GetLocal{Index: c.local(scan.Source)})
-	instrs = append(instrs, instruction.GetLocal{Index: c.local(scan.Key)})
-	instrs = append(instrs, instruction.Call{Index: c.function(opaValueGet)})
+	instrs = append(instrs, instruction.GetLocal{Index: lcursor})
+	instrs = append(instrs, instruction.Call{Index: c.function(opaValueCursorValue)})
 	instrs = append(instrs, instruction.SetLocal{Index: c.local(scan.Value)})
 
 	// Loop body.
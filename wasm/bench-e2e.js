@@ -0,0 +1,176 @@
+// End-to-end macro benchmark: replays recorded inputs against a compiled
+// policy module through the one-shot opa_eval ABI and prints one JSON
+// object per input with latency percentiles and per-eval heap statistics
+// (peak heap and allocation counts, from the stats exports in malloc.c).
+//
+//   node bench-e2e.js <policy.wasm> <data.json> <inputs.jsonl>
+//
+// The inputs file holds one JSON input document per line, as captured from
+// production traffic. Knobs (environment variables):
+//
+//   BENCH_E2E_ITERATIONS  timed evals per input (default 100)
+//   BENCH_E2E_WARMUP      untimed evals per input first (default 10)
+//   BENCH_E2E_ENTRYPOINT  entrypoint id to evaluate (default 0)
+//   BENCH_E2E_PAGES       imported memory size in 64KB pages (default 1000)
+//
+// Modules built against runtimes without the heap stats exports still
+// report latency; the heap fields are then null.
+
+const { readFileSync } = require('fs');
+
+function stringDecoder(mem) {
+    return function (addr) {
+        const i8 = new Int8Array(mem.buffer);
+        const start = addr;
+        var s = "";
+        while (i8[addr] != 0) {
+            s += String.fromCharCode(i8[addr++]);
+        }
+        return s;
+    }
+}
+
+function percentile(sorted, p) {
+    const i = Math.min(sorted.length - 1, Math.ceil((p / 100) * sorted.length) - 1);
+    return sorted[Math.max(0, i)];
+}
+
+async function benchE2E(modulePath, dataPath, inputsPath) {
+
+    const iterations = parseInt(process.env.BENCH_E2E_ITERATIONS || '100');
+    const warmup = parseInt(process.env.BENCH_E2E_WARMUP || '10');
+    const entrypoint = parseInt(process.env.BENCH_E2E_ENTRYPOINT || '0');
+    const pages = parseInt(process.env.BENCH_E2E_PAGES || '1000');
+
+    const mem = new WebAssembly.Memory({ initial: pages });
+    const addr2string = stringDecoder(mem);
+
+    const module = await WebAssembly.instantiate(readFileSync(modulePath), {
+        env: {
+            memory: mem,
+            opa_builtin0: (_1, _2) => { return 0; },
+            opa_builtin1: (_1, _2, _3, _4) => { return 0; },
+            opa_builtin2: (_1, _2, _3, _4) => { return 0; },
+            opa_builtin3: (_1, _2, _3, _4, _5) => { return 0; },
+            opa_builtin4: (_1, _2, _3, _4, _5, _6) => { return 0; },
+            opa_println: (msg) => {
+                console.log(addr2string(msg));
+            },
+            opa_abort: (msg) => {
+                throw 'abort: ' + addr2string(msg);
+            },
+            opa_clock: () => {
+                return process.hrtime.bigint();
+            },
+            opa_bench_report: (name, iterations, ns) => { },
+        }
+    });
+
+    const e = module.instance.exports;
+
+    if (typeof e._initialize === 'function') {
+        e._initialize();
+    }
+
+    function writeString(s) {
+        const buf = Buffer.from(s);
+        const addr = e.opa_malloc(buf.length);
+        new Uint8Array(mem.buffer).set(buf, addr);
+        return [addr, buf.length];
+    }
+
+    // the data document is loaded once, below the per-eval heap mark
+    const [dataAddr, dataLen] = writeString(readFileSync(dataPath, 'utf8'));
+    const data = e.opa_json_parse(dataAddr, dataLen);
+
+    if (data == 0) {
+        console.log("ERROR", "data document failed to parse");
+        process.exit(1);
+    }
+
+    const heapBase = e.opa_heap_ptr_get();
+
+    // heap statistics are optional: older runtimes lack the exports
+    const haveStats = typeof e.opa_heap_high_water_get === 'function' &&
+        typeof e.opa_heap_alloc_count_get === 'function';
+
+    const inputs = readFileSync(inputsPath, 'utf8')
+        .split('\n')
+        .filter((line) => line.trim().length > 0);
+
+    if (inputs.length == 0) {
+        console.log("ERROR", "no inputs to replay");
+        process.exit(2);
+    }
+
+    const all = [];
+
+    inputs.forEach((line, index) => {
+        const buf = Buffer.from(line);
+        const samples = [];
+        let peakHeap = 0;
+        let allocs = 0;
+        let result = null;
+
+        for (let i = 0; i < warmup + iterations; i++) {
+            // one-shot ABI: the input lives at the heap pointer and the
+            // evaluation runs just above it; opa_eval rewinds to that mark
+            // itself on every call
+            new Uint8Array(mem.buffer).set(buf, heapBase);
+            const heap = heapBase + buf.length;
+            const before = haveStats ? e.opa_heap_alloc_count_get() : 0;
+
+            const start = process.hrtime.bigint();
+            const addr = e.opa_eval(0, entrypoint, data, heapBase, buf.length, heap, 0);
+            const elapsed = Number(process.hrtime.bigint() - start);
+
+            if (i < warmup) {
+                if (result === null) {
+                    result = addr == 0 ? null : addr2string(addr);
+                }
+                continue;
+            }
+
+            samples.push(elapsed);
+
+            if (haveStats) {
+                peakHeap = Math.max(peakHeap, e.opa_heap_high_water_get() - heap);
+                allocs += e.opa_heap_alloc_count_get() - before;
+            }
+        }
+
+        samples.sort((a, b) => a - b);
+        all.push(...samples);
+
+        // one JSON object per line, for machine consumption
+        console.log(JSON.stringify({
+            input: index,
+            evals: samples.length,
+            p50_ns: percentile(samples, 50),
+            p90_ns: percentile(samples, 90),
+            p99_ns: percentile(samples, 99),
+            max_ns: samples[samples.length - 1],
+            peak_heap_bytes: haveStats ? peakHeap : null,
+            allocs_per_eval: haveStats ? allocs / samples.length : null,
+            result: result,
+        }));
+    });
+
+    all.sort((a, b) => a - b);
+
+    console.log(JSON.stringify({
+        inputs: inputs.length,
+        evals: all.length,
+        p50_ns: percentile(all, 50),
+        p90_ns: percentile(all, 90),
+        p99_ns: percentile(all, 99),
+        max_ns: all[all.length - 1],
+    }));
+}
+
+if (process.argv.length != 5) {
+    console.log(process.argv[1] + " <policy.wasm> <data.json> <inputs.jsonl>");
+    process.exit(1);
+}
+
+benchE2E(process.argv[2], process.argv[3], process.argv[4]);
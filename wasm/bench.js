@@ -0,0 +1,76 @@
+const { readFileSync } = require('fs');
+
+function stringDecoder(mem) {
+    return function (addr) {
+        const i8 = new Int8Array(mem.buffer);
+        const start = addr;
+        var s = "";
+        while (i8[addr] != 0) {
+            s += String.fromCharCode(i8[addr++]);
+        }
+        return s;
+    }
+}
+
+async function bench(executable) {
+
+    const mem = new WebAssembly.Memory({ initial: 3 });
+    const addr2string = stringDecoder(mem);
+
+    const module = await WebAssembly.instantiate(readFileSync(executable), {
+        env: {
+            memory: mem,
+            opa_builtin0: (_1, _2) => { return 0; },
+            opa_builtin1: (_1, _2, _3, _4) => { return 0; },
+            opa_builtin2: (_1, _2, _3, _4) => { return 0; },
+            opa_builtin3: (_1, _2, _3, _4, _5) => { return 0; },
+            opa_builtin4: (_1, _2, _3, _4, _5, _6) => { return 0; },
+            opa_println: (msg) => {
+                console.log(addr2string(msg));
+            },
+            opa_abort: (msg) => {
+                throw 'abort: ' + addr2string(msg);
+            },
+            opa_test_pass: (note, func) => { },
+            opa_test_fail: (note, func, file, line) => { },
+            opa_clock: () => {
+                return process.hrtime.bigint();
+            },
+            opa_bench_report: (name, iterations, ns) => {
+                // one JSON object per line, for machine consumption
+                console.log(JSON.stringify({
+                    name: addr2string(name),
+                    iterations: iterations,
+                    ns: Number(ns),
+                    ns_per_op: Number(ns) / iterations,
+                }));
+            },
+        }
+    });
+
+    let ran = 0;
+
+    for (let key in module.instance.exports) {
+        if (key.startsWith("bench_")) {
+            try {
+                module.instance.exports[key]();
+                ran++;
+            } catch (e) {
+                console.log("ERROR", key, e);
+                process.exit(1);
+            }
+        }
+    }
+
+    if (ran == 0) {
+        console.log("ERROR", "no benchmarks executed");
+        process.exit(2);
+    }
+}
+
+if (process.argv.length != 3) {
+    console.log(process.argv[1] + " <test executable path>");
+    process.exit(1);
+}
+
+bench(process.argv[2]);
@@ -1,4 +1,7 @@
+#include <stdint.h>
+
 #include "aggregates.h"
+#include "malloc.h"
 #include "mpd.h"
 #include "std.h"
 #include "unicode.h"
@@ -33,208 +36,265 @@ opa_value *opa_agg_count(opa_value *v)
     }
 }
 
-static mpd_t *mpd_int(int v)
+// Accumulates sum or product over a collection's members. Integer
+// members accumulate in a long long; the first non-integer member or an
+// overflow switches the running total to the libmpdec path, which the
+// old code paid for (an mpd_t per element) even on all-integer input.
+static opa_value *__agg_accumulate(opa_value *v, int mul)
 {
-    mpd_t *r = mpd_qnew();
-    uint32_t status = 0;
-    mpd_qset_i32(r, v, mpd_max_ctx(), &status);
-    if (status)
+    int type = opa_value_type(v);
+
+    if (type != OPA_ARRAY && type != OPA_SET)
     {
-        opa_abort("aggregates: int");
+        return NULL;
     }
 
-    return r;
-}
+    long long acc = mul ? 1 : 0;
+    mpd_t *r = NULL;
+    opa_value_cursor_t cur = {v, 0, NULL};
 
-OPA_BUILTIN
-opa_value *opa_agg_sum(opa_value *v)
-{
-    switch (opa_value_type(v))
+    for (opa_value *key = opa_value_cursor_next(&cur); key != NULL; key = opa_value_cursor_next(&cur))
     {
-    case OPA_ARRAY: {
-        opa_array_t *a = opa_cast_array(v);
-        mpd_t *r = mpd_int(0);
+        opa_value *elem = type == OPA_SET ? key : opa_value_cursor_value(&cur);
 
-        for (int i = 0; i < a->len; i++)
+        if (opa_value_type(elem) != OPA_NUMBER)
         {
-            if (opa_value_type(a->elems[i].v) != OPA_NUMBER)
+            if (r != NULL)
             {
-                mpd_del(r);
-                return NULL;
+                opa_mpd_del(r);
             }
 
-            r = qadd(r, opa_number_to_bf(a->elems[i].v));
+            return NULL;
         }
 
-        return opa_bf_to_number(r);
-    }
+        long long x, next;
 
-    case OPA_SET: {
-        opa_set_t *s = opa_cast_set(v);
-        mpd_t *r = mpd_int(0);
-
-        for (int i = 0; i < s->n; i++)
+        if (r == NULL && opa_number_try_int(opa_cast_number(elem), &x) == 0 &&
+            (mul ? !__builtin_mul_overflow(acc, x, &next)
+                 : !__builtin_add_overflow(acc, x, &next)))
         {
-            for (opa_set_elem_t *elem = s->buckets[i]; elem != NULL; elem = elem->next)
-            {
-                if (opa_value_type(elem->v) != OPA_NUMBER)
-                {
-                    mpd_del(r);
-                    return NULL;
-                }
+            acc = next;
+            continue;
+        }
 
-                r = qadd(r, opa_number_to_bf(elem->v));
-            }
+        if (r == NULL)
+        {
+            r = opa_number_to_bf(opa_number_int(acc));
         }
 
-        return opa_bf_to_number(r);
+        r = mul ? qmul(r, opa_number_to_bf(elem)) : qadd(r, opa_number_to_bf(elem));
     }
 
-    default:
-        return NULL;
+    if (r != NULL)
+    {
+        return opa_bf_to_number(r);
     }
+
+    return opa_number_int(acc);
 }
 
 OPA_BUILTIN
-opa_value *opa_agg_product(opa_value *v)
+opa_value *opa_agg_sum(opa_value *v)
 {
-    switch (opa_value_type(v))
-    {
-    case OPA_ARRAY: {
-        opa_array_t *a = opa_cast_array(v);
-        mpd_t *r = mpd_int(1);
+    return __agg_accumulate(v, 0);
+}
 
-        for (int i = 0; i < a->len; i++)
-        {
-            if (opa_value_type(a->elems[i].v) != OPA_NUMBER)
-            {
-                mpd_del(r);
-                return NULL;
-            }
+OPA_BUILTIN
+opa_value *opa_agg_product(opa_value *v)
+{
+    return __agg_accumulate(v, 1);
+}
 
-            r = qmul(r, opa_number_to_bf(a->elems[i].v));
-        }
+// Linear scan for the extreme member ('sign' > 0 selects the maximum,
+// < 0 the minimum). While the running extreme is a machine integer,
+// integer candidates compare inline; everything else goes through
+// opa_value_compare. Ties keep the first member seen, as before.
+static opa_value *__agg_extreme(opa_value *v, int sign)
+{
+    int type = opa_value_type(v);
 
-        return opa_bf_to_number(r);
+    if (type != OPA_ARRAY && type != OPA_SET)
+    {
+        return NULL;
     }
 
-    case OPA_SET: {
-        opa_set_t *s = opa_cast_set(v);
-        mpd_t *r = mpd_int(1);
+    opa_value_cursor_t cur = {v, 0, NULL};
+    opa_value *best = NULL;
+    long long best_int = 0;
+    int is_int = 0;
 
-        for (int i = 0; i < s->n; i++)
+    for (opa_value *key = opa_value_cursor_next(&cur); key != NULL; key = opa_value_cursor_next(&cur))
+    {
+        opa_value *elem = type == OPA_SET ? key : opa_value_cursor_value(&cur);
+        long long x;
+        int elem_is_int = opa_value_type(elem) == OPA_NUMBER &&
+            opa_number_try_int(opa_cast_number(elem), &x) == 0;
+
+        if (best == NULL)
         {
-            for (opa_set_elem_t *elem = s->buckets[i]; elem != NULL; elem = elem->next)
-            {
-                if (opa_value_type(elem->v) != OPA_NUMBER)
-                {
-                    mpd_del(r);
-                    return NULL;
-                }
+            best = elem;
+            is_int = elem_is_int;
+            best_int = elem_is_int ? x : 0;
+            continue;
+        }
 
-                r = qmul(r, opa_number_to_bf(elem->v));
+        if (is_int && elem_is_int)
+        {
+            if (sign > 0 ? x > best_int : x < best_int)
+            {
+                best = elem;
+                best_int = x;
             }
+
+            continue;
         }
 
-        return opa_bf_to_number(r);
+        if (sign * opa_value_compare(best, elem) < 0)
+        {
+            best = elem;
+            is_int = elem_is_int;
+            best_int = elem_is_int ? x : 0;
+        }
     }
 
-    default:
-        return NULL;
-    }
+    return best;
 }
 
 OPA_BUILTIN
 opa_value *opa_agg_max(opa_value *v)
 {
-    switch (opa_value_type(v))
+    return __agg_extreme(v, 1);
+}
+
+OPA_BUILTIN
+opa_value *opa_agg_min(opa_value *v)
+{
+    return __agg_extreme(v, -1);
+}
+
+// Returns OPA_NUMBER when every element is an integer-representable
+// number, OPA_STRING when every element is a string, and 0 otherwise,
+// so sorting can pick a specialized path with a single type scan.
+static int __agg_sort_class(opa_array_t *arr)
+{
+    int cls = 0;
+
+    for (size_t i = 0; i < arr->len; i++)
     {
-    case OPA_ARRAY: {
-        opa_array_t *a = opa_cast_array(v);
-        opa_value *max = NULL;
+        int t = opa_value_type(arr->elems[i].v);
+        long long x;
 
-        for (int i = 0; i < a->len; i++)
+        if (t != OPA_NUMBER && t != OPA_STRING)
         {
-            if (max == NULL || opa_value_compare(max, a->elems[i].v) < 0)
-            {
-                max = a->elems[i].v;
-            }
+            return 0;
         }
 
-        return max;
-    }
-
-    case OPA_SET: {
-        opa_set_t *s = opa_cast_set(v);
-        if (s->len == 0)
+        if (t == OPA_NUMBER && opa_number_try_int(opa_cast_number(arr->elems[i].v), &x) != 0)
         {
-            return NULL;
+            return 0;
         }
 
-        opa_value *max = NULL;
-        for (int i = 0; i < s->n; i++)
+        if (i == 0)
         {
-            for (opa_set_elem_t *elem = s->buckets[i]; elem != NULL; elem = elem->next)
-            {
-                if (max == NULL || opa_value_compare(max, elem->v) < 0)
-                {
-                    max = elem->v;
-                }
-            }
+            cls = t;
+        }
+        else if (cls != t)
+        {
+            return 0;
         }
-
-        return max;
     }
 
-    default:
-        return NULL;
-    }
+    return cls;
 }
 
-OPA_BUILTIN
-opa_value *opa_agg_min(opa_value *v)
+// LSD radix sort for arrays of integer-representable numbers: no
+// comparisons at all, eight counting passes over biased 64-bit keys
+// (passes whose byte is constant across the array are skipped).
+static void __agg_sort_ints(opa_array_t *arr)
 {
-    switch (opa_value_type(v))
+    size_t n = arr->len;
+    uint64_t *keys = (uint64_t *)opa_malloc(2 * n * sizeof(uint64_t));
+    uint64_t *tkeys = keys + n;
+    opa_value **vals = (opa_value **)opa_malloc(2 * n * sizeof(opa_value *));
+    opa_value **tvals = vals + n;
+    uint64_t *kbuf = keys;
+    opa_value **vbuf = vals;
+
+    for (size_t i = 0; i < n; i++)
     {
-    case OPA_ARRAY: {
-        opa_array_t *a = opa_cast_array(v);
-        opa_value *min = NULL;
+        long long x;
 
-        for (int i = 0; i < a->len; i++)
+        opa_number_try_int(opa_cast_number(arr->elems[i].v), &x);
+
+        // flipping the sign bit makes unsigned byte order match signed order
+        keys[i] = (uint64_t)x ^ 0x8000000000000000ULL;
+        vals[i] = arr->elems[i].v;
+    }
+
+    for (int shift = 0; shift < 64; shift += 8)
+    {
+        size_t count[257] = {0};
+
+        for (size_t i = 0; i < n; i++)
         {
-            if (min == NULL || opa_value_compare(min, a->elems[i].v) > 0)
-            {
-                min = a->elems[i].v;
-            }
+            count[((keys[i] >> shift) & 0xff) + 1]++;
         }
 
-        return min;
-    }
+        if (count[((keys[0] >> shift) & 0xff) + 1] == n)
+        {
+            continue;
+        }
 
-    case OPA_SET: {
-        opa_set_t *s = opa_cast_set(v);
-        if (s->len == 0)
+        for (int b = 0; b < 256; b++)
         {
-            return NULL;
+            count[b+1] += count[b];
         }
 
-        opa_value *min = NULL;
-        for (int i = 0; i < s->n; i++)
+        for (size_t i = 0; i < n; i++)
         {
-            for (opa_set_elem_t *elem = s->buckets[i]; elem != NULL; elem = elem->next)
-            {
-                if (min == NULL || opa_value_compare(min, elem->v) > 0)
-                {
-                    min = elem->v;
-                }
-            }
+            size_t pos = count[(keys[i] >> shift) & 0xff]++;
+
+            tkeys[pos] = keys[i];
+            tvals[pos] = vals[i];
         }
 
-        return min;
+        uint64_t *tk = keys;
+        opa_value **tv = vals;
+
+        keys = tkeys;
+        vals = tvals;
+        tkeys = tk;
+        tvals = tv;
+    }
+
+    for (size_t i = 0; i < n; i++)
+    {
+        arr->elems[i].v = vals[i];
     }
 
+    opa_free(kbuf);
+    opa_free(vbuf);
+}
+
+// comparator for all-string arrays: skips the type dispatch of
+// opa_value_compare on every comparison
+static int __agg_cmp_string(opa_value *a, opa_value *b)
+{
+    return opa_value_compare_string(opa_cast_string(a), opa_cast_string(b));
+}
+
+static void __agg_sort_array(opa_array_t *arr)
+{
+    switch (__agg_sort_class(arr))
+    {
+    case OPA_NUMBER:
+        __agg_sort_ints(arr);
+        break;
+    case OPA_STRING:
+        opa_array_sort(arr, __agg_cmp_string);
+        break;
     default:
-        return NULL;
+        opa_array_sort(arr, opa_value_compare);
     }
 }
 
@@ -245,7 +305,7 @@ opa_value *opa_agg_sort(opa_value *v)
     {
     case OPA_ARRAY: {
         opa_value *r = opa_value_shallow_copy(v);
-        opa_array_sort(opa_cast_array(r), opa_value_compare);
+        __agg_sort_array(opa_cast_array(r));
         return r;
     }
     case OPA_SET: {
@@ -260,7 +320,7 @@ opa_value *opa_agg_sort(opa_value *v)
             }
         }
 
-        opa_array_sort(r, opa_value_compare);
+        __agg_sort_array(r);
         return &r->hdr;
     }
     default:
@@ -1,3 +1,4 @@
+#include <limits.h>
 #include <mpdecimal.h>
 #include <stdio.h>
 
@@ -5,22 +6,53 @@
 #include "set.h"
 #include "std.h"
 #include "str.h"
+#include "string.h"
 #include "value.h"
 
 OPA_BUILTIN
 opa_value *opa_arith_abs(opa_value *v)
 {
+    if (opa_value_type(v) == OPA_NUMBER)
+    {
+        opa_number_t *n = opa_cast_number(v);
+
+        if (n->repr == OPA_NUMBER_REPR_INT)
+        {
+            if (n->v.i >= 0)
+            {
+                return v;
+            }
+
+            if (n->v.i != LLONG_MIN) // -LLONG_MIN overflows
+            {
+                return opa_number_int(-n->v.i);
+            }
+        }
+        else if (n->repr == OPA_NUMBER_REPR_REF && n->v.ref.len > 0)
+        {
+            // The magnitude is the operand's own digit text, minus any
+            // sign: share it without copying, like the set operations
+            // share their operands' elements.
+            if (n->v.ref.s[0] == '-')
+            {
+                return opa_number_ref(n->v.ref.s + 1, n->v.ref.len - 1);
+            }
+
+            return v;
+        }
+    }
+
     mpd_t *n = opa_number_to_bf(v);
     if (n == NULL)
     {
         return NULL;
     }
 
-    mpd_t *r = mpd_qnew();
+    mpd_t *r = opa_mpd_new();
     uint32_t status = 0;
 
     mpd_qabs(r, n, mpd_max_ctx(), &status);
-    mpd_del(n);
+    opa_mpd_del(n);
 
     if (status != 0)
     {
@@ -30,20 +62,95 @@ opa_value *opa_arith_abs(opa_value *v)
     return opa_bf_to_number(r);
 }
 
+// Splits a ref-repr decimal of the form [-]digits.digits (no exponent)
+// into its integer part, sign, and leading fraction digit, so round,
+// ceil and floor can resolve it exactly without converting through
+// libmpdec. Returns false when the text does not have that shape or the
+// integer part overflows a machine integer.
+static bool arith_split_ref(opa_number_t *n, long long *ip, bool *neg,
+                            bool *frac, int *first)
+{
+    if (n->repr != OPA_NUMBER_REPR_REF)
+    {
+        return false;
+    }
+
+    const char *s = n->v.ref.s;
+    size_t len = n->v.ref.len;
+    const char *dot = memchr(s, '.', len);
+
+    if (dot == NULL || memchr(s, 'e', len) != NULL || memchr(s, 'E', len) != NULL)
+    {
+        return false;
+    }
+
+    if (opa_atoi64(s, dot - s, ip) != 0)
+    {
+        return false;
+    }
+
+    *neg = s[0] == '-';
+    *frac = false;
+
+    for (const char *p = dot + 1; p < s + len; p++)
+    {
+        if (*p < '0' || *p > '9')
+        {
+            return false;
+        }
+
+        if (*p != '0')
+        {
+            *frac = true;
+        }
+    }
+
+    *first = dot + 1 < s + len ? dot[1] - '0' : 0;
+    return true;
+}
+
 OPA_BUILTIN
 opa_value *opa_arith_round(opa_value *v)
 {
+    if (opa_value_type(v) == OPA_NUMBER)
+    {
+        opa_number_t *num = opa_cast_number(v);
+        long long i;
+
+        if (opa_number_try_int(num, &i) == 0)
+        {
+            return v; // already an integer
+        }
+
+        bool neg, frac;
+        int first;
+
+        if (arith_split_ref(num, &i, &neg, &frac, &first))
+        {
+            if (!frac || first < 5)
+            {
+                return opa_number_int(i);
+            }
+
+            // .5 and above rounds away from zero, like mpd_max_ctx
+            if (neg ? i != LLONG_MIN : i != LLONG_MAX)
+            {
+                return opa_number_int(neg ? i - 1 : i + 1);
+            }
+        }
+    }
+
     mpd_t *n = opa_number_to_bf(v);
     if (n == NULL)
     {
         return NULL;
     }
 
-    mpd_t *r = mpd_qnew();
+    mpd_t *r = opa_mpd_new();
     uint32_t status = 0;
 
     mpd_qround_to_int(r, n, mpd_max_ctx(), &status);
-    mpd_del(n);
+    opa_mpd_del(n);
 
     if (status != 0)
     {
@@ -56,17 +163,44 @@ opa_value *opa_arith_round(opa_value *v)
 OPA_BUILTIN
 opa_value *opa_arith_ceil(opa_value *v)
 {
+    if (opa_value_type(v) == OPA_NUMBER)
+    {
+        opa_number_t *num = opa_cast_number(v);
+        long long i;
+
+        if (opa_number_try_int(num, &i) == 0)
+        {
+            return v; // already an integer
+        }
+
+        bool neg, frac;
+        int first;
+
+        if (arith_split_ref(num, &i, &neg, &frac, &first))
+        {
+            if (!frac || neg)
+            {
+                return opa_number_int(i);
+            }
+
+            if (i != LLONG_MAX)
+            {
+                return opa_number_int(i + 1);
+            }
+        }
+    }
+
     mpd_t *n = opa_number_to_bf(v);
     if (n == NULL)
     {
         return NULL;
     }
 
-    mpd_t *r = mpd_qnew();
+    mpd_t *r = opa_mpd_new();
     uint32_t status = 0;
 
     mpd_qceil(r, n, mpd_max_ctx(), &status);
-    mpd_del(n);
+    opa_mpd_del(n);
 
     if (status)
     {
@@ -79,17 +213,44 @@ opa_value *opa_arith_ceil(opa_value *v)
 OPA_BUILTIN
 opa_value *opa_arith_floor(opa_value *v)
 {
+    if (opa_value_type(v) == OPA_NUMBER)
+    {
+        opa_number_t *num = opa_cast_number(v);
+        long long i;
+
+        if (opa_number_try_int(num, &i) == 0)
+        {
+            return v; // already an integer
+        }
+
+        bool neg, frac;
+        int first;
+
+        if (arith_split_ref(num, &i, &neg, &frac, &first))
+        {
+            if (!frac || !neg)
+            {
+                return opa_number_int(i);
+            }
+
+            if (i != LLONG_MIN)
+            {
+                return opa_number_int(i - 1);
+            }
+        }
+    }
+
      mpd_t *n = opa_number_to_bf(v);
     if (n == NULL)
     {
         return NULL;
     }
 
-    mpd_t *r = mpd_qnew();
+    mpd_t *r = opa_mpd_new();
     uint32_t status = 0;
 
     mpd_qfloor(r, n, mpd_max_ctx(), &status);
-    mpd_del(n);
+    opa_mpd_del(n);
 
     if (status)
     {
@@ -111,12 +272,12 @@ opa_value *opa_arith_plus(opa_value *a, opa_value *b)
         return NULL;
     }
 
-    mpd_t *r = mpd_qnew();
+    mpd_t *r = opa_mpd_new();
     uint32_t status = 0;
 
     mpd_qadd(r, x, y, mpd_max_ctx(), &status);
-    mpd_del(x);
-    mpd_del(y);
+    opa_mpd_del(x);
+    opa_mpd_del(y);
 
     status &= ~(MPD_Rounded | MPD_Inexact);
     if (status != 0)
@@ -134,12 +295,12 @@ opa_value *opa_arith_minus(opa_value *a, opa_value *b)
     mpd_t *y = opa_number_to_bf(b);
     if (x != NULL && y != NULL)
     {
-        mpd_t *r = mpd_qnew();
+        mpd_t *r = opa_mpd_new();
         uint32_t status = 0;
 
         mpd_qsub(r, x, y, mpd_max_ctx(), &status);
-        mpd_del(x);
-        mpd_del(y);
+        opa_mpd_del(x);
+        opa_mpd_del(y);
 
         status &= ~(MPD_Rounded | MPD_Inexact);
         if (status != 0)
@@ -156,9 +317,26 @@ opa_value *opa_arith_minus(opa_value *a, opa_value *b)
     return opa_set_diff(a, b);
 }
 
+// Tries the machine-integer fast path shared by multiply, divide and
+// rem: returns true with *x and *y set when both operands are
+// integer-representable numbers.
+static bool arith_try_ints(opa_value *a, opa_value *b, long long *x, long long *y)
+{
+    return opa_value_type(a) == OPA_NUMBER && opa_value_type(b) == OPA_NUMBER &&
+        opa_number_try_int(opa_cast_number(a), x) == 0 &&
+        opa_number_try_int(opa_cast_number(b), y) == 0;
+}
+
 OPA_BUILTIN
 opa_value *opa_arith_multiply(opa_value *a, opa_value *b)
 {
+    long long i, j, k;
+
+    if (arith_try_ints(a, b, &i, &j) && !__builtin_mul_overflow(i, j, &k))
+    {
+        return opa_number_int(k);
+    }
+
     mpd_t *x = opa_number_to_bf(a);
     mpd_t *y = opa_number_to_bf(b);
     if (x == NULL || y == NULL)
@@ -168,12 +346,12 @@ opa_value *opa_arith_multiply(opa_value *a, opa_value *b)
         return NULL;
     }
 
-    mpd_t *r = mpd_qnew();
+    mpd_t *r = opa_mpd_new();
     uint32_t status = 0;
 
     mpd_qmul(r, x, y, mpd_max_ctx(), &status);
-    mpd_del(x);
-    mpd_del(y);
+    opa_mpd_del(x);
+    opa_mpd_del(y);
 
     status &= ~(MPD_Rounded | MPD_Inexact);
     if (status != 0)
@@ -187,6 +365,16 @@ opa_value *opa_arith_multiply(opa_value *a, opa_value *b)
 OPA_BUILTIN
 opa_value *opa_arith_divide(opa_value *a, opa_value *b)
 {
+    long long i, j;
+
+    // Exact integer division stays out of libmpdec; inexact quotients
+    // fall through for the context's decimal rounding.
+    if (arith_try_ints(a, b, &i, &j) && j != 0 &&
+        !(i == LLONG_MIN && j == -1) && i % j == 0)
+    {
+        return opa_number_int(i / j);
+    }
+
     mpd_t *x = opa_number_to_bf(a);
     mpd_t *y = opa_number_to_bf(b);
     if (x == NULL || y == NULL)
@@ -196,13 +384,13 @@ opa_value *opa_arith_divide(opa_value *a, opa_value *b)
         return NULL;
     }
 
-    mpd_t *r = mpd_qnew();
+    mpd_t *r = opa_mpd_new();
     uint32_t status = 0;
 
     // Use the default context to enforce rounding, similar to golang.
     mpd_qdiv(r, x, y, mpd_default_ctx(), &status);
-    mpd_del(x);
-    mpd_del(y);
+    opa_mpd_del(x);
+    opa_mpd_del(y);
 
     if (status & MPD_Division_by_zero)
     {
@@ -221,6 +409,24 @@ opa_value *opa_arith_divide(opa_value *a, opa_value *b)
 OPA_BUILTIN
 opa_value *opa_arith_rem(opa_value *a, opa_value *b)
 {
+    long long i, j;
+
+    if (arith_try_ints(a, b, &i, &j))
+    {
+        if (j == 0)
+        {
+            return NULL;
+        }
+
+        if (i == LLONG_MIN && j == -1)
+        {
+            return opa_number_int(0); // i % j would overflow the division
+        }
+
+        // like mpd_qrem, the result takes the sign of the dividend
+        return opa_number_int(i % j);
+    }
+
     mpd_t *x = opa_number_to_bf(a);
     mpd_t *y = opa_number_to_bf(b);
     if (x == NULL || y == NULL || !mpd_isinteger(x) || !mpd_isinteger(y))
@@ -230,12 +436,12 @@ opa_value *opa_arith_rem(opa_value *a, opa_value *b)
         return NULL;
     }
 
-    mpd_t *r = mpd_qnew();
+    mpd_t *r = opa_mpd_new();
     uint32_t status = 0;
 
     mpd_qrem(r, x, y, mpd_max_ctx(), &status);
-    mpd_del(x);
-    mpd_del(y);
+    opa_mpd_del(x);
+    opa_mpd_del(y);
 
     if (status)
     {
@@ -1,3 +1,6 @@
+#include <string.h>
+
+#include "malloc.h"
 #include "std.h"
 #include "value.h"
 
@@ -11,19 +14,74 @@ opa_value *opa_array_concat(opa_value *a, opa_value *b)
 
     opa_array_t *x = opa_cast_array(a);
     opa_array_t *y = opa_cast_array(b);
-    opa_array_t *r = opa_cast_array(opa_array_with_cap(x->len + y->len));
 
-    for (int i = 0; i < x->len; i++)
+    opa_array_elem_t *elems = (opa_array_elem_t *)opa_malloc((x->len + y->len) * sizeof(opa_array_elem_t));
+
+    if (x->len > 0)
     {
-        opa_array_append(r, x->elems[i].v);
+        memcpy(elems, x->elems, x->len * sizeof(opa_array_elem_t));
     }
 
-    for (int i = 0; i < y->len; i++)
+    if (y->len > 0)
     {
-        opa_array_append(r, y->elems[i].v);
+        memcpy(elems + x->len, y->elems, y->len * sizeof(opa_array_elem_t));
     }
 
-    return &r->hdr;
+    return opa_array_with_elems(elems, x->len + y->len, x->len + y->len);
+}
+
+// opa_array_concat_move is opa_array_concat for callers that know the left
+// operand is a dead temporary: instead of allocating a third array it
+// extends 'a' in place — opa_realloc grows a block at the heap top without
+// copying — and returns it. Comprehension chains that concatenate
+// repeatedly stay linear this way instead of copying the accumulated
+// prefix on every step. Frozen or borrowed-storage operands fall back to
+// the copying path.
+OPA_BUILTIN
+opa_value *opa_array_concat_move(opa_value *a, opa_value *b)
+{
+    if (opa_value_type(a) != OPA_ARRAY || opa_value_type(b) != OPA_ARRAY)
+    {
+        return NULL;
+    }
+
+    if (opa_value_frozen(a))
+    {
+        return opa_array_concat(a, b);
+    }
+
+    opa_array_t *x = opa_cast_array(a);
+    opa_array_t *y = opa_cast_array(b);
+
+    if (x->cap < x->len + y->len)
+    {
+        if (x->free && x->elems != NULL)
+        {
+            x->elems = (opa_array_elem_t *)opa_realloc(x->elems, (x->len + y->len) * sizeof(opa_array_elem_t));
+        }
+        else
+        {
+            opa_array_elem_t *elems = (opa_array_elem_t *)opa_malloc((x->len + y->len) * sizeof(opa_array_elem_t));
+
+            if (x->len > 0)
+            {
+                memcpy(elems, x->elems, x->len * sizeof(opa_array_elem_t));
+            }
+
+            x->elems = elems;
+            x->free = 1;
+        }
+
+        x->cap = x->len + y->len;
+    }
+
+    if (y->len > 0)
+    {
+        memcpy(x->elems + x->len, y->elems, y->len * sizeof(opa_array_elem_t));
+    }
+
+    x->len += y->len;
+    return a;
 }
 
 OPA_BUILTIN
@@ -57,6 +115,15 @@ opa_value *opa_array_slice(opa_value *a, opa_value *i, opa_value *j)
         start = stop;
     }
 
+    // Frozen arrays cannot change before a heap reset discards them, so
+    // their slices need no copy at all: hand out a borrowed view of the
+    // parent's elements. Pagination rules slicing large frozen data arrays
+    // get O(1) slices this way.
+    if (opa_value_frozen(a))
+    {
+        return opa_array_view(arr, start, stop - start);
+    }
+
     opa_array_t *r = opa_cast_array(opa_array_with_cap(stop-start));
 
     for (int i = start; i < stop; i++)
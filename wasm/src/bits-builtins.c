@@ -5,9 +5,26 @@
 
 #define swap(x, y) { mpd_t *v = x; x = y; y = v; }
 
+// Machine-integer fast path shared by the bitwise builtins: int64 two's
+// complement agrees with the arbitrary-precision semantics whenever both
+// operands fit, so only big integers take the libmpdec route.
+static bool bits_try_ints(opa_value *a, opa_value *b, long long *x, long long *y)
+{
+    return opa_value_type(a) == OPA_NUMBER && opa_value_type(b) == OPA_NUMBER &&
+        opa_number_try_int(opa_cast_number(a), x) == 0 &&
+        opa_number_try_int(opa_cast_number(b), y) == 0;
+}
+
 OPA_BUILTIN
 opa_value *opa_bits_or(opa_value *a, opa_value *b)
 {
+    long long i, j;
+
+    if (bits_try_ints(a, b, &i, &j))
+    {
+        return opa_number_int(i | j);
+    }
+
     mpd_t *x = opa_number_to_bf(a);
     mpd_t *y = opa_number_to_bf(b);
     if (x == NULL || y == NULL || !mpd_isinteger(x) || !mpd_isinteger(y))
@@ -48,6 +65,13 @@ opa_value *opa_bits_or(opa_value *a, opa_value *b)
 OPA_BUILTIN
 opa_value *opa_bits_and(opa_value *a, opa_value *b)
 {
+    long long i, j;
+
+    if (bits_try_ints(a, b, &i, &j))
+    {
+        return opa_number_int(i & j);
+    }
+
     mpd_t *x = opa_number_to_bf(a);
     mpd_t *y = opa_number_to_bf(b);
     if (x == NULL || y == NULL || !mpd_isinteger(x) || !mpd_isinteger(y))
@@ -88,6 +112,16 @@ opa_value *opa_bits_and(opa_value *a, opa_value *b)
 OPA_BUILTIN
 opa_value *opa_bits_negate(opa_value *a)
 {
+    if (opa_value_type(a) == OPA_NUMBER)
+    {
+        long long i;
+
+        if (opa_number_try_int(opa_cast_number(a), &i) == 0)
+        {
+            return opa_number_int(~i);
+        }
+    }
+
     mpd_t *x = opa_number_to_bf(a);
     if (x == NULL || !mpd_isinteger(x))
     {
@@ -117,6 +151,13 @@ opa_value *opa_bits_negate(opa_value *a)
 OPA_BUILTIN
 opa_value *opa_bits_xor(opa_value *a, opa_value *b)
 {
+    long long i, j;
+
+    if (bits_try_ints(a, b, &i, &j))
+    {
+        return opa_number_int(i ^ j);
+    }
+
     mpd_t *x = opa_number_to_bf(a);
     mpd_t *y = opa_number_to_bf(b);
     if (x == NULL || y == NULL || !mpd_isinteger(x) || !mpd_isinteger(y))
@@ -156,6 +197,28 @@ opa_value *opa_bits_xor(opa_value *a, opa_value *b)
 OPA_BUILTIN
 opa_value *opa_bits_shiftleft(opa_value *a, opa_value *b)
 {
+    long long i, s;
+
+    if (bits_try_ints(a, b, &i, &s))
+    {
+        if (s < 0)
+        {
+            return NULL;
+        }
+
+        if (s < 64)
+        {
+            long long k = (long long)((unsigned long long)i << s);
+
+            if (k >> s == i) // shifted back unchanged: no overflow
+            {
+                return opa_number_int(k);
+            }
+        }
+
+        // the result outgrows int64; fall through to the big path
+    }
+
     mpd_t *x = opa_bf_to_bf_bits(opa_number_to_bf(a));
     if (x == NULL)
     {
@@ -165,22 +228,22 @@ opa_value *opa_bits_shiftleft(opa_value *a, opa_value *b)
 
     if (opa_value_type(b) != OPA_NUMBER)
     {
-        mpd_del(x);
+        opa_mpd_del(x);
         return NULL;
     }
 
     long long n;
     if (opa_number_try_int(opa_cast_number(b), &n) || n < 0)
     {
-        mpd_del(x);
+        opa_mpd_del(x);
         return NULL;
     }
 
-    mpd_t *r = mpd_qnew();
+    mpd_t *r = opa_mpd_new();
     uint32_t status = 0;
 
     mpd_qshiftn(r, x, n, mpd_max_ctx(), &status);
-    mpd_del(x);
+    opa_mpd_del(x);
 
     if (status)
     {
@@ -193,6 +256,19 @@ opa_value *opa_bits_shiftleft(opa_value *a, opa_value *b)
 OPA_BUILTIN
 opa_value *opa_bits_shiftright(opa_value *a, opa_value *b)
 {
+    long long i, s;
+
+    if (bits_try_ints(a, b, &i, &s))
+    {
+        if (s < 0)
+        {
+            return NULL;
+        }
+
+        // an arithmetic shift by 63 or more leaves only the sign
+        return opa_number_int(i >> (s < 63 ? s : 63));
+    }
+
     mpd_t *x = opa_number_to_bf(a);
     if (x == NULL || !mpd_isinteger(x))
     {
@@ -201,14 +277,14 @@ opa_value *opa_bits_shiftright(opa_value *a, opa_value *b)
 
     if (opa_value_type(b) != OPA_NUMBER)
     {
-        mpd_del(x);
+        opa_mpd_del(x);
         return NULL;
     }
 
     long long n;
     if (opa_number_try_int(opa_cast_number(b), &n) || n < 0)
     {
-        mpd_del(x);
+        opa_mpd_del(x);
         return NULL;
     }
 
@@ -0,0 +1,450 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "cbor.h"
+#include "malloc.h"
+#include "std.h"
+#include "str.h"
+#include "value.h"
+
+typedef struct
+{
+    const uint8_t *curr;
+    const uint8_t *end;
+} opa_cbor_ctx;
+
+#define OPA_CBOR_INDEFINITE (~(uint64_t)0)
+
+// Reads an initial byte and its argument. Returns 0 with the argument in
+// *arg, 1 for an indefinite-length marker (or the break byte), and -1 on
+// malformed or truncated input.
+static int opa_cbor_head(opa_cbor_ctx *ctx, int *major, uint64_t *arg)
+{
+    if (ctx->curr >= ctx->end)
+    {
+        return -1;
+    }
+
+    uint8_t b = *ctx->curr++;
+    int ai = b & 0x1f;
+
+    *major = b >> 5;
+
+    if (ai < 24)
+    {
+        *arg = ai;
+        return 0;
+    }
+
+    int n;
+
+    switch (ai)
+    {
+    case 24: n = 1; break;
+    case 25: n = 2; break;
+    case 26: n = 4; break;
+    case 27: n = 8; break;
+    case 31: return 1;
+    default: return -1;
+    }
+
+    if (ctx->end - ctx->curr < n)
+    {
+        return -1;
+    }
+
+    uint64_t v = 0;
+
+    for (int i = 0; i < n; i++)
+    {
+        v = (v << 8) | ctx->curr[i];
+    }
+
+    ctx->curr += n;
+    *arg = v;
+    return 0;
+}
+
+static double opa_cbor_float16(uint16_t h)
+{
+    uint32_t sign = (uint32_t)(h >> 15) << 31;
+    uint32_t exp = (h >> 10) & 0x1f;
+    uint32_t mant = h & 0x3ff;
+    uint32_t bits;
+
+    if (exp == 0)
+    {
+        if (mant == 0)
+        {
+            bits = sign;
+        }
+        else
+        {
+            // normalize the subnormal
+            exp = 113;
+
+            while ((mant & 0x400) == 0)
+            {
+                mant <<= 1;
+                exp--;
+            }
+
+            bits = sign | (exp << 23) | ((mant & 0x3ff) << 13);
+        }
+    }
+    else
+    {
+        bits = sign | ((exp + 112) << 23) | (mant << 13);
+    }
+
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+// CBOR integers cover the full 64-bit range; the few values outside long
+// long become number refs, like any other arbitrary-precision number.
+static opa_value *opa_cbor_number_big(uint64_t magnitude, int negative)
+{
+    char tmp[21];
+    char *p = &tmp[21];
+
+    do
+    {
+        *--p = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    }
+    while (magnitude > 0);
+
+    if (negative)
+    {
+        *--p = '-';
+    }
+
+    size_t len = &tmp[21] - p;
+    char *cpy = (char *)opa_malloc(len);
+
+    for (size_t i = 0; i < len; i++)
+    {
+        cpy[i] = p[i];
+    }
+
+    return opa_number_ref_allocated(cpy, len);
+}
+
+// Reads a string payload, concatenating indefinite-length chunks. Byte
+// and text strings both become opa strings; the bytes are not validated.
+static opa_value *opa_cbor_read_string(opa_cbor_ctx *ctx, int major, uint64_t arg, int indefinite)
+{
+    if (!indefinite)
+    {
+        if ((uint64_t)(ctx->end - ctx->curr) < arg)
+        {
+            return NULL;
+        }
+
+        char *cpy = (char *)opa_malloc(arg);
+
+        for (size_t i = 0; i < arg; i++)
+        {
+            cpy[i] = ctx->curr[i];
+        }
+
+        ctx->curr += arg;
+        return opa_string_allocated(cpy, arg);
+    }
+
+    size_t len = 0, cap = 16;
+    char *buf = (char *)opa_malloc(cap);
+
+    for (;;)
+    {
+        if (ctx->curr >= ctx->end)
+        {
+            goto err;
+        }
+
+        if (*ctx->curr == 0xff)
+        {
+            ctx->curr++;
+            return opa_string_allocated(buf, len);
+        }
+
+        int m;
+        uint64_t n;
+
+        if (opa_cbor_head(ctx, &m, &n) != 0 || m != major ||
+            (uint64_t)(ctx->end - ctx->curr) < n)
+        {
+            goto err;
+        }
+
+        while (len + n > cap)
+        {
+            cap *= 2;
+            buf = (char *)opa_realloc(buf, cap);
+        }
+
+        for (size_t i = 0; i < n; i++)
+        {
+            buf[len + i] = ctx->curr[i];
+        }
+
+        len += n;
+        ctx->curr += n;
+    }
+
+err:
+    opa_free(buf);
+    return NULL;
+}
+
+struct opa_cbor_frame
+{
+    opa_value *value;   // array or object under construction
+    opa_value *key;     // decoded map key awaiting its value
+    uint64_t remaining; // entries left, or OPA_CBOR_INDEFINITE
+    int map;
+};
+
+// Decodes one CBOR data item. Like the JSON parser this runs on an
+// explicit frame stack, so document depth is bounded by heap rather
+// than call stack. Tags are skipped, byte strings decode as strings and
+// maps allow the same key types opa_object does. Non-finite floats have
+// no value representation and are rejected.
+OPA_INTERNAL
+WASM_EXPORT(opa_cbor_parse)
+opa_value *opa_cbor_parse(const char *input, size_t len)
+{
+    opa_cbor_ctx ctx = {(const uint8_t *)input, (const uint8_t *)input + len};
+    struct opa_cbor_frame *stack = NULL;
+    size_t depth = 0, cap = 0;
+    opa_value *v = NULL;
+
+need_value:;
+    const uint8_t *head = ctx.curr;
+    int major;
+    uint64_t arg;
+    int rc = opa_cbor_head(&ctx, &major, &arg);
+
+    if (rc < 0)
+    {
+        goto error;
+    }
+
+    switch (major)
+    {
+    case 0: // unsigned integer
+        if (rc != 0)
+        {
+            goto error;
+        }
+
+        v = arg <= 0x7fffffffffffffffULL ? opa_number_int((long long)arg)
+                                         : opa_cbor_number_big(arg, 0);
+        goto deliver;
+
+    case 1: // negative integer, -1 - arg
+        if (rc != 0)
+        {
+            goto error;
+        }
+
+        if (arg <= 0x7fffffffffffffffULL)
+        {
+            v = opa_number_int(-1 - (long long)arg);
+        }
+        else if (arg == OPA_CBOR_INDEFINITE)
+        {
+            // -2^64: the one magnitude that itself overflows uint64
+            v = opa_number_ref("-18446744073709551616", 21);
+        }
+        else
+        {
+            v = opa_cbor_number_big(arg + 1, 1);
+        }
+
+        goto deliver;
+
+    case 2: // byte string
+    case 3: // text string
+        v = opa_cbor_read_string(&ctx, major, arg, rc == 1);
+
+        if (v == NULL)
+        {
+            goto error;
+        }
+
+        goto deliver;
+
+    case 4: // array
+    case 5: // map
+    {
+        int map = major == 5;
+
+        // A definite count of n entries takes at least n (2n for maps)
+        // bytes of input; reject absurd counts before preallocating.
+        if (rc == 0 && arg > (uint64_t)(ctx.end - ctx.curr) / (map ? 2 : 1))
+        {
+            goto error;
+        }
+
+        if (depth == cap)
+        {
+            if (cap == 0)
+            {
+                cap = 64;
+                stack = (struct opa_cbor_frame *)opa_malloc(cap * sizeof(*stack));
+            }
+            else
+            {
+                cap *= 2;
+                stack = (struct opa_cbor_frame *)opa_realloc(stack, cap * sizeof(*stack));
+            }
+        }
+
+        if (map)
+        {
+            stack[depth].value = rc == 0 && arg > 0 ? opa_object_with_cap(arg) : opa_object();
+        }
+        else
+        {
+            stack[depth].value = rc == 0 && arg > 0 ? opa_array_with_cap(arg) : opa_array();
+        }
+
+        stack[depth].key = NULL;
+        stack[depth].remaining = rc == 1 ? OPA_CBOR_INDEFINITE : arg;
+        stack[depth].map = map;
+        depth++;
+
+        if (rc == 0 && arg == 0)
+        {
+            v = stack[--depth].value;
+            goto deliver;
+        }
+
+        goto need_value;
+    }
+
+    case 6: // tag: carries no value semantics here, decode the tagged item
+        if (rc != 0)
+        {
+            goto error;
+        }
+
+        goto need_value;
+
+    case 7:
+        if (rc == 1) // break: ends the innermost indefinite container
+        {
+            if (depth == 0 || stack[depth-1].remaining != OPA_CBOR_INDEFINITE ||
+                stack[depth-1].key != NULL)
+            {
+                goto error;
+            }
+
+            v = stack[--depth].value;
+            goto deliver;
+        }
+
+        switch (head[0] & 0x1f)
+        {
+        case 20:
+            v = opa_boolean(false);
+            break;
+        case 21:
+            v = opa_boolean(true);
+            break;
+        case 22:
+        case 23: // undefined decodes as null
+            v = opa_null();
+            break;
+        case 25:
+            if (((arg >> 10) & 0x1f) == 0x1f)
+            {
+                goto error;
+            }
+
+            v = opa_number_float(opa_cbor_float16((uint16_t)arg));
+            break;
+        case 26:
+        {
+            if (((arg >> 23) & 0xff) == 0xff)
+            {
+                goto error;
+            }
+
+            uint32_t bits = (uint32_t)arg;
+            float f;
+            memcpy(&f, &bits, sizeof(f));
+            v = opa_number_float(f);
+            break;
+        }
+        case 27:
+        {
+            if (((arg >> 52) & 0x7ff) == 0x7ff)
+            {
+                goto error;
+            }
+
+            double d;
+            memcpy(&d, &arg, sizeof(d));
+            v = opa_number_float(d);
+            break;
+        }
+        default: // other simple values have no value representation
+            goto error;
+        }
+
+        goto deliver;
+
+    default:
+        goto error;
+    }
+
+deliver:
+    while (depth > 0)
+    {
+        struct opa_cbor_frame *top = &stack[depth-1];
+
+        if (top->map && top->key == NULL)
+        {
+            top->key = v;
+            goto need_value;
+        }
+
+        if (top->map)
+        {
+            opa_object_insert(opa_cast_object(top->value), top->key, v);
+            top->key = NULL;
+        }
+        else
+        {
+            opa_array_append(opa_cast_array(top->value), v);
+        }
+
+        if (top->remaining != OPA_CBOR_INDEFINITE && --top->remaining == 0)
+        {
+            v = top->value;
+            depth--;
+            continue;
+        }
+
+        goto need_value;
+    }
+
+    if (stack != NULL)
+    {
+        opa_free(stack);
+    }
+
+    return v;
+
+error:
+    if (stack != NULL)
+    {
+        opa_free(stack);
+    }
+
+    return NULL;
+}
@@ -0,0 +1,21 @@
+#ifndef OPA_CBOR_H
+#define OPA_CBOR_H
+
+#include "value.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Decodes a CBOR (RFC 8949) document into the same value trees
+// opa_json_parse produces, without transcoding through JSON text.
+// Definite and indefinite length containers and strings, tags (ignored)
+// and half/single/double precision floats are supported; non-finite
+// floats and malformed input yield NULL.
+opa_value *opa_cbor_parse(const char *input, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
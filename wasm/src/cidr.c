@@ -1,12 +1,14 @@
 #include <stddef.h>
 #include <string.h>
 
+#include "malloc.h"
 #include "std.h"
 #include "str.h"
 #include "value.h"
 
 typedef struct {
     uint8_t len;
+    uint8_t bits; // prefix length
     unsigned char ip[16];
     unsigned char mask[16];
 } ip_net;
@@ -23,12 +25,14 @@ static bool parse_ip(const char *src, int n, ip_net *dst)
         if (src[i] == '.')
         {
             dst->len = 4;
+            dst->bits = 32;
             memset(dst->mask, 0xff, 4);
             return inet_pton4(src, src + n, dst->ip);
         }
         else if (src[i] == ':')
         {
             dst->len = 16;
+            dst->bits = 128;
             memset(dst->mask, 0xff, 16);
             return inet_pton6(src, src + n, dst->ip);
         }
@@ -68,6 +72,8 @@ static bool parse_cidr(const char *src, size_t n, ip_net *dst)
         return false;
     }
 
+    dst->bits = (uint8_t)bits;
+
     for (int i = 0; i < dst->len; i++)
     {
         if (bits >= 8) {
@@ -88,6 +94,141 @@ static bool parse_cidr(const char *src, size_t n, ip_net *dst)
     return true;
 }
 
+// Parsed operand cache. Membership tests typically run many addresses
+// against the same network lists, so the text operands repeat; the cache
+// maps operand text to its packed parsed form in an open-addressed table.
+// It lives in a builtin cache slot like the regex and glob caches: a heap
+// reset frees the entries along with everything else and clears the slot
+// with them.
+
+typedef struct
+{
+    char *text;  // NULL marks an empty slot
+    size_t len;
+    ip_net net;
+    bool cidr;   // parsed as an address/mask pair, not a plain address
+} cidr_entry;
+
+typedef struct
+{
+    size_t n;    // allocated slots, power of two
+    size_t used;
+    cidr_entry *entries;
+} cidr_cache;
+
+static size_t cidr_cache_slot = OPA_BUILTIN_CACHE_UNREGISTERED;
+
+static cidr_cache *cache(void)
+{
+    if (cidr_cache_slot == OPA_BUILTIN_CACHE_UNREGISTERED)
+    {
+        cidr_cache_slot = opa_builtin_cache_register(NULL);
+    }
+
+    cidr_cache *c = opa_builtin_cache_get(cidr_cache_slot);
+    if (c == NULL)
+    {
+        c = opa_malloc(sizeof(cidr_cache));
+        c->n = 64;
+        c->used = 0;
+        c->entries = opa_malloc(c->n * sizeof(cidr_entry));
+        memset(c->entries, 0, c->n * sizeof(cidr_entry));
+        opa_builtin_cache_set(cidr_cache_slot, c);
+    }
+
+    return c;
+}
+
+static size_t cidr_hash(const char *s, size_t n)
+{
+    size_t h = 2166136261;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        h ^= (unsigned char)s[i];
+        h *= 16777619;
+    }
+
+    return h;
+}
+
+// returns the slot holding the given text, or the empty slot to insert it
+// into.
+static cidr_entry *find(cidr_cache *c, const char *s, size_t n)
+{
+    for (size_t i = cidr_hash(s, n) & (c->n - 1); ; i = (i + 1) & (c->n - 1))
+    {
+        cidr_entry *e = &c->entries[i];
+        if (e->text == NULL || (e->len == n && memcmp(e->text, s, n) == 0))
+        {
+            return e;
+        }
+    }
+}
+
+static void grow(cidr_cache *c)
+{
+    cidr_entry *old = c->entries;
+    size_t old_n = c->n;
+
+    c->n *= 2;
+    c->entries = opa_malloc(c->n * sizeof(cidr_entry));
+    memset(c->entries, 0, c->n * sizeof(cidr_entry));
+
+    for (size_t i = 0; i < old_n; i++)
+    {
+        if (old[i].text != NULL)
+        {
+            *find(c, old[i].text, old[i].len) = old[i];
+        }
+    }
+
+    opa_free(old);
+}
+
+// parse_operand resolves the operand text through the cache, parsing and
+// inserting on a miss. ip_ok selects whether a plain address is accepted
+// alongside an address/mask pair.
+static bool parse_operand(opa_string_t *s, bool ip_ok, ip_net *dst)
+{
+    cidr_cache *c = cache();
+
+    if (c->used * 4 >= c->n * 3)
+    {
+        grow(c);
+    }
+
+    cidr_entry *e = find(c, s->v, s->len);
+    if (e->text == NULL)
+    {
+        if (parse_cidr(s->v, s->len, &e->net))
+        {
+            e->cidr = true;
+        }
+        else if (parse_ip(s->v, s->len, &e->net))
+        {
+            e->cidr = false;
+        }
+        else
+        {
+            return false;
+        }
+
+        e->text = opa_malloc(s->len);
+        memcpy(e->text, s->v, s->len);
+        e->len = s->len;
+        c->used++;
+    }
+
+    if (!e->cidr && !ip_ok)
+    {
+        return false;
+    }
+
+    *dst = e->net;
+    return true;
+}
+
 // returns true if a contains b.
 static bool contains(ip_net *a, ip_net *b)
 {
@@ -139,13 +280,11 @@ opa_value *opa_cidr_contains(opa_value *a, opa_value *b)
 
     ip_net ip_a, ip_b;
 
-    opa_string_t *s = opa_cast_string(a);
-    if (!parse_cidr(s->v, s->len, &ip_a)) {
+    if (!parse_operand(opa_cast_string(a), false, &ip_a)) {
         return NULL;
     }
 
-    s = opa_cast_string(b);
-    if (!parse_ip(s->v, s->len, &ip_b) && !parse_cidr(s->v, s->len, &ip_b)) {
+    if (!parse_operand(opa_cast_string(b), true, &ip_b)) {
         return NULL;
     }
 
@@ -160,16 +299,408 @@ opa_value *opa_cidr_intersects(opa_value *a, opa_value *b)
         return NULL;
     }
 
-    opa_string_t *as = opa_cast_string(a);
-    opa_string_t *bs = opa_cast_string(b);
     ip_net ip_a, ip_b;
-    if (!parse_cidr(as->v, as->len, &ip_a) || !parse_cidr(bs->v, bs->len, &ip_b)) {
+    if (!parse_operand(opa_cast_string(a), false, &ip_a) ||
+        !parse_operand(opa_cast_string(b), false, &ip_b)) {
         return NULL;
     }
 
     return opa_boolean(contains(&ip_a, &ip_b) || contains(&ip_b, &ip_a));
 }
 
+// Address formatting for expansion. format_ip4 emits a dotted quad.
+// format_ip6 emits the RFC 5952 form the host runtime produces:
+// lowercase hex groups with the leftmost longest run of two or more zero
+// groups compressed to "::". Both return the formatted length.
+static size_t format_ip4(const unsigned char *ip, char *out, size_t cap)
+{
+    return snprintf(out, cap, "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+}
+
+static size_t format_ip6(const unsigned char *ip, char *out, size_t cap)
+{
+    unsigned int groups[8];
+    for (int i = 0; i < 8; i++)
+    {
+        groups[i] = ((unsigned int)ip[2*i] << 8) | ip[2*i+1];
+    }
+
+    int best = -1, best_n = 1;
+    for (int i = 0, run = -1, n = 0; i < 8; i++)
+    {
+        if (groups[i] != 0)
+        {
+            run = -1;
+            continue;
+        }
+
+        if (run < 0)
+        {
+            run = i;
+            n = 0;
+        }
+
+        if (++n > best_n)
+        {
+            best = run;
+            best_n = n;
+        }
+    }
+
+    size_t len = 0;
+    for (int i = 0; i < 8; i++)
+    {
+        if (i == best)
+        {
+            // A single ':' here; the group following the run prefixes
+            // itself with the second one. A run reaching the end has no
+            // following group, so it closes the "::" itself.
+            out[len++] = ':';
+            if (best + best_n == 8)
+            {
+                out[len++] = ':';
+            }
+
+            i += best_n - 1;
+            continue;
+        }
+
+        if (i > 0)
+        {
+            out[len++] = ':';
+        }
+
+        len += snprintf(&out[len], cap - len, "%x", groups[i]);
+    }
+
+    return len;
+}
+
+// opa_cidr_expand enumerates the addresses a network covers into a set,
+// formatting each address natively as it is produced. Expansions of 2^32
+// addresses or more cannot be materialized in a 32-bit address space, so
+// they are undefined like a malformed operand rather than dying in the
+// allocator partway through.
+OPA_BUILTIN
+opa_value *opa_cidr_expand(opa_value *a)
+{
+    if (opa_value_type(a) != OPA_STRING)
+    {
+        return NULL;
+    }
+
+    ip_net net;
+    if (!parse_operand(opa_cast_string(a), false, &net))
+    {
+        return NULL;
+    }
+
+    int host_bits = net.len * 8 - net.bits;
+    if (host_bits >= 32)
+    {
+        return NULL;
+    }
+
+    size_t count = (size_t)1 << host_bits;
+
+    opa_value *result = opa_set_with_cap(count);
+    opa_set_t *set = opa_cast_set(result);
+
+    unsigned char addr[16];
+    memcpy(addr, net.ip, net.len);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        char buf[46];
+        size_t len = net.len == 4 ?
+            format_ip4(addr, buf, sizeof(buf)) :
+            format_ip6(addr, buf, sizeof(buf));
+
+        char *v = opa_malloc(len + 1);
+        memcpy(v, buf, len);
+        v[len] = 0;
+        opa_set_add(set, opa_string_allocated(v, len));
+
+        // The host portion counts up big-endian.
+        for (int j = net.len - 1; j >= 0; j--)
+        {
+            if (++addr[j] != 0)
+            {
+                break;
+            }
+        }
+    }
+
+    return result;
+}
+
+// Bulk containment. net.cidr_contains_matches tests every network in the
+// first operand against every element of the second; iterating the
+// networks per query is O(n) parses and compares. Instead the networks
+// are inserted once into a binary trie on their masked address bits, and
+// each query walks its own address bits, collecting the networks whose
+// prefix ends on the path — O(address bits) per query. Built tries are
+// kept in a builtin cache slot keyed by collection identity, so repeated
+// calls against the same network list reuse the trie until the next heap
+// reset.
+
+#define CIDR_TRIE_CACHE_SIZE (4)
+
+typedef struct cidr_trie_index
+{
+    opa_value *index;
+    struct cidr_trie_index *next;
+} cidr_trie_index;
+
+typedef struct cidr_trie_node
+{
+    struct cidr_trie_node *child[2];
+    cidr_trie_index *indices; // networks whose prefix ends at this node
+} cidr_trie_node;
+
+typedef struct
+{
+    opa_value *cidrs;        // collection the tries were built from
+    size_t len;              // its length when built, to catch reuse of the address
+    cidr_trie_node *root[2]; // one trie per address family: v4, v6
+} cidr_trie;
+
+typedef struct
+{
+    size_t next;
+    cidr_trie tries[CIDR_TRIE_CACHE_SIZE];
+} cidr_trie_cache;
+
+static cidr_trie_node *trie_node(void)
+{
+    cidr_trie_node *n = opa_malloc(sizeof(cidr_trie_node));
+    n->child[0] = NULL;
+    n->child[1] = NULL;
+    n->indices = NULL;
+    return n;
+}
+
+static int trie_bit(ip_net *net, int k)
+{
+    return (net->ip[k >> 3] >> (7 - (k & 7))) & 1;
+}
+
+static void trie_insert(cidr_trie_node *root, ip_net *net, opa_value *index)
+{
+    cidr_trie_node *n = root;
+
+    for (int k = 0; k < net->bits; k++)
+    {
+        int b = trie_bit(net, k);
+        if (n->child[b] == NULL)
+        {
+            n->child[b] = trie_node();
+        }
+
+        n = n->child[b];
+    }
+
+    cidr_trie_index *i = opa_malloc(sizeof(cidr_trie_index));
+    i->index = index;
+    i->next = n->indices;
+    n->indices = i;
+}
+
+// cidr_match_term extracts the CIDR text of a collection element: the
+// element itself for a string, its first entry for a non-empty array.
+static opa_string_t *cidr_match_term(opa_value *v)
+{
+    if (opa_value_type(v) == OPA_STRING)
+    {
+        return opa_cast_string(v);
+    }
+
+    if (opa_value_type(v) == OPA_ARRAY && opa_cast_array(v)->len > 0)
+    {
+        opa_value *first = opa_cast_array(v)->elems[0].v;
+        if (opa_value_type(first) == OPA_STRING)
+        {
+            return opa_cast_string(first);
+        }
+    }
+
+    return NULL;
+}
+
+typedef bool (*cidr_elem_fn)(opa_string_t *cidr, opa_value *index, void *arg);
+
+// cidr_iter_operand visits the elements of a net.cidr_contains_matches
+// operand with their indexing terms: a string stands for itself, arrays
+// index by position, sets by element and objects by key. Other operand
+// types have no elements.
+static bool cidr_iter_operand(opa_value *v, cidr_elem_fn fn, void *arg)
+{
+    switch (opa_value_type(v))
+    {
+    case OPA_STRING:
+        return fn(opa_cast_string(v), v, arg);
+
+    case OPA_ARRAY: {
+        opa_array_t *a = opa_cast_array(v);
+        for (size_t i = 0; i < a->len; i++)
+        {
+            opa_string_t *s = cidr_match_term(a->elems[i].v);
+            if (s == NULL || !fn(s, opa_number_interned((long long)i), arg))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    case OPA_SET:
+        for (opa_value *k = opa_value_iter(v, NULL); k != NULL; k = opa_value_iter(v, k))
+        {
+            opa_string_t *s = cidr_match_term(k);
+            if (s == NULL || !fn(s, k, arg))
+            {
+                return false;
+            }
+        }
+        return true;
+
+    case OPA_OBJECT:
+        for (opa_value *k = opa_value_iter(v, NULL); k != NULL; k = opa_value_iter(v, k))
+        {
+            opa_string_t *s = cidr_match_term(opa_value_get(v, k));
+            if (s == NULL || !fn(s, k, arg))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    return true;
+}
+
+static bool trie_insert_elem(opa_string_t *cidr, opa_value *index, void *arg)
+{
+    cidr_trie *t = arg;
+
+    ip_net net;
+    if (!parse_operand(cidr, false, &net))
+    {
+        return false;
+    }
+
+    trie_insert(t->root[net.len == 4 ? 0 : 1], &net, index);
+    return true;
+}
+
+static size_t cidr_trie_slot = OPA_BUILTIN_CACHE_UNREGISTERED;
+
+static cidr_trie *trie_for(opa_value *cidrs)
+{
+    if (cidr_trie_slot == OPA_BUILTIN_CACHE_UNREGISTERED)
+    {
+        cidr_trie_slot = opa_builtin_cache_register(NULL);
+    }
+
+    cidr_trie_cache *c = opa_builtin_cache_get(cidr_trie_slot);
+    if (c == NULL)
+    {
+        c = opa_malloc(sizeof(cidr_trie_cache));
+        memset(c, 0, sizeof(cidr_trie_cache));
+        opa_builtin_cache_set(cidr_trie_slot, c);
+    }
+
+    size_t len = opa_value_length(cidrs);
+
+    for (size_t i = 0; i < CIDR_TRIE_CACHE_SIZE; i++)
+    {
+        if (c->tries[i].cidrs == cidrs && c->tries[i].len == len)
+        {
+            return &c->tries[i];
+        }
+    }
+
+    cidr_trie *t = &c->tries[c->next];
+    c->next = (c->next + 1) % CIDR_TRIE_CACHE_SIZE;
+
+    t->cidrs = NULL;
+    t->len = len;
+    t->root[0] = trie_node();
+    t->root[1] = trie_node();
+
+    if (!cidr_iter_operand(cidrs, trie_insert_elem, t))
+    {
+        return NULL;
+    }
+
+    t->cidrs = cidrs;
+    return t;
+}
+
+typedef struct
+{
+    cidr_trie *t;
+    opa_value *result;
+} cidr_query;
+
+static bool trie_query_elem(opa_string_t *cidr, opa_value *index, void *arg)
+{
+    cidr_query *q = arg;
+
+    ip_net net;
+    if (!parse_operand(cidr, true, &net))
+    {
+        return false;
+    }
+
+    cidr_trie_node *n = q->t->root[net.len == 4 ? 0 : 1];
+
+    for (int k = 0; ; k++)
+    {
+        // Every prefix ending on the path is no longer than this
+        // element's own mask, so it contains the element.
+        for (cidr_trie_index *i = n->indices; i != NULL; i = i->next)
+        {
+            opa_value *pair = opa_array_with_cap(2);
+            opa_array_append(opa_cast_array(pair), i->index);
+            opa_array_append(opa_cast_array(pair), index);
+            opa_set_add(opa_cast_set(q->result), pair);
+        }
+
+        if (k == net.bits)
+        {
+            break;
+        }
+
+        n = n->child[trie_bit(&net, k)];
+        if (n == NULL)
+        {
+            break;
+        }
+    }
+
+    return true;
+}
+
+OPA_BUILTIN
+opa_value *opa_cidr_contains_matches(opa_value *a, opa_value *b)
+{
+    cidr_trie *t = trie_for(a);
+    if (t == NULL)
+    {
+        return NULL;
+    }
+
+    cidr_query q = {t, opa_set()};
+
+    if (!cidr_iter_operand(b, trie_query_elem, &q))
+    {
+        return NULL;
+    }
+
+    return q.result;
+}
+
 /*
  * Copyright (c) 2004 by Internet Systems Consortium, Inc. ("ISC")
  * Copyright (c) 1996,1999 by Internet Software Consortium.
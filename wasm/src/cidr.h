@@ -4,6 +4,8 @@
 #include "value.h"
 
 opa_value *opa_cidr_contains(opa_value *net, opa_value *ip_or_net);
+opa_value *opa_cidr_contains_matches(opa_value *nets, opa_value *ips_or_nets);
 opa_value *opa_cidr_intersects(opa_value *a, opa_value *b);
+opa_value *opa_cidr_expand(opa_value *cidr);
 
 #endif
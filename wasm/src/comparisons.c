@@ -1,38 +1,178 @@
+#include "str.h"
 #include "value.h"
 #include "comparisons.h"
 
+// Ordering guards overwhelmingly compare two numbers, and almost always
+// two int-repr numbers. The kernels below peel those cases off ahead of
+// the general opa_value_compare type switch: a repr probe with
+// opa_number_try_int and a branch for int/int, and an exact double
+// comparison for int/float pairs that would otherwise round-trip through
+// libmpdec. Everything else falls through to the general path unchanged.
+
+// Integers up to 2^53 are exact as doubles.
+#define CMP_EXACT_INT (1LL << 53)
+
+// Loads a float-repr operand as a double, but only when the text-to-double
+// mapping is order-preserving: a plain decimal with at most 15 significant
+// digits converts to a unique nearest double, so comparing the doubles
+// agrees with comparing the exact values. Longer literals and exponent
+// forms return non-zero and take the general path.
+static int cmp_float_operand(opa_number_t *n, double *d)
+{
+    const char *s = n->v.ref.s;
+    size_t len = n->v.ref.len;
+    size_t k = (len > 0 && s[0] == '-') ? 1 : 0;
+    size_t sig = 0;
+    bool dot = false;
+    bool nonzero = false;
+
+    for (; k < len; k++)
+    {
+        if (s[k] == '.')
+        {
+            if (dot)
+            {
+                return 1;
+            }
+
+            dot = true;
+            continue;
+        }
+
+        if (s[k] < '0' || s[k] > '9')
+        {
+            return 1;
+        }
+
+        if (s[k] != '0' || nonzero)
+        {
+            nonzero = true;
+            sig++;
+        }
+    }
+
+    if (!dot || sig > 15)
+    {
+        return 1;
+    }
+
+    return opa_atof64(s, len, d);
+}
+
+// Compares two numeric operands into *cmp, returning zero when handled.
+static int cmp_numbers(opa_value *a, opa_value *b, int *cmp)
+{
+    if (opa_value_type(a) != OPA_NUMBER || opa_value_type(b) != OPA_NUMBER)
+    {
+        return 1;
+    }
+
+    opa_number_t *na = opa_cast_number(a);
+    opa_number_t *nb = opa_cast_number(b);
+
+    long long ia, ib;
+    bool a_int = opa_number_try_int(na, &ia) == 0;
+    bool b_int = opa_number_try_int(nb, &ib) == 0;
+
+    if (a_int && b_int)
+    {
+        *cmp = (ia > ib) - (ia < ib);
+        return 0;
+    }
+
+    if (a_int != b_int)
+    {
+        long long i = a_int ? ia : ib;
+        double d;
+
+        if (i > -CMP_EXACT_INT && i < CMP_EXACT_INT &&
+            cmp_float_operand(a_int ? nb : na, &d) == 0)
+        {
+            double di = (double)i;
+            double da = a_int ? di : d;
+            double db = a_int ? d : di;
+            *cmp = (da > db) - (da < db);
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
 OPA_BUILTIN
 opa_value *opa_cmp_eq(opa_value *a, opa_value *b)
 {
-    return opa_boolean(opa_value_compare(a, b) == 0);
+    int cmp;
+
+    if (cmp_numbers(a, b, &cmp) == 0)
+    {
+        return opa_boolean(cmp == 0);
+    }
+
+    return opa_boolean(opa_value_eq(a, b));
 }
 
 OPA_BUILTIN
 opa_value *opa_cmp_neq(opa_value *a, opa_value *b)
 {
-    return opa_boolean(opa_value_compare(a, b) != 0);
+    int cmp;
+
+    if (cmp_numbers(a, b, &cmp) == 0)
+    {
+        return opa_boolean(cmp != 0);
+    }
+
+    return opa_boolean(!opa_value_eq(a, b));
 }
 
 OPA_BUILTIN
 opa_value *opa_cmp_gt(opa_value *a, opa_value *b)
 {
+    int cmp;
+
+    if (cmp_numbers(a, b, &cmp) == 0)
+    {
+        return opa_boolean(cmp > 0);
+    }
+
     return opa_boolean(opa_value_compare(a, b) > 0);
 }
 
 OPA_BUILTIN
 opa_value *opa_cmp_gte(opa_value *a, opa_value *b)
 {
+    int cmp;
+
+    if (cmp_numbers(a, b, &cmp) == 0)
+    {
+        return opa_boolean(cmp >= 0);
+    }
+
     return opa_boolean(opa_value_compare(a, b) >= 0);
 }
 
 OPA_BUILTIN
 opa_value *opa_cmp_lt(opa_value *a, opa_value *b)
 {
+    int cmp;
+
+    if (cmp_numbers(a, b, &cmp) == 0)
+    {
+        return opa_boolean(cmp < 0);
+    }
+
     return opa_boolean(opa_value_compare(a, b) < 0);
 }
 
 OPA_BUILTIN
 opa_value *opa_cmp_lte(opa_value *a, opa_value *b)
 {
+    int cmp;
+
+    if (cmp_numbers(a, b, &cmp) == 0)
+    {
+        return opa_boolean(cmp <= 0);
+    }
+
     return opa_boolean(opa_value_compare(a, b) <= 0);
 }
@@ -1,9 +1,29 @@
 #include "malloc.h"
 #include "context.h"
+#include "error.h"
+#include "memoize.h"
+#include "mpd.h"
 #include "stdlib.h"
+#include "str.h"
 #include "value.h"
 #include "json.h"
 
+// opa_initialize runs every lazy one-time initialization eagerly: the
+// heap allocator, libmpdec's contexts and the interned-number table. A
+// host that snapshots linear memory after instantiation (wizer-style) can
+// call this first so clones instantiated from the snapshot start warmed
+// instead of paying first-use initialization on their first eval.
+// Per-policy state is out of scope: the compiler emits its own
+// opa_memoize_init call with the policy's table size, and regex
+// prewarming needs the policy's patterns (see opa_regex_prewarm).
+WASM_EXPORT(opa_initialize)
+void opa_initialize(void)
+{
+    opa_free(opa_malloc(0)); // any allocation runs the allocator's setup
+    opa_mpd_init();
+    opa_value_intern_init();
+}
+
 WASM_EXPORT(opa_eval_ctx_new)
 opa_eval_ctx_t *opa_eval_ctx_new()
 {
@@ -15,12 +35,51 @@ opa_eval_ctx_t *opa_eval_ctx_new()
     return ctx;
 }
 
+// opa_eval_ctx_reset prepares a context for reuse: the input and result
+// are cleared while the data document and entrypoint are retained. Paired
+// with a heap snapshot taken after the context and data were built, the
+// host's eval loop allocates nothing before policy code runs.
+WASM_EXPORT(opa_eval_ctx_reset)
+void opa_eval_ctx_reset(opa_eval_ctx_t *ctx)
+{
+    ctx->input = NULL;
+    ctx->result = NULL;
+}
+
 WASM_EXPORT(opa_eval_ctx_set_input)
 void opa_eval_ctx_set_input(opa_eval_ctx_t *ctx, opa_value *v)
 {
     ctx->input = v;
 }
 
+#ifdef EVAL_PROFILE
+// Eval phase profile: cycles spent in input parsing, rule evaluation and
+// result serialization for the most recent opa_eval call, timed with the
+// same host-provided clock import the builtin profile uses. The phase
+// marks compile away entirely without EVAL_PROFILE, so the import is only
+// required of hosts that opt in.
+unsigned long long opa_clock(void) __attribute__((import_name("opa_clock")));
+
+static struct {
+    unsigned long long parse;
+    unsigned long long eval;
+    unsigned long long dump;
+} eval_profile;
+
+#define EVAL_PHASE_START() \
+    unsigned long long __phase = opa_clock(); \
+    eval_profile.parse = eval_profile.eval = eval_profile.dump = 0
+#define EVAL_PHASE(field) \
+    do { \
+        unsigned long long __now = opa_clock(); \
+        eval_profile.field = __now - __phase; \
+        __phase = __now; \
+    } while (0)
+#else
+#define EVAL_PHASE_START() do { } while (0)
+#define EVAL_PHASE(field) do { } while (0)
+#endif
+
 WASM_EXPORT(opa_eval)
 char *opa_eval(void *reserved, int entrypoint, opa_value *data, char *input, uint32_t input_len, uint32_t heap, bool want_value)
 {
@@ -28,20 +87,542 @@ char *opa_eval(void *reserved, int entrypoint, opa_value *data, char *input, uin
         opa_abort("invalid reserved argument");
     }
 
-    opa_heap_ptr_set(heap);
+    // Retained memo entries (and the decision cache, in opa_eval_cached)
+    // live just above the host's heap mark: evaluate above them.
+    opa_heap_ptr_set(opa_memoize_retained_floor(heap));
+
+    // All allocations made below are released at once when the caller resets
+    // the heap pointer, so run the heap as a bump arena for the duration of
+    // the evaluation: opa_free calls become no-ops and opa_malloc skips the
+    // free lists entirely.
+    opa_heap_bump_set(true);
+
+    EVAL_PHASE_START();
+
+    opa_eval_ctx_t ctx = {
+      .entrypoint = entrypoint,
+      .data = data,
+      .input = opa_value_parse(input, input_len),
+    };
+
+    EVAL_PHASE(parse);
+
+    // drop retained entries whose registered input fields changed
+    opa_memoize_input_delta(ctx.input);
+
+    int rc = eval(&ctx);
+
+    EVAL_PHASE(eval);
+
+    if (rc != 0) {
+        if (opa_error_recoverable()) {
+            // recoverable mode: record the error and hand control
+            // back instead of trapping the instance
+            opa_error_record("eval failed");
+            opa_memoize_retain_discard();
+            opa_heap_bump_set(false);
+            return NULL;
+        }
+
+        opa_abort("eval failed");
+    }
+
+    char *result = want_value ? opa_value_dump(ctx.result) : opa_json_dump(ctx.result);
+
+    EVAL_PHASE(dump);
+
+    opa_memoize_retain_commit(result);
+    opa_heap_bump_set(false);
+    return result;
+}
+
+#ifdef EVAL_PROFILE
+#include "printf.h"
+
+// dumps the phase timing of the most recent opa_eval call as a JSON
+// object of cycle counts. The returned string is heap allocated. The
+// alternate entry points (opa_eval_cached, opa_eval_parsed and friends)
+// are not phase-timed; route a call through opa_eval to profile it.
+WASM_EXPORT(opa_eval_profile_dump)
+char *opa_eval_profile_dump(void)
+{
+    char *buf = opa_malloc(128);
+    snprintf(buf, 128, "{\"parse\":%llu,\"eval\":%llu,\"dump\":%llu}",
+             eval_profile.parse, eval_profile.eval, eval_profile.dump);
+    return buf;
+}
+#endif
+
+// Decision cache. opa_eval_cached memoizes complete evaluations: the parsed
+// input is hashed with opa_value_hash and matched against recent decisions,
+// and a hit returns the cached serialized result without running eval().
+// Hash collisions are ruled out by also comparing the input's serialized
+// form. The cached strings are copied to the bottom of the eval arena, just
+// above the host's heap mark, and the per-call reset point is moved past
+// them, so they survive the resets that discard everything else; when the
+// entry table fills or the host presents a different heap mark (new data),
+// the cache is dropped wholesale.
+
+#define DECISION_CACHE_SIZE 64
+
+struct decision_entry {
+    size_t hash;
+    int entrypoint;
+    bool value;       // serialized with opa_value_dump rather than opa_json_dump
+    char *input;      // serialized parsed input, for exact matching
+    size_t input_len;
+    char *result;     // nul-terminated serialized result
+};
+
+static struct decision_entry decision_cache[DECISION_CACHE_SIZE];
+static size_t decision_cache_len = 0;
+static unsigned int decision_cache_base = 0; // host heap mark the cache sits above
+static unsigned int decision_cache_ptr = 0;  // first byte past the cached strings
+
+// appends n bytes to the cached string region. The source lives above
+// decision_cache_ptr, so a forward copy is safe even when the regions
+// overlap after a wholesale drop.
+static char *decision_cache_copy(const char *s, size_t n)
+{
+    char *dst = (char *)(uintptr_t)decision_cache_ptr;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        dst[i] = s[i];
+    }
+
+    decision_cache_ptr += n;
+    return dst;
+}
+
+WASM_EXPORT(opa_eval_cached)
+char *opa_eval_cached(void *reserved, int entrypoint, opa_value *data, char *input, uint32_t input_len, uint32_t heap, bool want_value)
+{
+    if (reserved != NULL) {
+        opa_abort("invalid reserved argument");
+    }
+
+    // The decision cache stacks above the retained memo region; when that
+    // region grows or is dropped, the changed base drops the cache too.
+    heap = opa_memoize_retained_floor(heap);
+
+    if (decision_cache_base != heap)
+    {
+        decision_cache_len = 0;
+        decision_cache_base = heap;
+        decision_cache_ptr = heap;
+    }
+
+    opa_heap_ptr_set(decision_cache_ptr);
+    opa_heap_bump_set(true);
+
+    opa_value *parsed = opa_value_parse(input, input_len);
+    size_t hash = opa_value_hash(parsed);
+    char *key = opa_json_dump(parsed);
+    size_t key_len = opa_strlen(key);
+
+    for (size_t i = 0; i < decision_cache_len; i++)
+    {
+        struct decision_entry *e = &decision_cache[i];
+
+        if (e->hash != hash || e->entrypoint != entrypoint ||
+            e->value != want_value || e->input_len != key_len)
+        {
+            continue;
+        }
+
+        size_t j = 0;
+
+        while (j < key_len && e->input[j] == key[j])
+        {
+            j++;
+        }
+
+        if (j == key_len)
+        {
+            opa_heap_bump_set(false);
+            return e->result;
+        }
+    }
+
+    opa_eval_ctx_t ctx = {
+      .entrypoint = entrypoint,
+      .data = data,
+      .input = parsed,
+    };
+
+    opa_memoize_input_delta(parsed);
+
+    if (eval(&ctx) != 0) {
+        if (opa_error_recoverable()) {
+            // recoverable mode: record the error and hand control
+            // back instead of trapping the instance
+            opa_error_record("eval failed");
+            opa_memoize_retain_discard();
+            opa_heap_bump_set(false);
+            return NULL;
+        }
+
+        opa_abort("eval failed");
+    }
+
+    char *result = want_value ? opa_value_dump(ctx.result) : opa_json_dump(ctx.result);
+
+    if (decision_cache_len == DECISION_CACHE_SIZE)
+    {
+        decision_cache_len = 0;
+        decision_cache_ptr = decision_cache_base;
+    }
+
+    struct decision_entry *e = &decision_cache[decision_cache_len++];
+    e->hash = hash;
+    e->entrypoint = entrypoint;
+    e->value = want_value;
+    e->input_len = key_len;
+    e->input = decision_cache_copy(key, key_len);
+    e->result = decision_cache_copy(result, opa_strlen(result) + 1);
+
+    opa_heap_bump_set(false);
+    return e->result;
+}
+
+// opa_eval_parsed is opa_eval for callers that parsed the input up front
+// (with the exported opa_value_parse) and evaluate it repeatedly. The caller
+// captures the heap pointer after parsing and passes it as 'heap': every
+// evaluation then resets to just above the parsed input, releasing the
+// evaluation's allocations while keeping the input alive.
+WASM_EXPORT(opa_eval_parsed)
+char *opa_eval_parsed(void *reserved, int entrypoint, opa_value *data, opa_value *input, uint32_t heap, bool want_value)
+{
+    if (reserved != NULL) {
+        opa_abort("invalid reserved argument");
+    }
+
+    opa_heap_ptr_set(opa_memoize_retained_floor(heap));
+    opa_heap_bump_set(true);
+
+    opa_eval_ctx_t ctx = {
+      .entrypoint = entrypoint,
+      .data = data,
+      .input = input,
+    };
+
+    opa_memoize_input_delta(input);
+
+    if (eval(&ctx) != 0) {
+        if (opa_error_recoverable()) {
+            // recoverable mode: record the error and hand control
+            // back instead of trapping the instance
+            opa_error_record("eval failed");
+            opa_memoize_retain_discard();
+            opa_heap_bump_set(false);
+            return NULL;
+        }
+
+        opa_abort("eval failed");
+    }
+
+    char *result = want_value ? opa_value_dump(ctx.result) : opa_json_dump(ctx.result);
+    opa_memoize_retain_commit(result);
+    opa_heap_bump_set(false);
+    return result;
+}
+
+// opa_eval_into is opa_eval for hosts that pin one result buffer per
+// instance: the serialized result is written into 'buf' instead of being
+// returned as a fresh allocation. Returns the number of bytes the result
+// needs including the terminating nul; the buffer holds the complete,
+// nul-terminated result only when the returned size is at most 'buf_len',
+// otherwise the caller grows the buffer and evaluates again.
+WASM_EXPORT(opa_eval_into)
+uint32_t opa_eval_into(void *reserved, int entrypoint, opa_value *data, char *input, uint32_t input_len, uint32_t heap, bool want_value, char *buf, uint32_t buf_len)
+{
+    if (reserved != NULL) {
+        opa_abort("invalid reserved argument");
+    }
+
+    opa_heap_ptr_set(opa_memoize_retained_floor(heap));
+    opa_heap_bump_set(true);
+
     opa_eval_ctx_t ctx = {
       .entrypoint = entrypoint,
       .data = data,
       .input = opa_value_parse(input, input_len),
     };
 
+    opa_memoize_input_delta(ctx.input);
+
     if (eval(&ctx) != 0) {
+        if (opa_error_recoverable()) {
+            // recoverable mode: record the error and hand control
+            // back instead of trapping the instance
+            opa_error_record("eval failed");
+            opa_memoize_retain_discard();
+            opa_heap_bump_set(false);
+            return 0;
+        }
+
         opa_abort("eval failed");
     }
-    if (want_value) {
-        return opa_value_dump(ctx.result);
+
+    opa_json_stream_t *s = want_value ? opa_value_stream(ctx.result) : opa_json_stream(ctx.result);
+    size_t total = opa_json_stream_write(s, buf, buf_len);
+
+    if (total < buf_len)
+    {
+        buf[total] = 0;
+    }
+    else
+    {
+        // The result did not fit (or left no room for the nul): drain the
+        // rest of the stream to report the required size.
+        char scratch[256];
+        size_t n;
+
+        while ((n = opa_json_stream_write(s, scratch, sizeof(scratch))) > 0)
+        {
+            total += n;
+        }
+    }
+
+    opa_json_stream_free(s);
+    opa_memoize_retain_commit(NULL); // the result is in the caller's buffer
+    opa_heap_bump_set(false);
+    return (uint32_t)(total + 1);
+}
+
+// opa_eval_batch evaluates several entrypoints over one input and returns a
+// single serialized object mapping each entrypoint id to its result set.
+// Compared to calling opa_eval per entrypoint, the input is parsed once, all
+// evaluations share one heap snapshot, and the host boundary is crossed once.
+// 'entrypoints' points to 'n' entrypoint ids in the shared memory.
+WASM_EXPORT(opa_eval_batch)
+char *opa_eval_batch(void *reserved, int32_t *entrypoints, uint32_t n, opa_value *data, char *input, uint32_t input_len, uint32_t heap, bool want_value)
+{
+    if (reserved != NULL) {
+        opa_abort("invalid reserved argument");
+    }
+
+    opa_heap_ptr_set(opa_memoize_retained_floor(heap));
+    opa_heap_bump_set(true);
+
+    opa_value *parsed = opa_value_parse(input, input_len);
+    opa_value *results = opa_object();
+
+    opa_memoize_input_delta(parsed);
+
+    for (uint32_t i = 0; i < n; i++) {
+        opa_eval_ctx_t ctx = {
+          .entrypoint = entrypoints[i],
+          .data = data,
+          .input = parsed,
+        };
+
+        if (eval(&ctx) != 0) {
+            if (opa_error_recoverable()) {
+                // recoverable mode: record the error and hand control
+                // back instead of trapping the instance
+                opa_error_record("eval failed");
+                opa_memoize_retain_discard();
+                opa_heap_bump_set(false);
+                return NULL;
+            }
+
+            opa_abort("eval failed");
+        }
+
+        opa_object_insert(opa_cast_object(results), opa_number_int(entrypoints[i]), ctx.result);
     }
-    return opa_json_dump(ctx.result);
+
+    char *result = want_value ? opa_value_dump(results) : opa_json_dump(results);
+    opa_memoize_retain_commit(result);
+    opa_heap_bump_set(false);
+    return result;
+}
+
+// opa_eval_inputs evaluates one entrypoint over a JSON array of inputs and
+// returns a JSON array with one result per input, in order. The host
+// boundary is crossed once for the whole batch, and each input is evaluated
+// on a heap popped back to just above the accumulated results, so peak
+// memory tracks the largest single evaluation rather than the batch. This
+// toolchain has no wasm threads, so distributing a batch across workers
+// stays host-side: workers sharing a mounted data document can each take a
+// slice of the array.
+WASM_EXPORT(opa_eval_inputs)
+char *opa_eval_inputs(void *reserved, int entrypoint, opa_value *data, char *input, uint32_t input_len, uint32_t heap, bool want_value)
+{
+    if (reserved != NULL) {
+        opa_abort("invalid reserved argument");
+    }
+
+    opa_heap_ptr_set(opa_memoize_retained_floor(heap));
+    opa_heap_bump_set(true);
+
+    opa_value *inputs = opa_value_parse(input, input_len);
+
+    if (inputs == NULL || opa_value_type(inputs) != OPA_ARRAY) {
+        opa_abort("opa_eval_inputs: expected an array of inputs");
+    }
+
+    opa_array_t *arr = opa_cast_array(inputs);
+
+    // The serialized results accumulate at 'out', just above the parsed
+    // batch. Each copy moves bytes downwards from the evaluation's
+    // allocations into the region the next reset discards, so a forward
+    // copy is safe (see decision_cache_copy).
+    char *out = (char *)opa_heap_ptr_get();
+    size_t n = 0;
+
+    out[n++] = '[';
+
+    for (size_t i = 0; i < arr->len; i++)
+    {
+        if (i > 0)
+        {
+            out[n++] = ',';
+        }
+
+        opa_heap_ptr_set((opa_heap_addr_t)(out + n));
+
+        opa_eval_ctx_t ctx = {
+          .entrypoint = entrypoint,
+          .data = data,
+          .input = arr->elems[i].v,
+        };
+
+        opa_memoize_input_delta(ctx.input);
+
+        if (eval(&ctx) != 0) {
+            if (opa_error_recoverable()) {
+                // recoverable mode: record the error and hand control
+                // back instead of trapping the instance
+                opa_error_record("eval failed");
+                opa_memoize_retain_discard();
+                opa_heap_bump_set(false);
+                return NULL;
+            }
+
+            opa_abort("eval failed");
+        }
+
+        char *result = want_value ? opa_value_dump(ctx.result) : opa_json_dump(ctx.result);
+
+        for (size_t j = 0; result[j] != '\0'; j++)
+        {
+            out[n++] = result[j];
+        }
+
+        // retained entries cannot be committed here: the values they point
+        // at are discarded by the next iteration's heap pop
+        opa_memoize_retain_discard();
+    }
+
+    out[n++] = ']';
+    out[n] = 0;
+    opa_heap_bump_set(false);
+    return out;
+}
+
+// eval_bool_status classifies a result set for the boolean result
+// protocol: an empty set is an undefined decision, a single object whose
+// "result" entry is a boolean is that decision, and anything else the
+// protocol cannot carry.
+static int32_t eval_bool_status(opa_value *result)
+{
+    if (result == NULL || opa_value_length(result) == 0)
+    {
+        return OPA_EVAL_BOOL_UNDEFINED;
+    }
+
+    if (opa_value_length(result) != 1)
+    {
+        return OPA_EVAL_BOOL_OTHER;
+    }
+
+    opa_value *first = opa_value_iter(result, NULL);
+
+    if (opa_value_type(result) != OPA_SET)
+    {
+        first = opa_value_get(result, first);
+    }
+
+    if (first == NULL || opa_value_type(first) != OPA_OBJECT)
+    {
+        return OPA_EVAL_BOOL_OTHER;
+    }
+
+    opa_value *v = opa_value_get(first, opa_string_terminated("result"));
+
+    if (v == NULL || opa_value_type(v) != OPA_BOOLEAN)
+    {
+        return OPA_EVAL_BOOL_OTHER;
+    }
+
+    return opa_cast_boolean(v)->v ? OPA_EVAL_BOOL_TRUE : OPA_EVAL_BOOL_FALSE;
+}
+
+// opa_eval_bool is opa_eval for entrypoints that decide a bare allow or
+// deny: the decision comes back as an immediate status code and nothing
+// is serialized or parsed on the way out. OPA_EVAL_BOOL_OTHER reports a
+// result this protocol cannot carry — the caller re-evaluates through
+// opa_eval to see it — and OPA_EVAL_BOOL_ERROR a recoverable evaluation
+// error (see opa_error_recoverable).
+WASM_EXPORT(opa_eval_bool)
+int32_t opa_eval_bool(void *reserved, int entrypoint, opa_value *data, char *input, uint32_t input_len, uint32_t heap)
+{
+    if (reserved != NULL) {
+        opa_abort("invalid reserved argument");
+    }
+
+    opa_heap_ptr_set(opa_memoize_retained_floor(heap));
+    opa_heap_bump_set(true);
+
+    opa_eval_ctx_t ctx = {
+      .entrypoint = entrypoint,
+      .data = data,
+      .input = opa_value_parse(input, input_len),
+    };
+
+    opa_memoize_input_delta(ctx.input);
+
+    if (eval(&ctx) != 0) {
+        if (opa_error_recoverable()) {
+            // recoverable mode: record the error and hand control
+            // back instead of trapping the instance
+            opa_error_record("eval failed");
+            opa_memoize_retain_discard();
+            opa_heap_bump_set(false);
+            return OPA_EVAL_BOOL_ERROR;
+        }
+
+        opa_abort("eval failed");
+    }
+
+    int32_t status = eval_bool_status(ctx.result);
+    opa_memoize_retain_commit(NULL); // nothing is serialized
+    opa_heap_bump_set(false);
+    return status;
+}
+
+// opa_eval_recover makes an instance whose eval trapped — or failed in
+// recoverable mode — safe to reuse, so the host pays a heap reset instead
+// of a re-instantiation (and keeps warmed state: interned strings, regex
+// cache). 'heap' is the host's heap mark. Everything allocated by the
+// failed eval is discarded by the heap reset; the caches whose statics may
+// have been mid-update when the trap fired are dropped wholesale, and the
+// heap-epoch bump from the reset invalidates the epoch-stamped memo caches
+// on values. This toolchain has no setjmp/longjmp, so the host's trap
+// handler plays the longjmp: catch, call opa_eval_recover, evaluate again.
+WASM_EXPORT(opa_eval_recover)
+void opa_eval_recover(uint32_t heap)
+{
+    opa_heap_bump_set(false);
+    opa_memoize_retain_discard();
+    decision_cache_len = 0;
+    decision_cache_base = 0;
+    decision_cache_ptr = 0;
+    opa_heap_ptr_set(opa_memoize_retained_floor(heap));
+    opa_error_clear();
 }
 
 // NOTE(sr): Without this attribute set, LLVM would not let this function
@@ -71,6 +652,258 @@ opa_value *opa_eval_ctx_get_result(opa_eval_ctx_t *ctx)
     return ctx->result;
 }
 
+#ifdef BUILTIN_PROFILE
+#include "printf.h"
+
+// builtin dispatch profile: call counts and cycles per builtin id for the
+// host-dispatched builtins. The wrappers below keep the opa_builtin0..4
+// import names the SDKs already provide and time each call with a
+// host-provided clock import, so the runtime stays independent of any
+// particular tick source. Natively implemented builtins are called
+// directly by the generated code and are not covered; to profile one,
+// compile the policy with the builtin left to the host so the call routes
+// through this dispatch.
+
+unsigned long long opa_clock(void) __attribute__((import_name("opa_clock")));
+
+opa_value *__opa_builtin0(int, void *) __attribute__((import_name("opa_builtin0")));
+opa_value *__opa_builtin1(int, void *, opa_value *) __attribute__((import_name("opa_builtin1")));
+opa_value *__opa_builtin2(int, void *, opa_value *, opa_value *) __attribute__((import_name("opa_builtin2")));
+opa_value *__opa_builtin3(int, void *, opa_value *, opa_value *, opa_value *) __attribute__((import_name("opa_builtin3")));
+opa_value *__opa_builtin4(int, void *, opa_value *, opa_value *, opa_value *, opa_value *) __attribute__((import_name("opa_builtin4")));
+
+#define BUILTIN_PROFILE_IDS (256)
+
+static struct {
+    unsigned int count;
+    unsigned long long cycles;
+} builtin_profile[BUILTIN_PROFILE_IDS];
+
+static void builtin_profile_record(int id, unsigned long long cycles)
+{
+    if (id >= 0 && id < BUILTIN_PROFILE_IDS)
+    {
+        builtin_profile[id].count++;
+        builtin_profile[id].cycles += cycles;
+    }
+}
+
+opa_value *opa_builtin0(int id, void *ctx)
+{
+    unsigned long long start = opa_clock();
+    opa_value *result = __opa_builtin0(id, ctx);
+    builtin_profile_record(id, opa_clock() - start);
+    return result;
+}
+
+opa_value *opa_builtin1(int id, void *ctx, opa_value *a)
+{
+    unsigned long long start = opa_clock();
+    opa_value *result = __opa_builtin1(id, ctx, a);
+    builtin_profile_record(id, opa_clock() - start);
+    return result;
+}
+
+opa_value *opa_builtin2(int id, void *ctx, opa_value *a, opa_value *b)
+{
+    unsigned long long start = opa_clock();
+    opa_value *result = __opa_builtin2(id, ctx, a, b);
+    builtin_profile_record(id, opa_clock() - start);
+    return result;
+}
+
+opa_value *opa_builtin3(int id, void *ctx, opa_value *a, opa_value *b, opa_value *c)
+{
+    unsigned long long start = opa_clock();
+    opa_value *result = __opa_builtin3(id, ctx, a, b, c);
+    builtin_profile_record(id, opa_clock() - start);
+    return result;
+}
+
+opa_value *opa_builtin4(int id, void *ctx, opa_value *a, opa_value *b, opa_value *c, opa_value *d)
+{
+    unsigned long long start = opa_clock();
+    opa_value *result = __opa_builtin4(id, ctx, a, b, c, d);
+    builtin_profile_record(id, opa_clock() - start);
+    return result;
+}
+
+// dumps the profile as a JSON object mapping builtin ids to their call
+// counts and cycles. The returned string is heap allocated.
+WASM_EXPORT(opa_builtin_profile_dump)
+char *opa_builtin_profile_dump(void)
+{
+    size_t cap = 2;
+
+    for (int i = 0; i < BUILTIN_PROFILE_IDS; i++)
+    {
+        if (builtin_profile[i].count > 0)
+        {
+            cap += 64;
+        }
+    }
+
+    char *buf = opa_malloc(cap + 1);
+    size_t n = 0;
+    int first = 1;
+
+    buf[n++] = '{';
+
+    for (int i = 0; i < BUILTIN_PROFILE_IDS; i++)
+    {
+        if (builtin_profile[i].count > 0)
+        {
+            n += snprintf(&buf[n], cap - n, "%s\"%d\":{\"count\":%u,\"cycles\":%llu}",
+                          first ? "" : ",", i,
+                          builtin_profile[i].count, builtin_profile[i].cycles);
+            first = 0;
+        }
+    }
+
+    buf[n++] = '}';
+    buf[n] = '\0';
+    return buf;
+}
+#endif
+
+// Batched host-builtin dispatch. A comprehension calling a host-dispatched
+// builtin crosses the wasm/host boundary once per element, and for cheap
+// pure helpers the crossing and marshalling dwarf the builtin's own work.
+// The batch API lets generated code accumulate the argument tuples of one
+// builtin across a loop and dispatch them in a single host call:
+//
+//     b = opa_builtin_batch_begin(id, ctx);
+//     for each element: opa_builtin_batch_push1(b, arg);
+//     results = opa_builtin_batch_end(b);   // array, one entry per tuple
+//
+// BUILTIN_BATCH=1 builds route opa_builtin_batch_end through a single
+// 'opa_builtin_batch' host import that receives the tuple array and returns
+// the result array; hosts that answer NULL — and builds without the flag,
+// which keep the import out of the module for SDKs that do not provide
+// it — fall back to per-tuple opa_builtin0..4 calls, so generated code can
+// use the batch form unconditionally. Only total builtins should be
+// batched: an undefined per-tuple result is stored as JSON null.
+
+struct opa_builtin_batch_t
+{
+    int id;
+    void *ctx;
+    opa_array_t *tuples; // one array of arguments per accumulated call
+};
+
+#ifdef BUILTIN_BATCH
+opa_value *__opa_builtin_batch(int, void *, opa_value *) __attribute__((import_name("opa_builtin_batch")));
+#endif
+
+OPA_INTERNAL
+opa_builtin_batch_t *opa_builtin_batch_begin(int id, void *ctx)
+{
+    opa_builtin_batch_t *b = (opa_builtin_batch_t *)opa_malloc(sizeof(opa_builtin_batch_t));
+
+    b->id = id;
+    b->ctx = ctx;
+    b->tuples = opa_cast_array(opa_array());
+    return b;
+}
+
+static void opa_builtin_batch_push(opa_builtin_batch_t *b, opa_value **args, size_t n)
+{
+    opa_value *tuple = opa_array_with_cap(n);
+
+    for (size_t i = 0; i < n; i++)
+    {
+        opa_array_append(opa_cast_array(tuple), args[i]);
+    }
+
+    opa_array_append(b->tuples, tuple);
+}
+
+OPA_INTERNAL
+void opa_builtin_batch_push0(opa_builtin_batch_t *b)
+{
+    opa_builtin_batch_push(b, NULL, 0);
+}
+
+OPA_INTERNAL
+void opa_builtin_batch_push1(opa_builtin_batch_t *b, opa_value *a)
+{
+    opa_builtin_batch_push(b, (opa_value *[]){a}, 1);
+}
+
+OPA_INTERNAL
+void opa_builtin_batch_push2(opa_builtin_batch_t *b, opa_value *a, opa_value *a2)
+{
+    opa_builtin_batch_push(b, (opa_value *[]){a, a2}, 2);
+}
+
+OPA_INTERNAL
+void opa_builtin_batch_push3(opa_builtin_batch_t *b, opa_value *a, opa_value *a2, opa_value *a3)
+{
+    opa_builtin_batch_push(b, (opa_value *[]){a, a2, a3}, 3);
+}
+
+OPA_INTERNAL
+void opa_builtin_batch_push4(opa_builtin_batch_t *b, opa_value *a, opa_value *a2, opa_value *a3, opa_value *a4)
+{
+    opa_builtin_batch_push(b, (opa_value *[]){a, a2, a3, a4}, 4);
+}
+
+// dispatches the accumulated tuples and returns the result array. The batch
+// and its tuple arrays are freed shallowly — the argument values themselves
+// belong to the evaluation.
+OPA_INTERNAL
+opa_value *opa_builtin_batch_end(opa_builtin_batch_t *b)
+{
+    opa_array_t *tuples = b->tuples;
+    opa_value *results = NULL;
+
+#ifdef BUILTIN_BATCH
+    results = __opa_builtin_batch(b->id, b->ctx, &tuples->hdr);
+#endif
+
+    if (results == NULL)
+    {
+        results = opa_array_with_cap(tuples->len);
+
+        for (size_t i = 0; i < tuples->len; i++)
+        {
+            opa_array_t *t = opa_cast_array(tuples->elems[i].v);
+            opa_array_elem_t *a = t->elems;
+            opa_value *r = NULL;
+
+            switch (t->len)
+            {
+            case 0:
+                r = opa_builtin0(b->id, b->ctx);
+                break;
+            case 1:
+                r = opa_builtin1(b->id, b->ctx, a[0].v);
+                break;
+            case 2:
+                r = opa_builtin2(b->id, b->ctx, a[0].v, a[1].v);
+                break;
+            case 3:
+                r = opa_builtin3(b->id, b->ctx, a[0].v, a[1].v, a[2].v);
+                break;
+            case 4:
+                r = opa_builtin4(b->id, b->ctx, a[0].v, a[1].v, a[2].v, a[3].v);
+                break;
+            }
+
+            opa_array_append(opa_cast_array(results), r != NULL ? r : opa_null());
+        }
+    }
+
+    for (size_t i = 0; i < tuples->len; i++)
+    {
+        opa_array_free(opa_cast_array(tuples->elems[i].v));
+    }
+
+    opa_array_free(tuples);
+    opa_free(b);
+    return results;
+}
+
 OPA_INTERNAL
 void __force_import_opa_builtins()
 {
@@ -11,7 +11,16 @@ typedef struct
     int entrypoint;
 } opa_eval_ctx_t;
 
+// Status codes of the boolean result protocol (opa_eval_bool).
+#define OPA_EVAL_BOOL_FALSE (0)
+#define OPA_EVAL_BOOL_TRUE (1)
+#define OPA_EVAL_BOOL_UNDEFINED (2) // empty result set
+#define OPA_EVAL_BOOL_OTHER (3)     // result is not a bare boolean; use opa_eval
+#define OPA_EVAL_BOOL_ERROR (4)     // recoverable evaluation error
+
 opa_eval_ctx_t *opa_eval_ctx_new();
+void opa_eval_ctx_reset(opa_eval_ctx_t *ctx);
+void opa_initialize(void);
 void opa_eval_ctx_set_input(opa_eval_ctx_t *ctx, opa_value *v);
 void opa_eval_ctx_set_data(opa_eval_ctx_t *ctx, opa_value *v);
 void opa_eval_ctx_set_entrypoint(opa_eval_ctx_t *ctx, int entrypoint);
@@ -23,6 +32,22 @@ opa_value *opa_builtin2(int, void *, opa_value *, opa_value *);
 opa_value *opa_builtin3(int, void *, opa_value *, opa_value *, opa_value *);
 opa_value *opa_builtin4(int, void *, opa_value *, opa_value *, opa_value *, opa_value *);
 
+// Batched dispatch for host builtins called in a loop: accumulate one
+// argument tuple per call with the push functions, then dispatch them in a
+// single host crossing (or, without BUILTIN_BATCH support, per tuple).
+// opa_builtin_batch_end returns an array with one result per tuple;
+// undefined results are stored as JSON null, so only total builtins should
+// be batched.
+typedef struct opa_builtin_batch_t opa_builtin_batch_t;
+
+opa_builtin_batch_t *opa_builtin_batch_begin(int id, void *ctx);
+void opa_builtin_batch_push0(opa_builtin_batch_t *b);
+void opa_builtin_batch_push1(opa_builtin_batch_t *b, opa_value *a);
+void opa_builtin_batch_push2(opa_builtin_batch_t *b, opa_value *a, opa_value *a2);
+void opa_builtin_batch_push3(opa_builtin_batch_t *b, opa_value *a, opa_value *a2, opa_value *a3);
+void opa_builtin_batch_push4(opa_builtin_batch_t *b, opa_value *a, opa_value *a2, opa_value *a3, opa_value *a4);
+opa_value *opa_builtin_batch_end(opa_builtin_batch_t *b);
+
 int32_t eval(opa_eval_ctx_t *ctx);
 
 #endif
\ No newline at end of file
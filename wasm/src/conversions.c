@@ -19,6 +19,23 @@ opa_value *opa_to_number(opa_value *v)
     case OPA_STRING:
     {
         opa_string_t *a = opa_cast_string(v);
+
+        // Plain integer strings take the SWAR opa_atoi64 path straight to
+        // an int-repr number, skipping the float validation and the later
+        // ref-to-mpd conversion. The length cap keeps us clear of
+        // opa_atoi64's silent wraparound: 18 digits always fit in 64 bits.
+        size_t digits = (a->len > 0 && a->v[0] == '-') ? a->len - 1 : a->len;
+
+        if (digits >= 1 && digits <= 18)
+        {
+            long long i;
+
+            if (opa_atoi64(a->v, a->len, &i) == 0)
+            {
+                return opa_number_interned(i);
+            }
+        }
+
         double n;
         // NOTE: we're only using opa_atof64 for validation here
         if (opa_atof64(a->v, a->len, &n) != 0)
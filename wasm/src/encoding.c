@@ -38,7 +38,13 @@
 #include <string.h>
 #include <limits.h>
 
+#ifdef __wasm_simd128__
+#include <wasm_simd128.h>
+#endif
+
+#include "encoding.h"
 #include "json.h"
+#include "malloc.h"
 #include "value.h"
 
 static const unsigned char base64_table[65] =
@@ -68,6 +74,57 @@ static unsigned char * base64_gen_encode(const unsigned char *src, size_t len,
 	end = src + len;
 	in = src;
 	pos = out;
+
+#ifdef __wasm_simd128__
+	/* Transcode 12 input bytes to 16 output characters at a time.  Each
+	 * iteration loads a full vector, so it stops while at least 16 input
+	 * bytes remain; the byte loop below finishes the tail and padding.
+	 *
+	 * The two alphabets only differ in the characters for values 62 and
+	 * 63, so the same kernel serves both with a per-table offset LUT. */
+	if (end - in >= 16) {
+		const v128_t shift_lut = table == base64_url_table ?
+			wasm_i8x16_const(71, -4, -4, -4, -4, -4, -4, -4,
+					 -4, -4, -4, -17, 32, 65, 0, 0) :
+			wasm_i8x16_const(71, -4, -4, -4, -4, -4, -4, -4,
+					 -4, -4, -4, -19, -16, 65, 0, 0);
+
+		while (end - in >= 16) {
+			/* Spread each 3-byte group over a 32-bit lane as
+			 * [b1 b0 b2 b1] (little endian), so that every 6-bit
+			 * field ends up extractable with lane-wide shifts. */
+			v128_t v = wasm_i8x16_swizzle(wasm_v128_load(in),
+				wasm_i8x16_const(1, 0, 2, 1, 4, 3, 5, 4,
+						 7, 6, 8, 7, 10, 9, 11, 10));
+
+			v128_t idx = wasm_v128_or(
+				wasm_v128_or(
+					wasm_v128_and(wasm_u32x4_shr(v, 10),
+						      wasm_i32x4_splat(0x0000003f)),
+					wasm_v128_and(wasm_i32x4_shl(v, 4),
+						      wasm_i32x4_splat(0x00003f00))),
+				wasm_v128_or(
+					wasm_v128_and(wasm_u32x4_shr(v, 6),
+						      wasm_i32x4_splat(0x003f0000)),
+					wasm_v128_and(wasm_i32x4_shl(v, 8),
+						      wasm_i32x4_splat(0x3f000000))));
+
+			/* Map the 6-bit values to ASCII by adding an offset
+			 * selected by range: 0..25 -> 13, 26..51 -> 0,
+			 * 52..63 -> 1..12 index the LUT above. */
+			v128_t range = wasm_v128_or(
+				wasm_u8x16_sub_sat(idx, wasm_i8x16_splat(51)),
+				wasm_v128_and(wasm_u8x16_lt(idx, wasm_i8x16_splat(26)),
+					      wasm_i8x16_splat(13)));
+			wasm_v128_store(pos, wasm_i8x16_add(idx,
+				wasm_i8x16_swizzle(shift_lut, range)));
+
+			in += 12;
+			pos += 16;
+		}
+	}
+#endif
+
 	while (end - in >= 3) {
 		*pos++ = table[(in[0] >> 2) & 0x3f];
 		*pos++ = table[(((in[0] & 0x03) << 4) | (in[1] >> 4)) & 0x3f];
@@ -98,72 +155,187 @@ static unsigned char * base64_gen_encode(const unsigned char *src, size_t len,
 }
 
 
-static unsigned char * base64_gen_decode(const unsigned char *src, size_t len,
-                                         size_t *out_len,
-                                         const unsigned char *table)
+static void base64_build_dtable(unsigned char *dtable,
+                                const unsigned char *table)
 {
-	unsigned char dtable[256], *out, *pos, block[4], tmp;
-	size_t i, count, olen;
-	int pad = 0;
-	size_t extra_pad;
-
 	memset(dtable, 0x80, 256);
-	for (i = 0; i < sizeof(base64_table) - 1; i++)
+	for (size_t i = 0; i < sizeof(base64_table) - 1; i++)
 		dtable[table[i]] = (unsigned char) i;
 	dtable['='] = 0;
+}
+
+/* Single-pass decode with validation. Walks src exactly once with the
+ * skip-and-pad behavior of the byte decoder, implying trailing '='
+ * characters for unpadded input as it goes instead of sizing the walk
+ * with a counting prepass. 'out' may be NULL to validate without
+ * producing output (olen is then ignored); otherwise it must hold at
+ * least len / 4 * 3 + 3 bytes. On success returns the decoded length and
+ * stores the number of implied trailing '=' characters in *extra_pad
+ * (when non-NULL); on invalid input returns -1. */
+static long base64_gen_core(const unsigned char *src, size_t len,
+                            const unsigned char *table, unsigned char *out,
+                            size_t olen, size_t *extra_pad)
+{
+	unsigned char dtable[256], block[4], tmp;
+	size_t i, count, pos, implied;
+	int pad = 0;
+	int seen = 0;
+
+	base64_build_dtable(dtable, table);
 
 	count = 0;
-	for (i = 0; i < len; i++) {
-		if (dtable[src[i]] != 0x80)
-			count++;
-	}
+	pos = 0;
+	implied = 0;
+	i = 0;
+
+#ifdef __wasm_simd128__
+	/* Decode 16 characters to 12 bytes at a time while the input is a
+	 * clean run of alphabet characters.  Any other byte — padding,
+	 * whitespace, garbage — stops the block loop, and the byte loop
+	 * below takes over with its skip-and-pad handling intact.  With a
+	 * NULL sink the merge and store are skipped, leaving the validity
+	 * check.
+	 *
+	 * Characters are validated and mapped to their 6-bit values by
+	 * nibble: lut_lo[low] & lut_hi[high] is non-zero for bytes outside
+	 * the alphabet, and roll[high] is the value-minus-character offset,
+	 * except for the value-63 character whose high nibble it shares
+	 * with a letter range ('/' with '+', '_' with 'P'..'Z'). */
+	{
+		const int url = table == base64_url_table;
+		const v128_t lut_lo = url ?
+			wasm_i8x16_const(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+					 0x11, 0x11, 0x13, 0x3b, 0x3b, 0x3a, 0x3b, 0x33) :
+			wasm_i8x16_const(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+					 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+		const v128_t lut_hi = url ?
+			wasm_i8x16_const(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x20,
+					 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10) :
+			wasm_i8x16_const(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+					 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+		const v128_t roll = url ?
+			wasm_i8x16_const(0, 0, 17, 4, -65, -65, -71, -71,
+					 0, 0, 0, 0, 0, 0, 0, 0) :
+			wasm_i8x16_const(0, 0, 19, 4, -65, -65, -71, -71,
+					 0, 0, 0, 0, 0, 0, 0, 0);
+		const v128_t last = wasm_i8x16_splat(url ? '_' : '/');
+		const v128_t last_roll = wasm_i8x16_splat(url ? -32 : 16);
+
+		while (len - i >= 16 && (out == NULL || olen - pos >= 16)) {
+			v128_t v = wasm_v128_load(src + i);
+			v128_t hi = wasm_u8x16_shr(v, 4);
+			v128_t lo = wasm_v128_and(v, wasm_i8x16_splat(0x0f));
+
+			if (wasm_v128_any_true(
+				wasm_v128_and(wasm_i8x16_swizzle(lut_lo, lo),
+					      wasm_i8x16_swizzle(lut_hi, hi))))
+				break;
 
-	if (count == 0)
-		return NULL;
-	extra_pad = (4 - count % 4) % 4;
+			if (out) {
+				v = wasm_i8x16_add(v, wasm_v128_bitselect(last_roll,
+					wasm_i8x16_swizzle(roll, hi),
+					wasm_i8x16_eq(v, last)));
+
+				/* Merge the four 6-bit values of each 32-bit
+				 * lane into its low three bytes, then compact
+				 * the lanes.  The store writes 16 bytes, hence
+				 * the output bound above. */
+				v128_t m = wasm_v128_or(
+					wasm_v128_or(
+						wasm_v128_or(
+							wasm_v128_and(wasm_i32x4_shl(v, 2),
+								      wasm_i32x4_splat(0x000000fc)),
+							wasm_v128_and(wasm_u32x4_shr(v, 12),
+								      wasm_i32x4_splat(0x00000003))),
+						wasm_v128_or(
+							wasm_v128_and(wasm_i32x4_shl(v, 4),
+								      wasm_i32x4_splat(0x0000f000)),
+							wasm_v128_and(wasm_u32x4_shr(v, 10),
+								      wasm_i32x4_splat(0x00000f00)))),
+					wasm_v128_or(
+						wasm_v128_and(wasm_i32x4_shl(v, 6),
+							      wasm_i32x4_splat(0x00c00000)),
+						wasm_v128_and(wasm_u32x4_shr(v, 8),
+							      wasm_i32x4_splat(0x003f0000))));
+				wasm_v128_store(out + pos, wasm_i8x16_swizzle(m,
+					wasm_i8x16_const(0, 1, 2, 4, 5, 6, 8, 9,
+							 10, 12, 13, 14, 0, 0, 0, 0)));
+			}
 
-	olen = (count + extra_pad) / 4 * 3;
-	pos = out = malloc(olen);
-	if (out == NULL)
-		return NULL;
+			seen = 1;
+			pos += 12;
+			i += 16;
+		}
+	}
+#endif
 
-	count = 0;
-	for (i = 0; i < len + extra_pad; i++) {
+	for (;; i++) {
 		unsigned char val;
 
-		if (i >= len)
-			val = '=';
-		else
+		if (i < len)
 			val = src[i];
+		else if (count != 0) {
+			val = '='; /* implied trailing padding */
+			implied++;
+		}
+		else
+			break;
+
 		tmp = dtable[val];
 		if (tmp == 0x80)
 			continue;
 
+		seen = 1;
 		if (val == '=')
 			pad++;
 		block[count] = tmp;
 		count++;
 		if (count == 4) {
-			*pos++ = (block[0] << 2) | (block[1] >> 4);
-			*pos++ = (block[1] << 4) | (block[2] >> 2);
-			*pos++ = (block[2] << 6) | block[3];
+			if (out) {
+				out[pos] = (block[0] << 2) | (block[1] >> 4);
+				out[pos + 1] = (block[1] << 4) | (block[2] >> 2);
+				out[pos + 2] = (block[2] << 6) | block[3];
+			}
+			pos += 3;
 			count = 0;
 			if (pad) {
-				if (pad == 1)
-					pos--;
-				else if (pad == 2)
-					pos -= 2;
-				else {
-					/* Invalid padding */
-					free(out);
-					return NULL;
-				}
+				if (pad > 2)
+					return -1; /* Invalid padding */
+				pos -= pad;
 				break;
 			}
 		}
 	}
 
-	*out_len = pos - out;
+	if (!seen)
+		return -1; /* No alphabet characters */
+
+	if (extra_pad)
+		*extra_pad = implied;
+
+	return (long)pos;
+}
+
+static unsigned char * base64_gen_decode(const unsigned char *src, size_t len,
+                                         size_t *out_len,
+                                         const unsigned char *table)
+{
+	unsigned char *out;
+	size_t olen;
+	long n;
+
+	olen = len / 4 * 3 + 3; /* upper bound: the core skips non-alphabet bytes */
+	out = malloc(olen);
+	if (out == NULL)
+		return NULL;
+
+	n = base64_gen_core(src, len, table, out, olen, NULL);
+	if (n < 0) {
+		free(out);
+		return NULL;
+	}
+
+	*out_len = (size_t)n;
 	return out;
 }
 
@@ -226,15 +398,7 @@ opa_value *opa_base64_is_valid(opa_value *a)
     }
 
     opa_string_t *s = opa_cast_string(a);
-    size_t len;
-    unsigned char *dec = base64_decode((const unsigned char*)s->v, s->len, &len);
-    if (dec == NULL)
-    {
-        return opa_boolean(false);
-    }
-
-    free(dec);
-    return opa_boolean(true);
+    return opa_boolean(base64_gen_core((const unsigned char*)s->v, s->len, base64_table, NULL, 0, NULL) >= 0);
 }
 
 OPA_BUILTIN
@@ -293,6 +457,354 @@ opa_value *opa_base64_url_encode(opa_value *a)
     return enc == NULL ? NULL : opa_string_allocated(enc, len);
 }
 
+// Streaming decode. A stream decodes a base64 string into caller-provided
+// buffers one chunk at a time, so inspecting a large blob never
+// materializes the full decoded copy on the heap next to the input. The
+// constructor validates the whole input up front (base64_gen_core with a
+// null sink, no allocation), so writes cannot fail; the stream
+// borrows the operand's bytes and the caller keeps the string alive until
+// the stream is freed.
+
+struct opa_base64_stream_t
+{
+    const unsigned char *src; // borrowed from the operand
+    size_t len;
+    size_t extra_pad;         // implied trailing '=' characters
+    size_t i;                 // position in the input
+    unsigned char block[4];   // 6-bit values of the quad being filled
+    size_t count;
+    int pad;
+    int done;                 // a padded quad ends the decode
+    unsigned char out[3];     // decoded quad bytes not yet flushed
+    size_t out_i;
+    size_t out_len;
+    unsigned char dtable[256];
+};
+
+static opa_base64_stream_t *base64_gen_stream(opa_value *a, const unsigned char *table)
+{
+    if (opa_value_type(a) != OPA_STRING)
+    {
+        return NULL;
+    }
+
+    opa_string_t *s = opa_cast_string(a);
+    size_t extra_pad;
+    if (base64_gen_core((const unsigned char *)s->v, s->len, table, NULL, 0, &extra_pad) < 0)
+    {
+        return NULL;
+    }
+
+    opa_base64_stream_t *st = malloc(sizeof(opa_base64_stream_t));
+    if (st == NULL)
+    {
+        return NULL;
+    }
+
+    st->src = (const unsigned char *)s->v;
+    st->len = s->len;
+    st->extra_pad = extra_pad;
+    st->i = 0;
+    st->count = 0;
+    st->pad = 0;
+    st->done = 0;
+    st->out_i = 0;
+    st->out_len = 0;
+    base64_build_dtable(st->dtable, table);
+    return st;
+}
+
+WASM_EXPORT(opa_base64_stream)
+opa_base64_stream_t *opa_base64_stream(opa_value *a)
+{
+    return base64_gen_stream(a, base64_table);
+}
+
+WASM_EXPORT(opa_base64_url_stream)
+opa_base64_stream_t *opa_base64_url_stream(opa_value *a)
+{
+    return base64_gen_stream(a, base64_url_table);
+}
+
+WASM_EXPORT(opa_base64_stream_write)
+size_t opa_base64_stream_write(opa_base64_stream_t *s, char *buf, size_t len)
+{
+    size_t written = 0;
+
+    while (written < len)
+    {
+        if (s->out_i < s->out_len)
+        {
+            buf[written++] = (char)s->out[s->out_i++];
+            continue;
+        }
+
+        if (s->done || s->i >= s->len + s->extra_pad)
+        {
+            break;
+        }
+
+        unsigned char val = s->i >= s->len ? '=' : s->src[s->i];
+        s->i++;
+
+        unsigned char tmp = s->dtable[val];
+        if (tmp == 0x80)
+        {
+            continue;
+        }
+
+        if (val == '=')
+        {
+            s->pad++;
+        }
+
+        s->block[s->count++] = tmp;
+        if (s->count == 4)
+        {
+            s->out[0] = (s->block[0] << 2) | (s->block[1] >> 4);
+            s->out[1] = (s->block[1] << 4) | (s->block[2] >> 2);
+            s->out[2] = (s->block[2] << 6) | s->block[3];
+            s->out_i = 0;
+            s->out_len = 3;
+            s->count = 0;
+
+            if (s->pad)
+            {
+                // the constructor rejected pad > 2
+                s->out_len = 3 - (size_t)s->pad;
+                s->done = 1;
+            }
+        }
+    }
+
+    return written;
+}
+
+WASM_EXPORT(opa_base64_stream_free)
+void opa_base64_stream_free(opa_base64_stream_t *s)
+{
+    free(s);
+}
+
+static const char hex_digits_lower[] = "0123456789abcdef";
+static const char hex_digits_upper[] = "0123456789ABCDEF";
+
+static int hex_digit_value(unsigned char c)
+{
+    if (c >= '0' && c <= '9')
+    {
+        return c - '0';
+    }
+
+    if (c >= 'a' && c <= 'f')
+    {
+        return c - 'a' + 10;
+    }
+
+    if (c >= 'A' && c <= 'F')
+    {
+        return c - 'A' + 10;
+    }
+
+    return -1;
+}
+
+OPA_BUILTIN
+opa_value *opa_hex_encode(opa_value *a)
+{
+    if (opa_value_type(a) != OPA_STRING)
+    {
+        return NULL;
+    }
+
+    opa_string_t *s = opa_cast_string(a);
+    if (s->len >= SIZE_MAX / 2)
+    {
+        return NULL;
+    }
+
+    char *out = malloc(s->len * 2);
+    if (out == NULL)
+    {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < s->len; i++)
+    {
+        unsigned char c = (unsigned char)s->v[i];
+        out[i * 2] = hex_digits_lower[c >> 4];
+        out[i * 2 + 1] = hex_digits_lower[c & 0x0f];
+    }
+
+    return opa_string_allocated(out, s->len * 2);
+}
+
+OPA_BUILTIN
+opa_value *opa_hex_decode(opa_value *a)
+{
+    if (opa_value_type(a) != OPA_STRING)
+    {
+        return NULL;
+    }
+
+    opa_string_t *s = opa_cast_string(a);
+    if (s->len % 2 != 0)
+    {
+        return NULL;
+    }
+
+    char *out = malloc(s->len / 2);
+    if (out == NULL)
+    {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < s->len; i += 2)
+    {
+        int hi = hex_digit_value((unsigned char)s->v[i]);
+        int lo = hex_digit_value((unsigned char)s->v[i + 1]);
+        if (hi < 0 || lo < 0)
+        {
+            free(out);
+            return NULL;
+        }
+
+        out[i / 2] = (char)((hi << 4) | lo);
+    }
+
+    return opa_string_allocated(out, s->len / 2);
+}
+
+// urlquery_unreserved reports whether c is emitted as-is by query escaping,
+// per the escaping rules of Go's net/url.QueryEscape.
+static int urlquery_unreserved(unsigned char c)
+{
+    return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') ||
+        (c >= '0' && c <= '9') || c == '-' || c == '_' || c == '.' || c == '~';
+}
+
+OPA_BUILTIN
+opa_value *opa_urlquery_encode(opa_value *a)
+{
+    if (opa_value_type(a) != OPA_STRING)
+    {
+        return NULL;
+    }
+
+    opa_string_t *s = opa_cast_string(a);
+    size_t olen = 0;
+    for (size_t i = 0; i < s->len; i++)
+    {
+        unsigned char c = (unsigned char)s->v[i];
+        olen += urlquery_unreserved(c) || c == ' ' ? 1 : 3;
+    }
+
+    char *out = malloc(olen);
+    if (out == NULL)
+    {
+        return NULL;
+    }
+
+    char *pos = out;
+    for (size_t i = 0; i < s->len; i++)
+    {
+        unsigned char c = (unsigned char)s->v[i];
+        if (urlquery_unreserved(c))
+        {
+            *pos++ = (char)c;
+        }
+        else if (c == ' ')
+        {
+            *pos++ = '+';
+        }
+        else
+        {
+            *pos++ = '%';
+            *pos++ = hex_digits_upper[c >> 4];
+            *pos++ = hex_digits_upper[c & 0x0f];
+        }
+    }
+
+    return opa_string_allocated(out, olen);
+}
+
+OPA_BUILTIN
+opa_value *opa_urlquery_decode(opa_value *a)
+{
+    if (opa_value_type(a) != OPA_STRING)
+    {
+        return NULL;
+    }
+
+    opa_string_t *s = opa_cast_string(a);
+    char *out = malloc(s->len);
+    if (out == NULL)
+    {
+        return NULL;
+    }
+
+    char *pos = out;
+    for (size_t i = 0; i < s->len; i++)
+    {
+        unsigned char c = (unsigned char)s->v[i];
+        if (c == '%')
+        {
+            if (i + 2 >= s->len)
+            {
+                free(out);
+                return NULL;
+            }
+
+            int hi = hex_digit_value((unsigned char)s->v[i + 1]);
+            int lo = hex_digit_value((unsigned char)s->v[i + 2]);
+            if (hi < 0 || lo < 0)
+            {
+                free(out);
+                return NULL;
+            }
+
+            *pos++ = (char)((hi << 4) | lo);
+            i += 2;
+        }
+        else if (c == '+')
+        {
+            *pos++ = ' ';
+        }
+        else
+        {
+            *pos++ = (char)c;
+        }
+    }
+
+    return opa_string_allocated(out, (size_t)(pos - out));
+}
+
+// Policies often unmarshal the same embedded JSON string — an interned
+// claim payload, say — many times per evaluation, and each call parsed it
+// from scratch. A small memo keyed by string identity (the opa_string_t
+// pointer plus its length, like the CIDR trie cache keys collections)
+// makes the repeats free: the interned argument is the same value on
+// every call, so identity is enough and no content hashing is needed.
+// Entries are evicted round-robin, and a heap reset drops the memo with
+// the values it points into.
+
+#define JSON_MEMO_CACHE_SIZE (8)
+
+typedef struct
+{
+    opa_string_t *s; // NULL marks an empty slot
+    size_t len;
+    opa_value *parsed;
+} json_memo_entry;
+
+typedef struct
+{
+    size_t next;
+    json_memo_entry entries[JSON_MEMO_CACHE_SIZE];
+} json_memo_cache;
+
+static size_t json_memo_slot = OPA_BUILTIN_CACHE_UNREGISTERED;
+
 OPA_BUILTIN
 opa_value *opa_json_unmarshal(opa_value *a)
 {
@@ -302,7 +814,42 @@ opa_value *opa_json_unmarshal(opa_value *a)
     }
 
     opa_string_t *s = opa_cast_string(a);
-    return opa_json_parse(s->v, s->len);
+
+    if (json_memo_slot == OPA_BUILTIN_CACHE_UNREGISTERED)
+    {
+        json_memo_slot = opa_builtin_cache_register(NULL);
+    }
+
+    json_memo_cache *c = opa_builtin_cache_get(json_memo_slot);
+    if (c == NULL)
+    {
+        c = opa_malloc(sizeof(json_memo_cache));
+        memset(c, 0, sizeof(json_memo_cache));
+        opa_builtin_cache_set(json_memo_slot, c);
+    }
+
+    for (size_t i = 0; i < JSON_MEMO_CACHE_SIZE; i++)
+    {
+        if (c->entries[i].s == s && c->entries[i].len == s->len)
+        {
+            return c->entries[i].parsed;
+        }
+    }
+
+    opa_value *parsed = opa_json_parse(s->v, s->len);
+    if (parsed == NULL)
+    {
+        return NULL;
+    }
+
+    json_memo_entry *e = &c->entries[c->next];
+    c->next = (c->next + 1) % JSON_MEMO_CACHE_SIZE;
+
+    e->s = s;
+    e->len = s->len;
+    e->parsed = parsed;
+
+    return parsed;
 }
 
 OPA_BUILTIN
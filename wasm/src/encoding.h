@@ -8,6 +8,22 @@ opa_value *opa_base64_decode(opa_value *a);
 opa_value *opa_base64_encode(opa_value *a);
 opa_value *opa_base64_url_decode(opa_value *a);
 opa_value *opa_base64_url_encode(opa_value *a);
+
+// Streaming decode: emits decoded bytes into caller-provided buffers chunk
+// by chunk. The constructor validates the input up front and returns NULL
+// when it does not decode; opa_base64_stream_write returns the number of
+// bytes written, zero once the decode is complete. The stream borrows the
+// operand's bytes: keep the string alive until the stream is freed.
+typedef struct opa_base64_stream_t opa_base64_stream_t;
+
+opa_base64_stream_t *opa_base64_stream(opa_value *a);
+opa_base64_stream_t *opa_base64_url_stream(opa_value *a);
+size_t opa_base64_stream_write(opa_base64_stream_t *s, char *buf, size_t len);
+void opa_base64_stream_free(opa_base64_stream_t *s);
+opa_value *opa_hex_encode(opa_value *a);
+opa_value *opa_hex_decode(opa_value *a);
+opa_value *opa_urlquery_encode(opa_value *a);
+opa_value *opa_urlquery_decode(opa_value *a);
 opa_value *opa_json_unmarshal(opa_value *a);
 opa_value *opa_json_marshal(opa_value *a);
 
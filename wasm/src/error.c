@@ -19,3 +19,54 @@ void opa_runtime_error(const char *loc, int row, int col, const char *msg)
 
     opa_abort(err);
 }
+
+// A static buffer rather than an allocation: an abort may fire because the
+// heap itself is in a bad state.
+#define OPA_ERROR_MSG_MAX (256)
+
+static char error_msg[OPA_ERROR_MSG_MAX];
+static bool error_set = false;
+static bool error_recoverable = false;
+
+void opa_error_record(const char *msg)
+{
+    size_t n = opa_strlen(msg);
+
+    if (n >= OPA_ERROR_MSG_MAX)
+    {
+        n = OPA_ERROR_MSG_MAX - 1;
+    }
+
+    for (size_t i = 0; i < n; i++)
+    {
+        error_msg[i] = msg[i];
+    }
+
+    error_msg[n] = 0;
+    error_set = true;
+}
+
+WASM_EXPORT(opa_error_message)
+const char *opa_error_message(void)
+{
+    return error_set ? error_msg : NULL;
+}
+
+void opa_error_clear(void)
+{
+    error_set = false;
+}
+
+// Opt-in: with recoverable errors enabled, an eval() failure makes the eval
+// wrappers record the error and return NULL instead of trapping, so the
+// host pays a heap reset instead of a re-instantiation.
+WASM_EXPORT(opa_error_recoverable_set)
+void opa_error_recoverable_set(bool recoverable)
+{
+    error_recoverable = recoverable;
+}
+
+bool opa_error_recoverable(void)
+{
+    return error_recoverable;
+}
@@ -1,6 +1,19 @@
-#ifndef OPA_STRINGS_H
-#define OPA_STRINGS_H
+#ifndef OPA_ERROR_H
+#define OPA_ERROR_H
+
+#include <stdbool.h>
 
 void opa_runtime_error(const char *loc, int row, int col, const char *msg);
 
+// Error status. opa_abort records its message here before trapping, so a
+// host that catches the trap can read what went wrong without decoding the
+// abort parameter. With opa_error_recoverable_set, the eval wrappers record
+// "eval failed" and return NULL instead of trapping at all. Either way,
+// opa_eval_recover (context.c) makes the instance safe to reuse.
+void opa_error_record(const char *msg);
+const char *opa_error_message(void); // NULL when no error is recorded
+void opa_error_clear(void);
+void opa_error_recoverable_set(bool recoverable);
+bool opa_error_recoverable(void);
+
 #endif
@@ -1,3 +1,4 @@
+#include "glob-compiler.h"
 #include "glob-parser.h"
 #include "unicode.h"
 #include "std.h"
@@ -124,6 +125,16 @@ std::string glob_translate(const char *glob, size_t n, const std::vector<std::st
         return error;
     }
 
+    error = glob_translate_node(root, delimiters, re2);
+    delete(root);
+    delete(l);
+    return error;
+}
+
+// glob_translate_node translates an already parsed pattern, for callers
+// that keep the AST around.
+std::string glob_translate_node(node *root, const std::vector<std::string>& delimiters, std::string *re2)
+{
     std::string single_mark;
 
     if (delimiters.empty())
@@ -147,8 +158,6 @@ std::string glob_translate(const char *glob, size_t n, const std::vector<std::st
     }
 
     *re2 = root->re2(single_mark);
-    delete(root);
-    delete(l);
     return "";
 }
 
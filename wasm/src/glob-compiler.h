@@ -4,6 +4,9 @@
 #include <string>
 #include <vector>
 
+#include "glob-parser.h"
+
 std::string glob_translate(const char *glob, size_t n, const std::vector<std::string>& delimiters, std::string *re2);
+std::string glob_translate_node(node *root, const std::vector<std::string>& delimiters, std::string *re2);
 
 #endif
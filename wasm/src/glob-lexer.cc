@@ -6,6 +6,7 @@
 #include "str.h"
 #include "unicode.h"
 
+#include <new>
 #include <vector>
 #include "glob-lexer.h"
 
@@ -48,14 +49,41 @@ const static int char_range_not     = '!';
 const static int char_range_between = '-';
 
 lexer::lexer(const char *source, size_t n_)
-    : data(source), pos(0), n(n_), error(NULL), tokens(), terms_level(0), has_rune(false), last_rune("", 0, eof) { }
+    : data(source), pos(0), n(n_), error(NULL), tokens(), terms_level(0), has_rune(false), last_rune("", 0, eof),
+      arena_used(0), arena_overflow() { }
 
 lexer::~lexer()
 {
     for (int i = 0; i < tokens.size(); i++)
     {
-        delete tokens[i];
+        tokens[i]->~token();
     }
+
+    for (int i = 0; i < arena_overflow.size(); i++)
+    {
+        opa_free(arena_overflow[i]);
+    }
+}
+
+void *lexer::arena_alloc(size_t size)
+{
+    size = (size + 7) & ~static_cast<size_t>(7);
+
+    if (arena_used + size <= sizeof(arena))
+    {
+        void *p = &arena[arena_used];
+        arena_used += size;
+        return p;
+    }
+
+    void *p = opa_malloc(size);
+    arena_overflow.push_back(p);
+    return p;
+}
+
+token *lexer::make_token(int kind, const char *s, size_t n)
+{
+    return new (arena_alloc(sizeof(token))) token(kind, s, n);
 }
 
 void lexer::next(token *out)
@@ -69,7 +97,7 @@ void lexer::next(token *out)
     if (!tokens.empty())
     {
         *out = *tokens[0];
-        delete tokens[0];
+        tokens[0]->~token();
 
         for (int i = 1; i < tokens.size(); i++)
         {
@@ -136,30 +164,30 @@ void lexer::fetch_item()
 
     if (r.cp == eof)
     {
-        tokens.push_back(new token(glob_lexer_token_eof, r.s, 0));
+        tokens.push_back(make_token(glob_lexer_token_eof, r.s, 0));
     }
     else if (r.cp == char_terms_open)
     {
         terms_enter();
-        tokens.push_back(new token(glob_lexer_token_terms_open, r.s, r.n));
+        tokens.push_back(make_token(glob_lexer_token_terms_open, r.s, r.n));
     }
     else if (r.cp == char_comma && in_terms())
     {
-        tokens.push_back(new token(glob_lexer_token_separator, r.s, r.n));
+        tokens.push_back(make_token(glob_lexer_token_separator, r.s, r.n));
     }
     else if (r.cp == char_terms_close && in_terms())
     {
-        tokens.push_back(new token(glob_lexer_token_terms_close, r.s, r.n));
+        tokens.push_back(make_token(glob_lexer_token_terms_close, r.s, r.n));
         terms_leave();
     }
     else if (r.cp == char_range_open)
     {
-        tokens.push_back(new token(glob_lexer_token_range_open, r.s, r.n));
+        tokens.push_back(make_token(glob_lexer_token_range_open, r.s, r.n));
         fetch_range();
     }
     else if (r.cp == char_single)
     {
-        tokens.push_back(new token(glob_lexer_token_single, r.s, r.n));
+        tokens.push_back(make_token(glob_lexer_token_single, r.s, r.n));
     }
     else if (r.cp == char_any)
     {
@@ -167,10 +195,10 @@ void lexer::fetch_item()
         read(&n);
         if (n.cp == char_any)
         {
-            tokens.push_back(new token(glob_lexer_token_super, r.s, r.n + n.n));
+            tokens.push_back(make_token(glob_lexer_token_super, r.s, r.n + n.n));
         } else {
             unread();
-            tokens.push_back(new token(glob_lexer_token_any, r.s, r.n));
+            tokens.push_back(make_token(glob_lexer_token_any, r.s, r.n));
         }
     }
     else
@@ -201,21 +229,21 @@ void lexer::fetch_range()
             if (r.cp != char_range_close) {
                 error = "expected close range character";
             } else {
-                tokens.push_back(new token(glob_lexer_token_range_close, r.s, r.n));
+                tokens.push_back(make_token(glob_lexer_token_range_close, r.s, r.n));
             }
             return;
         }
 
         if (want_hi)
         {
-            tokens.push_back(new token(glob_lexer_token_range_hi, r.s, r.n));
+            tokens.push_back(make_token(glob_lexer_token_range_hi, r.s, r.n));
             want_close = true;
             continue;
         }
 
         if (!seen_not && r.cp == char_range_not)
         {
-            tokens.push_back(new token(glob_lexer_token_not, r.s, r.n));
+            tokens.push_back(make_token(glob_lexer_token_not, r.s, r.n));
             seen_not = true;
             continue;
         }
@@ -225,8 +253,8 @@ void lexer::fetch_range()
         if (n.cp == char_range_between)
         {
             seek(n.n);
-            tokens.push_back(new token(glob_lexer_token_range_lo, r.s, r.n));
-            tokens.push_back(new token(glob_lexer_token_range_between, n.s, n.n));
+            tokens.push_back(make_token(glob_lexer_token_range_lo, r.s, r.n));
+            tokens.push_back(make_token(glob_lexer_token_range_between, n.s, n.n));
             want_hi = true;
             continue;
         }
@@ -292,13 +320,12 @@ void lexer::fetch_text(const int *breakers)
         n += arr[i].second;
     }
 
-    char *v = static_cast<char *>(opa_malloc(n));
+    char *v = static_cast<char *>(arena_alloc(n));
     for (int i = 0, j = 0; i < arr.size(); i++)
     {
         memcpy(&v[j], arr[i].first, arr[i].second);
         j += arr[i].second;
     }
 
-    tokens.push_back(new token(glob_lexer_token_text, v, n));
-    opa_free(v);
+    tokens.push_back(make_token(glob_lexer_token_text, v, n));
 }
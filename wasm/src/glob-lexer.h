@@ -55,6 +55,8 @@ private:
     void fetch_item();
     void fetch_range();
     void fetch_text(const int *breakers);
+    void *arena_alloc(size_t size);
+    token *make_token(int kind, const char *s, size_t n);
 
     const char* data;
     size_t pos;
@@ -64,6 +66,14 @@ private:
     int terms_level;
     bool has_rune;
     rune last_rune;
+
+    // Tokens and text scratch are produced and retired in bursts while a
+    // pattern compiles, so they come from a small bump arena — an inline
+    // chunk with opa_malloc overflow blocks — released all at once with
+    // the lexer.
+    char arena[1024];
+    size_t arena_used;
+    std::vector<void*> arena_overflow;
 };
 
 #endif
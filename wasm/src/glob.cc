@@ -1,11 +1,15 @@
 #include <string>
+#include <string.h>
 #include <unordered_map>
+#include <vector>
 
 #include "glob.h"
 #include "glob-compiler.h"
+#include "glob-parser.h"
 #include "malloc.h"
-#include "regex.h"
+#include "re2/re2.h"
 #include "std.h"
+#include "unicode.h"
 #include "value.h"
 
 struct cache_key {
@@ -36,20 +40,203 @@ struct std::hash<cache_key>
     }
 };
 
-typedef std::unordered_map<cache_key, std::string> glob_cache;
+// The cache holds the matcher itself, not an intermediate form. Flat
+// patterns of text, '?', '*' and '**' — the dominant shape for resource
+// paths — are matched directly off the AST and never touch the regex
+// engine; anything with ranges, lists or alternates is translated and
+// compiled to an RE2 object once here. Keeping the compiled object in
+// this cache means the regex path costs a single lookup per call and
+// cannot be recompiled behind our back when the regex builtin cache
+// evicts on its own schedule.
+struct glob_compiled {
+    node *root;
+    bool direct;
+    std::vector<int> delims; // decoded delimiter runes, for the direct path
+    re2::RE2 *re;            // compiled translation, for the regex path
+};
+
+typedef std::unordered_map<cache_key, glob_compiled*> glob_cache;
 
 static glob_cache* cache()
 {
-    glob_cache* c = static_cast<glob_cache*>(opa_builtin_cache_get(1));
+    static size_t slot = opa_builtin_cache_register(NULL);
+
+    glob_cache* c = static_cast<glob_cache*>(opa_builtin_cache_get(slot));
     if (c == NULL)
     {
         c = new glob_cache();
-        opa_builtin_cache_set(1, c);
+        opa_builtin_cache_set(slot, c);
     }
 
     return c;
 }
 
+static bool is_delim(int cp, const std::vector<int>& delims)
+{
+    for (int i = 0; i < delims.size(); i++)
+    {
+        if (delims[i] == cp)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// glob_match_direct matches the elements of a flat pattern against str,
+// backtracking at each wildcard. '?' and '*' never cross a delimiter;
+// '**' matches any rune but a newline, like the ".*" it translates to.
+static bool glob_match_direct(const std::vector<node*>& elems, size_t ei,
+                              const char *str, int pos, int n,
+                              const std::vector<int>& delims)
+{
+    for (; ei < elems.size(); ei++)
+    {
+        node *e = elems[ei];
+
+        switch (e->kind)
+        {
+        case kind_text: {
+            size_t len = e->text.length();
+            if (static_cast<size_t>(n - pos) < len || memcmp(&str[pos], e->text.data(), len) != 0)
+            {
+                return false;
+            }
+
+            pos += len;
+            break;
+        }
+
+        case kind_single: {
+            int len;
+            int cp = pos < n ? opa_unicode_decode_utf8(str, pos, n, &len) : -1;
+            if (cp < 0 || is_delim(cp, delims))
+            {
+                return false;
+            }
+
+            pos += len;
+            break;
+        }
+
+        default: // kind_any, kind_super
+            while (true)
+            {
+                if (glob_match_direct(elems, ei + 1, str, pos, n, delims))
+                {
+                    return true;
+                }
+
+                if (pos >= n)
+                {
+                    return false;
+                }
+
+                int len;
+                int cp = opa_unicode_decode_utf8(str, pos, n, &len);
+                if (cp < 0 || (e->kind == kind_any ? is_delim(cp, delims) : cp == '\n'))
+                {
+                    return false;
+                }
+
+                pos += len;
+            }
+        }
+    }
+
+    return pos == n;
+}
+
+// compile returns the cached matcher for the key, compiling on a miss. On
+// the miss path the key is moved into the cache, so the caller builds it
+// exactly once per call instead of it being recopied for lookup and again
+// for insertion.
+static glob_compiled* compile(opa_string_t *p, cache_key& key)
+{
+    glob_cache *c = cache();
+    const std::vector<std::string>& delimiters = key.delimiters;
+    glob_cache::iterator i = c->find(key);
+    if (i != c->end())
+    {
+        return i->second;
+    }
+
+    lexer *l = new lexer(p->v, p->len);
+    node *root = NULL;
+    if (glob_parse(l, &root) != "")
+    {
+        delete l;
+        return NULL;
+    }
+
+    glob_compiled *compiled = new glob_compiled();
+    compiled->root = root;
+    compiled->direct = true;
+    compiled->re = NULL;
+
+    for (int j = 0; j < root->children.size(); j++)
+    {
+        kind k = root->children[j]->kind;
+        if (k != kind_text && k != kind_any && k != kind_super && k != kind_single)
+        {
+            compiled->direct = false;
+            break;
+        }
+    }
+
+    if (compiled->direct)
+    {
+        if (delimiters.empty())
+        {
+            compiled->delims.push_back('.');
+        }
+
+        for (int j = 0; j < delimiters.size(); j++)
+        {
+            int len;
+            int cp = opa_unicode_decode_utf8(delimiters[j].c_str(), 0, delimiters[j].length(), &len);
+            if (cp < 0 || len != delimiters[j].length())
+            {
+                // "delimiter is not a single character"
+                delete root;
+                delete l;
+                delete compiled;
+                return NULL;
+            }
+
+            compiled->delims.push_back(cp);
+        }
+    }
+    else
+    {
+        std::string translated;
+        if (glob_translate_node(root, delimiters, &translated) != "")
+        {
+            delete root;
+            delete l;
+            delete compiled;
+            return NULL;
+        }
+
+        re2::RE2::Options options;
+        options.set_log_errors(false);
+        compiled->re = new re2::RE2(re2::StringPiece(translated.data(), translated.size()), options);
+        if (!compiled->re->ok())
+        {
+            delete compiled->re;
+            delete root;
+            delete l;
+            delete compiled;
+            return NULL;
+        }
+    }
+
+    delete l;
+    c->insert(std::make_pair(std::move(key), compiled));
+    return compiled;
+}
+
 OPA_BUILTIN
 opa_value *opa_glob_match(opa_value *pattern, opa_value *delimiters, opa_value *match)
 {
@@ -60,7 +247,10 @@ opa_value *opa_glob_match(opa_value *pattern, opa_value *delimiters, opa_value *
 
     opa_string_t *p = opa_cast_string(pattern);
 
-    std::vector<std::string> v;
+    // The key is built in place, once: compile() probes the cache with it
+    // and moves it into the cache on a miss.
+    cache_key key;
+    key.pattern.assign(p->v, p->len);
 
     opa_value *prev = NULL;
     opa_value *curr = NULL;
@@ -72,26 +262,22 @@ opa_value *opa_glob_match(opa_value *pattern, opa_value *delimiters, opa_value *
             return NULL;
         }
         opa_string_t *s = opa_cast_string(elem);
-        v.push_back(std::string(s->v, s->len));
+        key.delimiters.push_back(std::string(s->v, s->len));
         prev = curr;
     }
 
-    glob_cache *c = cache();
-    cache_key key = cache_key(std::string(p->v, p->len), v);
-    glob_cache::iterator i = c->find(key);
-    std::string re2;
-    if (i != c->end())
+    glob_compiled *compiled = compile(p, key);
+    if (compiled == NULL)
     {
-        re2 = i->second;
-    } else {
-        std::string error = glob_translate(p->v, p->len, v, &re2);
-        if (!error.empty())
-        {
-            return NULL;
-        }
+        return NULL;
+    }
 
-        cache()->insert(std::make_pair(key, re2));
+    opa_string_t *s = opa_cast_string(match);
+
+    if (compiled->direct)
+    {
+        return opa_boolean(glob_match_direct(compiled->root->children, 0, s->v, 0, s->len, compiled->delims));
     }
 
-    return opa_regex_match(opa_string(re2.c_str(), re2.length()), match);
+    return opa_boolean(re2::RE2::PartialMatch(re2::StringPiece(s->v, s->len), *compiled->re));
 }
@@ -1,41 +1,29 @@
+#include <string.h>
+
 #include "graphs.h"
+#include "malloc.h"
 #include "std.h"
 
+// Appends every not-yet-reached neighbor to the queue. Neighbor
+// collections may be sets or arrays; anything else contributes nothing.
 static void __builtin_graph_reachable(opa_value *edges, opa_array_t *queue, opa_set_t *reached)
 {
-    switch (opa_value_type(edges))
+    int type = opa_value_type(edges);
+
+    if (type != OPA_SET && type != OPA_ARRAY)
     {
-        case OPA_SET:
-        {
-            opa_set_t *x = opa_cast_set(edges);
-
-            for (int i = 0; i < x->n; i++)
-            {
-                opa_set_elem_t *elem = x->buckets[i];
-
-                while (elem != NULL)
-                {
-                    if (reached == NULL || opa_set_get(reached, elem->v) == NULL)
-                    {
-                        opa_array_append(queue, elem->v);
-                    }
-                    elem = elem->next;
-                }
-            }
-        }  
-        case OPA_ARRAY: 
-        {
-            opa_array_t *y = opa_cast_array(edges);
+        return;
+    }
+
+    opa_value_cursor_t cur = {edges, 0, NULL};
 
-            for (int i = 0; i < y->len; i++)
-            {
-                opa_value *elem = y->elems[i].v;
+    for (opa_value *key = opa_value_cursor_next(&cur); key != NULL; key = opa_value_cursor_next(&cur))
+    {
+        opa_value *node = type == OPA_SET ? key : opa_value_cursor_value(&cur);
 
-                if (reached == NULL || opa_set_get(reached, elem) == NULL)
-                {
-                    opa_array_append(queue, elem);
-                }
-            }
+        if (reached == NULL || opa_set_get(reached, node) == NULL)
+        {
+            opa_array_append(queue, node);
         }
     }
 }
@@ -43,39 +31,134 @@ static void __builtin_graph_reachable(opa_value *edges, opa_array_t *queue, opa_
 OPA_BUILTIN
 opa_value *builtin_graph_reachable(opa_value *graph, opa_value *initial)
 {
-
-     if (opa_value_type(graph) != OPA_OBJECT)
+    if (opa_value_type(graph) != OPA_OBJECT)
     {
         return opa_set();
     }
 
+    // Every graph node can appear at most once in the visited set and,
+    // after deduplication, roughly once in the queue: size both up front
+    // so neither table nor array grows while the search runs.
+    size_t nodes = opa_value_length(graph);
+
     // This is a queue that holds all nodes we still need to visit. It is
     // initialized to the initial set of nodes we start out with.
-    opa_array_t *queue = opa_cast_array(opa_array());
+    opa_array_t *queue = opa_cast_array(opa_array_with_cap(nodes));
 
     if (initial != NULL)
     {
         __builtin_graph_reachable(initial, queue, NULL);
-    }    
+    }
 
     // This is the set of nodes we have reached.
-    opa_set_t *reached = opa_cast_set(opa_set());
+    opa_set_t *reached = opa_cast_set(opa_set_with_cap(nodes));
 
     // Keep going as long as we have nodes in the queue.
     for (int index = 0; index < queue->len; index++)
     {
-        // Get the edges for this node.
         opa_value *node = queue->elems[index].v;
+
+        if (opa_set_get(reached, node) != NULL)
+        {
+            // Already expanded through another path.
+            continue;
+        }
+
+        // Get the edges for this node.
         opa_value *edges = opa_value_get(graph, node);
 
         if (edges != NULL)
         {
-            __builtin_graph_reachable(edges, queue, reached);
-
-            // Mark current node as reached.
+            // Mark current node as reached before expanding it, so a
+            // self-loop does not queue the node again.
             opa_set_add(reached, node);
+
+            __builtin_graph_reachable(edges, queue, reached);
         }
     }
 
     return &reached->hdr;
 }
+
+// Depth-first path enumeration. The working path doubles as the search
+// stack: find_paths appends the node on the way down and pops it on the
+// way back up, so the whole search runs off one array however many paths
+// it emits. Results are exact-size copies of the working path taken at
+// the moment a path ends.
+
+typedef struct
+{
+    opa_value *graph;
+    opa_array_t *path;
+    opa_set_t *results;
+} path_search;
+
+static void path_emit(path_search *s)
+{
+    size_t len = s->path->len;
+    opa_array_elem_t *elems = opa_malloc(len * sizeof(opa_array_elem_t));
+    memcpy(elems, s->path->elems, len * sizeof(opa_array_elem_t));
+    opa_set_add(s->results, opa_array_with_elems(elems, len, len));
+}
+
+static void find_paths(path_search *s, opa_value *node)
+{
+    for (size_t i = 0; i < s->path->len; i++)
+    {
+        if (opa_value_compare(s->path->elems[i].v, node) == 0)
+        {
+            // Cycle: the path up to the repeat is a result.
+            path_emit(s);
+            return;
+        }
+    }
+
+    opa_array_append(s->path, node);
+
+    opa_value *edges = opa_value_get(s->graph, node);
+    int type = edges == NULL ? OPA_NULL : opa_value_type(edges);
+
+    if ((type != OPA_SET && type != OPA_ARRAY) || opa_value_length(edges) == 0)
+    {
+        path_emit(s);
+    }
+    else
+    {
+        opa_value_cursor_t cur = {edges, 0, NULL};
+
+        for (opa_value *key = opa_value_cursor_next(&cur); key != NULL; key = opa_value_cursor_next(&cur))
+        {
+            find_paths(s, type == OPA_SET ? key : opa_value_cursor_value(&cur));
+        }
+    }
+
+    s->path->len--;
+}
+
+// builtin_graph_reachable_paths returns the set of maximal paths out of
+// the initial nodes: a path ends at a node without outgoing edges, or
+// just before it would repeat a node already on it.
+OPA_BUILTIN
+opa_value *builtin_graph_reachable_paths(opa_value *graph, opa_value *initial)
+{
+    if (opa_value_type(graph) != OPA_OBJECT)
+    {
+        return opa_set();
+    }
+
+    path_search s = {graph, opa_cast_array(opa_array()), opa_cast_set(opa_set())};
+
+    int type = initial == NULL ? OPA_NULL : opa_value_type(initial);
+
+    if (type == OPA_SET || type == OPA_ARRAY)
+    {
+        opa_value_cursor_t cur = {initial, 0, NULL};
+
+        for (opa_value *key = opa_value_cursor_next(&cur); key != NULL; key = opa_value_cursor_next(&cur))
+        {
+            find_paths(&s, type == OPA_SET ? key : opa_value_cursor_value(&cur));
+        }
+    }
+
+    return &s.results->hdr;
+}
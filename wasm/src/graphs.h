@@ -4,5 +4,6 @@
 #include "value.h"
 
 opa_value *builtin_graph_reachable(opa_value *graph, opa_value *initial);
+opa_value *builtin_graph_reachable_paths(opa_value *graph, opa_value *initial);
 
 #endif
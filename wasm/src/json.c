@@ -2,11 +2,16 @@
 
 #include "stdlib.h"
 #include "str.h"
+#include "string.h"
 #include "value.h"
 #include "json.h"
 #include "malloc.h"
 #include "unicode.h"
 
+#ifdef __wasm_simd128__
+#include <wasm_simd128.h>
+#endif
+
 static opa_value *opa_json_parse_token(opa_json_lex *ctx, int token);
 
 int opa_json_lex_offset(opa_json_lex *ctx)
@@ -152,6 +157,60 @@ int opa_json_lex_read_string(opa_json_lex *ctx)
 
     while (1)
     {
+#ifdef __wasm_simd128__
+        // Scan plain string bytes 16 at a time: any quote, backslash,
+        // control or non-ASCII byte stops the block scan and drops back to
+        // the byte loop below to be classified.
+        while (opa_json_lex_remaining(ctx) >= 16)
+        {
+            v128_t chunk = wasm_v128_load(ctx->curr);
+            v128_t special = wasm_v128_or(
+                wasm_v128_or(wasm_i8x16_eq(chunk, wasm_i8x16_splat('"')),
+                             wasm_i8x16_eq(chunk, wasm_i8x16_splat('\\'))),
+                wasm_v128_or(wasm_u8x16_lt(chunk, wasm_i8x16_splat(' ')),
+                             wasm_u8x16_gt(chunk, wasm_i8x16_splat('~'))));
+            int mask = wasm_i8x16_bitmask(special);
+
+            if (mask == 0)
+            {
+                ctx->curr += 16;
+                continue;
+            }
+
+            ctx->curr += __builtin_ctz(mask);
+            break;
+        }
+#else
+        // Scan plain string bytes eight at a time with the word-wise
+        // has-byte tricks: any quote, backslash, control or non-ASCII
+        // byte stops the block scan and drops back to the byte loop
+        // below to be classified.
+        while (opa_json_lex_remaining(ctx) >= 8)
+        {
+            uint64_t w;
+            memcpy(&w, ctx->curr, 8);
+
+            uint64_t q = w ^ 0x2222222222222222ULL;  // '"'
+            uint64_t e = w ^ 0x5c5c5c5c5c5c5c5cULL;  // '\\'
+            uint64_t d = w ^ 0x7f7f7f7f7f7f7f7fULL;  // DEL
+            uint64_t special = (((q - 0x0101010101010101ULL) & ~q) |
+                                ((e - 0x0101010101010101ULL) & ~e) |
+                                ((d - 0x0101010101010101ULL) & ~d) |
+                                ((w - 0x2020202020202020ULL) & ~w) |  // < ' '
+                                w) &                                  // >= 0x80
+                               0x8080808080808080ULL;
+
+            if (special == 0)
+            {
+                ctx->curr += 8;
+                continue;
+            }
+
+            ctx->curr += __builtin_ctzll(special) >> 3;
+            break;
+        }
+#endif
+
         if (opa_json_lex_eof(ctx))
         {
             goto err;
@@ -204,7 +263,7 @@ int opa_json_lex_read_string(opa_json_lex *ctx)
                 goto err;
             }
 
-            if (b > '~')
+            if (b > '~' && !ctx->trusted_enabled)
             {
                 // Revert to slow path to validate UTF-8 encoding.
                 escaped = 1;
@@ -259,6 +318,34 @@ int opa_json_lex_read(opa_json_lex *ctx)
 {
     while (!opa_json_lex_eof(ctx))
     {
+#ifdef __wasm_simd128__
+        // Skip whitespace runs 16 bytes at a time.
+        while (opa_json_lex_remaining(ctx) >= 16)
+        {
+            v128_t chunk = wasm_v128_load(ctx->curr);
+            v128_t ws = wasm_v128_or(
+                wasm_v128_or(wasm_i8x16_eq(chunk, wasm_i8x16_splat(' ')),
+                             wasm_i8x16_eq(chunk, wasm_i8x16_splat('\n'))),
+                wasm_v128_or(wasm_i8x16_eq(chunk, wasm_i8x16_splat('\t')),
+                             wasm_i8x16_eq(chunk, wasm_i8x16_splat('\r'))));
+            int mask = wasm_i8x16_bitmask(ws);
+
+            if (mask == 0xffff)
+            {
+                ctx->curr += 16;
+                continue;
+            }
+
+            ctx->curr += __builtin_ctz(~mask);
+            break;
+        }
+
+        if (opa_json_lex_eof(ctx))
+        {
+            break;
+        }
+#endif
+
         char b = *ctx->curr;
         switch (b)
         {
@@ -315,44 +402,9 @@ void opa_json_lex_init(const char *input, size_t len, opa_json_lex *ctx)
     ctx->buf = NULL;
     ctx->buf_end = NULL;
     ctx->set_literals_enabled = 0;
-}
-
-size_t opa_json_max_string_len(const char *buf, size_t len)
-{
-    // The lexer will catch invalid escaping, e.g., if the last char in the
-    // buffer is reverse solidus this will be caught ahead-of-time.
-    int skip = 0;
-
-    for (int i = 0; i < len; i++)
-    {
-        if (buf[i] == '\\')
-        {
-            int codepoint;
-
-            codepoint = opa_unicode_decode_unit(buf, i, len);
-            if (codepoint == -1) {
-                // If not a codepoint \uXXXX, must be a single
-                // character escaping.
-                skip++;
-                i++;
-                continue;
-            }
-
-            i += 5;
-
-            // Assume each UTF-16 encoded character to take full 4
-            // bytes when encoded as UTF-8.  However, if encoded as a
-            // surrogate pair, it's split to two 2 bytes.
-            if (!opa_unicode_surrogate(codepoint)) {
-                skip += 2;
-                continue;
-            }
-
-            skip += 4;
-        }
-    }
-
-    return len - skip;
+    ctx->borrow_enabled = 0;
+    ctx->trusted_enabled = 0;
+    ctx->lazy_enabled = 0;
 }
 
 opa_value *opa_json_parse_string(int token, const char *buf, int len)
@@ -360,17 +412,14 @@ opa_value *opa_json_parse_string(int token, const char *buf, int len)
     if (token == OPA_JSON_TOKEN_STRING)
     {
         char *cpy = (char *)opa_malloc(len);
-
-        for (int i = 0; i < len; i++)
-        {
-            cpy[i] = buf[i];
-        }
-
+        memcpy(cpy, buf, len);
         return opa_string_allocated(cpy, len);
     }
 
-    int max_len = opa_json_max_string_len(buf, len);
-    char *cpy = (char *)opa_malloc(max_len);
+    // Decoded text never outgrows the token: every JSON escape spans at
+    // least as many bytes as the UTF-8 it decodes to. Size the buffer by the
+    // token, decode in a single pass, and trim the surplus afterwards.
+    char *cpy = (char *)opa_malloc(len);
     char *out = cpy;
 
     for (int i = 0; i < len;)
@@ -389,16 +438,17 @@ opa_value *opa_json_parse_string(int token, const char *buf, int len)
                 *out++ = c;
                 i++;
             } else {
+                // Valid UTF-8 passes through unchanged: validate the
+                // sequence and copy its bytes instead of re-encoding
+                // the decoded code point.
                 int n;
-                int cp = opa_unicode_decode_utf8(buf, i, len, &n);
-                if (cp == -1)
+                if (opa_unicode_decode_utf8(buf, i, len, &n) == -1)
                 {
                     opa_abort("illegal utf-8");
                 }
 
+                memcpy(out, &buf[i], n);
                 i += n;
-
-                n = opa_unicode_encode_utf8(cp, out);
                 out += n;
             }
 
@@ -469,7 +519,14 @@ opa_value *opa_json_parse_string(int token, const char *buf, int len)
         }
     }
 
-    return opa_string_allocated(cpy, out-cpy);
+    size_t n = out - cpy;
+
+    if (n < (size_t)len)
+    {
+        cpy = (char *)opa_realloc(cpy, n);
+    }
+
+    return opa_string_allocated(cpy, n);
 }
 
 opa_value *opa_json_parse_number(const char *buf, int len)
@@ -484,208 +541,482 @@ opa_value *opa_json_parse_number(const char *buf, int len)
     return opa_number_ref_allocated(cpy, len);
 }
 
-opa_value *opa_json_parse_array(opa_json_lex *ctx)
+static opa_value *opa_json_parse_scalar(opa_json_lex *ctx, int token)
 {
-    opa_value *ret = opa_array();
-    opa_array_t *arr = opa_cast_array(ret);
-    int sep = 0;
-
-    while (1)
+    switch (token)
     {
-        int token = opa_json_lex_read(ctx);
+    case OPA_JSON_TOKEN_NULL:
+        return opa_null();
+    case OPA_JSON_TOKEN_TRUE:
+        return opa_boolean(true);
+    case OPA_JSON_TOKEN_FALSE:
+        return opa_boolean(false);
+    case OPA_JSON_TOKEN_NUMBER:
+        return opa_json_parse_number(ctx->buf, ctx->buf_end - ctx->buf);
+    case OPA_JSON_TOKEN_STRING:
+        if (ctx->borrow_enabled)
+        {
+            // Unescaped strings are valid UTF-8 as-is: reference the input
+            // buffer instead of copying it.
+            return opa_string(ctx->buf, ctx->buf_end - ctx->buf);
+        }
+        // fallthrough
+    case OPA_JSON_TOKEN_STRING_ESCAPED:
+        return opa_json_parse_string(token, ctx->buf, ctx->buf_end - ctx->buf);
+    case OPA_JSON_TOKEN_EMPTY_SET:
+        return opa_set();
+    default:
+        return NULL;
+    }
+}
 
-        switch (token)
+// The parser runs as a loop over an explicit stack of frames rather than
+// recursing per nesting level: deeply nested documents cannot overflow the
+// wasm stack, and array-heavy inputs skip the per-element call overhead.
+//
+// A frame exists per open '[' or '{'. Its state records what the completed
+// sub-value (or the next token) means to the container under construction.
+struct opa_json_frame
+{
+    opa_value *value; // container being built; NULL until '{' is disambiguated
+    opa_value *key;   // object: parsed key awaiting its value
+    size_t hint;      // pre-sizing element count estimate (0 = none)
+    int state;
+};
+
+// Inputs at least this long get a pre-sizing pass before parsing.
+#define OPA_JSON_PRESIZE_MIN (256)
+
+// Object values spanning at least this much input are deferred by the lazy
+// parse instead of being built.
+#define OPA_JSON_LAZY_MIN (256)
+
+// Counts the elements of every container in the input in a single pass, in
+// document (open-bracket) order, so the parser can size arrays and tables
+// once up front instead of growing them through repeated rehash and copy
+// generations. The counts are hints: commas are counted without regard to
+// grammar, so quirky documents may over-count, which only costs slack.
+static size_t *opa_json_presize(opa_json_lex *ctx, size_t *n)
+{
+    size_t cap = 64;
+    size_t len = 0;
+    size_t *counts = (size_t *)opa_malloc(cap * sizeof(size_t));
+    size_t scap = 64;
+    size_t depth = 0;
+    size_t *stack = (size_t *)opa_malloc(scap * sizeof(size_t));
+
+    for (const char *p = ctx->input, *end = ctx->input + ctx->len; p < end; p++)
+    {
+        switch (*p)
         {
-        case OPA_JSON_TOKEN_ARRAY_END:
-            return ret;
-        case OPA_JSON_TOKEN_COMMA:
-            if (sep)
+        case '[':
+        case '{':
+            if (depth > 0 && counts[stack[depth-1]] == 0)
             {
-                sep = 0;
-                continue;
+                counts[stack[depth-1]] = 1;
             }
-        }
 
-        opa_value *elem = opa_json_parse_token(ctx, token);
+            if (len == cap)
+            {
+                cap *= 2;
+                counts = (size_t *)opa_realloc(counts, cap * sizeof(size_t));
+            }
 
-        if (elem == NULL)
-        {
-            return NULL;
-        }
+            if (depth == scap)
+            {
+                scap *= 2;
+                stack = (size_t *)opa_realloc(stack, scap * sizeof(size_t));
+            }
+
+            counts[len] = 0;
+            stack[depth++] = len++;
+            break;
+
+        case ']':
+        case '}':
+            if (depth == 0)
+            {
+                goto done; // malformed; the parser will reject it
+            }
+
+            depth--;
+            break;
+
+        case ',':
+            if (depth > 0)
+            {
+                counts[stack[depth-1]]++;
+            }
+            break;
+
+        case '"':
+            if (depth > 0 && counts[stack[depth-1]] == 0)
+            {
+                counts[stack[depth-1]] = 1;
+            }
+
+            for (p++; p < end && *p != '"'; p++)
+            {
+                if (*p == '\\')
+                {
+                    p++;
+                }
+            }
+            break;
+
+        case ' ':
+        case '\t':
+        case '\n':
+        case '\r':
+        case ':':
+            break;
 
-        opa_array_append(arr, elem);
-        sep = 1;
+        default:
+            if (depth > 0 && counts[stack[depth-1]] == 0)
+            {
+                counts[stack[depth-1]] = 1;
+            }
+            break;
+        }
     }
+
+done:
+    opa_free(stack);
+    *n = len;
+    return counts;
 }
 
-opa_value *opa_json_parse_set(opa_json_lex *ctx, opa_value *elem, int token)
+// Object keys are routed through the global intern table so a key repeated
+// across a document (and across documents) shares one allocation. A NULL from
+// opa_string_intern means the key is not internable; it then stays owned by
+// the object like any other value.
+static opa_value *opa_json_intern_key(opa_value *value)
 {
-    if (!ctx->set_literals_enabled)
+    if (value->type != OPA_STRING)
     {
-        return NULL;
+        return value;
     }
 
-    opa_set_t *set = opa_cast_set(opa_set());
-    opa_set_add(set, elem);
+    opa_string_t *s = opa_cast_string(value);
+    opa_value *interned = opa_string_intern(s->v, s->len);
 
-    if (token == OPA_JSON_TOKEN_OBJECT_END)
+    if (interned == NULL)
     {
-        return &set->hdr;
+        return value;
     }
 
-    token = opa_json_lex_read(ctx);
+    opa_value_free(value);
+    return interned;
+}
+
+// Consumes the tokens of one complete value, given its first token, without
+// building anything. Returns 0 on success and -1 on a lexing error or EOF;
+// brackets are only counted, so token sequences the parser would reject can
+// still skip cleanly — materialization re-checks them.
+static int opa_json_lex_skip_value(opa_json_lex *ctx, int token)
+{
+    size_t depth = 0;
 
     while (1)
     {
-        elem = opa_json_parse_token(ctx, token);
-
-        if (elem == NULL)
-        {
-            return NULL;
-        }
-
-        opa_set_add(set, elem);
-        token = opa_json_lex_read(ctx);
-
         switch (token)
         {
-        case OPA_JSON_TOKEN_COMMA:
-            token = opa_json_lex_read(ctx);
+        case OPA_JSON_TOKEN_ARRAY_START:
+        case OPA_JSON_TOKEN_OBJECT_START:
+            depth++;
             break;
+        case OPA_JSON_TOKEN_ARRAY_END:
         case OPA_JSON_TOKEN_OBJECT_END:
-            return &set->hdr;
-        default:
-            return NULL;
+            if (depth == 0)
+            {
+                return -1;
+            }
+
+            depth--;
+            break;
+        case OPA_JSON_TOKEN_ERROR:
+        case OPA_JSON_TOKEN_EOF:
+            return -1;
         }
-    }
 
-    return NULL;
+        if (depth == 0)
+        {
+            return 0;
+        }
+
+        token = opa_json_lex_read(ctx);
+    }
 }
 
-opa_value *opa_json_parse_object(opa_json_lex *ctx, opa_value *key)
+// Reads the first token of an object value. When lazy parsing is on and the
+// value is a container spanning at least OPA_JSON_LAZY_MIN bytes of input,
+// the whole span is captured as an unparsed opa_lazy value. Returns that
+// value, or NULL with *token holding the first token for the normal parse
+// (rewinding when a skipped container came up short).
+static opa_value *opa_json_lazy_value(opa_json_lex *ctx, int *token)
 {
-    int token = opa_json_lex_read(ctx);
-    opa_value *val = opa_json_parse_token(ctx, token);
+    const char *start = ctx->curr;
+    *token = opa_json_lex_read(ctx);
 
-    if (val == NULL)
+    if (!ctx->lazy_enabled ||
+        (*token != OPA_JSON_TOKEN_OBJECT_START && *token != OPA_JSON_TOKEN_ARRAY_START))
     {
         return NULL;
     }
 
-    opa_object_t *obj = opa_cast_object(opa_object());
-    opa_object_insert(obj, key, val);
-    token = opa_json_lex_read(ctx);
+    if (opa_json_lex_skip_value(ctx, *token) != 0 ||
+        (size_t)(ctx->curr - start) < OPA_JSON_LAZY_MIN)
+    {
+        // parse (or reject) it the normal way
+        ctx->curr = start;
+        *token = opa_json_lex_read(ctx);
+        return NULL;
+    }
+
+    return opa_lazy(start, (size_t)(ctx->curr - start));
+}
 
+#define OPA_JSON_ARR (0)       // array: expecting the first element or ']'
+#define OPA_JSON_ARR_SEP (1)   // array: expecting ',' or ']' after an element
+#define OPA_JSON_ARR_ELEM (2)  // array: element completed
+#define OPA_JSON_HEAD (3)      // '{' consumed: expecting '}' or the head value
+#define OPA_JSON_HEAD_ELEM (4) // head value completed: ':' decides object vs set
+#define OPA_JSON_OBJ_KEY (5)   // object: key completed
+#define OPA_JSON_OBJ_VAL (6)   // object: value completed
+#define OPA_JSON_SET_ELEM (7)  // set: element completed
+
+opa_value *opa_json_parse_token(opa_json_lex *ctx, int token)
+{
+    if (token != OPA_JSON_TOKEN_ARRAY_START && token != OPA_JSON_TOKEN_OBJECT_START)
+    {
+        return opa_json_parse_scalar(ctx, token);
+    }
+
+    size_t cap = 64;
+    size_t depth = 0;
+    struct opa_json_frame *stack = (struct opa_json_frame *)opa_malloc(cap * sizeof(struct opa_json_frame));
+    struct opa_json_frame *top;
+    opa_value *value;
+    size_t hint = 0;
+
+    // Container counts from the pre-sizing pass, consumed in open order.
+    size_t *presized = NULL;
+    size_t npresized = 0;
+    size_t next_presized = 0;
+
+    if (ctx->len >= OPA_JSON_PRESIZE_MIN)
+    {
+        presized = opa_json_presize(ctx, &npresized);
+    }
+
+need_value:
+    // Parse a value beginning at 'token'. Containers open a frame; anything
+    // else completes immediately and control moves to 'deliver'.
     switch (token)
     {
-    case OPA_JSON_TOKEN_OBJECT_END:
-        return &obj->hdr;
-    case OPA_JSON_TOKEN_COMMA:
+    case OPA_JSON_TOKEN_ARRAY_START:
+        hint = next_presized < npresized ? presized[next_presized++] : 0;
+        value = hint > 0 ? opa_array_with_cap(hint) : opa_array();
+        break;
+    case OPA_JSON_TOKEN_OBJECT_START:
+        hint = next_presized < npresized ? presized[next_presized++] : 0;
+        value = NULL;
         break;
     default:
-        return NULL;
+        value = opa_json_parse_scalar(ctx, token);
+
+        if (value == NULL)
+        {
+            goto error;
+        }
+
+        goto deliver;
     }
 
+    if (depth == cap)
+    {
+        cap *= 2;
+        stack = (struct opa_json_frame *)opa_realloc(stack, cap * sizeof(struct opa_json_frame));
+    }
+
+    stack[depth].value = value;
+    stack[depth].key = NULL;
+    stack[depth].hint = hint;
+    stack[depth].state = value == NULL ? OPA_JSON_HEAD : OPA_JSON_ARR;
+    depth++;
+
+step:
+    // The innermost frame consumes the next token.
+    top = &stack[depth-1];
     token = opa_json_lex_read(ctx);
 
-    while (1)
+    switch (top->state)
     {
-        key = opa_json_parse_token(ctx, token);
+    case OPA_JSON_ARR_SEP:
+        if (token == OPA_JSON_TOKEN_COMMA)
+        {
+            top->state = OPA_JSON_ARR;
+            goto step;
+        }
+        // Like the recursive parser, a missing separator is tolerated.
+        // fallthrough
+    case OPA_JSON_ARR:
+        if (token == OPA_JSON_TOKEN_ARRAY_END)
+        {
+            value = top->value;
+            depth--;
+            goto deliver;
+        }
+
+        top->state = OPA_JSON_ARR_ELEM;
+        goto need_value;
 
-        if (key == NULL)
+    case OPA_JSON_HEAD:
+        if (token == OPA_JSON_TOKEN_OBJECT_END)
         {
-            return NULL;
+            value = opa_object();
+            depth--;
+            goto deliver;
         }
 
-        token = opa_json_lex_read(ctx);
+        top->state = OPA_JSON_HEAD_ELEM;
+        goto need_value;
+    }
 
-        if (token != OPA_JSON_TOKEN_COLON)
+error:
+    if (presized != NULL)
+    {
+        opa_free(presized);
+    }
+
+    opa_free(stack);
+    return NULL;
+
+deliver:
+    // A value completed: hand it to the enclosing frame, or return it.
+    if (depth == 0)
+    {
+        if (presized != NULL)
         {
-            return NULL;
+            opa_free(presized);
         }
 
+        opa_free(stack);
+        return value;
+    }
+
+    top = &stack[depth-1];
+
+    switch (top->state)
+    {
+    case OPA_JSON_ARR_ELEM:
+        opa_array_append(opa_cast_array(top->value), value);
+        top->state = OPA_JSON_ARR_SEP;
+        goto step;
+
+    case OPA_JSON_HEAD_ELEM:
         token = opa_json_lex_read(ctx);
-        val = opa_json_parse_token(ctx, token);
 
-        if (val == NULL)
+        if (token == OPA_JSON_TOKEN_COLON)
+        {
+            top->value = top->hint > 0 ? opa_object_with_cap(top->hint) : opa_object();
+            top->key = opa_json_intern_key(value);
+            top->state = OPA_JSON_OBJ_VAL;
+            value = opa_json_lazy_value(ctx, &token);
+
+            if (value != NULL)
+            {
+                goto deliver;
+            }
+
+            goto need_value;
+        }
+
+        if (!ctx->set_literals_enabled)
+        {
+            goto error;
+        }
+
+        top->value = top->hint > 0 ? opa_set_with_cap(top->hint) : opa_set();
+        opa_set_add(opa_cast_set(top->value), value);
+
+        if (token == OPA_JSON_TOKEN_OBJECT_END)
+        {
+            value = top->value;
+            depth--;
+            goto deliver;
+        }
+
+        if (token != OPA_JSON_TOKEN_COMMA)
         {
-            return NULL;
+            goto error;
         }
 
-        opa_object_insert(obj, key, val);
+        top->state = OPA_JSON_SET_ELEM;
         token = opa_json_lex_read(ctx);
+        goto need_value;
 
-        switch (token)
+    case OPA_JSON_SET_ELEM:
+        opa_set_add(opa_cast_set(top->value), value);
+        token = opa_json_lex_read(ctx);
+
+        if (token == OPA_JSON_TOKEN_OBJECT_END)
         {
-        case OPA_JSON_TOKEN_OBJECT_END:
-            return &obj->hdr;
-        case OPA_JSON_TOKEN_COMMA:
+            value = top->value;
+            depth--;
+            goto deliver;
+        }
+
+        if (token != OPA_JSON_TOKEN_COMMA)
         {
-            token = opa_json_lex_read(ctx);
-            break;
+            goto error;
         }
-        default:
-            return NULL;
+
+        token = opa_json_lex_read(ctx);
+        goto need_value;
+
+    case OPA_JSON_OBJ_KEY:
+        top->key = opa_json_intern_key(value);
+        token = opa_json_lex_read(ctx);
+
+        if (token != OPA_JSON_TOKEN_COLON)
+        {
+            goto error;
         }
-    }
 
-    return NULL;
-}
+        top->state = OPA_JSON_OBJ_VAL;
+        value = opa_json_lazy_value(ctx, &token);
 
-opa_value *opa_json_parse_object_or_set(opa_json_lex *ctx)
-{
-    int token = opa_json_lex_read(ctx);
+        if (value != NULL)
+        {
+            goto deliver;
+        }
 
-    if (token == OPA_JSON_TOKEN_OBJECT_END)
-    {
-        return opa_object();
-    }
+        goto need_value;
 
-    opa_value *head = opa_json_parse_token(ctx, token);
+    case OPA_JSON_OBJ_VAL:
+        opa_object_insert(opa_cast_object(top->value), top->key, value);
+        top->key = NULL;
+        token = opa_json_lex_read(ctx);
 
-    if (head == NULL)
-    {
-        return NULL;
-    }
+        if (token == OPA_JSON_TOKEN_OBJECT_END)
+        {
+            value = top->value;
+            depth--;
+            goto deliver;
+        }
 
-    token = opa_json_lex_read(ctx);
+        if (token != OPA_JSON_TOKEN_COMMA)
+        {
+            goto error;
+        }
 
-    switch (token)
-    {
-    case OPA_JSON_TOKEN_OBJECT_END:
-    case OPA_JSON_TOKEN_COMMA:
-        return opa_json_parse_set(ctx, head, token);
-    case OPA_JSON_TOKEN_COLON:
-        return opa_json_parse_object(ctx, head);
+        top->state = OPA_JSON_OBJ_KEY;
+        token = opa_json_lex_read(ctx);
+        goto need_value;
     }
 
-    return NULL;
-}
-
-opa_value *opa_json_parse_token(opa_json_lex *ctx, int token)
-{
-    switch (token)
-    {
-    case OPA_JSON_TOKEN_NULL:
-        return opa_null();
-    case OPA_JSON_TOKEN_TRUE:
-        return opa_boolean(true);
-    case OPA_JSON_TOKEN_FALSE:
-        return opa_boolean(false);
-    case OPA_JSON_TOKEN_NUMBER:
-        return opa_json_parse_number(ctx->buf, ctx->buf_end - ctx->buf);
-    case OPA_JSON_TOKEN_STRING:
-    case OPA_JSON_TOKEN_STRING_ESCAPED:
-        return opa_json_parse_string(token, ctx->buf, ctx->buf_end - ctx->buf);
-    case OPA_JSON_TOKEN_ARRAY_START:
-        return opa_json_parse_array(ctx);
-    case OPA_JSON_TOKEN_OBJECT_START:
-        return opa_json_parse_object_or_set(ctx);
-    case OPA_JSON_TOKEN_EMPTY_SET:
-        return opa_set();
-    default:
-        return NULL;
-    }
+    goto error;
 }
 
 OPA_INTERNAL
@@ -709,6 +1040,356 @@ opa_value *opa_value_parse(const char *input, size_t len)
     return opa_json_parse_token(&ctx, token);
 }
 
+// opa_json_parse_dedup is opa_json_parse followed by a hash-consing pass:
+// structurally identical subtrees — documents listing the same permission
+// object thousands of times, say — collapse to one shared instance. The
+// result is a DAG and carries opa_value_dedup's frozen-document contract:
+// read-only, never opa_value_free_deep, discarded by a heap reset.
+OPA_INTERNAL
+WASM_EXPORT(opa_json_parse_dedup)
+opa_value *opa_json_parse_dedup(const char *input, size_t len)
+{
+    return opa_value_dedup(opa_json_parse(input, len));
+}
+
+// opa_json_parse_borrowed is like opa_json_parse, except that strings
+// without escape sequences reference the input buffer instead of being
+// copied out of it. The caller must keep the buffer pinned (allocated and
+// unmodified) for as long as the returned value is in use.
+OPA_INTERNAL
+WASM_EXPORT(opa_json_parse_borrowed)
+opa_value *opa_json_parse_borrowed(const char *input, size_t len)
+{
+    opa_json_lex ctx;
+    opa_json_lex_init(input, len, &ctx);
+    ctx.borrow_enabled = 1;
+    int token = opa_json_lex_read(&ctx);
+    return opa_json_parse_token(&ctx, token);
+}
+
+// opa_json_parse_lazy defers cold subtrees: an object value whose raw span
+// is OPA_JSON_LAZY_MIN bytes or longer is stored unparsed and materialized
+// on first access — opa_value_get and the other accessors parse it (again
+// lazily, so its own large values stay deferred) and cache the result. Load
+// time still scans the input once for structure, but nodes are built only
+// for the subtrees actually touched, so resident parsed memory scales with
+// the working set rather than the document. Comparison, hashing and
+// serialization force the subtrees they reach. The spans reference the
+// input, so the caller must keep the buffer pinned for as long as the value
+// is in use, as with opa_json_parse_borrowed.
+OPA_INTERNAL
+WASM_EXPORT(opa_json_parse_lazy)
+opa_value *opa_json_parse_lazy(const char *input, size_t len)
+{
+    opa_json_lex ctx;
+    opa_json_lex_init(input, len, &ctx);
+    ctx.lazy_enabled = 1;
+    int token = opa_json_lex_read(&ctx);
+    return opa_json_parse_token(&ctx, token);
+}
+
+// opa_value_parse_trusted is opa_value_parse for input the host has already
+// validated as JSON and UTF-8. UTF-8 re-validation is skipped, so strings
+// without escape sequences — non-ASCII included — always reference the
+// input buffer instead of being copied out of it, with the buffer-pinning
+// contract of opa_json_parse_borrowed. Structural errors still return NULL;
+// invalid UTF-8 passes through undetected. Opt-in only: hosts that do not
+// validate their inputs must stay on opa_value_parse.
+OPA_INTERNAL
+WASM_EXPORT(opa_value_parse_trusted)
+opa_value *opa_value_parse_trusted(const char *input, size_t len)
+{
+    opa_json_lex ctx;
+    opa_json_lex_init(input, len, &ctx);
+    ctx.set_literals_enabled = 1;
+    ctx.borrow_enabled = 1;
+    ctx.trusted_enabled = 1;
+    int token = opa_json_lex_read(&ctx);
+    return opa_json_parse_token(&ctx, token);
+}
+
+// Push-based parsing. opa_json_parse needs the whole input resident before
+// it starts, so loading a large document holds the input and the parsed
+// tree in memory at once. The push parser instead consumes host-delivered
+// chunks as they arrive: each opa_json_parse_feed advances the parse as far
+// as the buffered input allows and keeps only the unconsumed tail — at most
+// one token plus trailing whitespace — so peak memory is the parsed tree
+// plus one chunk, and parsing overlaps with whatever delivers the chunks.
+//
+// The machine is the token-at-a-time form of opa_json_parse_token: the same
+// frame stack, but with the expectation between tokens ('value', 'colon',
+// 'comma-or-close') held in the parser so it can stop after any token.
+// Errors are deferred: feed never fails, and opa_json_parse_end reports a
+// malformed or incomplete document by returning NULL. Set literals and
+// pre-sizing are not supported; the push parser reads plain JSON.
+
+#define OPA_JSON_PUSH_VALUE (0) // expecting a value (or a closing bracket)
+#define OPA_JSON_PUSH_COLON (1) // object: expecting ':' after a key
+#define OPA_JSON_PUSH_COMMA (2) // expecting ',' or the container's close
+#define OPA_JSON_PUSH_END (3)   // root completed: only whitespace may follow
+
+struct opa_json_parser_t
+{
+    char *buf;   // unconsumed input: retained tail plus the latest chunk
+    size_t len;
+    size_t cap;
+    struct opa_json_frame *stack; // open containers, as in opa_json_parse_token
+    size_t depth;
+    size_t stack_cap;
+    opa_value *root;
+    int expect;
+    int err;
+};
+
+OPA_INTERNAL
+WASM_EXPORT(opa_json_parse_begin)
+opa_json_parser_t *opa_json_parse_begin(void)
+{
+    opa_json_parser_t *p = (opa_json_parser_t *)opa_malloc(sizeof(opa_json_parser_t));
+
+    p->buf = NULL;
+    p->len = 0;
+    p->cap = 0;
+    p->stack_cap = 64;
+    p->stack = (struct opa_json_frame *)opa_malloc(p->stack_cap * sizeof(struct opa_json_frame));
+    p->depth = 0;
+    p->root = NULL;
+    p->expect = OPA_JSON_PUSH_VALUE;
+    p->err = 0;
+
+    return p;
+}
+
+// Hands a completed value to the innermost frame, or makes it the root.
+static void __opa_json_push_deliver(opa_json_parser_t *p, opa_value *value)
+{
+    if (p->depth == 0)
+    {
+        p->root = value;
+        p->expect = OPA_JSON_PUSH_END;
+        return;
+    }
+
+    struct opa_json_frame *top = &p->stack[p->depth-1];
+
+    if (top->value->type == OPA_ARRAY)
+    {
+        opa_array_append(opa_cast_array(top->value), value);
+        p->expect = OPA_JSON_PUSH_COMMA;
+    }
+    else if (top->key == NULL)
+    {
+        top->key = opa_json_intern_key(value);
+        p->expect = OPA_JSON_PUSH_COLON;
+    }
+    else
+    {
+        opa_object_insert(opa_cast_object(top->value), top->key, value);
+        top->key = NULL;
+        p->expect = OPA_JSON_PUSH_COMMA;
+    }
+}
+
+// Advances the machine by one token. Returns 0, or -1 on a malformed
+// document (recorded in p->err as well).
+static int __opa_json_push_token(opa_json_parser_t *p, opa_json_lex *ctx, int token)
+{
+    struct opa_json_frame *top = p->depth > 0 ? &p->stack[p->depth-1] : NULL;
+
+    switch (p->expect)
+    {
+    case OPA_JSON_PUSH_COLON:
+        if (token != OPA_JSON_TOKEN_COLON)
+        {
+            goto error;
+        }
+
+        p->expect = OPA_JSON_PUSH_VALUE;
+        return 0;
+
+    case OPA_JSON_PUSH_COMMA:
+        if (token == OPA_JSON_TOKEN_COMMA)
+        {
+            p->expect = OPA_JSON_PUSH_VALUE;
+            return 0;
+        }
+
+        if (top->value->type == OPA_ARRAY)
+        {
+            if (token == OPA_JSON_TOKEN_ARRAY_END)
+            {
+                p->depth--;
+                __opa_json_push_deliver(p, top->value);
+                return 0;
+            }
+
+            // Like the other parsers, a missing separator is tolerated.
+            break;
+        }
+
+        if (token == OPA_JSON_TOKEN_OBJECT_END)
+        {
+            p->depth--;
+            __opa_json_push_deliver(p, top->value);
+            return 0;
+        }
+
+        goto error;
+
+    case OPA_JSON_PUSH_END:
+        goto error; // trailing garbage after the root value
+    }
+
+    // Expecting a value.
+    switch (token)
+    {
+    case OPA_JSON_TOKEN_ARRAY_END:
+        if (top == NULL || top->value->type != OPA_ARRAY)
+        {
+            goto error;
+        }
+
+        p->depth--;
+        __opa_json_push_deliver(p, top->value);
+        return 0;
+
+    case OPA_JSON_TOKEN_OBJECT_END:
+        if (top == NULL || top->value->type != OPA_OBJECT || top->key != NULL)
+        {
+            goto error;
+        }
+
+        p->depth--;
+        __opa_json_push_deliver(p, top->value);
+        return 0;
+
+    case OPA_JSON_TOKEN_ARRAY_START:
+    case OPA_JSON_TOKEN_OBJECT_START:
+        if (p->depth == p->stack_cap)
+        {
+            p->stack_cap *= 2;
+            p->stack = (struct opa_json_frame *)opa_realloc(p->stack, p->stack_cap * sizeof(struct opa_json_frame));
+        }
+
+        p->stack[p->depth].value = token == OPA_JSON_TOKEN_ARRAY_START ? opa_array() : opa_object();
+        p->stack[p->depth].key = NULL;
+        p->depth++;
+        p->expect = OPA_JSON_PUSH_VALUE;
+        return 0;
+
+    default:
+    {
+        opa_value *value = opa_json_parse_scalar(ctx, token);
+
+        if (value == NULL)
+        {
+            goto error;
+        }
+
+        __opa_json_push_deliver(p, value);
+        return 0;
+    }
+    }
+
+error:
+    p->err = 1;
+    return -1;
+}
+
+// Runs the machine over the buffered input. When 'final' is clear, a token
+// that reaches the end of the buffer may continue in the next chunk — a
+// number split across chunks, a half-delivered atom or string — so the
+// machine stops before it and the tail from its start is retained. When
+// 'final' is set the input is complete and every token is taken at face
+// value.
+static void __opa_json_push_run(opa_json_parser_t *p, int final)
+{
+    if (p->err)
+    {
+        return;
+    }
+
+    opa_json_lex ctx;
+    opa_json_lex_init(p->buf, p->len, &ctx);
+
+    for (;;)
+    {
+        const char *start = ctx.curr;
+        int token = opa_json_lex_read(&ctx);
+
+        if (token == OPA_JSON_TOKEN_EOF)
+        {
+            p->len = 0;
+            return;
+        }
+
+        if (!final && (token == OPA_JSON_TOKEN_ERROR ||
+                       (token == OPA_JSON_TOKEN_NUMBER && opa_json_lex_eof(&ctx))))
+        {
+            // Possibly the front of a token finished by the next chunk:
+            // retain from its start and decide when more input arrives.
+            size_t tail = p->len - (start - p->buf);
+            memmove(p->buf, start, tail);
+            p->len = tail;
+            return;
+        }
+
+        if (__opa_json_push_token(p, &ctx, token) == -1)
+        {
+            p->len = 0;
+            return;
+        }
+    }
+}
+
+OPA_INTERNAL
+WASM_EXPORT(opa_json_parse_feed)
+void opa_json_parse_feed(opa_json_parser_t *p, const char *chunk, size_t len)
+{
+    if (p->err)
+    {
+        return;
+    }
+
+    if (p->len + len > p->cap)
+    {
+        p->cap = p->len + len;
+        p->buf = p->buf == NULL ? (char *)opa_malloc(p->cap)
+                                : (char *)opa_realloc(p->buf, p->cap);
+    }
+
+    memcpy(p->buf + p->len, chunk, len);
+    p->len += len;
+
+    __opa_json_push_run(p, 0);
+
+    // Release the consumed prefix: shrink the buffer back to the retained
+    // tail so what feed holds between chunks stays at one token's worth.
+    if (p->len > 0 && p->cap - p->len >= 4096)
+    {
+        p->cap = p->len;
+        p->buf = (char *)opa_realloc(p->buf, p->cap);
+    }
+}
+
+OPA_INTERNAL
+WASM_EXPORT(opa_json_parse_end)
+opa_value *opa_json_parse_end(opa_json_parser_t *p)
+{
+    __opa_json_push_run(p, 1);
+
+    opa_value *root = p->expect == OPA_JSON_PUSH_END && p->err == 0 ? p->root : NULL;
+
+    if (p->buf != NULL)
+    {
+        opa_free(p->buf);
+    }
+
+    opa_free(p->stack);
+    opa_free(p);
+    return root;
+}
+
 typedef struct {
     char *buf;
     char *next;
@@ -832,6 +1513,22 @@ int opa_json_writer_emit_number(opa_json_writer *w, opa_number_t *n)
     }
 }
 
+// Per-byte escape classes for string output. Zero means the byte passes
+// through untouched; 'u' means it becomes \u00XX; any other value is the
+// character that follows the backslash. Characters below 32 (space) are
+// escaped, as are \ and ". Anything else is expected to be valid UTF-8.
+static const unsigned char opa_json_escape_class[256] = {
+    [0x00] = 'u', [0x01] = 'u', [0x02] = 'u', [0x03] = 'u',
+    [0x04] = 'u', [0x05] = 'u', [0x06] = 'u', [0x07] = 'u',
+    [0x08] = 'u', ['\t'] = 't', ['\n'] = 'n', [0x0b] = 'u',
+    [0x0c] = 'u', ['\r'] = 'r', [0x0e] = 'u', [0x0f] = 'u',
+    [0x10] = 'u', [0x11] = 'u', [0x12] = 'u', [0x13] = 'u',
+    [0x14] = 'u', [0x15] = 'u', [0x16] = 'u', [0x17] = 'u',
+    [0x18] = 'u', [0x19] = 'u', [0x1a] = 'u', [0x1b] = 'u',
+    [0x1c] = 'u', [0x1d] = 'u', [0x1e] = 'u', [0x1f] = 'u',
+    ['"'] = '"', ['\\'] = '\\',
+};
+
 int opa_json_writer_emit_string(opa_json_writer *w, opa_string_t *s)
 {
     int rc = opa_json_writer_emit_char(w, '"');
@@ -841,38 +1538,39 @@ int opa_json_writer_emit_string(opa_json_writer *w, opa_string_t *s)
         return rc;
     }
 
-    for (size_t i = 0; i < s->len; i++)
+    for (size_t i = 0; i < s->len;)
     {
-        // Encode any character below 32 (space) with \u00XX, unless
-        // \n, \r or \t.  including and above character 32, escape if
-        // \ or ". Anything else is expected to be valid UTF-8.
+        // Copy the maximal run of bytes that need no escaping in one go.
+        size_t j = i;
 
-        unsigned char c = s->v[i];
-        if (c >= ' ' && c != '\\' && c != '"')
+        while (j < s->len && opa_json_escape_class[(unsigned char)s->v[j]] == 0)
+        {
+            j++;
+        }
+
+        if (j > i)
         {
-            rc = opa_json_writer_emit_char(w, c);
+            rc = opa_json_writer_emit_chars(w, &s->v[i], j - i);
             if (rc != 0)
             {
                 return rc;
             }
 
+            i = j;
             continue;
         }
 
+        unsigned char c = s->v[i];
+        unsigned char cls = opa_json_escape_class[c];
+
         rc = opa_json_writer_emit_char(w, '\\');
         if (rc != 0)
         {
             return rc;
         }
 
-        if (c == '\\' || c == '"') {
-            rc = opa_json_writer_emit_char(w, c);
-        } else if (c == '\n') {
-            rc = opa_json_writer_emit_char(w, 'n');
-        } else if (c == '\r') {
-            rc = opa_json_writer_emit_char(w, 'r');
-        } else if (c == '\t') {
-            rc = opa_json_writer_emit_char(w, 't');
+        if (cls != 'u') {
+            rc = opa_json_writer_emit_char(w, cls);
         } else {
             rc = opa_json_writer_emit_chars(w, "u00", 3);
             if (rc != 0)
@@ -894,6 +1592,8 @@ int opa_json_writer_emit_string(opa_json_writer *w, opa_string_t *s)
         {
             return rc;
         }
+
+        i++;
     }
 
     rc = opa_json_writer_emit_char(w, '"');
@@ -1031,15 +1731,153 @@ int opa_json_writer_emit_value(opa_json_writer *w, opa_value *v)
         return opa_json_writer_emit_set_literal(w, opa_cast_set(v));
     }
     case OPA_OBJECT:
+    {
+        opa_object_t *obj = opa_cast_object(v);
+
+        // A memoized serialization is only valid for the default writer
+        // configuration: the set literal and non-string key modes change
+        // how nested values are rendered.
+        if (!w->set_literals_enabled && !w->non_string_object_keys_enabled &&
+            obj->dump != NULL && obj->dump_epoch == opa_heap_epoch())
+        {
+            return opa_json_writer_emit_chars(w, obj->dump, obj->dump_len);
+        }
+
         return opa_json_writer_emit_collection(w, v, '{', '}', opa_json_writer_emit_object_element);
     }
+    case OPA_LAZY:
+        return opa_json_writer_emit_value(w, opa_value_force(v));
+    }
 
     return -2;
 }
 
+static size_t opa_json_writer_size_value(opa_json_writer *w, opa_value *v);
+
+static size_t opa_json_writer_size_string(opa_string_t *s)
+{
+    size_t size = 2;
+
+    for (size_t i = 0; i < s->len; i++)
+    {
+        unsigned char cls = opa_json_escape_class[(unsigned char)s->v[i]];
+
+        if (cls == 0)
+        {
+            size += 1;
+        }
+        else if (cls != 'u')
+        {
+            size += 2;
+        }
+        else
+        {
+            size += 6; // \u00XX
+        }
+    }
+
+    return size;
+}
+
+// Estimates the serialized length of 'v' so the writer can allocate its
+// output buffer once up front instead of growing and copying as it emits.
+// Strings and structure are sized exactly; separators and object keys that
+// need double encoding may be off by a little, which either leaves slack or
+// makes the writer fall back to growing.
+static size_t opa_json_writer_size_value(opa_json_writer *w, opa_value *v)
+{
+    switch (opa_value_type(v))
+    {
+    case OPA_NULL:
+        return sizeof("null")-1;
+    case OPA_BOOLEAN:
+        return opa_cast_boolean(v)->v ? sizeof("true")-1 : sizeof("false")-1;
+    case OPA_NUMBER:
+    {
+        opa_number_t *n = opa_cast_number(v);
+
+        if (n->repr == OPA_NUMBER_REPR_REF)
+        {
+            return n->v.ref.len;
+        }
+
+        size_t size = n->v.i <= 0 ? 2 : 1; // first digit, or sign and "0"
+
+        for (long long i = n->v.i; i / 10 != 0; i /= 10)
+        {
+            size++;
+        }
+
+        return size;
+    }
+    case OPA_STRING:
+        return opa_json_writer_size_string(opa_cast_string(v));
+    case OPA_ARRAY:
+    {
+        opa_array_t *arr = opa_cast_array(v);
+        size_t size = 2;
+
+        for (size_t i = 0; i < arr->len; i++)
+        {
+            size += opa_json_writer_size_value(w, arr->elems[i].v) + 1;
+        }
+
+        return size;
+    }
+    case OPA_SET:
+    {
+        opa_set_t *set = opa_cast_set(v);
+
+        if (w->set_literals_enabled && set->len == 0)
+        {
+            return sizeof("set()")-1;
+        }
+
+        size_t size = 2;
+
+        for (size_t i = 0; i < set->n; i++)
+        {
+            for (opa_set_elem_t *elem = set->buckets[i]; elem != NULL; elem = elem->next)
+            {
+                size += opa_json_writer_size_value(w, elem->v) + 1;
+            }
+        }
+
+        return size;
+    }
+    case OPA_OBJECT:
+    {
+        opa_object_t *obj = opa_cast_object(v);
+
+        if (!w->set_literals_enabled && !w->non_string_object_keys_enabled &&
+            obj->dump != NULL && obj->dump_epoch == opa_heap_epoch())
+        {
+            return obj->dump_len;
+        }
+
+        size_t size = 2;
+
+        for (size_t i = 0; i < obj->n; i++)
+        {
+            for (opa_object_elem_t *elem = obj->buckets[i]; elem != NULL; elem = elem->next)
+            {
+                size += opa_json_writer_size_value(w, elem->k) +
+                    opa_json_writer_size_value(w, elem->v) + 2;
+            }
+        }
+
+        return size;
+    }
+    case OPA_LAZY:
+        return opa_json_writer_size_value(w, opa_value_force(v));
+    }
+
+    return 0;
+}
+
 char *opa_json_writer_write(opa_json_writer *w, opa_value *v)
 {
-    if (opa_json_writer_grow(w, 1024, 0) != 0)
+    if (opa_json_writer_grow(w, opa_json_writer_size_value(w, v) + 1, 0) != 0)
     {
         goto errout;
     }
@@ -1054,6 +1892,34 @@ char *opa_json_writer_write(opa_json_writer *w, opa_value *v)
         goto errout;
     }
 
+    // Memoize the serialization on a root object so repeated marshals of an
+    // unchanged value — and dumps of values embedding it — skip the walk.
+    // Nested objects are not cached: copying every subtree on every dump
+    // would cost more than it saves.
+    if (opa_value_type(v) == OPA_OBJECT &&
+        !w->set_literals_enabled && !w->non_string_object_keys_enabled)
+    {
+        opa_object_t *obj = opa_cast_object(v);
+
+        if (obj->dump == NULL || obj->dump_epoch != opa_heap_epoch())
+        {
+            size_t n = opa_json_writer_offset(w); // includes the nul
+            char *dump = (char *)opa_malloc(n);
+
+            if (dump != NULL)
+            {
+                for (size_t i = 0; i < n; i++)
+                {
+                    dump[i] = w->buf[i];
+                }
+
+                obj->dump = dump;
+                obj->dump_len = n - 1;
+                obj->dump_epoch = opa_heap_epoch();
+            }
+        }
+    }
+
     return w->buf;
 
 errout:
@@ -1078,3 +1944,320 @@ char *opa_value_dump(opa_value *v)
     w.non_string_object_keys_enabled = 1;
     return opa_json_writer_write(&w, v);
 }
+
+// Streaming dump. A stream serializes a value into caller-provided buffers
+// one chunk at a time, so the host can move a large result over the network
+// without the runtime ever materializing the whole string on the heap. The
+// walk keeps an explicit stack of work items (pending values and literal
+// punctuation) plus the position inside the string or atom being emitted,
+// and suspends whenever the chunk fills up.
+
+typedef struct
+{
+    opa_value *v;     // value to emit, or NULL for literal text
+    const char *text; // literal text to emit
+    size_t len;
+    int key;          // value is an object key
+} opa_json_stream_item;
+
+struct opa_json_stream_t
+{
+    opa_json_stream_item *items; // work stack, top at items[depth-1]
+    size_t depth;
+    size_t cap;
+    opa_string_t *str;           // string currently being escaped
+    size_t str_i;
+    opa_value *str_owner;        // double-encoded key, freed once emitted
+    const char *atom;            // pending output bytes
+    size_t atom_len;
+    char scratch[32];            // formatted numbers and escape units
+    int set_literals_enabled;
+    int non_string_object_keys_enabled;
+};
+
+static void opa_json_stream_push(opa_json_stream_t *s, opa_value *v, const char *text, size_t len, int key)
+{
+    if (s->depth == s->cap)
+    {
+        s->cap *= 2;
+        s->items = (opa_json_stream_item *)opa_realloc(s->items, s->cap * sizeof(opa_json_stream_item));
+    }
+
+    s->items[s->depth].v = v;
+    s->items[s->depth].text = text;
+    s->items[s->depth].len = len;
+    s->items[s->depth].key = key;
+    s->depth++;
+}
+
+static opa_json_stream_t *opa_json_stream_with_flags(opa_value *v, int set_literals, int non_string_keys)
+{
+    opa_json_stream_t *s = (opa_json_stream_t *)opa_malloc(sizeof(opa_json_stream_t));
+
+    s->cap = 64;
+    s->depth = 0;
+    s->items = (opa_json_stream_item *)opa_malloc(s->cap * sizeof(opa_json_stream_item));
+    s->str = NULL;
+    s->str_i = 0;
+    s->str_owner = NULL;
+    s->atom = NULL;
+    s->atom_len = 0;
+    s->set_literals_enabled = set_literals;
+    s->non_string_object_keys_enabled = non_string_keys;
+
+    opa_json_stream_push(s, v, NULL, 0, 0);
+    return s;
+}
+
+OPA_INTERNAL
+WASM_EXPORT(opa_json_stream)
+opa_json_stream_t *opa_json_stream(opa_value *v)
+{
+    return opa_json_stream_with_flags(v, 0, 0);
+}
+
+OPA_INTERNAL
+WASM_EXPORT(opa_value_stream)
+opa_json_stream_t *opa_value_stream(opa_value *v)
+{
+    return opa_json_stream_with_flags(v, 1, 1);
+}
+
+WASM_EXPORT(opa_json_stream_free)
+void opa_json_stream_free(opa_json_stream_t *s)
+{
+    opa_free(s->items);
+    opa_free(s);
+}
+
+// Fills 'buf' with the next chunk of serialized output and returns the
+// number of bytes written. A return of zero means the dump is complete.
+OPA_INTERNAL
+WASM_EXPORT(opa_json_stream_write)
+size_t opa_json_stream_write(opa_json_stream_t *s, char *buf, size_t len)
+{
+    size_t written = 0;
+
+    while (written < len)
+    {
+        if (s->atom_len > 0)
+        {
+            size_t n = s->atom_len < len - written ? s->atom_len : len - written;
+
+            for (size_t i = 0; i < n; i++)
+            {
+                buf[written + i] = s->atom[i];
+            }
+
+            written += n;
+            s->atom += n;
+            s->atom_len -= n;
+            continue;
+        }
+
+        if (s->str != NULL)
+        {
+            opa_string_t *str = s->str;
+
+            if (s->str_i == str->len)
+            {
+                s->str = NULL;
+                s->atom = "\"";
+                s->atom_len = 1;
+
+                if (s->str_owner != NULL)
+                {
+                    opa_value_free(s->str_owner);
+                    s->str_owner = NULL;
+                }
+
+                continue;
+            }
+
+            unsigned char c = (unsigned char)str->v[s->str_i];
+            unsigned char cls = opa_json_escape_class[c];
+
+            if (cls == 0)
+            {
+                // batch the run of characters that need no escaping
+                size_t j = s->str_i + 1;
+
+                while (j < str->len && opa_json_escape_class[(unsigned char)str->v[j]] == 0)
+                {
+                    j++;
+                }
+
+                s->atom = &str->v[s->str_i];
+                s->atom_len = j - s->str_i;
+                s->str_i = j;
+                continue;
+            }
+
+            s->scratch[0] = '\\';
+
+            if (cls != 'u')
+            {
+                s->scratch[1] = cls;
+                s->atom_len = 2;
+            }
+            else
+            {
+                snprintf(&s->scratch[1], sizeof(s->scratch)-1, "u%04x", c);
+                s->atom_len = 6;
+            }
+
+            s->atom = s->scratch;
+            s->str_i++;
+            continue;
+        }
+
+        if (s->depth == 0)
+        {
+            break;
+        }
+
+        opa_json_stream_item item = s->items[--s->depth];
+
+        if (item.text != NULL)
+        {
+            s->atom = item.text;
+            s->atom_len = item.len;
+            continue;
+        }
+
+        if (item.key && !s->non_string_object_keys_enabled && opa_value_type(item.v) != OPA_STRING)
+        {
+            // Non-string keys are serialized, then emitted as a JSON string,
+            // matching opa_json_writer_emit_object_element.
+            char *b = opa_json_dump(item.v);
+            s->str_owner = opa_string_allocated(b, opa_strlen(b));
+            s->str = opa_cast_string(s->str_owner);
+            s->str_i = 0;
+            s->atom = "\"";
+            s->atom_len = 1;
+            continue;
+        }
+
+        switch (opa_value_type(item.v))
+        {
+        case OPA_NULL:
+            s->atom = "null";
+            s->atom_len = 4;
+            break;
+        case OPA_BOOLEAN:
+            s->atom = opa_cast_boolean(item.v)->v ? "true" : "false";
+            s->atom_len = opa_cast_boolean(item.v)->v ? 4 : 5;
+            break;
+        case OPA_NUMBER:
+        {
+            opa_number_t *n = opa_cast_number(item.v);
+
+            if (n->repr == OPA_NUMBER_REPR_REF)
+            {
+                s->atom = n->v.ref.s;
+                s->atom_len = n->v.ref.len;
+            }
+            else
+            {
+                opa_itoa(n->v.i, s->scratch, 10);
+                s->atom = s->scratch;
+                s->atom_len = opa_strlen(s->scratch);
+            }
+            break;
+        }
+        case OPA_STRING:
+            s->str = opa_cast_string(item.v);
+            s->str_i = 0;
+            s->atom = "\"";
+            s->atom_len = 1;
+            break;
+        case OPA_ARRAY:
+        {
+            opa_array_t *arr = opa_cast_array(item.v);
+
+            opa_json_stream_push(s, NULL, "]", 1, 0);
+
+            for (size_t i = arr->len; i > 0; i--)
+            {
+                opa_json_stream_push(s, arr->elems[i-1].v, NULL, 0, 0);
+
+                if (i > 1)
+                {
+                    opa_json_stream_push(s, NULL, ",", 1, 0);
+                }
+            }
+
+            s->atom = "[";
+            s->atom_len = 1;
+            break;
+        }
+        case OPA_SET:
+        {
+            opa_set_t *set = opa_cast_set(item.v);
+            int literal = s->set_literals_enabled;
+
+            if (literal && set->len == 0)
+            {
+                s->atom = "set()";
+                s->atom_len = 5;
+                break;
+            }
+
+            opa_json_stream_push(s, NULL, literal ? "}" : "]", 1, 0);
+
+            size_t left = set->len;
+
+            for (size_t i = set->n; i > 0; i--)
+            {
+                for (opa_set_elem_t *elem = set->buckets[i-1]; elem != NULL; elem = elem->next)
+                {
+                    opa_json_stream_push(s, elem->v, NULL, 0, 0);
+
+                    if (--left > 0)
+                    {
+                        opa_json_stream_push(s, NULL, ",", 1, 0);
+                    }
+                }
+            }
+
+            s->atom = literal ? "{" : "[";
+            s->atom_len = 1;
+            break;
+        }
+        case OPA_OBJECT:
+        {
+            opa_object_t *obj = opa_cast_object(item.v);
+
+            opa_json_stream_push(s, NULL, "}", 1, 0);
+
+            size_t left = obj->len;
+
+            for (size_t i = obj->n; i > 0; i--)
+            {
+                for (opa_object_elem_t *elem = obj->buckets[i-1]; elem != NULL; elem = elem->next)
+                {
+                    opa_json_stream_push(s, elem->v, NULL, 0, 0);
+                    opa_json_stream_push(s, NULL, ":", 1, 0);
+                    opa_json_stream_push(s, elem->k, NULL, 0, 1);
+
+                    if (--left > 0)
+                    {
+                        opa_json_stream_push(s, NULL, ",", 1, 0);
+                    }
+                }
+            }
+
+            s->atom = "{";
+            s->atom_len = 1;
+            break;
+        }
+        case OPA_LAZY:
+            // containers push element values as-is, so an untouched lazy
+            // subtree surfaces here: materialize and revisit it
+            opa_json_stream_push(s, opa_value_force(item.v), NULL, 0, 0);
+            break;
+        }
+    }
+
+    return written;
+}
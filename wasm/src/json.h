@@ -15,6 +15,9 @@ typedef struct
     const char *buf_end;
     const char *curr;
     int set_literals_enabled;
+    int borrow_enabled;
+    int trusted_enabled;
+    int lazy_enabled;
 } opa_json_lex;
 
 #define OPA_JSON_TOKEN_ERROR 0
@@ -37,11 +40,34 @@ void opa_json_lex_init(const char *input, size_t len, opa_json_lex *ctx);
 int opa_json_lex_read(opa_json_lex *ctx);
 
 opa_value *opa_json_parse(const char *input, size_t len);
+opa_value *opa_json_parse_dedup(const char *input, size_t len);
+opa_value *opa_json_parse_borrowed(const char *input, size_t len);
+opa_value *opa_json_parse_lazy(const char *input, size_t len);
+opa_value *opa_value_parse_trusted(const char *input, size_t len);
+
+// Push-based parsing: consumes host-delivered chunks as they arrive, so the
+// whole input never needs to be resident — peak memory is the parsed tree
+// plus one chunk. Feed never fails; opa_json_parse_end returns the parsed
+// value, or NULL if the document was malformed or incomplete, and frees the
+// parser.
+typedef struct opa_json_parser_t opa_json_parser_t;
+
+opa_json_parser_t *opa_json_parse_begin(void);
+void opa_json_parse_feed(opa_json_parser_t *p, const char *chunk, size_t len);
+opa_value *opa_json_parse_end(opa_json_parser_t *p);
 opa_value *opa_value_parse(const char *input, size_t len);
 char *opa_json_dump(opa_value *v);
 char *opa_value_dump(opa_value *v);
 
-size_t opa_json_max_string_len(const char *input, size_t len);
+// Streaming dump: serializes into caller-provided buffers chunk by chunk.
+// opa_json_stream_write returns the number of bytes written; zero means the
+// dump is complete and the stream can be freed.
+typedef struct opa_json_stream_t opa_json_stream_t;
+
+opa_json_stream_t *opa_json_stream(opa_value *v);
+opa_json_stream_t *opa_value_stream(opa_value *v);
+size_t opa_json_stream_write(opa_json_stream_t *s, char *buf, size_t len);
+void opa_json_stream_free(opa_json_stream_t *s);
 
 #ifdef __cplusplus
 }
@@ -80,6 +80,12 @@ static const double huge = 1.0e300;
 
 double ceil(double x)
 {
+#ifdef __wasm__
+    // f64.ceil is a core wasm instruction; the builtin lowers to it
+    // directly, so the word-twiddling fallback below is only needed for
+    // non-wasm hosts.
+    return __builtin_ceil(x);
+#else
     int32_t i0,i1,j0;
     uint32_t i,j;
     EXTRACT_WORDS(i0,i1,x);
@@ -118,6 +124,7 @@ double ceil(double x)
     }
     INSERT_WORDS(x,i0,i1);
     return x;
+#endif
 }
 
 static const double
@@ -32,6 +32,7 @@
 
 #include "printf.h"
 #include "../std.h"
+#include "../str.h"
 #include <float.h>
 
 // define this globally (e.g. gcc -DPRINTF_INCLUDE_CONFIG_H ...) to include the
@@ -317,92 +318,56 @@ static size_t _etoa(out_fct_type out, char* buffer, size_t idx, size_t maxlen, d
 #endif
 
 
-// internal ftoa for fixed decimal floating point
-static size_t _ftoa(out_fct_type out, char* buffer, size_t idx, size_t maxlen, double value, unsigned int prec, unsigned int width, unsigned int flags)
+// rounds the digit string (value = 0.dig * 10^kk) to 'keep' digits, half
+// away from zero, propagating the carry; an overflowing carry leaves a
+// single leading 1 and moves the decimal point right
+static void _dtoa_round(char* dig, int* n, int* kk, int keep)
 {
-  char buf[PRINTF_FTOA_BUFFER_SIZE];
-  size_t len  = 0U;
-  double diff = 0.0;
-
-  // powers of 10
-  static const double pow10[] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000 };
-
-  // test for special values
-  if (value != value)
-    return _out_rev(out, buffer, idx, maxlen, "nan", 3, width, flags);
-  if (value < -DBL_MAX)
-    return _out_rev(out, buffer, idx, maxlen, "fni-", 4, width, flags);
-  if (value > DBL_MAX)
-    return _out_rev(out, buffer, idx, maxlen, (flags & FLAGS_PLUS) ? "fni+" : "fni", (flags & FLAGS_PLUS) ? 4U : 3U, width, flags);
-
-  // test for very large values
-  // standard printf behavior is to print EVERY whole number digit -- which could be 100s of characters overflowing your buffers == bad
-  if ((value > PRINTF_MAX_FLOAT) || (value < -PRINTF_MAX_FLOAT)) {
-#if defined(PRINTF_SUPPORT_EXPONENTIAL)
-    return _etoa(out, buffer, idx, maxlen, value, prec, width, flags);
-#else
-    return 0U;
-#endif
+  if (keep >= *n) {
+    return;
   }
-
-  // test for negative
-  bool negative = false;
-  if (value < 0) {
-    negative = true;
-    value = 0 - value;
+  if (keep < 0) {
+    *n = 0;  // everything rounds away
+    return;
   }
-
-  // set default precision, if not set explicitly
-  if (!(flags & FLAGS_PRECISION)) {
-    prec = PRINTF_DEFAULT_FLOAT_PRECISION;
+  bool roundup = dig[keep] >= '5';
+  *n = keep;
+  while (roundup && (*n > 0)) {
+    if (dig[*n - 1] != '9') {
+      dig[*n - 1]++;
+      return;
+    }
+    (*n)--;  // trailing 9s carry out; the layout pads them back as zeros
   }
-  // limit precision to 9, cause a prec >= 10 can lead to overflow errors
+  if (roundup) {
+    // e.g. 9.99 with one decimal kept becomes 10.0
+    dig[0] = '1';
+    *n = 1;
+    (*kk)++;
+  }
+}
+
+
+// lays out a rounded digit string (value = 0.dig * 10^kk) as a fixed
+// decimal with 'prec' fraction digits, reversed with sign and zero
+// padding the way _ntoa does, and hands it to _out_rev
+static size_t _ftoa_dig(out_fct_type out, char* buffer, size_t idx, size_t maxlen, bool negative, char* dig, int n, int kk, unsigned int prec, unsigned int width, unsigned int flags)
+{
+  char buf[PRINTF_FTOA_BUFFER_SIZE];
+  size_t len = 0U;
+
+  // limit precision to 9: deeper fraction digits emit as zeros
   while ((len < PRINTF_FTOA_BUFFER_SIZE) && (prec > 9U)) {
     buf[len++] = '0';
     prec--;
   }
 
-  int whole = (int)value;
-  double tmp = (value - whole) * pow10[prec];
-  unsigned long frac = (unsigned long)tmp;
-  diff = tmp - frac;
-
-  if (diff > 0.5) {
-    ++frac;
-    // handle rollover, e.g. case 0.99 with prec 1 is 1.0
-    if (frac >= pow10[prec]) {
-      frac = 0;
-      ++whole;
-    }
-  }
-  else if (diff < 0.5) {
-  }
-  else if ((frac == 0U) || (frac & 1U)) {
-    // if halfway, round up if odd OR if last digit is 0
-    ++frac;
-  }
+  _dtoa_round(dig, &n, &kk, kk + (int)prec);
 
-  if (prec == 0U) {
-    diff = value - (double)whole;
-    if ((!(diff < 0.5) || (diff > 0.5)) && (whole & 1)) {
-      // exactly 0.5 and ODD, then round up
-      // 1.5 -> 2, but 2.5 -> 2
-      ++whole;
-    }
-  }
-  else {
-    unsigned int count = prec;
-    // now do fractional part, as an unsigned number
-    while (len < PRINTF_FTOA_BUFFER_SIZE) {
-      --count;
-      buf[len++] = (char)(48U + (frac % 10U));
-      if (!(frac /= 10U)) {
-        break;
-      }
-    }
-    // add extra 0s
-    while ((len < PRINTF_FTOA_BUFFER_SIZE) && (count-- > 0U)) {
-      buf[len++] = '0';
+  // fractional part then the decimal point, reversed
+  if (prec != 0U) {
+    for (int i = kk + (int)prec - 1; (i >= kk) && (len < PRINTF_FTOA_BUFFER_SIZE); i--) {
+      buf[len++] = ((i >= 0) && (i < n)) ? dig[i] : '0';
     }
     if (len < PRINTF_FTOA_BUFFER_SIZE) {
       // add decimal
@@ -410,11 +375,15 @@ static size_t _ftoa(out_fct_type out, char* buffer, size_t idx, size_t maxlen, d
     }
   }
 
-  // do whole part, number is reversed
-  while (len < PRINTF_FTOA_BUFFER_SIZE) {
-    buf[len++] = (char)(48 + (whole % 10));
-    if (!(whole /= 10)) {
-      break;
+  // whole part, reversed
+  if (kk <= 0) {
+    if (len < PRINTF_FTOA_BUFFER_SIZE) {
+      buf[len++] = '0';
+    }
+  }
+  else {
+    for (int i = kk - 1; (i >= 0) && (len < PRINTF_FTOA_BUFFER_SIZE); i--) {
+      buf[len++] = (i < n) ? dig[i] : '0';
     }
   }
 
@@ -444,8 +413,59 @@ static size_t _ftoa(out_fct_type out, char* buffer, size_t idx, size_t maxlen, d
 }
 
 
+// internal ftoa for fixed decimal floating point
+static size_t _ftoa(out_fct_type out, char* buffer, size_t idx, size_t maxlen, double value, unsigned int prec, unsigned int width, unsigned int flags)
+{
+  // test for special values
+  if (value != value)
+    return _out_rev(out, buffer, idx, maxlen, "nan", 3, width, flags);
+  if (value < -DBL_MAX)
+    return _out_rev(out, buffer, idx, maxlen, "fni-", 4, width, flags);
+  if (value > DBL_MAX)
+    return _out_rev(out, buffer, idx, maxlen, (flags & FLAGS_PLUS) ? "fni+" : "fni", (flags & FLAGS_PLUS) ? 4U : 3U, width, flags);
+
+  // test for very large values
+  // standard printf behavior is to print EVERY whole number digit -- which could be 100s of characters overflowing your buffers == bad
+  if ((value > PRINTF_MAX_FLOAT) || (value < -PRINTF_MAX_FLOAT)) {
+#if defined(PRINTF_SUPPORT_EXPONENTIAL)
+    return _etoa(out, buffer, idx, maxlen, value, prec, width, flags);
+#else
+    return 0U;
+#endif
+  }
+
+  // test for negative
+  bool negative = false;
+  if (value < 0) {
+    negative = true;
+    value = 0 - value;
+  }
+
+  // set default precision, if not set explicitly
+  if (!(flags & FLAGS_PRECISION)) {
+    prec = PRINTF_DEFAULT_FLOAT_PRECISION;
+  }
+
+  // the shortest round-trip digits of the value, laid out under 'prec'
+  char dig[24];
+  int n, kk;
+  if (value == 0) {
+    dig[0] = '0';
+    n  = 1;
+    kk = 1;
+  }
+  else {
+    int k;
+    n  = opa_dtoa(value, dig, &k);
+    kk = n + k;
+  }
+
+  return _ftoa_dig(out, buffer, idx, maxlen, negative, dig, n, kk, prec, width, flags);
+}
+
+
 #if defined(PRINTF_SUPPORT_EXPONENTIAL)
-// internal ftoa variant for exponential floating-point type, contributed by Martijn Jasperse <m.jasperse@gmail.com>
+// internal ftoa variant for exponential floating-point type
 static size_t _etoa(out_fct_type out, char* buffer, size_t idx, size_t maxlen, double value, unsigned int prec, unsigned int width, unsigned int flags)
 {
   // check for NaN and special values
@@ -464,90 +484,73 @@ static size_t _etoa(out_fct_type out, char* buffer, size_t idx, size_t maxlen, d
     prec = PRINTF_DEFAULT_FLOAT_PRECISION;
   }
 
-  // determine the decimal exponent
-  // based on the algorithm by David Gay (https://www.ampl.com/netlib/fp/dtoa.c)
-  union {
-    uint64_t U;
-    double   F;
-  } conv;
-
-  conv.F = value;
-  int exp2 = (int)((conv.U >> 52U) & 0x07FFU) - 1023;           // effectively log2
-  conv.U = (conv.U & ((1ULL << 52U) - 1U)) | (1023ULL << 52U);  // drop the exponent so conv.F is now in [1,2)
-  // now approximate log10 from the log2 integer part and an expansion of ln around 1.5
-  int expval = (int)(0.1760912590558 + exp2 * 0.301029995663981 + (conv.F - 1.5) * 0.289529654602168);
-  // now we want to compute 10^expval but we want to be sure it won't overflow
-  exp2 = (int)(expval * 3.321928094887362 + 0.5);
-  const double z  = expval * 2.302585092994046 - exp2 * 0.6931471805599453;
-  const double z2 = z * z;
-  conv.U = (uint64_t)(exp2 + 1023) << 52U;
-  // compute exp(z) using continued fractions, see https://en.wikipedia.org/wiki/Exponential_function#Continued_fractions_for_ex
-  conv.F *= 1 + 2 * z / (2 - z + (z2 / (6 + (z2 / (10 + z2 / 14)))));
-  // correct for rounding errors
-  if (value < conv.F) {
-    expval--;
-    conv.F /= 10;
+  // the shortest round-trip digits determine the decimal exponent exactly
+  char dig[24];
+  int n, kk;
+  if (value == 0) {
+    dig[0] = '0';
+    n  = 1;
+    kk = 1;
+  }
+  else {
+    int k;
+    n  = opa_dtoa(value, dig, &k);
+    kk = n + k;
   }
-
-  // the exponent format is "%+03d" and largest value is "307", so set aside 4-5 characters
-  unsigned int minwidth = ((expval < 100) && (expval > -100)) ? 4U : 5U;
 
   // in "%g" mode, "prec" is the number of *significant figures* not decimals
   if (flags & FLAGS_ADAPT_EXP) {
     // do we want to fall-back to "%f" mode?
     if ((value >= 1e-4) && (value < 1e6)) {
+      const int expval = kk - 1;
       if ((int)prec > expval) {
         prec = (unsigned)((int)prec - expval - 1);
       }
       else {
         prec = 0;
       }
-      flags |= FLAGS_PRECISION;   // make sure _ftoa respects precision
-      // no characters in exponent
-      minwidth = 0U;
-      expval   = 0;
+      flags |= FLAGS_PRECISION;   // make sure the fixed layout respects precision
+      return _ftoa_dig(out, buffer, idx, maxlen, negative, dig, n, kk, prec, width, flags & ~FLAGS_ADAPT_EXP);
     }
-    else {
-      // we use one sigfig for the whole part
-      if ((prec > 0) && (flags & FLAGS_PRECISION)) {
-        --prec;
-      }
+    // we use one sigfig for the whole part
+    if ((prec > 0) && (flags & FLAGS_PRECISION)) {
+      --prec;
     }
   }
 
+  // round to one leading digit plus 'prec' decimals before sizing the
+  // exponent: a carry can push it up (9.99e99 with one decimal is 1.0e100)
+  _dtoa_round(dig, &n, &kk, ((prec > 9U) ? 9 : (int)prec) + 1);
+  const int expval = kk - 1;
+
+  // the exponent format is "%+03d" and largest value is "307", so set aside 4-5 characters
+  const unsigned int minwidth = ((expval < 100) && (expval > -100)) ? 4U : 5U;
+
   // will everything fit?
   unsigned int fwidth = width;
   if (width > minwidth) {
-    // we didn't fall-back so subtract the characters required for the exponent
+    // subtract the characters required for the exponent
     fwidth -= minwidth;
   } else {
     // not enough characters, so go back to default sizing
     fwidth = 0U;
   }
-  if ((flags & FLAGS_LEFT) && minwidth) {
+  if (flags & FLAGS_LEFT) {
     // if we're padding on the right, DON'T pad the floating part
     fwidth = 0U;
   }
 
-  // rescale the float value
-  if (expval) {
-    value /= conv.F;
-  }
-
-  // output the floating part
+  // output the mantissa as d.ddd, then the exponent part
   const size_t start_idx = idx;
-  idx = _ftoa(out, buffer, idx, maxlen, negative ? -value : value, prec, fwidth, flags & ~FLAGS_ADAPT_EXP);
-
-  // output the exponent part
-  if (minwidth) {
-    // output the exponential symbol
-    out((flags & FLAGS_UPPERCASE) ? 'E' : 'e', buffer, idx++, maxlen);
-    // output the exponent value
-    idx = _ntoa_long(out, buffer, idx, maxlen, (expval < 0) ? -expval : expval, expval < 0, 10, 0, minwidth-1, FLAGS_ZEROPAD | FLAGS_PLUS);
-    // might need to right-pad spaces
-    if (flags & FLAGS_LEFT) {
-      while (idx - start_idx < width) out(' ', buffer, idx++, maxlen);
-    }
+  idx = _ftoa_dig(out, buffer, idx, maxlen, negative, dig, n, 1, prec, fwidth, flags & ~FLAGS_ADAPT_EXP);
+
+  // output the exponential symbol
+  out((flags & FLAGS_UPPERCASE) ? 'E' : 'e', buffer, idx++, maxlen);
+  // output the exponent value
+  idx = _ntoa_long(out, buffer, idx, maxlen, (expval < 0) ? -expval : expval, expval < 0, 10, 0, minwidth-1, FLAGS_ZEROPAD | FLAGS_PLUS);
+  // might need to right-pad spaces
+  if (flags & FLAGS_LEFT) {
+    while (idx - start_idx < width) out(' ', buffer, idx++, maxlen);
   }
   return idx;
 }
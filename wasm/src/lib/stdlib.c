@@ -4,6 +4,7 @@
 #include <limits.h>
 #include <string.h>
 
+#include "../error.h"
 #include "../malloc.h"
 #include "../std.h"
 
@@ -17,6 +18,8 @@ void abort(void)
 
 void opa_abort(const char *msg)
 {
+    // recorded first so a host that catches the trap can still read it
+    opa_error_record(msg);
     opa_abort_(msg);
     __builtin_unreachable();
 }
@@ -1,14 +1,62 @@
+#include <stdint.h>
 #include <string.h>
 
 #include "../malloc.h"
 
+#ifdef __wasm_simd128__
+#include <wasm_simd128.h>
+#endif
+
+// The one fast byte-scan primitive in the runtime: sixteen bytes per step
+// with SIMD128 when available, otherwise eight at a time with the
+// word-wise has-zero trick. The lexer's substring searches and the string
+// builtins route their candidate scans through here rather than rolling
+// their own loops.
 void *memchr(const void *src, int c, size_t n)
 {
     const unsigned char *s = src;
+    unsigned char ch = (unsigned char)c;
+
+#ifdef __wasm_simd128__
+    v128_t needle = wasm_i8x16_splat((int8_t)ch);
+
+    while (n >= 16)
+    {
+        v128_t chunk = wasm_v128_load(s);
+        int mask = wasm_i8x16_bitmask(wasm_i8x16_eq(chunk, needle));
+
+        if (mask != 0)
+        {
+            return (void *)(s + __builtin_ctz(mask));
+        }
+
+        s += 16;
+        n -= 16;
+    }
+#else
+    uint64_t pat = 0x0101010101010101ULL * ch;
+
+    while (n >= 8)
+    {
+        uint64_t w;
+        __builtin_memcpy(&w, s, 8); // i64.load for a constant size
+
+        uint64_t x = w ^ pat;
+        uint64_t found = (x - 0x0101010101010101ULL) & ~x & 0x8080808080808080ULL;
+
+        if (found != 0)
+        {
+            return (void *)(s + (__builtin_ctzll(found) >> 3));
+        }
+
+        s += 8;
+        n -= 8;
+    }
+#endif
 
     while (n--)
     {
-        if (*s == (unsigned char)c)
+        if (*s == ch)
         {
             return (void *)s;
         }
@@ -45,6 +93,13 @@ int memcmp(const void *s1, const void *s2, size_t n)
 
 void *memcpy(void *dest, const void *src, size_t n)
 {
+#ifdef __wasm_bulk_memory__
+    // with bulk memory enabled clang lowers this builtin to a single
+    // memory.copy instruction rather than a libcall, so there is no
+    // recursion back into this function.
+    __builtin_memcpy(dest, src, n);
+    return dest;
+#else
     unsigned char *d = dest;
     const unsigned char *s = src;
 
@@ -54,10 +109,17 @@ void *memcpy(void *dest, const void *src, size_t n)
     }
 
     return dest;
+#endif
 }
 
 void *memmove(void *dest, const void *src, size_t n)
 {
+#ifdef __wasm_bulk_memory__
+    // memory.copy has memmove semantics: overlapping ranges are handled
+    // by the instruction, so no bounce buffer is needed.
+    __builtin_memmove(dest, src, n);
+    return dest;
+#else
     unsigned char *d = dest;
     const unsigned char *s = src;
     unsigned char *t = opa_malloc(n);
@@ -75,10 +137,15 @@ void *memmove(void *dest, const void *src, size_t n)
     opa_free(t);
 
     return dest;
+#endif
 }
 
 void *memset(void *s, int c, unsigned long n)
 {
+#ifdef __wasm_bulk_memory__
+    __builtin_memset(s, c, n); // lowered to memory.fill
+    return s;
+#else
     unsigned char *p = (unsigned char *)s;
 
     while (n--)
@@ -87,6 +154,7 @@ void *memset(void *s, int c, unsigned long n)
     }
 
     return s;
+#endif
 }
 
 char *strchr(const char *s, int c)
@@ -0,0 +1,77 @@
+#ifndef OPA_LIBCPP_ARENA_H
+#define OPA_LIBCPP_ARENA_H
+
+#include <string>
+#include <vector>
+
+// Per-call temporaries of the C++ builtins — pattern assembly strings,
+// delimiter vectors and the like — go through a bump arena layered on the
+// general heap, instead of round-tripping every node through operator
+// new's free-list path. A builtin opens an opa_arena_scope on entry; the
+// scope marks the arena and rewinds it on exit, so everything the call
+// allocated is reclaimed with pointer arithmetic. Scopes nest in LIFO
+// order. Objects that outlive the call (cache entries, compiled patterns,
+// opa values) must not use the arena.
+//
+// The arena's chunks live in a builtin cache slot: a heap reset discards
+// them along with everything else on the evaluation heap.
+
+struct opa_arena_mark_t
+{
+    void *chunk;
+    size_t used;
+};
+
+void *opa_arena_alloc(size_t size);
+opa_arena_mark_t opa_arena_mark(void);
+void opa_arena_rewind(opa_arena_mark_t mark);
+
+class opa_arena_scope
+{
+public:
+    opa_arena_scope() : mark(opa_arena_mark()) { }
+    ~opa_arena_scope() { opa_arena_rewind(mark); }
+
+private:
+    opa_arena_mark_t mark;
+};
+
+template <class T>
+struct opa_arena_allocator
+{
+    typedef T value_type;
+
+    opa_arena_allocator() = default;
+
+    template <class U>
+    opa_arena_allocator(const opa_arena_allocator<U>&) { }
+
+    T *allocate(size_t n)
+    {
+        return static_cast<T *>(opa_arena_alloc(n * sizeof(T)));
+    }
+
+    void deallocate(T *, size_t)
+    {
+        // reclaimed wholesale when the enclosing scope rewinds
+    }
+};
+
+template <class T, class U>
+bool operator==(const opa_arena_allocator<T>&, const opa_arena_allocator<U>&)
+{
+    return true;
+}
+
+template <class T, class U>
+bool operator!=(const opa_arena_allocator<T>&, const opa_arena_allocator<U>&)
+{
+    return false;
+}
+
+typedef std::basic_string<char, std::char_traits<char>, opa_arena_allocator<char>> opa_arena_string;
+
+template <class T>
+using opa_arena_vector = std::vector<T, opa_arena_allocator<T>>;
+
+#endif
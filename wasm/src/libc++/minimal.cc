@@ -4,6 +4,7 @@
 
 #include "../std.h"
 #include "../malloc.h"
+#include "arena.h"
 
 void* operator new(size_t size) {
     return opa_malloc(size);
@@ -25,6 +26,109 @@ extern "C" void __cxa_pure_virtual() {
     opa_abort("pure virtual");
 }
 
+// The builtin temporary arena (see arena.h): a chain of chunks carved from
+// the general heap, allocation bumps a pointer in the newest chunk, and
+// scope rewinds return whole chunks to a spare list for reuse. The chain
+// hangs off a builtin cache slot so heap resets drop it.
+
+#define ARENA_CHUNK_SIZE (64 * 1024)
+
+struct arena_chunk {
+    arena_chunk *next;
+    size_t cap;
+    size_t used;
+    // chunk data follows the header
+};
+
+struct arena {
+    arena_chunk *chunks; // newest first; allocation bumps the head
+    arena_chunk *spare;  // rewound chunks kept for reuse
+};
+
+static char *arena_chunk_data(arena_chunk *c) {
+    return reinterpret_cast<char *>(c + 1);
+}
+
+static arena *arena_state() {
+    static size_t slot = opa_builtin_cache_register(NULL);
+
+    arena *a = static_cast<arena *>(opa_builtin_cache_get(slot));
+    if (a == NULL)
+    {
+        a = static_cast<arena *>(opa_malloc(sizeof(arena)));
+        a->chunks = NULL;
+        a->spare = NULL;
+        opa_builtin_cache_set(slot, a);
+    }
+
+    return a;
+}
+
+void *opa_arena_alloc(size_t size) {
+    arena *a = arena_state();
+
+    size = (size + 7) & ~static_cast<size_t>(7);
+
+    arena_chunk *c = a->chunks;
+    if (c == NULL || c->cap - c->used < size)
+    {
+        // Take the first spare that fits, or carve a fresh chunk from the
+        // heap. Oversized requests get a chunk of their own.
+        arena_chunk **prev = &a->spare;
+
+        while (*prev != NULL && (*prev)->cap < size)
+        {
+            prev = &(*prev)->next;
+        }
+
+        if (*prev != NULL)
+        {
+            c = *prev;
+            *prev = c->next;
+        }
+        else
+        {
+            size_t cap = size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE;
+            c = static_cast<arena_chunk *>(opa_malloc(sizeof(arena_chunk) + cap));
+            c->cap = cap;
+        }
+
+        c->used = 0;
+        c->next = a->chunks;
+        a->chunks = c;
+    }
+
+    void *p = arena_chunk_data(c) + c->used;
+    c->used += size;
+    return p;
+}
+
+opa_arena_mark_t opa_arena_mark(void) {
+    arena *a = arena_state();
+    opa_arena_mark_t m;
+
+    m.chunk = a->chunks;
+    m.used = a->chunks != NULL ? a->chunks->used : 0;
+    return m;
+}
+
+void opa_arena_rewind(opa_arena_mark_t m) {
+    arena *a = arena_state();
+
+    while (a->chunks != m.chunk)
+    {
+        arena_chunk *c = a->chunks;
+        a->chunks = c->next;
+        c->next = a->spare;
+        a->spare = c;
+    }
+
+    if (a->chunks != NULL)
+    {
+        a->chunks->used = m.used;
+    }
+}
+
 // Instantiate the minimum set of templates part of standard libc++ ABI.
 // This is required because we do not link with the libc++.
 
@@ -1,4 +1,7 @@
 #include <string.h>
+#include "malloc.h"
+#undef opa_malloc // this file defines the undecorated allocator itself
+#include "printf.h"
 #include "std.h"
 #include "stdlib.h"
 
@@ -7,10 +10,35 @@
 #define ARRAY_SIZE(ARRAY) (sizeof(ARRAY) / sizeof((ARRAY)[0]))
 
 static int initialized;
-static unsigned int heap_ptr;
-static unsigned int heap_top;
+static opa_heap_addr_t heap_ptr;
+static opa_heap_addr_t heap_top;
 extern unsigned char __heap_base; // set by lld
-static void *builtin_cache[8];
+
+// Builtin cache registry. Native builtins keep persistent state — compiled
+// regex programs, parsed globs, the mpd pool, CIDR tries — in slots handed
+// out by opa_builtin_cache_register, one per subsystem, registered lazily
+// on first use. A heap reset reclaims the cached objects' memory with
+// everything else, so the reset clears the slot values (running a slot's
+// teardown hook first, for subsystems with state to drop outside the cache
+// allocation) while the registrations themselves persist.
+#define BUILTIN_CACHE_MAX (32)
+
+static void *builtin_cache[BUILTIN_CACHE_MAX];
+static opa_builtin_cache_teardown_fn builtin_cache_teardown[BUILTIN_CACHE_MAX];
+static size_t builtin_cache_n;
+
+// advances whenever a heap pointer reset or restore discards allocations
+// wholesale. Lazy caches that attach heap pointers to longer-lived values
+// (rune indexes, big-decimal conversions) record the epoch they were built
+// in and treat a mismatch as "the pointed-to memory is gone". Starts at 1
+// so a zeroed epoch field never matches.
+static unsigned int heap_epoch = 1;
+
+// if set, the heap operates as a bump arena: opa_malloc only moves the heap
+// pointer and opa_free is a no-op. The arena is released as a whole by
+// resetting the heap pointer through opa_heap_ptr_set. This is for
+// evaluations known to discard all their temporaries at once.
+static bool heap_bump_arena;
 
 struct heap_block {
     size_t size;
@@ -19,7 +47,8 @@ struct heap_block {
     unsigned char data[0];
 };
 
-// free blocks, ordered per their memory address.
+// free blocks, in no particular order. Coalescing uses boundary tags (see
+// below) instead of address ordering to find physically adjacent blocks.
 struct heap_blocks {
     bool fixed_size;
     size_t size; // if fixed size, this indicates the block size.
@@ -28,10 +57,12 @@ struct heap_blocks {
     struct heap_block end;
 };
 
-// all the free blocks: fixed size blocks of 4, 8, 16 and 64 bytes and then one free
-// list for varying sized blocks of 128 bytes or more.
+// all the free blocks: fixed size blocks of 4, 8, 16 and 64 bytes and then one
+// free list for varying sized blocks of 128 bytes or more. The smallest class
+// is pointer sized: a freed slab node must hold a freelist link, and on the
+// wasm32 target sizeof(void *) is the familiar 4.
 static struct heap_blocks heap_free[5] = {
-    {true, 4},
+    {true, sizeof(void *)},
     {true, 8},
     {true, 16},
     {true, 64},
@@ -44,6 +75,68 @@ static struct heap_blocks heap_free[5] = {
 #define HEAP_CHECK(blocks)
 #endif
 
+#define POOL_SLAB_SIZE (4096)
+
+#define SLAB_PAGE_SIZE (4096)
+#define SLAB_PAGE_MAX (1 << 20) // 4GB of linear memory in 4KB pages; a
+                                // memory64 build raises this with the target
+
+// fixed-class slab page: allocations in the fixed size classes are carved out
+// of page-aligned slabs that record the class once per page. opa_free derives
+// the class from the pointer's page, so the allocations carry no per-
+// allocation header.
+struct slab_page {
+    size_t size;          // the fixed class size served by this page
+    unsigned char *bump;  // next unused node
+    size_t left;          // bytes left for the bump allocator
+};
+
+// one bit per 4KB page of linear memory: set if the page is a live slab page.
+// This is the authority consulted by opa_free, so stale slab headers left
+// behind by a heap pointer reset cannot be mistaken for live pages.
+static unsigned char slab_page_map[SLAB_PAGE_MAX / 8];
+static size_t slab_page_high; // highest page index ever marked, plus one
+
+// per fixed class: freed nodes for reuse and the page currently bump-allocated
+// from. Freelist links are stored in the nodes themselves, as addresses.
+static opa_heap_addr_t slab_freelist[ARRAY_SIZE(heap_free) - 1];
+static struct slab_page *slab_current[ARRAY_SIZE(heap_free) - 1];
+
+// slab pools for small fixed-size nodes, e.g., object and set elements.
+// Nodes are carved out of page-sized slabs and carry no per-node header;
+// freed nodes are kept in a per-pool freelist, linked through their first
+// word. The pools are released wholesale when the heap pointer is reset.
+struct heap_pool {
+    size_t size;          // node size; 0 if the pool slot is unused
+    void *freelist;       // freed nodes available for reuse
+    unsigned char *slab;  // bump position within the current slab
+    size_t slab_left;     // bytes left in the current slab
+};
+
+static struct heap_pool heap_pools[4];
+
+// Cooperative evaluation metering. The host arms a byte budget before an
+// evaluation and every opa_malloc charges the bytes it hands out; a spent
+// budget traps through opa_abort with a distinguishable message. Checking
+// at allocation boundaries costs one compare in the steady state and still
+// bounds runaway evaluations: unbounded work in the runtime — container
+// growth in value.c included — allocates as it goes.
+static size_t heap_fuel;
+static bool heap_fuel_armed;
+
+// allocation statistics, exported for instrumentation. The high-water mark
+// tracks the peak heap pointer and is rearmed by a heap pointer reset, so it
+// reports per-eval peak usage under the SDK's reset-per-eval pattern.
+static struct {
+    size_t alloc_bytes;        // bytes currently allocated (net)
+    unsigned int alloc_count;
+    unsigned int free_count;
+    opa_heap_addr_t high_water; // peak heap pointer since the last reset
+    unsigned int grow_pages;   // linear memory pages grown
+    unsigned int class_alloc[ARRAY_SIZE(heap_free)];
+    unsigned int class_free[ARRAY_SIZE(heap_free)];
+} heap_stats;
+
 static void init_free()
 {
     for (int i = 0; i < ARRAY_SIZE(heap_free); i++) {
@@ -51,10 +144,34 @@ static void init_free()
         heap_free[i].end = (struct heap_block) { 0, &heap_free[i].start, NULL };
     }
 
-    for (int i = 0; i < ARRAY_SIZE(builtin_cache); i++)
+    for (int i = 0; i < ARRAY_SIZE(heap_pools); i++)
+    {
+        heap_pools[i] = (struct heap_pool) { 0, NULL, NULL, 0 };
+    }
+
+    for (int i = 0; i < ARRAY_SIZE(slab_freelist); i++)
+    {
+        slab_freelist[i] = 0;
+        slab_current[i] = NULL;
+    }
+
+    // Slab pages above the heap pointer are gone; pages below it persist.
+    for (size_t i = (heap_ptr + SLAB_PAGE_SIZE - 1) / SLAB_PAGE_SIZE; i < slab_page_high; i++)
+    {
+        slab_page_map[i / 8] &= ~(1 << (i % 8));
+    }
+
+    for (size_t i = 0; i < builtin_cache_n; i++)
     {
+        if (builtin_cache[i] != NULL && builtin_cache_teardown[i] != NULL)
+        {
+            builtin_cache_teardown[i](builtin_cache[i]);
+        }
+
         builtin_cache[i] = NULL;
     }
+
+    heap_epoch++;
 }
 
 static void heap_check(const char *name, struct heap_blocks *blocks)
@@ -75,69 +192,152 @@ static void heap_check(const char *name, struct heap_blocks *blocks)
     }
 }
 
-// try removing the last block(s) from the free list and adjusting the heap pointer accordingly.
-static bool compact_free(struct heap_blocks *blocks)
+// checks that a pointer stored in a block header plausibly refers to a free
+// list sentinel or a block header within the heap, i.e., that it is safe to
+// dereference.
+static bool __opa_block_ptr_valid(struct heap_block *b)
 {
-    struct heap_block *start = &blocks->start;
-    struct heap_block *end = &blocks->end;
-    unsigned int old_heap_ptr = heap_ptr;
+    void *p = (void *)b;
 
-    while (1)
+    if ((void *)&heap_free[0] <= p && p < (void *)&heap_free[ARRAY_SIZE(heap_free)])
     {
-        struct heap_block *last = end->prev;
+        return true;
+    }
 
-        if (last == start)
-        {
-            break;
-        }
+    return (void *)&__heap_base <= p && (p + sizeof(struct heap_block)) <= (void *)heap_ptr;
+}
 
-        if (((void *)(&last->data[0]) + last->size) != (void *)heap_ptr)
-        {
-            break;
-        }
+// checks that a candidate block header within the heap is a live free block:
+// its extent stays within the heap and it is linked into one of the free
+// lists. Allocated blocks have NULL links and fail the check, as do stale
+// headers left behind by a heap pointer reset.
+static bool __opa_free_block_valid(struct heap_block *b)
+{
+    opa_heap_addr_t data = (opa_heap_addr_t)b + sizeof(struct heap_block);
 
-        heap_ptr -= sizeof(struct heap_block) + last->size;
-        last->prev->next = end;
-        end->prev = last->prev;
+    if ((void *)b < (void *)&__heap_base || data > heap_ptr || b->size > heap_ptr - data)
+    {
+        return false;
     }
 
-    HEAP_CHECK(blocks);
-    return old_heap_ptr != heap_ptr;
+    return __opa_block_ptr_valid(b->prev) && __opa_block_ptr_valid(b->next) &&
+        b->prev->next == b && b->next->prev == b;
+}
+
+// writes the boundary tag of a free block: the last word of the block points
+// back to the block header so that the free block ending at a given address
+// can be found in constant time when coalescing.
+static void __opa_block_tag(struct heap_block *b)
+{
+    opa_heap_addr_t *footer = (void *)(&b->data[0]) + b->size - sizeof(opa_heap_addr_t);
+    *footer = (opa_heap_addr_t)b;
+}
+
+// returns the free block ending exactly at the given address, if any. The
+// boundary tag below the address is only a hint: it is validated as a linked
+// free block of the right extent before use.
+static struct heap_block *__opa_free_block_before(void *addr)
+{
+    opa_heap_addr_t *footer = addr - sizeof(opa_heap_addr_t);
+    struct heap_block *b = (void *)*footer;
+
+    if ((void *)b < (void *)&__heap_base || ((void *)b + sizeof(struct heap_block)) > addr)
+    {
+        return NULL;
+    }
+
+    if (!__opa_free_block_valid(b) || ((void *)(&b->data[0]) + b->size) != addr)
+    {
+        return NULL;
+    }
+
+    return b;
+}
+
+static void __opa_block_unlink(struct heap_block *b)
+{
+    b->prev->next = b->next;
+    b->next->prev = b->prev;
+    b->prev = NULL;
+    b->next = NULL;
+}
+
+static void __opa_block_push(struct heap_blocks *blocks, struct heap_block *b)
+{
+    b->prev = &blocks->start;
+    b->next = blocks->start.next;
+    b->prev->next = b;
+    b->next->prev = b;
+    __opa_block_tag(b);
+}
+
+// returns the block and any free blocks immediately below it back to the heap
+// by lowering the heap pointer.
+static void __opa_heap_release(struct heap_block *b)
+{
+    heap_ptr = (opa_heap_addr_t)b;
+
+    for (b = __opa_free_block_before((void *)heap_ptr); b != NULL;
+         b = __opa_free_block_before((void *)heap_ptr))
+    {
+        __opa_block_unlink(b);
+        heap_ptr = (opa_heap_addr_t)b;
+    }
+}
+
+// moves the heap pointer forward, growing the linear memory as needed and
+// maintaining the high-water mark.
+static void __opa_heap_ptr_grow(opa_heap_addr_t ptr)
+{
+    heap_ptr = ptr;
+
+    if (heap_ptr >= heap_top)
+    {
+        unsigned int pages = (unsigned int)((heap_ptr - heap_top) / WASM_PAGE_SIZE) + 1;
+        __builtin_wasm_memory_grow(0, pages);
+        heap_top += (pages * WASM_PAGE_SIZE);
+        heap_stats.grow_pages += pages;
+    }
+
+    if (heap_ptr > heap_stats.high_water)
+    {
+        heap_stats.high_water = heap_ptr;
+    }
 }
 
 static void init(void)
 {
     if (!initialized)
     {
-        heap_ptr = (unsigned int)&__heap_base;
+        heap_ptr = (opa_heap_addr_t)&__heap_base;
         heap_top = __builtin_wasm_memory_grow(0, 0) * WASM_PAGE_SIZE;
         init_free();
         initialized = 1;
     }
 }
 
-static struct heap_block * __opa_malloc_reuse_fixed(struct heap_blocks *blocks);
 static struct heap_block * __opa_malloc_reuse_varying(struct heap_blocks *blocks, size_t size);
 
 WASM_EXPORT(opa_heap_ptr_get)
-unsigned int opa_heap_ptr_get(void)
+opa_heap_addr_t opa_heap_ptr_get(void)
 {
     return heap_ptr;
 }
 
-unsigned int opa_heap_top_get(void)
+opa_heap_addr_t opa_heap_top_get(void)
 {
     return heap_top;
 }
 
 WASM_EXPORT(opa_heap_ptr_set)
-void opa_heap_ptr_set(unsigned int ptr)
+void opa_heap_ptr_set(opa_heap_addr_t ptr)
 {
     heap_ptr = ptr;
+    heap_stats.high_water = ptr;
     init_free();
 }
 
-void opa_heap_top_set(unsigned int top)
+void opa_heap_top_set(opa_heap_addr_t top)
 {
     heap_top = top;
     init_free();
@@ -159,16 +359,8 @@ static struct heap_blocks * __opa_blocks(size_t size) {
 
 static void *__opa_malloc_new_allocation(size_t size)
 {
-    unsigned int ptr = heap_ptr;
-    size_t block_size = sizeof(struct heap_block) + size;
-    heap_ptr += block_size;
-
-    if (heap_ptr >= heap_top)
-    {
-        unsigned int pages = (block_size / WASM_PAGE_SIZE) + 1;
-        __builtin_wasm_memory_grow(0, pages);
-        heap_top += (pages * WASM_PAGE_SIZE);
-    }
+    opa_heap_addr_t ptr = heap_ptr;
+    __opa_heap_ptr_grow(heap_ptr + sizeof(struct heap_block) + size);
 
     struct heap_block *b = (void *)ptr;
     b->size = size;
@@ -178,52 +370,298 @@ static void *__opa_malloc_new_allocation(size_t size)
     return b->data;
 }
 
-WASM_EXPORT(opa_malloc)
-void *opa_malloc(size_t size)
+// allocates a new page-aligned slab page for the given fixed class, directly
+// from the heap pointer. Slab pages carry no heap block header: they are
+// reclaimed wholesale by a heap pointer reset.
+static struct slab_page *__opa_slab_page_new(size_t size)
+{
+    opa_heap_addr_t ptr = (heap_ptr + SLAB_PAGE_SIZE - 1) & ~(opa_heap_addr_t)(SLAB_PAGE_SIZE - 1);
+    __opa_heap_ptr_grow(ptr + SLAB_PAGE_SIZE);
+
+    struct slab_page *pg = (void *)ptr;
+    pg->size = size;
+    pg->bump = (unsigned char *)(pg + 1);
+    pg->left = SLAB_PAGE_SIZE - sizeof(struct slab_page);
+
+    size_t i = ptr / SLAB_PAGE_SIZE;
+    slab_page_map[i / 8] |= 1 << (i % 8);
+
+    if (i + 1 > slab_page_high)
+    {
+        slab_page_high = i + 1;
+    }
+
+    return pg;
+}
+
+// returns the live slab page containing the pointer, or NULL if the pointer
+// was not allocated from a slab page.
+static struct slab_page *__opa_slab_page(void *ptr)
+{
+    size_t i = (opa_heap_addr_t)ptr / SLAB_PAGE_SIZE;
+
+    if (!(slab_page_map[i / 8] & (1 << (i % 8))))
+    {
+        return NULL;
+    }
+
+    return (void *)(i * SLAB_PAGE_SIZE);
+}
+
+static void *__opa_slab_malloc(int class)
+{
+    if (slab_freelist[class] != 0)
+    {
+        void *node = (void *)slab_freelist[class];
+        slab_freelist[class] = *(opa_heap_addr_t *)node;
+        return node;
+    }
+
+    size_t size = heap_free[class].size;
+    struct slab_page *pg = slab_current[class];
+
+    if (pg == NULL || pg->left < size)
+    {
+        pg = __opa_slab_page_new(size);
+        slab_current[class] = pg;
+    }
+
+    void *node = pg->bump;
+    pg->bump += size;
+    pg->left -= size;
+    return node;
+}
+
+static void __opa_slab_free(struct slab_page *pg, void *ptr)
+{
+    for (int i = 0; i < ARRAY_SIZE(slab_freelist); i++)
+    {
+        if (heap_free[i].size == pg->size)
+        {
+            *(opa_heap_addr_t *)ptr = slab_freelist[i];
+            slab_freelist[i] = (opa_heap_addr_t)ptr;
+            return;
+        }
+    }
+
+    opa_abort("opa_free: corrupted slab page");
+}
+
+WASM_EXPORT(opa_heap_save)
+opa_heap_addr_t opa_heap_save(void)
 {
     init();
+    return heap_ptr;
+}
 
-    // Look for the first free block that is large enough. Split the found block if necessary.
+// pops the heap back to a mark returned by opa_heap_save. Unlike
+// opa_heap_ptr_set, allocator state below the mark — free lists, slab pages
+// and pools — survives, so saved regions can be layered (data document,
+// per-request input, scratch) without re-building them.
+WASM_EXPORT(opa_heap_restore)
+void opa_heap_restore(opa_heap_addr_t token)
+{
+    init();
 
-    struct heap_blocks *blocks = __opa_blocks(size);
-    HEAP_CHECK(blocks);
+    if (token > heap_ptr)
+    {
+        opa_abort("opa_heap_restore: invalid token");
+    }
 
-    struct heap_block *b = blocks->fixed_size ?
-        __opa_malloc_reuse_fixed(blocks) : __opa_malloc_reuse_varying(blocks, size);
-    if (b != NULL)
+    // Unlink free blocks reaching at or above the mark. A block below the
+    // mark can cross it if it coalesced with a neighbor freed after the
+    // save, so prune by extent, not by header address.
+
+    for (int i = 0; i < ARRAY_SIZE(heap_free); i++)
     {
-        return b->data;
+        for (struct heap_block *b = heap_free[i].start.next, *next; b != &heap_free[i].end; b = next)
+        {
+            next = b->next;
+
+            if (((opa_heap_addr_t)&b->data[0]) + b->size > token)
+            {
+                __opa_block_unlink(b);
+            }
+        }
     }
 
-    // Allocate a new block.
+    // Drop freed slab nodes above the mark; nodes below it remain reusable.
 
-    if (blocks->fixed_size)
+    for (int i = 0; i < ARRAY_SIZE(slab_freelist); i++)
     {
-        size = blocks->size;
+        opa_heap_addr_t *prev = &slab_freelist[i];
+
+        for (opa_heap_addr_t n = *prev; n != 0; n = *prev)
+        {
+            if (n >= token)
+            {
+                *prev = *(opa_heap_addr_t *)n;
+            }
+            else
+            {
+                prev = (opa_heap_addr_t *)n;
+            }
+        }
+
+        if (slab_current[i] != NULL && (opa_heap_addr_t)slab_current[i] >= token)
+        {
+            slab_current[i] = NULL;
+        }
     }
 
-    return __opa_malloc_new_allocation(size);
+    for (int i = 0; i < ARRAY_SIZE(heap_pools); i++)
+    {
+        void **prev = &heap_pools[i].freelist;
+
+        for (void *n = *prev; n != NULL; n = *prev)
+        {
+            if ((opa_heap_addr_t)n >= token)
+            {
+                *prev = *(void **)n;
+            }
+            else
+            {
+                prev = (void **)n;
+            }
+        }
+
+        if (heap_pools[i].slab != NULL && (opa_heap_addr_t)heap_pools[i].slab >= token)
+        {
+            heap_pools[i].slab = NULL;
+            heap_pools[i].slab_left = 0;
+        }
+    }
+
+    heap_ptr = token;
+    heap_stats.high_water = token;
+
+    // Slab pages above the mark are gone.
+
+    for (size_t i = (heap_ptr + SLAB_PAGE_SIZE - 1) / SLAB_PAGE_SIZE; i < slab_page_high; i++)
+    {
+        slab_page_map[i / 8] &= ~(1 << (i % 8));
+    }
+
+    heap_epoch++;
 }
 
-// returns a free block from the list, if available.
-static struct heap_block * __opa_malloc_reuse_fixed(struct heap_blocks *blocks)
+WASM_EXPORT(opa_heap_bump_set)
+void opa_heap_bump_set(bool enabled)
 {
-    struct heap_block *end = &blocks->end;
-    struct heap_block *b = blocks->start.next;
+    heap_bump_arena = enabled;
+}
+
+bool opa_heap_bump_get(void)
+{
+    return heap_bump_arena;
+}
+
+// arms the evaluation fuel meter with a budget of allocatable bytes; zero
+// disarms it. Exhausting the budget aborts the running evaluation, so the
+// host must tear down or reinitialize the instance afterwards as usual.
+WASM_EXPORT(opa_heap_fuel_set)
+void opa_heap_fuel_set(size_t budget)
+{
+    heap_fuel = budget;
+    heap_fuel_armed = budget != 0;
+}
+
+WASM_EXPORT(opa_heap_fuel_get)
+size_t opa_heap_fuel_get(void)
+{
+    return heap_fuel;
+}
+
+WASM_EXPORT(opa_heap_alloc_bytes_get)
+size_t opa_heap_alloc_bytes_get(void)
+{
+    return heap_stats.alloc_bytes;
+}
+
+WASM_EXPORT(opa_heap_alloc_count_get)
+unsigned int opa_heap_alloc_count_get(void)
+{
+    return heap_stats.alloc_count;
+}
+
+WASM_EXPORT(opa_heap_free_count_get)
+unsigned int opa_heap_free_count_get(void)
+{
+    return heap_stats.free_count;
+}
+
+WASM_EXPORT(opa_heap_high_water_get)
+opa_heap_addr_t opa_heap_high_water_get(void)
+{
+    return heap_stats.high_water;
+}
 
-    if (b != end)
+WASM_EXPORT(opa_heap_grow_pages_get)
+unsigned int opa_heap_grow_pages_get(void)
+{
+    return heap_stats.grow_pages;
+}
+
+WASM_EXPORT(opa_heap_class_alloc_count_get)
+unsigned int opa_heap_class_alloc_count_get(size_t i)
+{
+    return i < ARRAY_SIZE(heap_free) ? heap_stats.class_alloc[i] : 0;
+}
+
+WASM_EXPORT(opa_heap_class_free_count_get)
+unsigned int opa_heap_class_free_count_get(size_t i)
+{
+    return i < ARRAY_SIZE(heap_free) ? heap_stats.class_free[i] : 0;
+}
+
+WASM_EXPORT(opa_malloc)
+void *opa_malloc(size_t size)
+{
+    init();
+
+    struct heap_blocks *blocks = __opa_blocks(size);
+
+    size_t charged = blocks->fixed_size ? blocks->size : size;
+
+    heap_stats.alloc_count++;
+    heap_stats.class_alloc[blocks - &heap_free[0]]++;
+    heap_stats.alloc_bytes += charged;
+
+    if (heap_fuel_armed)
     {
-        b->prev->next = b->next;
-        b->next->prev = b->prev;
-        b->prev = NULL;
-        b->next = NULL;
+        if (charged > heap_fuel)
+        {
+            opa_abort("opa_malloc: evaluation fuel exhausted");
+        }
 
-        HEAP_CHECK(blocks);
+        heap_fuel -= charged;
+    }
 
-        return b;
+    if (heap_bump_arena)
+    {
+        return __opa_malloc_new_allocation(size);
     }
 
-    return NULL;
+    // Serve the fixed size classes from the header-less slab pages.
+
+    if (blocks->fixed_size)
+    {
+        return __opa_slab_malloc(blocks - &heap_free[0]);
+    }
+
+    HEAP_CHECK(blocks);
+
+    // Look for the first free block that is large enough. Split the found block if necessary.
+
+    struct heap_block *b = __opa_malloc_reuse_varying(blocks, size);
+    if (b != NULL)
+    {
+        return b->data;
+    }
+
+    // Allocate a new block.
+
+    return __opa_malloc_new_allocation(size);
 }
 
 // finds a free block at least of given size, splitting the found block if the remaining block exceeds the minimum size.
@@ -243,6 +681,7 @@ static struct heap_block * __opa_malloc_reuse_varying(struct heap_blocks *blocks
             remaining->next = b->next;
             remaining->prev->next = remaining;
             remaining->next->prev = remaining;
+            __opa_block_tag(remaining);
 
             b->size = size;
             b->prev = NULL;
@@ -269,14 +708,35 @@ static struct heap_block * __opa_malloc_reuse_varying(struct heap_blocks *blocks
 WASM_EXPORT(opa_free)
 void opa_free(void *ptr)
 {
-    struct heap_block *block = ptr - sizeof(struct heap_block);
+    if (heap_bump_arena)
+    {
+        return;
+    }
 
 #ifdef DEBUG
     if (ptr == NULL)
     {
         opa_abort("opa_free: null pointer");
     }
+#endif
+
+    // Fixed class allocations live on slab pages and have no header: the
+    // class is derived from the page.
+
+    struct slab_page *pg = __opa_slab_page(ptr);
+
+    if (pg != NULL)
+    {
+        heap_stats.free_count++;
+        heap_stats.class_free[__opa_blocks(pg->size) - &heap_free[0]]++;
+        heap_stats.alloc_bytes -= pg->size;
+        __opa_slab_free(pg, ptr);
+        return;
+    }
 
+    struct heap_block *block = ptr - sizeof(struct heap_block);
+
+#ifdef DEBUG
     if (block->prev != NULL || block->next != NULL)
     {
         opa_abort("opa_free: double free");
@@ -284,74 +744,250 @@ void opa_free(void *ptr)
 #endif
 
     struct heap_blocks *blocks = __opa_blocks(block->size);
-    struct heap_block *start = &blocks->start;
-    struct heap_block *end = &blocks->end;
-    bool fixed_size = blocks->fixed_size;
+
+    heap_stats.free_count++;
+    heap_stats.class_free[blocks - &heap_free[0]]++;
+    heap_stats.alloc_bytes -= block->size;
 
     HEAP_CHECK(blocks);
 
-    // Find the free block available just before this block and try to
-    // defragment, by trying to merge with this block with the found
-    // block and the one after.
+    // A block ending at the heap pointer is returned to the heap right away,
+    // together with any free blocks immediately below it.
 
-    struct heap_block *prev = start;
-    for (struct heap_block *b = prev->next; b < block && b != end; prev = b, b = b->next);
+    if (((void *)(&block->data[0]) + block->size) == (void *)heap_ptr)
+    {
+        __opa_heap_release(block);
+        return;
+    }
+
+    // Defragment by merging with the physically adjacent free blocks, found
+    // in constant time through the boundary tags.
 
-    if (!fixed_size)
+    if (!blocks->fixed_size)
     {
-        struct heap_block *prev_end = (void *)(&prev->data[0]) + prev->size;
-        struct heap_block *block_end = (void *)(&block->data[0]) + block->size;
+        struct heap_block *next = (void *)(&block->data[0]) + block->size;
 
-        if (prev_end == block)
+        if (__opa_free_block_valid(next))
         {
+            __opa_block_unlink(next);
+            block->size += sizeof(struct heap_block) + next->size;
+        }
+
+        struct heap_block *prev = __opa_free_block_before((void *)block);
+
+        if (prev != NULL)
+        {
+            __opa_block_unlink(prev);
             prev->size += sizeof(struct heap_block) + block->size;
-            compact_free(blocks);
-            return;
+            block = prev;
         }
+    }
+
+    // List the block as free.
+
+    blocks = __opa_blocks(block->size);
+    __opa_block_push(blocks, block);
+    HEAP_CHECK(blocks);
+}
+
+// returns the pool serving nodes of the given size, claiming an unused pool
+// slot if the size has not been seen before. Returns NULL if all slots serve
+// other sizes.
+static struct heap_pool *__opa_pool(size_t size)
+{
+    if (size < sizeof(void *))
+    {
+        size = sizeof(void *);
+    }
 
-        if (block_end == prev->next)
+    for (int i = 0; i < ARRAY_SIZE(heap_pools); i++)
+    {
+        if (heap_pools[i].size == size)
         {
-            struct heap_block *next = prev->next;
-            block->prev = prev;
-            block->next = next->next;
-            block->size += sizeof(struct heap_block) + next->size;
+            return &heap_pools[i];
+        }
 
-            prev->next = block;
-            block->next->prev = block;
-            compact_free(blocks);
-            return;
+        if (heap_pools[i].size == 0)
+        {
+            heap_pools[i].size = size;
+            return &heap_pools[i];
         }
     }
 
-    // List the block as free.
+    return NULL;
+}
+
+// allocates a fixed-size node from a slab pool. Unlike opa_malloc, the
+// returned node carries no heap block header; it must be released with
+// opa_free_node and the same size.
+void *opa_malloc_node(size_t size)
+{
+    init();
+
+    struct heap_pool *p = __opa_pool(size);
+
+    if (p == NULL)
+    {
+        return opa_malloc(size);
+    }
+
+    if (p->freelist != NULL)
+    {
+        void *node = p->freelist;
+        p->freelist = *(void **)node;
+        return node;
+    }
+
+    if (p->slab_left < p->size)
+    {
+        p->slab = opa_malloc(POOL_SLAB_SIZE);
+        p->slab_left = POOL_SLAB_SIZE;
+    }
+
+    void *node = p->slab;
+    p->slab += p->size;
+    p->slab_left -= p->size;
+    return node;
+}
+
+// returns a node allocated with opa_malloc_node to its pool.
+void opa_free_node(void *ptr, size_t size)
+{
+    struct heap_pool *p = __opa_pool(size);
 
-    block->prev = prev;
-    block->next = prev->next;
-    prev->next = block;
-    block->next->prev = block;
-    compact_free(blocks);
+    if (p == NULL)
+    {
+        opa_free(ptr);
+        return;
+    }
+
+    *(void **)ptr = p->freelist;
+    p->freelist = ptr;
 }
 
 void *opa_realloc(void *ptr, size_t size)
 {
-    struct heap_block *block = ptr - sizeof(struct heap_block);
+    struct slab_page *pg = __opa_slab_page(ptr);
+
+    if (pg != NULL)
+    {
+        // Slab nodes cannot grow, but the node already accommodates any
+        // request within its class.
+
+        if (size <= pg->size)
+        {
+            return ptr;
+        }
+    }
+    else
+    {
+        struct heap_block *block = ptr - sizeof(struct heap_block);
+
+        if (size <= block->size)
+        {
+            // Shrink in place: split the tail off when it is large enough to
+            // stand on its own, keeping the shrunk block in the varying
+            // class. A tail ending at the heap pointer goes straight back to
+            // the heap instead of the free list.
+
+            size_t min_size = heap_free[ARRAY_SIZE(heap_free)-1].size;
+
+            if (!heap_bump_arena && size >= min_size &&
+                block->size >= (size + sizeof(struct heap_block) + min_size))
+            {
+                struct heap_block *remaining = (void *)(&block->data[0]) + size;
+                remaining->size = block->size - (sizeof(struct heap_block) + size);
+                heap_stats.alloc_bytes -= block->size - size;
+                block->size = size;
+
+                if (((void *)(&remaining->data[0]) + remaining->size) == (void *)heap_ptr)
+                {
+                    heap_ptr = (opa_heap_addr_t)remaining;
+                }
+                else
+                {
+                    __opa_block_push(__opa_blocks(remaining->size), remaining);
+                }
+            }
+
+            return ptr;
+        }
+
+        // Grow in place: a block at the end of the heap extends by moving
+        // the heap pointer.
+
+        if (((void *)(&block->data[0]) + block->size) == (void *)heap_ptr)
+        {
+            heap_stats.alloc_bytes += size - block->size;
+            __opa_heap_ptr_grow(heap_ptr + (size - block->size));
+            block->size = size;
+            return ptr;
+        }
+
+        // Or absorb a trailing free block, splitting off the excess if it
+        // still makes a minimum sized block.
+
+        struct heap_block *next = (void *)(&block->data[0]) + block->size;
+
+        if (!heap_bump_arena && __opa_free_block_valid(next) &&
+            (block->size + sizeof(struct heap_block) + next->size) >= size)
+        {
+            __opa_block_unlink(next);
+            block->size += sizeof(struct heap_block) + next->size;
+
+            size_t min_size = heap_free[ARRAY_SIZE(heap_free)-1].size;
+
+            if (block->size >= (size + sizeof(struct heap_block) + min_size))
+            {
+                struct heap_block *remaining = (void *)(&block->data[0]) + size;
+                remaining->size = block->size - (sizeof(struct heap_block) + size);
+                block->size = size;
+                __opa_block_push(__opa_blocks(remaining->size), remaining);
+            }
+
+            return ptr;
+        }
+    }
+
+    size_t old = pg != NULL ? pg->size : ((struct heap_block *)(ptr - sizeof(struct heap_block)))->size;
     void *p = opa_malloc(size);
 
-    memcpy(p, ptr, block->size < size ? block->size : size);
+    memcpy(p, ptr, old < size ? old : size);
     opa_free(ptr);
     return p;
 }
 
 static void **__opa_builtin_cache(size_t i)
 {
-    if (i >= ARRAY_SIZE(builtin_cache))
+    if (i >= builtin_cache_n)
     {
-        opa_abort("opa_malloc: illegal builtin cache index");
+        opa_abort("opa_malloc: unregistered builtin cache slot");
     }
 
     return &builtin_cache[i];
 }
 
+// Hands out the next free slot. The teardown hook may be NULL; it runs on
+// every heap reset while the slot holds a cache, and must not free heap
+// memory — the reset reclaims that wholesale — only drop state the
+// subsystem keeps outside the cache allocation.
+size_t opa_builtin_cache_register(opa_builtin_cache_teardown_fn teardown)
+{
+    if (builtin_cache_n == BUILTIN_CACHE_MAX)
+    {
+        opa_abort("opa_malloc: too many builtin caches");
+    }
+
+    builtin_cache[builtin_cache_n] = NULL;
+    builtin_cache_teardown[builtin_cache_n] = teardown;
+    return builtin_cache_n++;
+}
+
+unsigned int opa_heap_epoch(void)
+{
+    return heap_epoch;
+}
+
 void *opa_builtin_cache_get(size_t i)
 {
     return *__opa_builtin_cache(i);
@@ -362,16 +998,236 @@ void opa_builtin_cache_set(size_t i, void *p)
     *__opa_builtin_cache(i) = p;
 }
 
-// Compact all the free blocks. This is for testing only.
+// Per-eval scratch stack. Builtins that build an intermediate buffer and
+// free it before returning pay free-list bookkeeping twice per call; a
+// scratch allocation is a pointer bump off a chunk instead, released in
+// one opa_scratch_reset at builtin return. The chunk chain hangs off a
+// builtin cache slot, so a heap reset reclaims it with everything else and
+// clears the slot. Spill chunks from oversized calls go back to the heap
+// on reset; the newest chunk stays hot for the next builtin.
+#define OPA_SCRATCH_CHUNK (16 * 1024)
+
+struct opa_scratch_chunk {
+    struct opa_scratch_chunk *prev;
+    size_t cap;
+    size_t used;
+};
+
+#define OPA_SCRATCH_HDR ((sizeof(struct opa_scratch_chunk) + 7) & ~(size_t)7)
+
+static size_t opa_scratch_slot = OPA_BUILTIN_CACHE_UNREGISTERED;
+
+void *opa_scratch_alloc(size_t size)
+{
+    if (opa_scratch_slot == OPA_BUILTIN_CACHE_UNREGISTERED)
+    {
+        opa_scratch_slot = opa_builtin_cache_register(NULL);
+    }
+
+    struct opa_scratch_chunk *head = (struct opa_scratch_chunk *)opa_builtin_cache_get(opa_scratch_slot);
+
+    size = (size + 7) & ~(size_t)7;
+
+    if (head == NULL || head->cap - head->used < size)
+    {
+        size_t cap = size > OPA_SCRATCH_CHUNK ? size : OPA_SCRATCH_CHUNK;
+        struct opa_scratch_chunk *c = (struct opa_scratch_chunk *)opa_malloc(OPA_SCRATCH_HDR + cap);
+
+        c->prev = head;
+        c->cap = cap;
+        c->used = 0;
+        opa_builtin_cache_set(opa_scratch_slot, c);
+        head = c;
+    }
+
+    void *p = (char *)head + OPA_SCRATCH_HDR + head->used;
+    head->used += size;
+    return p;
+}
+
+void opa_scratch_reset(void)
+{
+    if (opa_scratch_slot == OPA_BUILTIN_CACHE_UNREGISTERED)
+    {
+        return;
+    }
+
+    struct opa_scratch_chunk *head = (struct opa_scratch_chunk *)opa_builtin_cache_get(opa_scratch_slot);
+
+    if (head == NULL)
+    {
+        return;
+    }
+
+    while (head->prev != NULL)
+    {
+        struct opa_scratch_chunk *prev = head->prev;
+        head->prev = prev->prev;
+        opa_free(prev);
+    }
+
+    head->used = 0;
+}
+
+#ifdef HEAP_PROFILE
+#include "printf.h"
+#include "string.h"
+
+// allocation-site profile: allocation counts and bytes keyed by the
+// __FILE__:__LINE__ literal captured by the opa_malloc macro in malloc.h.
+// Wasm offers no return addresses, so the macro is the closest equivalent.
+// Pointer identity suffices as the key: each expansion yields its own
+// literal.
+struct heap_profile_site {
+    const char *site;
+    unsigned int count;
+    unsigned int bytes;
+};
+
+#define HEAP_PROFILE_SITES (256)
+static struct heap_profile_site heap_profile[HEAP_PROFILE_SITES];
+
+void *opa_malloc_site(size_t size, const char *site)
+{
+    for (int i = 0; i < HEAP_PROFILE_SITES; i++)
+    {
+        if (heap_profile[i].site == site || heap_profile[i].site == NULL)
+        {
+            heap_profile[i].site = site;
+            heap_profile[i].count++;
+            heap_profile[i].bytes += size;
+            break;
+        }
+    }
+
+    return opa_malloc(size);
+}
+
+// dumps the profile as a JSON object mapping call sites to their counts and
+// bytes. The returned string is heap allocated.
+WASM_EXPORT(opa_heap_profile_dump)
+char *opa_heap_profile_dump(void)
+{
+    size_t cap = 2;
+
+    for (int i = 0; i < HEAP_PROFILE_SITES && heap_profile[i].site != NULL; i++)
+    {
+        cap += strlen(heap_profile[i].site) + 64;
+    }
+
+    char *buf = opa_malloc(cap);
+    size_t n = 0;
+
+    buf[n++] = '{';
+
+    for (int i = 0; i < HEAP_PROFILE_SITES && heap_profile[i].site != NULL; i++)
+    {
+        n += snprintf(&buf[n], cap - n, "%s\"%s\":{\"count\":%u,\"bytes\":%u}",
+                      i > 0 ? "," : "", heap_profile[i].site,
+                      heap_profile[i].count, heap_profile[i].bytes);
+    }
+
+    buf[n++] = '}';
+    buf[n] = '\0';
+    return buf;
+}
+#endif
+
+// Return free blocks at the top of the heap back to the heap, lowering the
+// heap pointer. A single sweep suffices: at most one free block ends at the
+// heap pointer and __opa_heap_release cascades through any free blocks
+// immediately below it via their boundary tags.
+WASM_EXPORT(opa_heap_compact)
 void opa_heap_compact(void)
 {
-    for (bool progress = true; progress; )
+    for (int i = 0; i < ARRAY_SIZE(heap_free); i++) {
+        for (struct heap_block *b = heap_free[i].start.next; b != &heap_free[i].end; b = b->next)
+        {
+            if (((void *)(&b->data[0]) + b->size) == (void *)heap_ptr)
+            {
+                __opa_block_unlink(b);
+                __opa_heap_release(b);
+                return;
+            }
+        }
+    }
+}
+
+// dumps free-space diagnostics as JSON: the heap pointer and top, and per
+// free-list class the block count, free bytes and largest block, plus the
+// slab freelist depths for the fixed classes. The per-class block count is
+// also the worst-case scan length of that list, so long-lived instances
+// can watch fragmentation build up and recycle proactively. The returned
+// string is heap allocated.
+WASM_EXPORT(opa_heap_blocks_dump)
+char *opa_heap_blocks_dump(void)
+{
+    init();
+
+    struct {
+        size_t blocks;
+        size_t bytes;
+        size_t largest;
+    } classes[ARRAY_SIZE(heap_free)];
+
+    size_t free_bytes = 0;
+
+    for (int i = 0; i < ARRAY_SIZE(heap_free); i++)
     {
-        progress = false;
-        for (int i = 0; i < ARRAY_SIZE(heap_free); i++) {
-            progress |= compact_free(&heap_free[i]);
+        classes[i].blocks = 0;
+        classes[i].bytes = 0;
+        classes[i].largest = 0;
+
+        for (struct heap_block *b = heap_free[i].start.next; b != &heap_free[i].end; b = b->next)
+        {
+            classes[i].blocks++;
+            classes[i].bytes += b->size;
+
+            if (b->size > classes[i].largest)
+            {
+                classes[i].largest = b->size;
+            }
         }
+
+        free_bytes += classes[i].bytes;
     }
+
+    size_t slabs[ARRAY_SIZE(slab_freelist)];
+
+    for (int i = 0; i < ARRAY_SIZE(slab_freelist); i++)
+    {
+        slabs[i] = 0;
+
+        for (opa_heap_addr_t node = slab_freelist[i]; node != 0; node = *(opa_heap_addr_t *)node)
+        {
+            slabs[i]++;
+        }
+    }
+
+    size_t cap = 128 + ARRAY_SIZE(heap_free) * 96;
+    char *buf = opa_malloc(cap);
+    size_t n = 0;
+
+    n += snprintf(&buf[n], cap - n, "{\"heap_ptr\":%zu,\"heap_top\":%zu,\"free_bytes\":%zu,\"classes\":[",
+                  (size_t)heap_ptr, (size_t)heap_top, free_bytes);
+
+    for (int i = 0; i < ARRAY_SIZE(heap_free); i++)
+    {
+        n += snprintf(&buf[n], cap - n, "%s{\"size\":%u,\"blocks\":%u,\"bytes\":%u,\"largest\":%u",
+                      i > 0 ? "," : "", (unsigned int)heap_free[i].size,
+                      (unsigned int)classes[i].blocks, (unsigned int)classes[i].bytes,
+                      (unsigned int)classes[i].largest);
+
+        if (i < ARRAY_SIZE(slab_freelist))
+        {
+            n += snprintf(&buf[n], cap - n, ",\"slab_free_nodes\":%u", (unsigned int)slabs[i]);
+        }
+
+        n += snprintf(&buf[n], cap - n, "}");
+    }
+
+    n += snprintf(&buf[n], cap - n, "]}");
+    return buf;
 }
 
 // Count the number of free blocks. This is for testing only.
@@ -1,7 +1,9 @@
 #ifndef OPA_MALLOC_H
 #define OPA_MALLOC_H
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -9,18 +11,74 @@ extern "C" {
 
 void *opa_malloc(size_t size);
 void opa_free(void *ptr);
+
+#ifdef HEAP_PROFILE
+// In profiling builds every opa_malloc call site is recorded under its
+// file:line. malloc.c itself compiles the undecorated functions.
+void *opa_malloc_site(size_t size, const char *site);
+char *opa_heap_profile_dump(void);
+
+#define OPA_HEAP_STR_(x) #x
+#define OPA_HEAP_STR(x) OPA_HEAP_STR_(x)
+#define opa_malloc(size) opa_malloc_site(size, __FILE__ ":" OPA_HEAP_STR(__LINE__))
+#endif
 void *opa_realloc(void *ptr, size_t size);
 
-unsigned int opa_heap_ptr_get(void);
-unsigned int opa_heap_top_get(void);
-void opa_heap_ptr_set(unsigned int);
-void opa_heap_top_set(unsigned int);
+void *opa_malloc_node(size_t size);
+void opa_free_node(void *ptr, size_t size);
+
+// Heap addresses are pointer width: 32 bits on the wasm32 target this tree
+// builds today, widening with the target under a memory64 build without
+// further changes to the heap bookkeeping. On wasm32 the exported accessor
+// ABI is the i32 it has always been.
+typedef uintptr_t opa_heap_addr_t;
+
+opa_heap_addr_t opa_heap_ptr_get(void);
+opa_heap_addr_t opa_heap_top_get(void);
+void opa_heap_ptr_set(opa_heap_addr_t);
+void opa_heap_top_set(opa_heap_addr_t);
+
+opa_heap_addr_t opa_heap_save(void);
+void opa_heap_restore(opa_heap_addr_t token);
+
+void opa_heap_bump_set(bool enabled);
+bool opa_heap_bump_get(void);
 
+void opa_heap_fuel_set(size_t budget);
+size_t opa_heap_fuel_get(void);
+
+size_t opa_heap_alloc_bytes_get(void);
+unsigned int opa_heap_alloc_count_get(void);
+unsigned int opa_heap_free_count_get(void);
+opa_heap_addr_t opa_heap_high_water_get(void);
+unsigned int opa_heap_grow_pages_get(void);
+unsigned int opa_heap_class_alloc_count_get(size_t i);
+unsigned int opa_heap_class_free_count_get(size_t i);
+
+unsigned int opa_heap_epoch(void);
+
+// Builtin cache registry: native builtins register a slot for persistent
+// cache state, optionally with a teardown hook run when a heap reset clears
+// the slot. Slots are handed out in registration order; a subsystem
+// registers once (lazily, on first use) and keeps its slot in a static.
+typedef void (*opa_builtin_cache_teardown_fn)(void *p);
+
+#define OPA_BUILTIN_CACHE_UNREGISTERED ((size_t)-1)
+
+size_t opa_builtin_cache_register(opa_builtin_cache_teardown_fn teardown);
 void *opa_builtin_cache_get(size_t i);
 void opa_builtin_cache_set(size_t i, void *p);
 
+// Per-eval scratch stack: bump allocations for builtin temporaries that
+// never escape the call. opa_scratch_reset drops every outstanding scratch
+// block at once, so builtins reset only on their own return path — never
+// from a helper another scratch user may be calling.
+void *opa_scratch_alloc(size_t size);
+void opa_scratch_reset(void);
+
 void opa_heap_compact(void);
 size_t opa_heap_free_blocks(void);
+char *opa_heap_blocks_dump(void);
 
 #ifdef __cplusplus
 }
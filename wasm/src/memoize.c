@@ -1,25 +1,37 @@
+#include <stdlib.h>
+#include <string.h>
+
 #include "memoize.h"
 #include "malloc.h"
+#include "snapshot.h"
 #include "std.h"
 
+// Rule memoization. The compiler assigns every memoized function a small
+// dense index and passes the total count to opa_memoize_init, so the table
+// is a flat array and get/insert are a bounds-checked load and store.
+// 'with' statements push a fresh table and pop restores the previous one.
+
 struct memoize {
     struct memoize  *prev;
-    opa_object_t    *table;
+    opa_value       **entries;
 };
 
 static struct memoize *m = NULL;
+static int32_t memoize_n = 0;
 
 struct memoize *opa_memoize_alloc(struct memoize *prev)
 {
     struct memoize *result = (struct memoize *)opa_malloc(sizeof(struct memoize));
     result->prev = prev;
-    result->table = opa_cast_object(opa_object());
+    result->entries = (opa_value **)opa_malloc(sizeof(opa_value *) * memoize_n);
+    memset(result->entries, 0, sizeof(opa_value *) * memoize_n);
     return result;
 }
 
 OPA_INTERNAL
-void opa_memoize_init(void)
+void opa_memoize_init(int32_t n)
 {
+    memoize_n = n;
     m = opa_memoize_alloc(NULL);
 }
 
@@ -40,18 +52,244 @@ void opa_memoize_pop(void)
 OPA_INTERNAL
 void opa_memoize_insert(int32_t index, opa_value *value)
 {
-    // NOTE(tsandall): allocating a number is suboptimal but worst-case is ~1 per
-    // planned rule so overhead should be minimal compared to the rest of evaluation.
-    opa_value *key = opa_number_int(index);
-    opa_object_insert(m->table, key, value);
+    if (index < 0 || index >= memoize_n)
+    {
+        opa_abort("opa_memoize_insert: index out of range");
+    }
+
+    m->entries[index] = value;
 }
 
 OPA_INTERNAL
 opa_value *opa_memoize_get(int32_t index)
 {
-    opa_number_t key;
-    opa_number_init_int(&key, index);
-    opa_object_elem_t *elem = opa_object_get(m->table, &key.hdr);
+    if (index < 0 || index >= memoize_n)
+    {
+        opa_abort("opa_memoize_get: index out of range");
+    }
+
+    return m->entries[index];
+}
+
+// Retained memoization. Rules the compiler can prove depend only on the
+// data document produce the same value every eval until the data changes,
+// so their memo entries need not die with the eval arena. The compiler
+// flags such a rule by routing its memo traffic through the *_retained
+// entry points below instead of opa_memoize_get/insert; the runtime keeps
+// those entries as mounted snapshot blobs in a region at the bottom of the
+// eval arena, just above the host's heap mark, with the per-eval reset
+// point moved past them — the decision cache arrangement (see context.c).
+// The region is dropped wholesale when the data generation counter changes
+// or the host presents a different heap mark.
+
+#define MEMOIZE_RETAIN_MAX (256)
+
+static opa_value *retained_entries[MEMOIZE_RETAIN_MAX];
+static unsigned int retained_generation = 0;
+static opa_heap_addr_t retained_base = 0; // host heap mark the region sits above
+static opa_heap_addr_t retained_ptr = 0;  // first byte past the region
+
+// entries computed during the current eval; they point into the arena until
+// opa_memoize_retain_commit copies them into the region
+static struct {
+    int32_t index;
+    opa_value *value;
+} retained_pending[MEMOIZE_RETAIN_MAX];
+
+static size_t retained_pending_len = 0;
+
+// Returns the reset point for an eval the host wants run above 'heap': just
+// past the retained region. Called at eval start; a stale region — new data
+// generation, different heap mark — is dropped here.
+opa_heap_addr_t opa_memoize_retained_floor(opa_heap_addr_t heap)
+{
+    if (retained_base != heap || retained_generation != opa_value_data_generation())
+    {
+        memset(retained_entries, 0, sizeof(retained_entries));
+        retained_generation = opa_value_data_generation();
+        retained_base = heap;
+        retained_ptr = heap;
+    }
+
+    retained_pending_len = 0;
+    return retained_ptr;
+}
+
+OPA_INTERNAL
+opa_value *opa_memoize_get_retained(int32_t index)
+{
+    if (index < 0 || index >= MEMOIZE_RETAIN_MAX)
+    {
+        opa_abort("opa_memoize_get_retained: index out of range");
+    }
+
+    return retained_entries[index];
+}
+
+OPA_INTERNAL
+void opa_memoize_insert_retained(int32_t index, opa_value *value)
+{
+    if (index < 0 || index >= MEMOIZE_RETAIN_MAX)
+    {
+        opa_abort("opa_memoize_insert_retained: index out of range");
+    }
+
+    if (retained_pending_len == MEMOIZE_RETAIN_MAX)
+    {
+        return; // pending table full: skip memoizing this one
+    }
+
+    // Visible to the rest of this eval right away; the copy that survives
+    // into later evals is made by opa_memoize_retain_commit.
+    retained_entries[index] = value;
+
+    retained_pending[retained_pending_len].index = index;
+    retained_pending[retained_pending_len].value = value;
+    retained_pending_len++;
+}
+
+// Discards the current eval's uncommitted entries. Eval wrappers that pop
+// the heap between evaluations (opa_eval_inputs) call this instead of
+// committing, since the values the entries point at do not survive the pop.
+void opa_memoize_retain_discard(void)
+{
+    for (size_t i = 0; i < retained_pending_len; i++)
+    {
+        retained_entries[retained_pending[i].index] = NULL;
+    }
+
+    retained_pending_len = 0;
+}
+
+// Copies this eval's new entries into the retained region. Each value is
+// snapshotted at the top of the arena and the blob copied down to the
+// region's end, so the forward copy is safe even when source and
+// destination overlap. 'result' is the serialized result about to be handed
+// to the host (NULL when it lives outside the arena): if the region would
+// grow over it, the remaining entries are discarded — recomputed next
+// eval — rather than corrupt the returned string.
+void opa_memoize_retain_commit(const char *result)
+{
+    for (size_t i = 0; i < retained_pending_len; i++)
+    {
+        size_t len = 0;
+        char *blob = opa_value_snapshot(retained_pending[i].value, &len);
+        char *dst = (char *)((retained_ptr + 7) & ~(opa_heap_addr_t)7);
+
+        if (result >= dst && result < dst + len)
+        {
+            for (size_t j = i; j < retained_pending_len; j++)
+            {
+                retained_entries[retained_pending[j].index] = NULL;
+            }
+
+            break;
+        }
+
+        for (size_t j = 0; j < len; j++)
+        {
+            dst[j] = blob[j];
+        }
+
+        retained_entries[retained_pending[i].index] = opa_value_mount(dst, len);
+        retained_ptr = (opa_heap_addr_t)(dst + len);
+    }
+
+    retained_pending_len = 0;
+}
+
+// Input-delta-aware retention. Session workloads evaluate with inputs
+// differing in a few fields (same subject, different resource), so a rule
+// that reads only untouched parts of the input produces the same value
+// again. The compiler routes such a rule through the retained entry
+// points above and registers the top-level input fields it reads with
+// opa_memoize_input_depend at initialization. At eval start the wrappers
+// hand the parsed input to opa_memoize_input_delta, which compares each
+// registered field against the previous eval's value by structural
+// digest (opa_value_digest) and drops the retained entries whose fields
+// changed. Entries with no registered fields are the input-independent
+// rules and survive as before. A digest collision would wrongly keep an
+// entry — the same 2^-128 exposure the digests accept elsewhere.
+
+#define MEMOIZE_INPUT_FIELDS_MAX (63) // one bit per field; bit 63 is reserved
+
+static struct {
+    const char *name; // points into the module's data segment
+    size_t len;
+    opa_value_digest_t digest; // of the previous eval's field value
+} input_fields[MEMOIZE_INPUT_FIELDS_MAX];
+
+static size_t input_fields_len = 0;
+static bool input_fields_seen = false; // a delta has been computed before
+static unsigned long long retained_deps[MEMOIZE_RETAIN_MAX];
+
+OPA_INTERNAL
+void opa_memoize_input_depend(int32_t index, const char *field)
+{
+    if (index < 0 || index >= MEMOIZE_RETAIN_MAX)
+    {
+        opa_abort("opa_memoize_input_depend: index out of range");
+    }
+
+    size_t len = strlen(field);
+
+    for (size_t i = 0; i < input_fields_len; i++)
+    {
+        if (input_fields[i].len == len && memcmp(input_fields[i].name, field, len) == 0)
+        {
+            retained_deps[index] |= 1ULL << i;
+            return;
+        }
+    }
+
+    if (input_fields_len == MEMOIZE_INPUT_FIELDS_MAX)
+    {
+        // no bit left to track the field: the reserved bit is always in
+        // the changed set, so the entry is recomputed every eval instead
+        retained_deps[index] |= 1ULL << 63;
+        return;
+    }
+
+    input_fields[input_fields_len].name = field;
+    input_fields[input_fields_len].len = len;
+    retained_deps[index] |= 1ULL << input_fields_len;
+    input_fields_len++;
+}
+
+void opa_memoize_input_delta(opa_value *input)
+{
+    unsigned long long changed = 1ULL << 63;
+
+    for (size_t i = 0; i < input_fields_len; i++)
+    {
+        opa_value_digest_t d = { 0, 0 }; // a missing field digests as zero
+
+        if (input != NULL)
+        {
+            opa_value *v = opa_value_get(input, opa_string(input_fields[i].name, input_fields[i].len));
+
+            if (v != NULL)
+            {
+                opa_value_digest(v, &d);
+            }
+        }
+
+        if (!input_fields_seen ||
+            d.lo != input_fields[i].digest.lo || d.hi != input_fields[i].digest.hi)
+        {
+            changed |= 1ULL << i;
+        }
+
+        input_fields[i].digest = d;
+    }
+
+    input_fields_seen = true;
 
-    return elem == NULL ? NULL : elem->v;
+    for (size_t i = 0; i < MEMOIZE_RETAIN_MAX; i++)
+    {
+        if (retained_deps[i] & changed)
+        {
+            retained_entries[i] = NULL;
+        }
+    }
 }
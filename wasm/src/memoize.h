@@ -1,12 +1,26 @@
 #ifndef OPA_MEMOIZE_H
 #define OPA_MEMOIZE_H
 
+#include "malloc.h"
 #include "value.h"
 
-void opa_memoize_init(void);
+void opa_memoize_init(int32_t n);
 void opa_memoize_push(void);
 void opa_memoize_pop(void);
 void opa_memoize_insert(int32_t, opa_value *);
 opa_value *opa_memoize_get(int32_t);
 
+// Retained memoization for rules the compiler knows are input-independent:
+// entries survive evals until the data generation changes. See memoize.c.
+opa_value *opa_memoize_get_retained(int32_t);
+void opa_memoize_insert_retained(int32_t, opa_value *);
+opa_heap_addr_t opa_memoize_retained_floor(opa_heap_addr_t heap);
+void opa_memoize_retain_commit(const char *result);
+void opa_memoize_retain_discard(void);
+
+// Input-delta-aware retention: retained entries whose registered input
+// fields are untouched since the previous eval survive it. See memoize.c.
+void opa_memoize_input_depend(int32_t index, const char *field);
+void opa_memoize_input_delta(opa_value *input);
+
 #endif
\ No newline at end of file
@@ -1,8 +1,89 @@
 #include <mpdecimal.h>
+#include <string.h>
 
+#include "malloc.h"
 #include "str.h"
 #include "value.h"
 
+// libmpdec allocation arena. Workspaces and coefficients are transient:
+// numbers cache their mpd conversions only under a heap epoch check, so
+// nothing libmpdec allocates after initialization needs to survive a
+// heap reset. The pluggable hooks in libmpdec/memory.c therefore point
+// at a grow-only arena — allocation bumps a pointer in chunks carved
+// from the general heap, free is a no-op — keeping libmpdec off the
+// free lists entirely. The chunk chain hangs off a builtin cache slot,
+// so a heap reset discards it wholesale. Blocks carry their size in a
+// header so realloc can copy the old contents.
+
+#define MPD_ARENA_CHUNK (16 * 1024)
+#define MPD_ARENA_HDR (8) // keeps blocks 8-aligned on wasm32
+
+typedef struct mpd_arena_chunk
+{
+    struct mpd_arena_chunk *next;
+    size_t cap;
+    size_t used;
+} mpd_arena_chunk;
+
+static size_t mpd_arena_slot = OPA_BUILTIN_CACHE_UNREGISTERED;
+
+static void *mpd_arena_malloc(size_t size)
+{
+    if (mpd_arena_slot == OPA_BUILTIN_CACHE_UNREGISTERED)
+    {
+        mpd_arena_slot = opa_builtin_cache_register(NULL);
+    }
+
+    size_t need = MPD_ARENA_HDR + ((size + 7) & ~(size_t)7);
+
+    mpd_arena_chunk *c = opa_builtin_cache_get(mpd_arena_slot);
+    if (c == NULL || c->cap - c->used < need)
+    {
+        size_t cap = need > MPD_ARENA_CHUNK ? need : MPD_ARENA_CHUNK;
+        mpd_arena_chunk *n = opa_malloc(sizeof(mpd_arena_chunk) + cap);
+        n->cap = cap;
+        n->used = 0;
+        n->next = c;
+        opa_builtin_cache_set(mpd_arena_slot, n);
+        c = n;
+    }
+
+    char *base = (char *)(c + 1) + c->used;
+    c->used += need;
+    *(size_t *)base = size;
+    return base + MPD_ARENA_HDR;
+}
+
+static void *mpd_arena_calloc(size_t nmemb, size_t size)
+{
+    void *p = mpd_arena_malloc(nmemb * size);
+    memset(p, 0, nmemb * size);
+    return p;
+}
+
+static void *mpd_arena_realloc(void *ptr, size_t size)
+{
+    if (ptr == NULL)
+    {
+        return mpd_arena_malloc(size);
+    }
+
+    size_t old = *(size_t *)((char *)ptr - MPD_ARENA_HDR);
+    if (size <= old)
+    {
+        return ptr;
+    }
+
+    void *p = mpd_arena_malloc(size);
+    memcpy(p, ptr, old);
+    return p;
+}
+
+static void mpd_arena_free(void *ptr)
+{
+    // reclaimed wholesale at the next heap reset
+}
+
 static int initialized;
 static mpd_context_t default_ctx;
 static mpd_context_t max_ctx;
@@ -16,6 +97,20 @@ void opa_mpd_init(void)
         mpd_defaultcontext(&default_ctx);
         default_ctx.traps = 0;
 
+        // Size fresh coefficients for the default context's working
+        // precision, like mpd_init does, so typical arithmetic never
+        // resizes a coefficient. Must precede the first allocation.
+        mpd_ssize_t minalloc = 2 * ((default_ctx.prec + MPD_RDIGITS - 1) / MPD_RDIGITS);
+        if (minalloc < MPD_MINALLOC_MIN)
+        {
+            minalloc = MPD_MINALLOC_MIN;
+        }
+        if (minalloc > MPD_MINALLOC_MAX)
+        {
+            minalloc = MPD_MINALLOC_MAX;
+        }
+        mpd_setminalloc(minalloc);
+
         mpd_maxcontext(&max_ctx);
         max_ctx.traps = 0;
         max_ctx.round = MPD_ROUND_HALF_UP; // .5 always rounded up
@@ -29,6 +124,15 @@ void opa_mpd_init(void)
             opa_abort("mpd: init");
         }
 
+        // Route the allocation hooks at the arena from here on.
+        // Everything allocated above ('one', via mpd_qnew) went through
+        // the default path below the host's heap mark, so it survives
+        // heap resets; arena-backed allocations do not need to.
+        mpd_mallocfunc = mpd_arena_malloc;
+        mpd_reallocfunc = mpd_arena_realloc;
+        mpd_callocfunc = mpd_arena_calloc;
+        mpd_free = mpd_arena_free;
+
         initialized = 1;
     }
 }
@@ -48,12 +152,69 @@ static mpd_t *mpd_one(void)
     return one;
 }
 
+// Pool of recycled mpd_t bodies. mpd_qnew allocates the struct and its
+// coefficient separately, so every big number operand and result costs two
+// trips through the allocator; recycling whole bodies across calls avoids
+// both. The pool lives in a builtin cache slot, like the regex and glob
+// caches: a heap reset frees the pooled bodies along with everything else
+// and clears the slot with them. Recycled bodies need no reset since the
+// mpd_qset_* and compute routines overwrite a result holding a previous
+// value, resizing its coefficient as needed.
+
+#define MPD_POOL_SIZE (32)
+
+typedef struct
+{
+    int len;
+    mpd_t *free[MPD_POOL_SIZE];
+} mpd_pool_t;
+
+static size_t mpd_pool_slot = OPA_BUILTIN_CACHE_UNREGISTERED;
+
+static mpd_pool_t *mpd_pool(void)
+{
+    if (mpd_pool_slot == OPA_BUILTIN_CACHE_UNREGISTERED)
+    {
+        mpd_pool_slot = opa_builtin_cache_register(NULL);
+    }
+
+    mpd_pool_t *p = opa_builtin_cache_get(mpd_pool_slot);
+    if (p == NULL)
+    {
+        p = opa_malloc(sizeof(mpd_pool_t));
+        p->len = 0;
+        opa_builtin_cache_set(mpd_pool_slot, p);
+    }
+
+    return p;
+}
+
+mpd_t *opa_mpd_new(void)
+{
+    mpd_pool_t *p = mpd_pool();
+    if (p->len > 0)
+    {
+        return p->free[--p->len];
+    }
+
+    return mpd_qnew();
+}
+
 void opa_mpd_del(mpd_t *v)
 {
-    if (v != NULL)
+    if (v == NULL)
+    {
+        return;
+    }
+
+    mpd_pool_t *p = mpd_pool();
+    if (p->len < MPD_POOL_SIZE && mpd_isdynamic(v) && mpd_isdynamic_data(v))
     {
-        mpd_del(v);
+        p->free[p->len++] = v;
+        return;
     }
+
+    mpd_del(v);
 }
 
 mpd_t *opa_number_to_bf(opa_value *v)
@@ -70,24 +231,40 @@ mpd_t *opa_number_to_bf(opa_value *v)
     switch (n->repr)
     {
     case OPA_NUMBER_REPR_REF:
-        r = mpd_qnew();
-
-        // Guarantee the existence of '\0' terminator. The string may
-        // be pointer to a longer buffer (allocated in JSON parsing).
-        char *s = malloc(n->v.ref.len+1);
-        memcpy(s, n->v.ref.s, n->v.ref.len);
-        s[n->v.ref.len] = 0;
-        mpd_qset_string(r, s, mpd_max_ctx(), &status);
-        if (status != 0)
+    {
+        // Parsing the digit string is the expensive part of the conversion,
+        // so the result is cached on the number and reused while its heap
+        // epoch is current. Callers own the returned value and routinely
+        // hand it to helpers that consume it, so hand out a copy.
+        unsigned int epoch = opa_heap_epoch();
+
+        if (n->bf == NULL || n->bf_epoch != epoch)
         {
-            opa_abort("opa_number_to_bf: invalid number");
+            mpd_t *c = opa_mpd_new();
+
+            // Guarantee the existence of '\0' terminator. The string may
+            // be pointer to a longer buffer (allocated in JSON parsing).
+            char *s = malloc(n->v.ref.len+1);
+            memcpy(s, n->v.ref.s, n->v.ref.len);
+            s[n->v.ref.len] = 0;
+            mpd_qset_string(c, s, mpd_max_ctx(), &status);
+            if (status != 0)
+            {
+                opa_abort("opa_number_to_bf: invalid number");
+            }
+
+            free(s);
+            n->bf = c;
+            n->bf_epoch = epoch;
         }
 
-        free(s);
+        r = opa_mpd_new();
+        mpd_qcopy(r, n->bf, &status);
         break;
+    }
 
     case OPA_NUMBER_REPR_INT:
-        r = mpd_qnew();
+        r = opa_mpd_new();
 
         if (n->v.i >= INT32_MIN && n->v.i <= INT32_MAX)
         {
@@ -99,7 +276,6 @@ mpd_t *opa_number_to_bf(opa_value *v)
                 opa_abort("opa_number_to_bf: overflow");
             }
 
-            r = mpd_qnew();
             mpd_qset_string(r, buf, mpd_default_ctx(), &status);
         }
         break;
@@ -130,12 +306,12 @@ opa_value *opa_bf_to_number(mpd_t *n)
 
     if (status == 0)
     {
-        mpd_del(n);
+        opa_mpd_del(n);
         return opa_number_int(i);
     }
 
     char *s = mpd_to_sci(n, 0);
-    mpd_del(n);
+    opa_mpd_del(n);
     return opa_number_ref(s, opa_strlen(s));
 }
 
@@ -168,13 +344,13 @@ mpd_t *opa_bf_to_bf_bits(mpd_t *v)
         return NULL;
     }
 
-    mpd_t *i = mpd_qnew();
+    mpd_t *i = opa_mpd_new();
     uint32_t status = 0;
 
     mpd_qround_to_intx(i, v, mpd_max_ctx(), &status);
     if (status)
     {
-        mpd_del(i);
+        opa_mpd_del(i);
         return NULL;
     }
 
@@ -184,12 +360,12 @@ mpd_t *opa_bf_to_bf_bits(mpd_t *v)
         opa_abort("opa_bits: bits conversion");
     }
 
-    mpd_del(v);
+    opa_mpd_del(v);
 
     if (c != 0)
     {
         // Not an integer value.
-        mpd_del(i);
+        opa_mpd_del(i);
         return NULL;
     }
 
@@ -198,14 +374,14 @@ mpd_t *opa_bf_to_bf_bits(mpd_t *v)
     {
         sign = MPD_NEG;
 
-        v = mpd_qnew();
+        v = opa_mpd_new();
         mpd_qabs(v, i, mpd_max_ctx(), &status);
         if (status)
         {
             opa_abort("opa_bits: bits conversion");
         }
 
-        mpd_del(i);
+        opa_mpd_del(i);
         i = v;
     }
 
@@ -217,9 +393,9 @@ mpd_t *opa_bf_to_bf_bits(mpd_t *v)
         opa_abort("opa_bits: bits conversion");
     }
 
-    mpd_del(i);
+    opa_mpd_del(i);
 
-    mpd_t *bits = mpd_qnew();
+    mpd_t *bits = opa_mpd_new();
     mpd_qimport_u16(bits, rdata, digits, sign, 10, mpd_max_ctx(), &status);
     if (status)
     {
@@ -243,14 +419,14 @@ mpd_t *opa_bf_bits_to_bf(mpd_t *v)
 
     if (mpd_sign(v))
     {
-        mpd_t *abs = mpd_qnew();
+        mpd_t *abs = opa_mpd_new();
         mpd_qabs(abs, v, mpd_max_ctx(), &status);
         if (status)
         {
             opa_abort("opa_bits: bits conversion");
         }
 
-        mpd_del(v);
+        opa_mpd_del(v);
         v = abs;
 
         sign = MPD_NEG;
@@ -264,9 +440,9 @@ mpd_t *opa_bf_bits_to_bf(mpd_t *v)
         opa_abort("opa_bits: bits conversion");
     }
 
-    mpd_del(v);
+    opa_mpd_del(v);
 
-    mpd_t *i = mpd_qnew();
+    mpd_t *i = opa_mpd_new();
     mpd_qimport_u16(i, rdata, digits, sign, 2, mpd_max_ctx(), &status);
     if (status)
     {
@@ -285,7 +461,7 @@ mpd_t *qabs(mpd_t *v)
         return NULL;
     }
 
-    mpd_t *a = mpd_qnew();
+    mpd_t *a = opa_mpd_new();
     uint32_t status = 0;
 
     mpd_qabs(a, v, mpd_max_ctx(), &status);
@@ -294,7 +470,7 @@ mpd_t *qabs(mpd_t *v)
         opa_abort("opa_bits: abs conversion");
     }
 
-    mpd_del(v);
+    opa_mpd_del(v);
     return a;
 }
 
@@ -305,7 +481,7 @@ mpd_t *qadd_one(mpd_t *v)
         return NULL;
     }
 
-    mpd_t *r = mpd_qnew();
+    mpd_t *r = opa_mpd_new();
     uint32_t status = 0;
 
     mpd_qadd(r, v, mpd_one(), mpd_max_ctx(), &status);
@@ -314,7 +490,7 @@ mpd_t *qadd_one(mpd_t *v)
         opa_abort("opa_bits: add one");
     }
 
-    mpd_del(v);
+    opa_mpd_del(v);
     return r;
 }
 
@@ -325,7 +501,7 @@ mpd_t *qadd(mpd_t *a, mpd_t *b)
         return NULL;
     }
 
-    mpd_t *r = mpd_qnew();
+    mpd_t *r = opa_mpd_new();
     uint32_t status = 0;
 
     mpd_qadd(r, a, b, mpd_max_ctx(), &status);
@@ -334,8 +510,8 @@ mpd_t *qadd(mpd_t *a, mpd_t *b)
         opa_abort("opa_bits: add");
     }
 
-    mpd_del(a);
-    mpd_del(b);
+    opa_mpd_del(a);
+    opa_mpd_del(b);
     return r;
 }
 
@@ -346,7 +522,7 @@ mpd_t *qsub_one(mpd_t *v)
         return NULL;
     }
 
-    mpd_t *r = mpd_qnew();
+    mpd_t *r = opa_mpd_new();
     uint32_t status = 0;
 
     mpd_qsub(r, v, mpd_one(), mpd_max_ctx(), &status);
@@ -355,7 +531,7 @@ mpd_t *qsub_one(mpd_t *v)
         opa_abort("opa_bits: minus one");
     }
 
-    mpd_del(v);
+    opa_mpd_del(v);
     return r;
 }
 
@@ -366,7 +542,7 @@ mpd_t *qmul(mpd_t *a, mpd_t *b)
         return NULL;
     }
 
-    mpd_t *r = mpd_qnew();
+    mpd_t *r = opa_mpd_new();
     uint32_t status = 0;
 
     mpd_qmul(r, a, b, mpd_max_ctx(), &status);
@@ -375,8 +551,8 @@ mpd_t *qmul(mpd_t *a, mpd_t *b)
         opa_abort("opa_bits: mul");
     }
 
-    mpd_del(a);
-    mpd_del(b);
+    opa_mpd_del(a);
+    opa_mpd_del(b);
     return r;
 }
 
@@ -391,12 +567,12 @@ mpd_t *qand(mpd_t *x, mpd_t *y)
         return NULL;
     }
 
-    mpd_t *r = mpd_qnew();
+    mpd_t *r = opa_mpd_new();
     uint32_t status = 0;
 
     mpd_qand(r, x, y, mpd_max_ctx(), &status);
-    mpd_del(x);
-    mpd_del(y);
+    opa_mpd_del(x);
+    opa_mpd_del(y);
 
     if (status)
     {
@@ -435,7 +611,7 @@ mpd_t *qand_not(mpd_t *x, mpd_t *y)
         rdata[i] = 1;
     }
 
-    mpd_t *mask = mpd_qnew();
+    mpd_t *mask = opa_mpd_new();
     mpd_qimport_u16(mask, rdata, rlen, MPD_POS, 10, mpd_max_ctx(), &status);
     if (status)
     {
@@ -444,20 +620,20 @@ mpd_t *qand_not(mpd_t *x, mpd_t *y)
 
     free(rdata);
 
-    mpd_t *ny = mpd_qnew();
+    mpd_t *ny = opa_mpd_new();
     mpd_qxor(ny, y, mask, mpd_max_ctx(), &status);
     if (status)
     {
         opa_abort("opa_bits_negate");
     }
 
-    mpd_del(y);
-    mpd_del(mask);
+    opa_mpd_del(y);
+    opa_mpd_del(mask);
 
-    mpd_t *r = mpd_qnew();
+    mpd_t *r = opa_mpd_new();
     mpd_qand(r, x, ny, mpd_max_ctx(), &status);
-    mpd_del(x);
-    mpd_del(ny);
+    opa_mpd_del(x);
+    opa_mpd_del(ny);
 
     if (status)
     {
@@ -478,12 +654,12 @@ mpd_t *qor(mpd_t *x, mpd_t *y)
         return NULL;
     }
 
-    mpd_t *r = mpd_qnew();
+    mpd_t *r = opa_mpd_new();
     uint32_t status = 0;
 
     mpd_qor(r, x, y, mpd_max_ctx(), &status);
-    mpd_del(x);
-    mpd_del(y);
+    opa_mpd_del(x);
+    opa_mpd_del(y);
 
     if (status)
     {
@@ -504,12 +680,12 @@ mpd_t *qxor(mpd_t *x, mpd_t *y)
         return NULL;
     }
 
-    mpd_t *r = mpd_qnew();
+    mpd_t *r = opa_mpd_new();
     uint32_t status = 0;
 
     mpd_qxor(r, x, y, mpd_max_ctx(), &status);
-    mpd_del(x);
-    mpd_del(y);
+    opa_mpd_del(x);
+    opa_mpd_del(y);
 
     if (status)
     {
@@ -527,11 +703,11 @@ mpd_t *qneg(mpd_t *x)
         return NULL;
     }
 
-    mpd_t *r = mpd_qnew();
+    mpd_t *r = opa_mpd_new();
     uint32_t status = 0;
 
     mpd_qminus(r, x, mpd_max_ctx(), &status);
-    mpd_del(x);
+    opa_mpd_del(x);
 
     if (status)
     {
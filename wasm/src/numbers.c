@@ -1,3 +1,4 @@
+#include "malloc.h"
 #include "numbers.h"
 #include "mpd.h"
 #include "std.h"
@@ -5,6 +6,36 @@
 OPA_BUILTIN
 opa_value *opa_numbers_range(opa_value *v1, opa_value *v2)
 {
+    long long lo, hi;
+
+    if (opa_value_type(v1) == OPA_NUMBER && opa_value_type(v2) == OPA_NUMBER &&
+        opa_number_try_int(opa_cast_number(v1), &lo) == 0 &&
+        opa_number_try_int(opa_cast_number(v2), &hi) == 0)
+    {
+        // Machine-integer endpoints: size the element array exactly once
+        // and fill it with interned numbers where the value allows,
+        // keeping libmpdec and the array growth path out of the loop.
+        // The unsigned arithmetic is immune to int64 overflow at the
+        // extremes; spans too large to address fall through.
+        unsigned long long n = (lo <= hi ?
+            (unsigned long long)hi - (unsigned long long)lo :
+            (unsigned long long)lo - (unsigned long long)hi) + 1;
+
+        if (n != 0 && n <= SIZE_MAX / sizeof(opa_array_elem_t))
+        {
+            opa_array_elem_t *elems = (opa_array_elem_t *)opa_malloc(n * sizeof(opa_array_elem_t));
+            unsigned long long step = lo <= hi ? 1 : -1;
+            unsigned long long v = (unsigned long long)lo;
+
+            for (unsigned long long k = 0; k < n; k++, v += step)
+            {
+                elems[k].v = opa_number_interned((long long)v);
+            }
+
+            return opa_array_with_elems(elems, n, n);
+        }
+    }
+
     mpd_t *i1 = NULL;
     mpd_t *i2 = NULL;
     opa_value *result = NULL;
@@ -1,5 +1,6 @@
 #include "std.h"
 #include "object.h"
+#include "str.h"
 
 static opa_value *__merge(opa_value *a, opa_value *b);
 static opa_value *__merge_with_overwrite(opa_value *a, opa_value *b);
@@ -200,6 +201,19 @@ opa_array_t *__get_json_paths(opa_value *a)
     return paths;
 }
 
+// Looks up array index i in a paths trie node without allocating: the
+// decimal key is rendered into a stack buffer posing as an opa_string_t.
+static opa_value *__get_array_index(opa_value *b, size_t i)
+{
+    char buf[sizeof(size_t) * 3 + 1];
+    opa_string_t key = {.hdr = {.type = OPA_STRING}, .free = 0, .v = buf, .hash = 0};
+
+    opa_itoa((long long)i, buf, 10);
+    key.len = opa_strlen(buf);
+
+    return opa_value_get(b, &key.hdr);
+}
+
 opa_value *__json_remove(opa_value *a, opa_value *b)
 {
     if (b == NULL)
@@ -237,24 +251,63 @@ opa_value *__json_remove(opa_value *a, opa_value *b)
         }
         case OPA_OBJECT:
         {
-            opa_object_t *new_obj = opa_cast_object(opa_object());
+            opa_object_t *src = opa_cast_object(a);
+            opa_object_t *trie = opa_cast_object(bObj);
+
+            // Only keys present in the trie node can change; when none of
+            // them occur in the object, the whole subtree is untouched.
+            size_t touched = 0;
 
-            for (opa_value *key = opa_value_iter(a, NULL); key != NULL; key = opa_value_iter(a, key))
+            for (size_t i = 0; i < trie->n; i++)
             {
-                opa_value *value = opa_value_get(a, key);
-                opa_value *diff_value = __json_remove(value, opa_value_get(bObj, key));
+                for (opa_object_elem_t *elem = trie->buckets[i]; elem != NULL; elem = elem->next)
+                {
+                    if (opa_object_get(src, elem->k) != NULL)
+                    {
+                        touched++;
+                    }
+                }
+            }
 
-                if (diff_value != NULL)
+            if (touched == 0)
+            {
+                return a;
+            }
+
+            // Clone the table (keys and values stay shared with a) and
+            // patch just the touched entries, instead of rebuilding and
+            // rehashing every key.
+            opa_object_t *new_obj = opa_cast_object(opa_value_shallow_copy(a));
+
+            for (size_t i = 0; i < trie->n; i++)
+            {
+                for (opa_object_elem_t *elem = trie->buckets[i]; elem != NULL; elem = elem->next)
                 {
-                    opa_object_insert(new_obj, key, diff_value);
+                    opa_object_elem_t *orig = opa_object_get(src, elem->k);
+
+                    if (orig == NULL)
+                    {
+                        continue;
+                    }
+
+                    opa_value *diff_value = __json_remove(orig->v, elem->v);
+
+                    if (diff_value == NULL)
+                    {
+                        opa_object_remove_keep(new_obj, elem->k);
+                    }
+                    else if (diff_value != orig->v)
+                    {
+                        opa_object_insert(new_obj, elem->k, diff_value);
+                    }
                 }
             }
             return &new_obj->hdr;
         }
         case OPA_SET:
         {
-            opa_set_t *new_set = opa_cast_set(opa_set());
             opa_set_t *set = opa_cast_set(a);
+            opa_set_t *new_set = opa_cast_set(opa_set_with_cap(set->len));
 
             for (int i = 0; i < set->n; i++)
             {
@@ -275,14 +328,14 @@ opa_value *__json_remove(opa_value *a, opa_value *b)
         }
         case OPA_ARRAY:
         {
-            opa_array_t *new_array = opa_cast_array(opa_array());
             opa_array_t *array = opa_cast_array(a);
+            opa_array_t *new_array = opa_cast_array(opa_array_with_cap(array->len));
 
             for (int i = 0; i < array->len; i++)
             {
                 opa_value *value = array->elems[i].v;
 
-                opa_value *diff_value = __json_remove(value, opa_value_get(bObj, opa_strings_format_int(opa_number_int(i), opa_number_int(10))));
+                opa_value *diff_value = __json_remove(value, __get_array_index(bObj, i));
 
                 if (diff_value != NULL)
                 {
@@ -298,13 +351,13 @@ opa_value *__json_remove(opa_value *a, opa_value *b)
 
 opa_value *__json_filter(opa_value *a, opa_value *b)
 {
-
-    if (opa_value_compare(b, opa_null()) == 0)
+    if (b != NULL && opa_value_type(b) == OPA_NULL)
     {
+        // A leaf of the paths trie: the whole subtree is selected.
         return a;
     }
 
-    if (opa_value_type(b) != OPA_OBJECT)
+    if (b == NULL || opa_value_type(b) != OPA_OBJECT)
     {
         return NULL;
     }
@@ -320,27 +373,56 @@ opa_value *__json_filter(opa_value *a, opa_value *b)
         }
         case OPA_OBJECT:
         {
-            opa_object_t *new_obj = opa_cast_object(opa_object());
+            opa_object_t *src = opa_cast_object(a);
+            opa_object_t *trie = opa_cast_object(b);
 
-            opa_object_t *iter_obj = opa_cast_object(a);
-            opa_object_t *other = opa_cast_object(b);
-
-            if (iter_obj->len < other->len)
+            // When every key of this node maps to a whole-subtree (null)
+            // leaf, filtering cannot change it: share it instead of
+            // copying. Only possible if the trie covers all of the keys.
+            if (trie->len >= src->len)
             {
-                iter_obj = opa_cast_object(b);
-                other = opa_cast_object(a);
+                int whole = 1;
+
+                for (size_t i = 0; whole && i < src->n; i++)
+                {
+                    for (opa_object_elem_t *elem = src->buckets[i]; elem != NULL; elem = elem->next)
+                    {
+                        opa_value *node = opa_value_get(b, elem->k);
+
+                        if (node == NULL || opa_value_type(node) != OPA_NULL)
+                        {
+                            whole = 0;
+                            break;
+                        }
+                    }
+                }
+
+                if (whole)
+                {
+                    return a;
+                }
             }
 
-            for (opa_value *key = opa_value_iter(&iter_obj->hdr, NULL); key != NULL; key = opa_value_iter(&iter_obj->hdr, key))
-            {
+            // The intersection of the two key sets bounds the result size;
+            // iterate whichever side is smaller.
+            opa_object_t *iter_obj = src->len < trie->len ? src : trie;
+            opa_object_t *other = iter_obj == src ? trie : src;
+            opa_object_t *new_obj = opa_cast_object(opa_object_with_cap(iter_obj->len));
 
-                if (opa_value_get(&other->hdr, key) != NULL)
+            for (size_t i = 0; i < iter_obj->n; i++)
+            {
+                for (opa_object_elem_t *it = iter_obj->buckets[i]; it != NULL; it = it->next)
                 {
-                    opa_value *filtered_value = __json_filter(opa_value_get(a, key), opa_value_get(b, key));
+                    opa_value *key = it->k;
 
-                    if (filtered_value != NULL)
+                    if (opa_object_get(other, key) != NULL)
                     {
-                        opa_object_insert(new_obj, key, filtered_value);
+                        opa_value *filtered_value = __json_filter(opa_value_get(a, key), opa_value_get(b, key));
+
+                        if (filtered_value != NULL)
+                        {
+                            opa_object_insert(new_obj, key, filtered_value);
+                        }
                     }
                 }
             }
@@ -348,8 +430,8 @@ opa_value *__json_filter(opa_value *a, opa_value *b)
         }
         case OPA_SET:
         {
-            opa_set_t *new_set = opa_cast_set(opa_set());
             opa_set_t *set = opa_cast_set(a);
+            opa_set_t *new_set = opa_cast_set(opa_set_with_cap(set->len));
 
             for (int i = 0; i < set->n; i++)
             {
@@ -370,14 +452,14 @@ opa_value *__json_filter(opa_value *a, opa_value *b)
         }
         case OPA_ARRAY:
         {
-            opa_array_t *new_array = opa_cast_array(opa_array());
             opa_array_t *array = opa_cast_array(a);
+            opa_array_t *new_array = opa_cast_array(opa_array_with_cap(array->len));
 
             for (int i = 0; i < array->len; i++)
             {
                 opa_value *value = array->elems[i].v;
 
-                opa_value *filtered_value = __json_filter(value, opa_value_get(b, opa_strings_format_int(opa_number_int(i), opa_number_int(10))));
+                opa_value *filtered_value = __json_filter(value, __get_array_index(b, i));
 
                 if (filtered_value != NULL)
                 {
@@ -391,6 +473,71 @@ opa_value *__json_filter(opa_value *a, opa_value *b)
     return NULL;
 }
 
+// Materializes the keys argument as a set, reusing it when it already is
+// one, so membership checks afterwards are single hashed probes.
+static opa_set_t *__keys_set(opa_value *keys)
+{
+    if (opa_value_type(keys) == OPA_SET)
+    {
+        return opa_cast_set(keys);
+    }
+
+    opa_set_t *set = opa_cast_set(opa_set_with_cap(opa_value_length(keys)));
+
+    if (opa_value_type(keys) == OPA_ARRAY)
+    {
+        // An array element is just its value pointer, so the element
+        // vector feeds the bulk add directly: one growth check, no
+        // per-key iteration machinery.
+        opa_array_t *arr = opa_cast_array(keys);
+        opa_set_add_bulk(set, (opa_value **)arr->elems, arr->len);
+        return set;
+    }
+
+    for (opa_value *key = opa_value_iter(keys, NULL); key != NULL; key = opa_value_iter(keys, key))
+    {
+        opa_set_add(set, key);
+    }
+
+    return set;
+}
+
+// Counts the object's entries whose keys are in the set, probing from
+// whichever side is smaller.
+static size_t __count_members(opa_object_t *obj, opa_set_t *set)
+{
+    size_t count = 0;
+
+    if (set->len < obj->len)
+    {
+        for (size_t i = 0; i < set->n; i++)
+        {
+            for (opa_set_elem_t *elem = set->buckets[i]; elem != NULL; elem = elem->next)
+            {
+                if (opa_object_get(obj, elem->v) != NULL)
+                {
+                    count++;
+                }
+            }
+        }
+
+        return count;
+    }
+
+    for (size_t i = 0; i < obj->n; i++)
+    {
+        for (opa_object_elem_t *elem = obj->buckets[i]; elem != NULL; elem = elem->next)
+        {
+            if (opa_set_get(set, elem->k) != NULL)
+            {
+                count++;
+            }
+        }
+    }
+
+    return count;
+}
+
 OPA_BUILTIN
 opa_value *builtin_object_filter(opa_value *obj, opa_value *keys)
 {
@@ -405,25 +552,31 @@ opa_value *builtin_object_filter(opa_value *obj, opa_value *keys)
         return NULL;
     }
 
-    opa_object_t *r = opa_cast_object(opa_object());
+    opa_object_t *src = opa_cast_object(obj);
+    opa_set_t *set = __keys_set(keys);
 
-    for (opa_value *key = opa_value_iter(keys, NULL); key != NULL; key = opa_value_iter(keys, key))
+    // Count the surviving entries first: when nothing is filtered out the
+    // object is returned as-is, and otherwise the result table is sized
+    // exactly. The counting pass only probes, it does not allocate.
+
+    size_t kept = __count_members(src, set);
+
+    if (kept == src->len)
     {
-        opa_value* k;
-        switch (opa_value_type(keys))
-        {
-        case OPA_OBJECT:
-        case OPA_SET:
-            k = key;
-            break;
-        case OPA_ARRAY:
-            k = opa_value_get(keys, key);
-        }
+        return obj;
+    }
+
+    opa_object_t *r = opa_cast_object(opa_object_with_cap(kept));
 
-        opa_object_elem_t *elem = opa_object_get(opa_cast_object(obj), k);
-        if (elem != NULL)
+    for (size_t i = 0; kept > 0 && i < src->n; i++)
+    {
+        for (opa_object_elem_t *elem = src->buckets[i]; elem != NULL; elem = elem->next)
         {
-            opa_object_insert(r, k, elem->v);
+            if (opa_set_get(set, elem->k) != NULL)
+            {
+                opa_object_insert(r, elem->k, elem->v);
+                kept--;
+            }
         }
     }
 
@@ -458,35 +611,25 @@ opa_value *builtin_object_remove(opa_value *obj, opa_value *keys)
         return NULL;
     }
 
-    opa_set_t *keys_to_remove = opa_cast_set(opa_set());
+    opa_object_t *src = opa_cast_object(obj);
+    opa_set_t *keys_to_remove = __keys_set(keys);
 
-    for (opa_value *key = opa_value_iter(keys, NULL); key != NULL;
-         key = opa_value_iter(keys, key))
+    size_t removed = __count_members(src, keys_to_remove);
+
+    if (removed == 0)
     {
-        opa_value* k;
-        switch (opa_value_type(keys))
-        {
-        case OPA_OBJECT:
-        case OPA_SET:
-            k = key;
-            break;
-        case OPA_ARRAY:
-            k = opa_value_get(keys, key);
-        }
-        opa_set_add(keys_to_remove, k);
+        return obj;
     }
 
-    opa_object_t *r = opa_cast_object(opa_object());
+    opa_object_t *r = opa_cast_object(opa_object_with_cap(src->len - removed));
 
-    for (opa_value *key = opa_value_iter(obj, NULL); key != NULL;
-         key = opa_value_iter(obj, key))
+    for (size_t i = 0; i < src->n; i++)
     {
-        if (opa_set_get(keys_to_remove, key) == NULL)
+        for (opa_object_elem_t *elem = src->buckets[i]; elem != NULL; elem = elem->next)
         {
-            opa_object_elem_t *elem = opa_object_get(opa_cast_object(obj), key);
-            if (elem != NULL)
+            if (opa_set_get(keys_to_remove, elem->k) == NULL)
             {
-                opa_object_insert(r, key, elem->v);
+                opa_object_insert(r, elem->k, elem->v);
             }
         }
     }
@@ -0,0 +1,59 @@
+#ifdef PGO_GENERATE
+
+#include "std.h"
+
+// Minimal in-module profile runtime for PGO=generate builds. Defining
+// __llvm_profile_runtime suppresses compiler-rt's file-writing runtime,
+// which a freestanding wasm module cannot link, and leaves just the
+// instrumented counter, data and name regions in the data segment. The
+// exports below hand the host the region bounds so it can snapshot a raw
+// profile from linear memory after replaying captured inputs;
+// llvm-profdata merges the snapshots into the .profdata consumed by the
+// PGO=use build (see the Makefile).
+
+int __llvm_profile_runtime = 0;
+
+extern char __start___llvm_prf_cnts;
+extern char __stop___llvm_prf_cnts;
+extern char __start___llvm_prf_data;
+extern char __stop___llvm_prf_data;
+extern char __start___llvm_prf_names;
+extern char __stop___llvm_prf_names;
+
+WASM_EXPORT(opa_profile_cnts_begin)
+unsigned int opa_profile_cnts_begin(void)
+{
+    return (unsigned int)&__start___llvm_prf_cnts;
+}
+
+WASM_EXPORT(opa_profile_cnts_end)
+unsigned int opa_profile_cnts_end(void)
+{
+    return (unsigned int)&__stop___llvm_prf_cnts;
+}
+
+WASM_EXPORT(opa_profile_data_begin)
+unsigned int opa_profile_data_begin(void)
+{
+    return (unsigned int)&__start___llvm_prf_data;
+}
+
+WASM_EXPORT(opa_profile_data_end)
+unsigned int opa_profile_data_end(void)
+{
+    return (unsigned int)&__stop___llvm_prf_data;
+}
+
+WASM_EXPORT(opa_profile_names_begin)
+unsigned int opa_profile_names_begin(void)
+{
+    return (unsigned int)&__start___llvm_prf_names;
+}
+
+WASM_EXPORT(opa_profile_names_end)
+unsigned int opa_profile_names_end(void)
+{
+    return (unsigned int)&__stop___llvm_prf_names;
+}
+
+#endif
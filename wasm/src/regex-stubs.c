@@ -0,0 +1,83 @@
+#ifdef STRIP_RE2
+
+#include <stdlib.h>
+
+#include "glob.h"
+#include "regex.h"
+#include "std.h"
+
+// STRIP_RE2 builds link these stubs instead of regex.cc, the glob
+// compiler and the RE2/libc++ objects behind them — about two thirds of
+// the module — for policies that use neither the regex nor the glob
+// builtins. The symbols keep their names so the compiler's name-section
+// lookup still resolves; a policy that does reach one of them fails with
+// a clear abort instead of a missing-function error at instantiation.
+
+static opa_value *opa_regex_unavailable(void)
+{
+    opa_abort("regex: not linked (module built with STRIP_RE2)");
+    return NULL;
+}
+
+OPA_BUILTIN
+opa_value *opa_regex_is_valid(opa_value *v)
+{
+    return opa_regex_unavailable();
+}
+
+OPA_BUILTIN
+opa_value *opa_regex_match(opa_value *pattern, opa_value *value)
+{
+    return opa_regex_unavailable();
+}
+
+OPA_BUILTIN
+opa_value *opa_regex_match_all(opa_value *patterns, opa_value *value)
+{
+    return opa_regex_unavailable();
+}
+
+OPA_BUILTIN
+opa_value *opa_regex_find_all_string_submatch(opa_value *pattern, opa_value *string, opa_value *number)
+{
+    return opa_regex_unavailable();
+}
+
+OPA_BUILTIN
+opa_value *opa_regex_split(opa_value *pattern, opa_value *string)
+{
+    return opa_regex_unavailable();
+}
+
+OPA_INTERNAL
+void opa_regex_cache_budget_set(size_t budget)
+{
+    // nothing to size: there is no pattern cache in a stripped build.
+}
+
+OPA_INTERNAL
+void opa_regex_max_mem_set(size_t max_mem)
+{
+    // nothing to budget: RE2 is not linked in a stripped build.
+}
+
+OPA_INTERNAL
+void opa_regex_eager_set(int eager)
+{
+    // nothing to build: RE2 is not linked in a stripped build.
+}
+
+WASM_EXPORT(opa_regex_prewarm)
+opa_value *opa_regex_prewarm(opa_value *patterns)
+{
+    return opa_regex_unavailable();
+}
+
+OPA_BUILTIN
+opa_value *opa_glob_match(opa_value *pattern, opa_value *delimiters, opa_value *match)
+{
+    opa_abort("glob: not linked (module built with STRIP_RE2)");
+    return NULL;
+}
+
+#endif
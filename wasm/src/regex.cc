@@ -1,14 +1,239 @@
 #include "regex.h"
 #include "re2/re2.h"
+#include "re2/regexp.h"
+#include "libc++/arena.h"
 #include "malloc.h"
 #include "std.h"
 #include "str.h"
 #include "unicode.h"
 #include "util/utf.h"
 
-#include <unordered_map>
+#include <list>
+#include <map>
+#include <string_view>
 
-typedef std::unordered_map<std::string, re2::RE2*> re_cache;
+// Compiled patterns are kept on an LRU list bounded by a byte budget, with
+// each entry costed at RE2's ProgramSize plus the pattern text. Policies
+// that interpolate input into patterns otherwise grow the cache without
+// bound for the life of the instance.
+#define OPA_REGEX_CACHE_BUDGET (8 * 1024 * 1024)
+
+// How a compiled pattern is matched. Patterns that parse to a bare literal
+// are answered with a substring search and bare ^-anchored literals with a
+// prefix comparison, skipping the regex machinery — both forms are common
+// in generated policies.
+#define RE_PATH_REGEX (0)
+#define RE_PATH_LITERAL (1)
+#define RE_PATH_PREFIX (2)
+
+struct re_compiled
+{
+    re2::RE2 *re;
+    int path;
+    std::string literal; // matched bytes for the literal and prefix paths
+};
+
+struct re_cache_entry
+{
+    std::string pattern;
+    re_compiled *c;
+    size_t size;
+    size_t hash;
+};
+
+typedef std::list<re_cache_entry> re_lru;
+
+// The index over the LRU entries is a linear-probing open-addressed table
+// keyed by (length, hash) views of the pattern bytes: the cache probe that
+// every regex builtin call starts with is a hash plus a memcmp over a flat
+// slot array, instead of the pointer-chasing comparisons of an ordered
+// map's nodes. Slots borrow their pattern pointer from the owning LRU
+// entry's string, which is stable for the entry's lifetime — splicing the
+// list on reuse moves no element. Evictions leave a tombstone that
+// reinsertions and rehashes reclaim.
+
+static const char re_index_tombstone[1] = { 0 };
+
+struct re_index_slot
+{
+    const char *pattern; // NULL: never used; re_index_tombstone: erased
+    size_t len;
+    size_t hash;
+    re_lru::iterator it;
+};
+
+struct re_index
+{
+    re_index_slot *slots;
+    size_t n;     // allocated slots, power of two
+    size_t live;
+    size_t tombs;
+
+    re_index() : slots(NULL), n(0), live(0), tombs(0) { }
+};
+
+// FNV-1a over the pattern bytes, as in the CIDR entry cache.
+static size_t re_pattern_hash(const char *s, size_t n)
+{
+    size_t h = 2166136261;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        h ^= (unsigned char)s[i];
+        h *= 16777619;
+    }
+
+    return h;
+}
+
+// index_probe returns the live slot matching the key, or NULL.
+static re_index_slot *index_probe(re_index *ix, const char *s, size_t len, size_t hash)
+{
+    if (ix->n == 0)
+    {
+        return NULL;
+    }
+
+    for (size_t i = hash & (ix->n - 1); ; i = (i + 1) & (ix->n - 1))
+    {
+        re_index_slot *slot = &ix->slots[i];
+
+        if (slot->pattern == NULL)
+        {
+            return NULL;
+        }
+
+        if (slot->pattern != re_index_tombstone && slot->len == len &&
+            slot->hash == hash && memcmp(slot->pattern, s, len) == 0)
+        {
+            return slot;
+        }
+    }
+}
+
+// index_grow rehashes the live slots into a fresh table, doubling it when
+// the live entries alone justify the space and otherwise just purging the
+// tombstones.
+static void index_grow(re_index *ix)
+{
+    size_t n = ix->n == 0 ? 64 : ((ix->live + 1) * 4 >= ix->n ? ix->n * 2 : ix->n);
+    re_index_slot *old = ix->slots;
+    size_t old_n = ix->n;
+
+    ix->slots = new re_index_slot[n]();
+    ix->n = n;
+    ix->tombs = 0;
+
+    for (size_t i = 0; i < old_n; i++)
+    {
+        re_index_slot *slot = &old[i];
+
+        if (slot->pattern == NULL || slot->pattern == re_index_tombstone)
+        {
+            continue;
+        }
+
+        for (size_t j = slot->hash & (n - 1); ; j = (j + 1) & (n - 1))
+        {
+            if (ix->slots[j].pattern == NULL)
+            {
+                ix->slots[j] = *slot;
+                break;
+            }
+        }
+    }
+
+    delete[](old);
+}
+
+static void index_insert(re_index *ix, const char *s, size_t len, size_t hash, re_lru::iterator it)
+{
+    if ((ix->live + ix->tombs + 1) * 2 >= ix->n)
+    {
+        index_grow(ix);
+    }
+
+    for (size_t i = hash & (ix->n - 1); ; i = (i + 1) & (ix->n - 1))
+    {
+        re_index_slot *slot = &ix->slots[i];
+
+        if (slot->pattern == NULL || slot->pattern == re_index_tombstone)
+        {
+            if (slot->pattern == re_index_tombstone)
+            {
+                ix->tombs--;
+            }
+
+            slot->pattern = s;
+            slot->len = len;
+            slot->hash = hash;
+            slot->it = it;
+            ix->live++;
+            return;
+        }
+    }
+}
+
+static void index_erase(re_index *ix, const char *s, size_t len, size_t hash)
+{
+    re_index_slot *slot = index_probe(ix, s, len, hash);
+
+    if (slot != NULL)
+    {
+        slot->pattern = re_index_tombstone;
+        ix->live--;
+        ix->tombs++;
+    }
+}
+
+struct re_cache
+{
+    re_lru lru; // most recently used first
+    re_index index;
+    size_t bytes;
+    size_t budget;
+
+    re_cache() : bytes(0), budget(OPA_REGEX_CACHE_BUDGET) { }
+};
+
+// Compilation options shared by every compile site. The memory budget
+// defaults to RE2's own; hosts running large patterns raise it through
+// opa_regex_max_mem_set so matching stays on the DFA instead of falling
+// back to the NFA or bitstate engines — those fallbacks are orders of
+// magnitude slower and show up as tail-latency outliers.
+static int64_t re_max_mem = 0; // 0: RE2's default
+
+// When set, compile() builds the forward and reverse programs as part of
+// compilation and primes the DFA with an empty match, instead of leaving
+// them to be built lazily during the first matches on the latency path.
+static bool re_eager = false;
+
+static re2::RE2::Options re_options()
+{
+    re2::RE2::Options options;
+    options.set_log_errors(false);
+
+    if (re_max_mem > 0)
+    {
+        options.set_max_mem(re_max_mem);
+    }
+
+    return options;
+}
+
+static void eager_build(re2::RE2 *re)
+{
+    if (!re_eager)
+    {
+        return;
+    }
+
+    // ProgramSize and ReverseProgramSize force the respective program
+    // compilations; the empty match creates the DFA and its start states.
+    re->ProgramSize();
+    re->ReverseProgramSize();
+    re2::RE2::PartialMatch(re2::StringPiece("", 0), *re);
+}
 
 OPA_BUILTIN
 opa_value *opa_regex_is_valid(opa_value *pattern)
@@ -18,50 +243,305 @@ opa_value *opa_regex_is_valid(opa_value *pattern)
         return opa_boolean(false);
     }
 
-    std::string pat(opa_cast_string(pattern)->v, opa_cast_string(pattern)->len);
-    re2::RE2::Options options;
-    re2::RE2 re(pat, options);
+    re2::StringPiece pat(opa_cast_string(pattern)->v, opa_cast_string(pattern)->len);
+    re2::RE2 re(pat, re_options());
     return opa_boolean(re.ok());
 }
 
 static re_cache* cache()
 {
-    re_cache* c = static_cast<re_cache*>(opa_builtin_cache_get(0));
+    static size_t slot = opa_builtin_cache_register(NULL);
+
+    re_cache* c = static_cast<re_cache*>(opa_builtin_cache_get(slot));
     if (c == NULL)
     {
         c = new re_cache();
-        opa_builtin_cache_set(0, c);
+        opa_builtin_cache_set(slot, c);
     }
 
     return c;
 }
 
+// Patterns compiled ahead of time through opa_regex_prewarm live outside
+// the per-evaluation cache and are never evicted. The host calls the
+// pre-warm export during instance initialization, before it records the
+// heap pointer it rewinds to between evaluations, so the compiled
+// programs sit below that mark and survive heap resets — the same
+// lifecycle contract as data documents.
+static std::map<std::string, re_compiled*, std::less<>> *re_prewarmed = NULL;
+
+static re_compiled* prewarmed(std::string_view pattern)
+{
+    if (re_prewarmed == NULL)
+    {
+        return NULL;
+    }
+
+    auto i = re_prewarmed->find(pattern);
+    return i == re_prewarmed->end() ? NULL : i->second;
+}
+
+// literal_bytes encodes the runes of a kRegexpLiteral/kRegexpLiteralString
+// node as the bytes RE2 would match. Case-folded literals stay on the
+// regex path.
+static bool literal_bytes(re2::Regexp *re, std::string *out)
+{
+    if ((re->parse_flags() & re2::Regexp::FoldCase) != 0)
+    {
+        return false;
+    }
+
+    bool latin1 = (re->parse_flags() & re2::Regexp::Latin1) != 0;
+    re2::Rune rune;
+    re2::Rune *runes;
+    int nrunes;
+
+    if (re->op() == re2::kRegexpLiteral)
+    {
+        rune = re->rune();
+        runes = &rune;
+        nrunes = 1;
+    }
+    else
+    {
+        runes = re->runes();
+        nrunes = re->nrunes();
+    }
+
+    for (int i = 0; i < nrunes; i++)
+    {
+        if (latin1)
+        {
+            out->push_back(static_cast<char>(runes[i]));
+        }
+        else
+        {
+            char buf[re2::UTFmax];
+            out->append(buf, re2::runetochar(buf, &runes[i]));
+        }
+    }
+
+    return true;
+}
+
+// classify inspects the parsed form of a freshly compiled pattern once, so
+// matching can skip the regex engine for the degenerate shapes.
+static void classify(re_compiled *c)
+{
+    c->path = RE_PATH_REGEX;
+
+    re2::Regexp *re = c->re->Regexp();
+    if (re == NULL)
+    {
+        return;
+    }
+
+    if (re->op() == re2::kRegexpLiteral || re->op() == re2::kRegexpLiteralString)
+    {
+        if (literal_bytes(re, &c->literal))
+        {
+            c->path = RE_PATH_LITERAL;
+        }
+
+        return;
+    }
+
+    std::string prefix;
+    bool foldcase = false;
+    re2::Regexp *suffix = NULL;
+
+    if (re->RequiredPrefix(&prefix, &foldcase, &suffix))
+    {
+        // Only a bare "^literal" collapses to a prefix comparison: any
+        // remaining sub-expression still needs the engine.
+        bool bare = suffix->op() == re2::kRegexpEmptyMatch;
+        suffix->Decref();
+
+        if (bare && !foldcase)
+        {
+            c->literal = prefix;
+            c->path = RE_PATH_PREFIX;
+        }
+    }
+}
+
 // compile compiles a pattern, using an earlier compilation if possible.
-static re2::RE2* compile(const char *pattern)
+// The pattern is a length-delimited view, typically straight over an
+// opa_string_t buffer.
+static re_compiled* compile(const char *pattern, size_t len)
 {
+    std::string_view key(pattern, len);
+
+    re_compiled *pre = prewarmed(key);
+    if (pre != NULL)
+    {
+        return pre;
+    }
+
     re_cache* c = cache();
-    re_cache::iterator i = c->find(pattern);
-    if (i != c->end())
+    re_index_slot *slot = index_probe(&c->index, pattern, len, re_pattern_hash(pattern, len));
+    if (slot != NULL)
     {
-        return i->second;
+        c->lru.splice(c->lru.begin(), c->lru, slot->it);
+        return slot->it->c;
     }
 
-    re2::RE2::Options options;
-    options.set_log_errors(false);
-    re2::RE2 *re = new re2::RE2(pattern, options);
+    re2::RE2 *re = new re2::RE2(re2::StringPiece(pattern, len), re_options());
     if (!re->ok())
     {
         delete(re);
         return NULL;
     }
 
-    return re;
+    re_compiled *compiled = new re_compiled();
+    compiled->re = re;
+    classify(compiled);
+
+    if (compiled->path == RE_PATH_REGEX)
+    {
+        eager_build(re);
+    }
+
+    return compiled;
 }
 
-// reuse returns the precompiled pattern to the cache.
-static void reuse(re2::RE2 *re)
+// reuse returns the precompiled pattern to the cache, evicting the least
+// recently used entries once the byte budget is exceeded. Eviction only
+// runs here, after the caller is done with the compiled pattern, so a
+// checked-out pattern is never deleted under its user.
+static void reuse(re_compiled *compiled)
 {
-    cache()->insert(std::make_pair(re->pattern(), re));
+    if (prewarmed(compiled->re->pattern()) == compiled)
+    {
+        return;
+    }
+
+    re_cache* c = cache();
+    const std::string &pattern = compiled->re->pattern();
+    size_t hash = re_pattern_hash(pattern.data(), pattern.size());
+
+    if (index_probe(&c->index, pattern.data(), pattern.size(), hash) != NULL)
+    {
+        return;
+    }
+
+    re_cache_entry entry;
+    entry.pattern = pattern;
+    entry.c = compiled;
+    entry.size = entry.pattern.size() + static_cast<size_t>(compiled->re->ProgramSize());
+    entry.hash = hash;
+
+    c->lru.push_front(entry);
+
+    // The index keys off the string held by the list entry, not the local
+    // copy: that buffer stays put until the entry is evicted.
+    re_cache_entry &front = c->lru.front();
+    index_insert(&c->index, front.pattern.data(), front.pattern.size(), hash, c->lru.begin());
+    c->bytes += entry.size;
+
+    while (c->bytes > c->budget && c->lru.size() > 1)
+    {
+        re_cache_entry &last = c->lru.back();
+        c->bytes -= last.size;
+        index_erase(&c->index, last.pattern.data(), last.pattern.size(), last.hash);
+        delete(last.c->re);
+        delete(last.c);
+        c->lru.pop_back();
+    }
+}
+
+// opa_regex_cache_budget_set overrides the default byte budget of the
+// compiled pattern cache. A smaller budget takes effect on the next
+// insertion.
+extern "C" OPA_INTERNAL
+void opa_regex_cache_budget_set(size_t budget)
+{
+    cache()->budget = budget;
+}
+
+// opa_regex_max_mem_set overrides RE2's per-pattern memory budget for
+// subsequent compilations. The budget bounds the compiled programs and
+// their cached DFA graphs; patterns that exceed it degrade to the far
+// slower NFA/bitstate engines mid-match, so hosts with large patterns
+// should raise it. Zero restores RE2's default. Already-cached patterns
+// keep the budget they were compiled with.
+extern "C" OPA_INTERNAL
+void opa_regex_max_mem_set(size_t max_mem)
+{
+    re_max_mem = static_cast<int64_t>(max_mem);
+}
+
+// opa_regex_eager_set makes subsequent compilations build the forward and
+// reverse programs and the initial DFA states eagerly instead of during
+// the first matches. DFA states beyond the start states are still built
+// on demand — they depend on the input — but the per-pattern compilation
+// spike moves off the match path. Combines with opa_regex_prewarm to do
+// that work at instance initialization.
+extern "C" OPA_INTERNAL
+void opa_regex_eager_set(int eager)
+{
+    re_eager = eager != 0;
+}
+
+// opa_regex_prewarm compiles every pattern in the given set or array
+// ahead of evaluation, so cold instances do not pay RE2 compilation on
+// first use. Call it during initialization, before the evaluation heap
+// pointer is recorded. Invalid patterns are skipped; the result is the
+// number of patterns compiled. The vendored RE2 has no program
+// serialization, so repeated instance spins still parse the patterns —
+// but at initialization rather than on the latency path.
+WASM_EXPORT(opa_regex_prewarm)
+opa_value *opa_regex_prewarm(opa_value *patterns)
+{
+    if (opa_value_type(patterns) != OPA_ARRAY && opa_value_type(patterns) != OPA_SET)
+    {
+        return NULL;
+    }
+
+    if (re_prewarmed == NULL)
+    {
+        re_prewarmed = new std::map<std::string, re_compiled*, std::less<>>();
+    }
+
+    long long compiled = 0;
+
+    for (opa_value *k = opa_value_iter(patterns, NULL); k != NULL; k = opa_value_iter(patterns, k))
+    {
+        opa_value *p = opa_value_get(patterns, k);
+
+        if (opa_value_type(p) != OPA_STRING)
+        {
+            return NULL;
+        }
+
+        std::string_view pat(opa_cast_string(p)->v, opa_cast_string(p)->len);
+
+        if (re_prewarmed->find(pat) != re_prewarmed->end())
+        {
+            continue;
+        }
+
+        re2::RE2 *re = new re2::RE2(re2::StringPiece(pat.data(), pat.size()), re_options());
+        if (!re->ok())
+        {
+            delete(re);
+            continue;
+        }
+
+        re_compiled *entry = new re_compiled();
+        entry->re = re;
+        classify(entry);
+
+        if (entry->path == RE_PATH_REGEX)
+        {
+            eager_build(re);
+        }
+
+        (*re_prewarmed)[std::string(pat)] = entry;
+        compiled++;
+    }
+
+    return opa_number_int(compiled);
 }
 
 OPA_BUILTIN
@@ -71,21 +551,119 @@ opa_value *opa_regex_match(opa_value *pattern, opa_value *value)
     {
         return NULL;
     }
-    std::string pat(opa_cast_string(pattern)->v, opa_cast_string(pattern)->len);
-    re2::RE2* re = compile(pat.c_str());
+    re_compiled* re = compile(opa_cast_string(pattern)->v, opa_cast_string(pattern)->len);
     if (re == NULL)
     {
         // TODO: return an error.
         return NULL;
     }
 
-    std::string v(opa_cast_string(value)->v, opa_cast_string(value)->len);
-    bool match = re2::RE2::PartialMatch(v, *re);
+    opa_string_t *s = opa_cast_string(value);
+    bool match;
+
+    switch (re->path)
+    {
+    case RE_PATH_LITERAL:
+        match = opa_memmem(s->v, s->len, re->literal.data(), re->literal.size()) != NULL;
+        break;
+    case RE_PATH_PREFIX:
+        match = s->len >= re->literal.size() &&
+            opa_strncmp(s->v, re->literal.data(), re->literal.size()) == 0;
+        break;
+    default:
+        match = re2::RE2::PartialMatch(re2::StringPiece(s->v, s->len), *re->re);
+        break;
+    }
 
     reuse(re);
     return opa_boolean(match);
 }
 
+// opa_regex_match_all matches a set or array of patterns against a value in
+// a single scan, returning the set of patterns that matched. The vendored
+// RE2 does not ship RE2::Set, so the patterns are compiled into one
+// alternation ((?:p0)|(?:p1)|...) that answers "does anything match" in one
+// pass — the common case for rule sets is no match at all — and only a hit
+// pays for the per-pattern scans that identify the matching patterns. The
+// alternation is cached under the joined pattern text like any other
+// compiled pattern.
+OPA_BUILTIN
+opa_value *opa_regex_match_all(opa_value *patterns, opa_value *value)
+{
+    if ((opa_value_type(patterns) != OPA_ARRAY && opa_value_type(patterns) != OPA_SET) ||
+        opa_value_type(value) != OPA_STRING)
+    {
+        return NULL;
+    }
+
+    // The joined pattern is a per-call temporary: it grows on the arena
+    // and is reclaimed when the scope closes. compile() copies what it
+    // keeps.
+    opa_arena_scope scope;
+    opa_arena_string combined;
+
+    for (opa_value *k = opa_value_iter(patterns, NULL); k != NULL; k = opa_value_iter(patterns, k))
+    {
+        opa_value *p = opa_value_get(patterns, k);
+
+        if (opa_value_type(p) != OPA_STRING)
+        {
+            return NULL;
+        }
+
+        if (!combined.empty())
+        {
+            combined.push_back('|');
+        }
+
+        combined.append("(?:");
+        combined.append(opa_cast_string(p)->v, opa_cast_string(p)->len);
+        combined.push_back(')');
+    }
+
+    opa_value *result = opa_set();
+
+    if (combined.empty())
+    {
+        return result;
+    }
+
+    re_compiled *re = compile(combined.data(), combined.size());
+    if (re == NULL)
+    {
+        // TODO: return an error.
+        return NULL;
+    }
+
+    re2::StringPiece v(opa_cast_string(value)->v, opa_cast_string(value)->len);
+    bool any = re2::RE2::PartialMatch(v, *re->re);
+    reuse(re);
+
+    if (!any)
+    {
+        return result;
+    }
+
+    for (opa_value *k = opa_value_iter(patterns, NULL); k != NULL; k = opa_value_iter(patterns, k))
+    {
+        opa_value *p = opa_value_get(patterns, k);
+        re_compiled *pre = compile(opa_cast_string(p)->v, opa_cast_string(p)->len);
+        if (pre == NULL)
+        {
+            return NULL;
+        }
+
+        if (re2::RE2::PartialMatch(v, *pre->re))
+        {
+            opa_set_add(opa_cast_set(result), p);
+        }
+
+        reuse(pre);
+    }
+
+    return result;
+}
+
 OPA_BUILTIN
 opa_value *opa_regex_find_all_string_submatch(opa_value *pattern, opa_value *value, opa_value *number)
 {
@@ -100,14 +678,14 @@ opa_value *opa_regex_find_all_string_submatch(opa_value *pattern, opa_value *val
         return NULL;
     }
 
-    std::string pat(opa_cast_string(pattern)->v, opa_cast_string(pattern)->len);
-    re2::RE2* re = compile(pat.c_str());
-    if (re == NULL)
+    re_compiled* compiled = compile(opa_cast_string(pattern)->v, opa_cast_string(pattern)->len);
+    if (compiled == NULL)
     {
         // TODO: return an error.
         return NULL;
     }
 
+    re2::RE2 *re = compiled->re;
     opa_string_t *s = opa_cast_string(value);
     opa_array_t *result = opa_cast_array(opa_array());
     int nsubmatch = re->NumberOfCapturingGroups() + 1;
@@ -180,6 +758,108 @@ opa_value *opa_regex_find_all_string_submatch(opa_value *pattern, opa_value *val
         lastend = p;
     }
 
-    reuse(re);
+    reuse(compiled);
+    return &result->hdr;
+}
+
+// opa_regex_split splits the value around matches of the pattern, with the
+// semantics of Go's regexp.Split without a limit: adjacent and trailing
+// matches produce empty substrings, an empty match at the start of the
+// value does not, and an empty value splits to a single empty substring.
+OPA_BUILTIN
+opa_value *opa_regex_split(opa_value *pattern, opa_value *value)
+{
+    if (opa_value_type(pattern) != OPA_STRING || opa_value_type(value) != OPA_STRING)
+    {
+        return NULL;
+    }
+
+    re_compiled* compiled = compile(opa_cast_string(pattern)->v, opa_cast_string(pattern)->len);
+    if (compiled == NULL)
+    {
+        // TODO: return an error.
+        return NULL;
+    }
+
+    re2::RE2 *re = compiled->re;
+    opa_string_t *s = opa_cast_string(value);
+    opa_array_t *result = opa_cast_array(opa_array());
+
+    if (opa_cast_string(pattern)->len > 0 && s->len == 0)
+    {
+        reuse(compiled);
+        opa_array_append(result, opa_string_terminated(""));
+        return &result->hdr;
+    }
+
+    re2::StringPiece submatches[1];
+
+    // Match advancement follows opa_regex_find_all_string_submatch; the
+    // substrings between the matches are what gets emitted.
+
+    const char* p = s->v;
+    const char* ep = p + s->len;
+    const char* lastend = NULL;
+    const char* beg = s->v;
+    const char* end = s->v;
+
+    while (p <= ep) {
+        if (!re->Match(s->v, static_cast<size_t>(p - s->v), s->len, re2::RE2::UNANCHORED, submatches, 1))
+        {
+            break;
+        }
+
+        if (submatches[0].data() == lastend && submatches[0].empty()) {
+            // Disallow empty match at end of last match: skip ahead.
+            if (re->options().encoding() == RE2::Options::EncodingUTF8 &&
+                re2::fullrune(p, static_cast<int>(std::min(ptrdiff_t{4}, ep - p)))) {
+                re2::Rune r;
+                int n = re2::chartorune(&r, p);
+                if (r > re2::Runemax) {
+                    n = 1;
+                    r = re2::Runeerror;
+                }
+
+                if (!(n == 1 && r == re2::Runeerror)) {  // no decoding error
+                    p += n;
+                    continue;
+                }
+            }
+
+            p++;
+            continue;
+        }
+
+        end = submatches[0].data();
+
+        // An empty match before the first byte separates nothing: Go's
+        // Split drops it rather than emit a leading empty substring.
+        if (submatches[0].data() + submatches[0].size() != s->v)
+        {
+            const size_t length = end - beg;
+            char *str = (char *)opa_malloc(length + 1);
+
+            memcpy(str, beg, length);
+            str[length] = '\0';
+            opa_array_append(result, opa_string_allocated(str, length));
+        }
+
+        beg = submatches[0].data() + submatches[0].size();
+
+        p = submatches[0].data() + submatches[0].size();
+        lastend = p;
+    }
+
+    if (end != ep)
+    {
+        const size_t length = ep - beg;
+        char *str = (char *)opa_malloc(length + 1);
+
+        memcpy(str, beg, length);
+        str[length] = '\0';
+        opa_array_append(result, opa_string_allocated(str, length));
+    }
+
+    reuse(compiled);
     return &result->hdr;
 }
@@ -9,7 +9,14 @@ extern "C" {
 
 opa_value *opa_regex_is_valid(opa_value *v);
 opa_value *opa_regex_match(opa_value *pattern, opa_value *value);
+opa_value *opa_regex_match_all(opa_value *patterns, opa_value *value);
 opa_value *opa_regex_find_all_string_submatch(opa_value *pattern, opa_value *string, opa_value *number);
+opa_value *opa_regex_split(opa_value *pattern, opa_value *string);
+
+void opa_regex_cache_budget_set(size_t budget);
+void opa_regex_max_mem_set(size_t max_mem);
+void opa_regex_eager_set(int eager);
+opa_value *opa_regex_prewarm(opa_value *patterns);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,214 @@
+#include <string.h>
+
+#include "json.h"
+#include "malloc.h"
+#include "result.h"
+#include "std.h"
+#include "str.h"
+
+// Structured result access. A host that reads two fields out of a 2KB
+// decision object pays for serializing and re-parsing all of it when the
+// result crosses the boundary as JSON. These exports let an SDK walk the
+// result value directly instead: opa_eval_ctx_get_result (or
+// opa_value_parse) hands out the handle, the probes classify it, and the
+// accessors return field handles, string bytes and scalars zero-copy
+// from linear memory. Handles are ordinary opa_value pointers and stay
+// valid until the heap is reset, like every other evaluation result.
+
+// opa_result_type returns the value's OPA_* type tag, or 0 for NULL —
+// lookups below return NULL for missing fields, so the probe composes
+// with them without a host-side check in between.
+WASM_EXPORT(opa_result_type)
+int32_t opa_result_type(opa_value *v)
+{
+    return v == NULL ? 0 : opa_value_type(v);
+}
+
+WASM_EXPORT(opa_result_length)
+uint32_t opa_result_length(opa_value *v)
+{
+    return v == NULL ? 0 : (uint32_t)opa_value_length(v);
+}
+
+// opa_result_get looks a string key up in an object (or a string member
+// in a set) without allocating: the key bytes are the caller's, wrapped
+// in a stack temporary for the lookup.
+WASM_EXPORT(opa_result_get)
+opa_value *opa_result_get(opa_value *v, const char *key, size_t key_len)
+{
+    if (v == NULL || key == NULL)
+    {
+        return NULL;
+    }
+
+    opa_string_t k = {
+        .hdr = {.type = OPA_STRING, .frozen = 0},
+        .free = 0,
+        .len = key_len,
+        .v = key,
+        .hash = 0,
+        .runes = NULL,
+    };
+
+    return opa_value_get(v, &k.hdr);
+}
+
+WASM_EXPORT(opa_result_get_index)
+opa_value *opa_result_get_index(opa_value *v, uint32_t i)
+{
+    if (v == NULL || opa_value_type(v) != OPA_ARRAY)
+    {
+        return NULL;
+    }
+
+    opa_array_t *arr = opa_cast_array(v);
+    return i < arr->len ? arr->elems[i].v : NULL;
+}
+
+// Iteration mirrors opa_value_iter: passing NULL starts it, each call
+// returns the next key handle (the element itself for sets, the index
+// for arrays) and NULL ends it. opa_result_iter_value resolves a key to
+// its value.
+WASM_EXPORT(opa_result_iter)
+opa_value *opa_result_iter(opa_value *v, opa_value *prev)
+{
+    return v == NULL ? NULL : opa_value_iter(v, prev);
+}
+
+WASM_EXPORT(opa_result_iter_value)
+opa_value *opa_result_iter_value(opa_value *v, opa_value *key)
+{
+    return v == NULL || key == NULL ? NULL : opa_value_get(v, key);
+}
+
+WASM_EXPORT(opa_result_string_ptr)
+const char *opa_result_string_ptr(opa_value *v)
+{
+    if (v == NULL || opa_value_type(v) != OPA_STRING)
+    {
+        return NULL;
+    }
+
+    return opa_cast_string(v)->v;
+}
+
+WASM_EXPORT(opa_result_string_len)
+uint32_t opa_result_string_len(opa_value *v)
+{
+    if (v == NULL || opa_value_type(v) != OPA_STRING)
+    {
+        return 0;
+    }
+
+    return (uint32_t)opa_cast_string(v)->len;
+}
+
+// opa_result_bool returns 0 or 1 for booleans and -1 for anything else.
+WASM_EXPORT(opa_result_bool)
+int32_t opa_result_bool(opa_value *v)
+{
+    if (v == NULL || opa_value_type(v) != OPA_BOOLEAN)
+    {
+        return -1;
+    }
+
+    return opa_cast_boolean(v)->v ? 1 : 0;
+}
+
+// opa_result_number returns the number as a float, 0 for anything else;
+// callers probe the type first when 0 is ambiguous.
+WASM_EXPORT(opa_result_number)
+double opa_result_number(opa_value *v)
+{
+    if (v == NULL || opa_value_type(v) != OPA_NUMBER)
+    {
+        return 0;
+    }
+
+    return opa_number_as_float(opa_cast_number(v));
+}
+
+// Paginated serialization. The accessors above let a host pick fields
+// out of a result without serializing it, and opa_json_stream moves one
+// big dump across in chunks; what neither covers is a host that wants
+// the elements of a large collection as separate JSON documents — to
+// forward them one at a time, apply backpressure, or stop after the
+// first page. A result cursor yields exactly that: one serialized
+// top-level element per call, built on opa_value_cursor so each step is
+// O(1) instead of re-finding the position by hash.
+WASM_EXPORT(opa_result_iter_begin)
+opa_value_cursor_t *opa_result_iter_begin(opa_value *v)
+{
+    if (v == NULL)
+    {
+        return NULL;
+    }
+
+    switch (opa_value_type(v))
+    {
+    case OPA_ARRAY:
+    case OPA_OBJECT:
+    case OPA_SET:
+        return opa_value_cursor(v);
+    }
+
+    return NULL;
+}
+
+// opa_result_iter_next returns the next element as a nul-terminated JSON
+// string, or NULL when the iteration is done. Array elements and set
+// members serialize as themselves; an object entry serializes as a
+// single-pair object, so concatenating the pages (with the outer
+// delimiters restored) reproduces opa_json_dump of the whole value.
+WASM_EXPORT(opa_result_iter_next)
+char *opa_result_iter_next(opa_value_cursor_t *cur)
+{
+    if (cur == NULL)
+    {
+        return NULL;
+    }
+
+    opa_value *key = opa_value_cursor_next(cur);
+
+    if (key == NULL)
+    {
+        return NULL;
+    }
+
+    if (opa_value_type(cur->node) != OPA_OBJECT)
+    {
+        return opa_json_dump(opa_value_cursor_value(cur));
+    }
+
+    // non-string keys are serialized and emitted as a JSON string,
+    // matching opa_json_dump of the enclosing object.
+    char *k;
+
+    if (opa_value_type(key) == OPA_STRING)
+    {
+        k = opa_json_dump(key);
+    }
+    else
+    {
+        char *inner = opa_json_dump(key);
+        opa_value *quoted = opa_string_allocated(inner, opa_strlen(inner));
+        k = opa_json_dump(quoted);
+        opa_value_free(quoted);
+    }
+
+    char *v = opa_json_dump(opa_value_cursor_value(cur));
+    size_t klen = opa_strlen(k);
+    size_t vlen = opa_strlen(v);
+    char *out = (char *)opa_malloc(klen + vlen + 4);
+
+    out[0] = '{';
+    memcpy(&out[1], k, klen);
+    out[klen + 1] = ':';
+    memcpy(&out[klen + 2], v, vlen);
+    out[klen + vlen + 2] = '}';
+    out[klen + vlen + 3] = 0;
+
+    opa_free(k);
+    opa_free(v);
+    return out;
+}
@@ -0,0 +1,23 @@
+#ifndef OPA_RESULT_H
+#define OPA_RESULT_H
+
+#include "value.h"
+
+int32_t opa_result_type(opa_value *v);
+uint32_t opa_result_length(opa_value *v);
+opa_value *opa_result_get(opa_value *v, const char *key, size_t key_len);
+opa_value *opa_result_get_index(opa_value *v, uint32_t i);
+opa_value *opa_result_iter(opa_value *v, opa_value *prev);
+opa_value *opa_result_iter_value(opa_value *v, opa_value *key);
+const char *opa_result_string_ptr(opa_value *v);
+uint32_t opa_result_string_len(opa_value *v);
+int32_t opa_result_bool(opa_value *v);
+double opa_result_number(opa_value *v);
+
+// Paginated serialization: opa_result_iter_next returns one serialized
+// top-level element per call (NULL when done), so large results can be
+// streamed element-wise instead of dumped in one string.
+opa_value_cursor_t *opa_result_iter_begin(opa_value *v);
+char *opa_result_iter_next(opa_value_cursor_t *cur);
+
+#endif
@@ -1,6 +1,40 @@
 #include "set.h"
 #include "std.h"
 
+// Membership probes against one fixed operand dominate the binary set
+// operations. For dense integer sets the memoized bitmap (see
+// opa_set_bitmap) answers such a probe with a couple of word tests instead
+// of a hash probe.
+typedef struct
+{
+    unsigned long long *bits; // NULL: fall back to opa_set_get
+    long long base;
+    size_t words;
+    opa_set_t *set;
+} opa_set_probe_t;
+
+static void opa_set_probe_init(opa_set_probe_t *p, opa_set_t *set)
+{
+    p->set = set;
+    p->bits = opa_set_bitmap(set, &p->base, &p->words);
+}
+
+static bool opa_set_probe(opa_set_probe_t *p, opa_value *v)
+{
+    if (p->bits != NULL && opa_value_type(v) == OPA_NUMBER)
+    {
+        long long i;
+
+        if (opa_number_try_int(opa_cast_number(v), &i) == 0)
+        {
+            return i >= p->base && i < p->base + (long long)(p->words * 64) &&
+                ((p->bits[(size_t)(i - p->base) / 64] >> ((size_t)(i - p->base) % 64)) & 1);
+        }
+    }
+
+    return opa_set_get(p->set, v) != NULL;
+}
+
 OPA_BUILTIN
 opa_value *opa_set_diff(opa_value *a, opa_value *b)
 {
@@ -11,7 +45,17 @@ opa_value *opa_set_diff(opa_value *a, opa_value *b)
 
     opa_set_t *x = opa_cast_set(a);
     opa_set_t *y = opa_cast_set(b);
-    opa_set_t *r = opa_cast_set(opa_set());
+
+    if (x->len == 0 || y->len == 0)
+    {
+        // Nothing can be subtracted: share the first operand.
+        return a;
+    }
+
+    opa_set_t *r = opa_cast_set(opa_set_with_cap(x->len));
+    opa_set_probe_t p;
+
+    opa_set_probe_init(&p, y);
 
     for (int i = 0; i < x->n; i++)
     {
@@ -19,7 +63,7 @@ opa_value *opa_set_diff(opa_value *a, opa_value *b)
 
         while (elem != NULL)
         {
-            if (opa_set_get(y, elem->v) == NULL)
+            if (!opa_set_probe(&p, elem->v))
             {
                 opa_set_add(r, elem->v);
             }
@@ -38,8 +82,24 @@ opa_value *opa_set_intersection(opa_value *a, opa_value *b)
         return NULL;
     }
 
+    if (a == b)
+    {
+        return a;
+    }
+
     opa_set_t *x = opa_cast_set(a);
     opa_set_t *y = opa_cast_set(b);
+
+    if (x->len == 0)
+    {
+        return a;
+    }
+
+    if (y->len == 0)
+    {
+        return b;
+    }
+
     opa_set_t *r = opa_cast_set(opa_set_with_cap(x->len < y->len ? x->len : y->len));
 
     if (y->len < x->len)
@@ -48,13 +108,17 @@ opa_value *opa_set_intersection(opa_value *a, opa_value *b)
         y = opa_cast_set(a);
     }
 
+    opa_set_probe_t p;
+
+    opa_set_probe_init(&p, y);
+
     for (int i = 0; i < x->n; i++)
     {
         opa_set_elem_t *elem = x->buckets[i];
 
         while (elem != NULL)
         {
-            if (opa_set_get(y, elem->v) != NULL)
+            if (opa_set_probe(&p, elem->v))
             {
                 opa_set_add(r, elem->v);
             }
@@ -80,7 +144,12 @@ opa_value *opa_sets_intersection(opa_value *v)
         return opa_set();
     }
 
-    opa_value *r = NULL;
+    // Intersect all members in one pass instead of folding pairwise
+    // through N-1 intermediate sets: collect the members, then probe
+    // every other member for each element of the smallest one.
+    opa_set_t **members = (opa_set_t **)opa_malloc(s->len * sizeof(opa_set_t *));
+    size_t n = 0;
+    opa_set_t *smallest = NULL;
 
     for (int i = 0; i < s->n; i++)
     {
@@ -90,28 +159,59 @@ opa_value *opa_sets_intersection(opa_value *v)
         {
             if (opa_value_type(elem->v) != OPA_SET)
             {
+                opa_free(members);
                 return NULL;
             }
 
-            if (r == NULL)
+            members[n] = opa_cast_set(elem->v);
+
+            if (smallest == NULL || members[n]->len < smallest->len)
             {
-                r = opa_set_union(opa_set(), elem->v);
-            } else {
-                opa_value *x = opa_set_intersection(r, elem->v);
-                opa_value_free(r);
-                if (x == NULL)
+                smallest = members[n];
+            }
+
+            n++;
+            elem = elem->next;
+        }
+    }
+
+    if (n == 1 || smallest->len == 0)
+    {
+        // A single member, or one that empties the intersection: share it.
+        opa_free(members);
+        return &smallest->hdr;
+    }
+
+    opa_set_t *r = opa_cast_set(opa_set_with_cap(smallest->len));
+
+    for (int i = 0; i < smallest->n; i++)
+    {
+        opa_set_elem_t *elem = smallest->buckets[i];
+
+        while (elem != NULL)
+        {
+            int all = 1;
+
+            for (size_t j = 0; j < n; j++)
+            {
+                if (members[j] != smallest && opa_set_get(members[j], elem->v) == NULL)
                 {
-                    return NULL;
+                    all = 0;
+                    break;
                 }
+            }
 
-                r = x;
+            if (all)
+            {
+                opa_set_add(r, elem->v);
             }
 
             elem = elem->next;
         }
     }
 
-    return r;
+    opa_free(members);
+    return &r->hdr;
 }
 
 OPA_BUILTIN
@@ -124,7 +224,20 @@ opa_value *opa_set_union(opa_value *a, opa_value *b)
 
     opa_set_t *x = opa_cast_set(a);
     opa_set_t *y = opa_cast_set(b);
-    opa_set_t *r = opa_cast_set(opa_set());
+
+    if (x->len == 0 || a == b)
+    {
+        return b;
+    }
+
+    if (y->len == 0)
+    {
+        return a;
+    }
+
+    // The union is at most |a| + |b| elements; size the table once so
+    // inserting them rehashes nothing.
+    opa_set_t *r = opa_cast_set(opa_set_with_cap(x->len + y->len));
 
     for (int i = 0; i < x->n; i++)
     {
@@ -160,7 +273,13 @@ opa_value *opa_sets_union(opa_value *v)
     }
 
     opa_set_t *s = opa_cast_set(v);
-    opa_value *r = opa_set();
+
+    // Union all members in one pass: a first sweep validates them and
+    // sums their cardinalities so the result table is sized once, then
+    // every element is inserted a single time. The pairwise fold built
+    // and discarded N-1 intermediate sets.
+    size_t total = 0;
+    opa_value *last = NULL;
 
     for (int i = 0; i < s->n; i++)
     {
@@ -173,17 +292,43 @@ opa_value *opa_sets_union(opa_value *v)
                 return NULL;
             }
 
-            opa_value *x = opa_set_union(r, elem->v);
-            opa_value_free(r);
-            if (x == NULL)
+            total += opa_cast_set(elem->v)->len;
+            last = elem->v;
+            elem = elem->next;
+        }
+    }
+
+    if (s->len == 1)
+    {
+        return last;
+    }
+
+    if (total == 0)
+    {
+        return opa_set();
+    }
+
+    opa_set_t *r = opa_cast_set(opa_set_with_cap(total));
+
+    for (int i = 0; i < s->n; i++)
+    {
+        opa_set_elem_t *elem = s->buckets[i];
+
+        while (elem != NULL)
+        {
+            opa_set_t *m = opa_cast_set(elem->v);
+
+            for (int j = 0; j < m->n; j++)
             {
-                return NULL;
+                for (opa_set_elem_t *me = m->buckets[j]; me != NULL; me = me->next)
+                {
+                    opa_set_add(r, me->v);
+                }
             }
 
-            r = x;
             elem = elem->next;
         }
     }
 
-    return r;
+    return &r->hdr;
 }
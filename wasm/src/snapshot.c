@@ -0,0 +1,567 @@
+#include <string.h>
+
+#include "malloc.h"
+#include "snapshot.h"
+#include "std.h"
+
+#define OPA_SNAPSHOT_MAGIC (0x4f504153)         // "OPAS"
+#define OPA_SNAPSHOT_MAGIC_MOUNTED (0x4f50414d) // "OPAM": fixed up in place
+// Version 2: opa_array_elem_t lost its stored index value, shrinking the
+// serialized element array. Version 3: opa_set_t gained the sorted-vector
+// flag. Version 4: opa_set_t gained the bitmap cache fields. Version 5:
+// opa_object_t gained the bloom filter fields. Version 6: the header
+// records the address a mounted region was fixed up for, so a region that
+// reappears at a different address can be relocated. Version 7: opa_value
+// gained the frozen flag. Version 8: opa_array_t gained the elems
+// ownership flag. Older blobs are rejected on restore.
+#define OPA_SNAPSHOT_VERSION (8)
+
+// Every region in the blob is aligned so the restored structs can be used
+// in place after the fix-up pass.
+#define OPA_SNAPSHOT_ALIGN(n) (((n) + 7) & ~(size_t)7)
+
+typedef struct
+{
+    unsigned int magic;
+    unsigned int version;
+    unsigned int len;  // total blob length in bytes
+    unsigned int root; // offset of the root value
+    unsigned long long base; // address the pointers were fixed up for;
+                             // 0 while the blob holds offsets
+} opa_snapshot_header;
+
+// Returns the blob space needed for 'v'. Interned values are serialized as
+// their plain counterparts; lazy subtrees are materialized, so a snapshot
+// never depends on the parse input staying pinned.
+static size_t opa_snapshot_size(opa_value *v)
+{
+    if (v->type == OPA_LAZY)
+    {
+        v = opa_value_force(v);
+    }
+
+    switch (opa_value_type(v))
+    {
+    case OPA_NULL:
+        return OPA_SNAPSHOT_ALIGN(sizeof(opa_value));
+    case OPA_BOOLEAN:
+        return OPA_SNAPSHOT_ALIGN(sizeof(opa_boolean_t));
+    case OPA_NUMBER:
+    {
+        opa_number_t *n = opa_cast_number(v);
+        size_t size = OPA_SNAPSHOT_ALIGN(sizeof(opa_number_t));
+
+        if (n->repr == OPA_NUMBER_REPR_REF)
+        {
+            size += OPA_SNAPSHOT_ALIGN(n->v.ref.len);
+        }
+
+        return size;
+    }
+    case OPA_STRING:
+        return OPA_SNAPSHOT_ALIGN(sizeof(opa_string_t)) +
+            OPA_SNAPSHOT_ALIGN(opa_cast_string(v)->len);
+    case OPA_ARRAY:
+    {
+        opa_array_t *arr = opa_cast_array(v);
+        size_t size = OPA_SNAPSHOT_ALIGN(sizeof(opa_array_t)) +
+            OPA_SNAPSHOT_ALIGN(arr->len * sizeof(opa_array_elem_t));
+
+        for (size_t i = 0; i < arr->len; i++)
+        {
+            size += opa_snapshot_size(arr->elems[i].v);
+        }
+
+        return size;
+    }
+    case OPA_OBJECT:
+    {
+        opa_object_t *obj = opa_cast_object(v);
+        size_t size = OPA_SNAPSHOT_ALIGN(sizeof(opa_object_t)) +
+            OPA_SNAPSHOT_ALIGN(obj->n * sizeof(opa_object_elem_t *));
+
+        for (size_t i = 0; i < obj->n; i++)
+        {
+            for (opa_object_elem_t *elem = obj->buckets[i]; elem != NULL; elem = elem->next)
+            {
+                size += OPA_SNAPSHOT_ALIGN(sizeof(opa_object_elem_t)) +
+                    opa_snapshot_size(elem->k) + opa_snapshot_size(elem->v);
+            }
+        }
+
+        return size;
+    }
+    case OPA_SET:
+    {
+        opa_set_t *set = opa_cast_set(v);
+        size_t size = OPA_SNAPSHOT_ALIGN(sizeof(opa_set_t)) +
+            OPA_SNAPSHOT_ALIGN(set->n * sizeof(opa_set_elem_t *));
+
+        for (size_t i = 0; i < set->n; i++)
+        {
+            for (opa_set_elem_t *elem = set->buckets[i]; elem != NULL; elem = elem->next)
+            {
+                size += OPA_SNAPSHOT_ALIGN(sizeof(opa_set_elem_t)) +
+                    opa_snapshot_size(elem->v);
+            }
+        }
+
+        return size;
+    }
+    }
+
+    return 0;
+}
+
+static size_t opa_snapshot_reserve(size_t *off, size_t size)
+{
+    size_t ret = *off;
+    *off += OPA_SNAPSHOT_ALIGN(size);
+    return ret;
+}
+
+// Writes 'v' into the blob at the cursor and returns its offset. Pointer
+// fields hold blob offsets; offset zero (the header) stands for NULL.
+static size_t opa_snapshot_emit(char *blob, size_t *off, opa_value *v)
+{
+    if (v->type == OPA_LAZY)
+    {
+        v = opa_value_force(v);
+    }
+
+    switch (opa_value_type(v))
+    {
+    case OPA_NULL:
+    {
+        size_t self = opa_snapshot_reserve(off, sizeof(opa_value));
+        ((opa_value *)(blob + self))->type = OPA_NULL;
+        ((opa_value *)(blob + self))->frozen = 0;
+        return self;
+    }
+    case OPA_BOOLEAN:
+    {
+        size_t self = opa_snapshot_reserve(off, sizeof(opa_boolean_t));
+        opa_boolean_t *out = (opa_boolean_t *)(blob + self);
+
+        out->hdr.type = OPA_BOOLEAN;
+        out->hdr.frozen = 0;
+        out->v = opa_cast_boolean(v)->v;
+        return self;
+    }
+    case OPA_NUMBER:
+    {
+        opa_number_t *n = opa_cast_number(v);
+        size_t self = opa_snapshot_reserve(off, sizeof(opa_number_t));
+        opa_number_t *out = (opa_number_t *)(blob + self);
+
+        out->hdr.type = OPA_NUMBER;
+        out->hdr.frozen = 0;
+        out->repr = n->repr;
+        out->bf = NULL;
+
+        if (n->repr == OPA_NUMBER_REPR_REF)
+        {
+            size_t chars = opa_snapshot_reserve(off, n->v.ref.len);
+
+            memcpy(blob + chars, n->v.ref.s, n->v.ref.len);
+            out->v.ref.s = (const char *)chars;
+            out->v.ref.len = n->v.ref.len;
+            out->v.ref.free = 0;
+        }
+        else
+        {
+            out->v.i = n->v.i;
+        }
+
+        return self;
+    }
+    case OPA_STRING:
+    {
+        opa_string_t *s = opa_cast_string(v);
+        size_t self = opa_snapshot_reserve(off, sizeof(opa_string_t));
+        size_t chars = opa_snapshot_reserve(off, s->len);
+        opa_string_t *out = (opa_string_t *)(blob + self);
+
+        memcpy(blob + chars, s->v, s->len);
+        out->hdr.type = OPA_STRING;
+        out->hdr.frozen = 0;
+        out->free = 0;
+        out->len = s->len;
+        out->v = (const char *)chars;
+        out->hash = s->hash;
+        out->runes = NULL;
+        return self;
+    }
+    case OPA_ARRAY:
+    {
+        opa_array_t *arr = opa_cast_array(v);
+        size_t self = opa_snapshot_reserve(off, sizeof(opa_array_t));
+        size_t elems = arr->len > 0 ?
+            opa_snapshot_reserve(off, arr->len * sizeof(opa_array_elem_t)) : 0;
+        opa_array_t *out = (opa_array_t *)(blob + self);
+
+        out->hdr.type = OPA_ARRAY;
+        out->hdr.frozen = 0;
+        out->free = 0;
+        out->len = arr->len;
+        out->cap = arr->len;
+        out->elems = (opa_array_elem_t *)elems;
+
+        for (size_t i = 0; i < arr->len; i++)
+        {
+            opa_array_elem_t *e = (opa_array_elem_t *)(blob + elems) + i;
+
+            e->v = (opa_value *)opa_snapshot_emit(blob, off, arr->elems[i].v);
+        }
+
+        return self;
+    }
+    case OPA_OBJECT:
+    {
+        opa_object_t *obj = opa_cast_object(v);
+        size_t self = opa_snapshot_reserve(off, sizeof(opa_object_t));
+        size_t buckets = opa_snapshot_reserve(off, obj->n * sizeof(opa_object_elem_t *));
+        opa_object_t *out = (opa_object_t *)(blob + self);
+
+        out->hdr.type = OPA_OBJECT;
+        out->hdr.frozen = 0;
+        out->n = obj->n;
+        out->len = obj->len;
+        out->keys = NULL;
+        out->bloom = NULL;
+        out->bloom_words = 0;
+        out->bloom_epoch = 0;
+        out->buckets = (opa_object_elem_t **)buckets;
+
+        for (size_t i = 0; i < obj->n; i++)
+        {
+            opa_object_elem_t **slot = (opa_object_elem_t **)(blob + buckets) + i;
+            opa_object_elem_t *prev = NULL;
+
+            *slot = NULL;
+
+            for (opa_object_elem_t *elem = obj->buckets[i]; elem != NULL; elem = elem->next)
+            {
+                size_t eoff = opa_snapshot_reserve(off, sizeof(opa_object_elem_t));
+                opa_object_elem_t *out_elem = (opa_object_elem_t *)(blob + eoff);
+
+                out_elem->hash = elem->hash;
+                out_elem->next = NULL;
+                out_elem->k = (opa_value *)opa_snapshot_emit(blob, off, elem->k);
+                out_elem->v = (opa_value *)opa_snapshot_emit(blob, off, elem->v);
+
+                if (prev == NULL)
+                {
+                    *slot = (opa_object_elem_t *)eoff;
+                }
+                else
+                {
+                    prev->next = (opa_object_elem_t *)eoff;
+                }
+
+                prev = out_elem;
+            }
+        }
+
+        return self;
+    }
+    case OPA_SET:
+    {
+        opa_set_t *set = opa_cast_set(v);
+        size_t self = opa_snapshot_reserve(off, sizeof(opa_set_t));
+        size_t buckets = opa_snapshot_reserve(off, set->n * sizeof(opa_set_elem_t *));
+        opa_set_t *out = (opa_set_t *)(blob + self);
+
+        out->hdr.type = OPA_SET;
+        out->hdr.frozen = 0;
+        out->n = set->n;
+        out->len = set->len;
+        out->sorted = set->sorted;
+        out->bitmap = NULL;
+        out->bitmap_base = 0;
+        out->bitmap_words = 0;
+        out->bitmap_epoch = 0;
+        out->buckets = (opa_set_elem_t **)buckets;
+
+        for (size_t i = 0; i < set->n; i++)
+        {
+            opa_set_elem_t **slot = (opa_set_elem_t **)(blob + buckets) + i;
+            opa_set_elem_t *prev = NULL;
+
+            *slot = NULL;
+
+            for (opa_set_elem_t *elem = set->buckets[i]; elem != NULL; elem = elem->next)
+            {
+                size_t eoff = opa_snapshot_reserve(off, sizeof(opa_set_elem_t));
+                opa_set_elem_t *out_elem = (opa_set_elem_t *)(blob + eoff);
+
+                out_elem->hash = elem->hash;
+                out_elem->next = NULL;
+                out_elem->v = (opa_value *)opa_snapshot_emit(blob, off, elem->v);
+
+                if (prev == NULL)
+                {
+                    *slot = (opa_set_elem_t *)eoff;
+                }
+                else
+                {
+                    prev->next = (opa_set_elem_t *)eoff;
+                }
+
+                prev = out_elem;
+            }
+        }
+
+        return self;
+    }
+    }
+
+    return 0;
+}
+
+// Turns the offsets stored at 'off' back into pointers relative to 'base'.
+static opa_value *opa_snapshot_fixup(char *base, size_t off)
+{
+    opa_value *v = (opa_value *)(base + off);
+
+    switch (v->type)
+    {
+    case OPA_NUMBER:
+    {
+        opa_number_t *n = opa_cast_number(v);
+
+        n->bf = NULL;
+
+        if (n->repr == OPA_NUMBER_REPR_REF)
+        {
+            n->v.ref.s = base + (size_t)n->v.ref.s;
+        }
+
+        break;
+    }
+    case OPA_STRING:
+    {
+        opa_string_t *s = opa_cast_string(v);
+
+        s->runes = NULL;
+        s->v = base + (size_t)s->v;
+        break;
+    }
+    case OPA_ARRAY:
+    {
+        opa_array_t *arr = opa_cast_array(v);
+
+        arr->elems = arr->len > 0 ?
+            (opa_array_elem_t *)(base + (size_t)arr->elems) : NULL;
+
+        for (size_t i = 0; i < arr->len; i++)
+        {
+            arr->elems[i].v = opa_snapshot_fixup(base, (size_t)arr->elems[i].v);
+        }
+
+        break;
+    }
+    case OPA_OBJECT:
+    {
+        opa_object_t *obj = opa_cast_object(v);
+
+        obj->keys = NULL;
+        obj->bloom = NULL;
+        obj->buckets = (opa_object_elem_t **)(base + (size_t)obj->buckets);
+
+        for (size_t i = 0; i < obj->n; i++)
+        {
+            size_t eoff = (size_t)obj->buckets[i];
+
+            obj->buckets[i] = eoff != 0 ? (opa_object_elem_t *)(base + eoff) : NULL;
+
+            for (opa_object_elem_t *elem = obj->buckets[i]; elem != NULL; elem = elem->next)
+            {
+                elem->k = opa_snapshot_fixup(base, (size_t)elem->k);
+                elem->v = opa_snapshot_fixup(base, (size_t)elem->v);
+
+                size_t noff = (size_t)elem->next;
+                elem->next = noff != 0 ? (opa_object_elem_t *)(base + noff) : NULL;
+            }
+        }
+
+        break;
+    }
+    case OPA_SET:
+    {
+        opa_set_t *set = opa_cast_set(v);
+
+        set->bitmap = NULL;
+        set->buckets = (opa_set_elem_t **)(base + (size_t)set->buckets);
+
+        for (size_t i = 0; i < set->n; i++)
+        {
+            size_t eoff = (size_t)set->buckets[i];
+
+            set->buckets[i] = eoff != 0 ? (opa_set_elem_t *)(base + eoff) : NULL;
+
+            for (opa_set_elem_t *elem = set->buckets[i]; elem != NULL; elem = elem->next)
+            {
+                elem->v = opa_snapshot_fixup(base, (size_t)elem->v);
+
+                size_t noff = (size_t)elem->next;
+                elem->next = noff != 0 ? (opa_set_elem_t *)(base + noff) : NULL;
+            }
+        }
+
+        break;
+    }
+    }
+
+    return v;
+}
+
+OPA_INTERNAL
+WASM_EXPORT(opa_value_snapshot)
+char *opa_value_snapshot(opa_value *v, size_t *len)
+{
+    size_t size = OPA_SNAPSHOT_ALIGN(sizeof(opa_snapshot_header)) + opa_snapshot_size(v);
+    char *blob = (char *)opa_malloc(size);
+    size_t off = OPA_SNAPSHOT_ALIGN(sizeof(opa_snapshot_header));
+    opa_snapshot_header *hdr = (opa_snapshot_header *)blob;
+
+    hdr->magic = OPA_SNAPSHOT_MAGIC;
+    hdr->version = OPA_SNAPSHOT_VERSION;
+    hdr->len = (unsigned int)size;
+    hdr->base = 0;
+    hdr->root = (unsigned int)opa_snapshot_emit(blob, &off, v);
+
+    if (len != NULL)
+    {
+        *len = size;
+    }
+
+    return blob;
+}
+
+OPA_INTERNAL
+WASM_EXPORT(opa_value_restore)
+opa_value *opa_value_restore(const char *blob, size_t len)
+{
+    if (blob == NULL || len < sizeof(opa_snapshot_header))
+    {
+        return NULL;
+    }
+
+    const opa_snapshot_header *hdr = (const opa_snapshot_header *)blob;
+
+    if (hdr->magic != OPA_SNAPSHOT_MAGIC || hdr->version != OPA_SNAPSHOT_VERSION ||
+        hdr->len > len || hdr->root >= hdr->len)
+    {
+        return NULL;
+    }
+
+    char *copy = (char *)opa_malloc(hdr->len);
+
+    memcpy(copy, blob, hdr->len);
+    return opa_snapshot_fixup(copy, hdr->root);
+}
+
+// Fixes a snapshot up where it sits instead of copying it onto the heap,
+// for blobs the host placed in a memory region shared by several instances
+// of the module: the data document then exists once per node instead of
+// once per instance. The first mount rewrites the blob's offsets into
+// pointers and stamps the header; instances bound to the same memory see
+// identical addresses, so later mounts recognize the stamp and return the
+// root without touching the region. The host must complete one mount
+// before any other instance evaluates — the fix-up pass is not atomic.
+OPA_INTERNAL
+WASM_EXPORT(opa_value_mount)
+opa_value *opa_value_mount(char *blob, size_t len)
+{
+    if (blob == NULL || len < sizeof(opa_snapshot_header))
+    {
+        return NULL;
+    }
+
+    opa_snapshot_header *hdr = (opa_snapshot_header *)blob;
+
+    if (hdr->magic == OPA_SNAPSHOT_MAGIC_MOUNTED)
+    {
+        if (hdr->version != OPA_SNAPSHOT_VERSION || hdr->len > len)
+        {
+            return NULL;
+        }
+
+        if ((opa_heap_addr_t)blob == (opa_heap_addr_t)hdr->base)
+        {
+            return (opa_value *)(blob + hdr->root);
+        }
+
+        // The region moved since it was mounted: its pointers are absolute
+        // for the old base, so one more walk adds the difference. The
+        // arithmetic is the offset fix-up with the delta as the base.
+        char *delta = (char *)((opa_heap_addr_t)blob - (opa_heap_addr_t)hdr->base);
+        opa_value *v = opa_snapshot_fixup(delta, (size_t)hdr->base + hdr->root);
+
+        hdr->base = (opa_heap_addr_t)blob;
+        return v;
+    }
+
+    if (hdr->magic != OPA_SNAPSHOT_MAGIC || hdr->version != OPA_SNAPSHOT_VERSION ||
+        hdr->len > len || hdr->root >= hdr->len)
+    {
+        return NULL;
+    }
+
+    opa_value *v = opa_snapshot_fixup(blob, hdr->root);
+
+    hdr->base = (opa_heap_addr_t)blob;
+    hdr->magic = OPA_SNAPSHOT_MAGIC_MOUNTED;
+    return v;
+}
+
+// Compile-time constant pool. Policy literals — strings, numbers, the
+// small arrays and objects rule bodies compare against — are otherwise
+// constructed at runtime through opa_string and friends every time a heap
+// reset discards them. The compiler instead snapshots an array of every
+// literal at build time, embeds the blob in the module's data segment and
+// calls opa_constants_init from _initialize, like opa_mapping_init;
+// compiled code then fetches literal i with opa_constant(i). The pool is
+// fixed up in place, frozen, and its hashes are warmed once, so a literal
+// costs an array index instead of an allocation and a hash.
+static opa_array_t *constants = NULL;
+
+OPA_INTERNAL
+WASM_EXPORT(opa_constants_init)
+void opa_constants_init(char *blob, size_t len)
+{
+    if (constants != NULL)
+    {
+        return;
+    }
+
+    opa_value *root = opa_value_mount(blob, len);
+
+    if (root == NULL || opa_value_type(root) != OPA_ARRAY)
+    {
+        opa_abort("opa_constants_init: invalid constant pool");
+    }
+
+    opa_value_freeze(root);
+    constants = opa_cast_array(root);
+
+    // the blob sits below the heap, so the hashes cached by this walk — and
+    // the pool itself — survive heap resets
+    for (size_t i = 0; i < constants->len; i++)
+    {
+        opa_value_hash(constants->elems[i].v);
+    }
+}
+
+OPA_INTERNAL
+WASM_EXPORT(opa_constant)
+opa_value *opa_constant(size_t i)
+{
+    if (constants == NULL || i >= constants->len)
+    {
+        return NULL;
+    }
+
+    return constants->elems[i].v;
+}
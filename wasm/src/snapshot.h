@@ -0,0 +1,44 @@
+#ifndef OPA_SNAPSHOT_H
+#define OPA_SNAPSHOT_H
+
+#include "value.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Binary value snapshots. opa_value_snapshot serializes a value tree,
+// including its hash table bucket layout and cached hashes, into a single
+// relocatable blob in which every pointer is an offset from the blob start.
+// opa_value_restore copies the blob onto the heap and runs one pointer
+// fix-up pass over it, which is much cheaper than re-parsing the JSON the
+// value came from. The blob is position-independent, so it can be produced
+// once and restored by any instance of the same module.
+//
+// A restored value lives inside the single restored allocation: it must be
+// treated as read-only and must not be passed to opa_value_free or mutated
+// through opa_value_add_path/opa_value_remove_path. Discard it by resetting
+// the heap pointer, as with parsed data documents.
+//
+// opa_value_mount fixes a blob up in place instead of copying it, so a data
+// document in a memory region shared by several instances is held once. A
+// mounted region that reappears at a different address — page-wise
+// deduplication can hand differently sized instances different placements —
+// is relocated by re-walking its pointers. See the function comment for the
+// single-mount requirement.
+char *opa_value_snapshot(opa_value *v, size_t *len);
+opa_value *opa_value_restore(const char *blob, size_t len);
+opa_value *opa_value_mount(char *blob, size_t len);
+
+// Compile-time constant pool: a snapshot blob of an array of policy
+// literals, embedded in the data segment and registered once from
+// _initialize. opa_constant returns literal i — frozen, hash warmed, no
+// allocation — or NULL when out of range.
+void opa_constants_init(char *blob, size_t len);
+opa_value *opa_constant(size_t i);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
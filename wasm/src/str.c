@@ -1,3 +1,6 @@
+#include <stdint.h>
+
+#include "str.h"
 #include "string.h"
 
 size_t opa_strlen(const char *s)
@@ -74,19 +77,58 @@ int opa_strcmp(const char *a, const char *b)
     return 0;
 }
 
+// returns the first occurrence of the needle in the length-delimited
+// haystack, or NULL. An empty needle matches at the start.
+const char *opa_memmem(const char *haystack, size_t n, const char *needle, size_t m)
+{
+    if (m == 0)
+    {
+        return haystack;
+    }
+
+    if (m > n)
+    {
+        return NULL;
+    }
+
+    for (size_t i = 0; i + m <= n; i++)
+    {
+        if (haystack[i] == needle[0] && opa_strncmp(&haystack[i], needle, m) == 0)
+        {
+            return &haystack[i];
+        }
+    }
+
+    return NULL;
+}
+
+const unsigned char opa_ctype[256] = {
+    ['\t'] = OPA_CT_SPACE | OPA_CT_LATIN1_SPACE,
+    ['\n'] = OPA_CT_SPACE | OPA_CT_LATIN1_SPACE,
+    ['\v'] = OPA_CT_LATIN1_SPACE,
+    ['\f'] = OPA_CT_LATIN1_SPACE,
+    ['\r'] = OPA_CT_SPACE | OPA_CT_LATIN1_SPACE,
+    [' '] = OPA_CT_SPACE | OPA_CT_LATIN1_SPACE,
+    [0x85] = OPA_CT_LATIN1_SPACE,
+    [0xa0] = OPA_CT_LATIN1_SPACE,
+    ['0' ... '9'] = OPA_CT_DIGIT | OPA_CT_HEX,
+    ['A' ... 'F'] = OPA_CT_HEX,
+    ['a' ... 'f'] = OPA_CT_HEX,
+};
+
 int opa_isdigit(char b)
 {
-    return b >= '0' && b <= '9';
+    return opa_ctype[(unsigned char)b] & OPA_CT_DIGIT;
 }
 
 int opa_isspace(char b)
 {
-    return b == ' ' || b == '\r' || b == '\n' || b == '\t';
+    return opa_ctype[(unsigned char)b] & OPA_CT_SPACE;
 }
 
 int opa_ishex(char b)
 {
-    return opa_isdigit(b) || (b >= 'A' && b <= 'F') || (b >= 'a' && b <= 'f');
+    return opa_ctype[(unsigned char)b] & OPA_CT_HEX;
 }
 
 char *opa_reverse(char *str)
@@ -115,8 +157,66 @@ char *opa_reverse(char *str)
 
 const char *digits = "0123456789abcdef";
 
+static const char digit_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
 char *opa_itoa(long long i, char *str, int base)
 {
+    if (base == 10)
+    {
+        // Emit two digits per division. Going through an unsigned value
+        // also keeps the smallest long long from overflowing on negation.
+        unsigned long long u = (unsigned long long)i;
+        char *out = str;
+
+        if (i < 0)
+        {
+            *out++ = '-';
+            u = -(unsigned long long)i;
+        }
+
+        char tmp[20];
+        char *p = &tmp[20];
+
+        while (u >= 100)
+        {
+            const char *d = &digit_pairs[(u % 100) * 2];
+
+            u /= 100;
+            *--p = d[1];
+            *--p = d[0];
+        }
+
+        if (u >= 10)
+        {
+            const char *d = &digit_pairs[u * 2];
+
+            *--p = d[1];
+            *--p = d[0];
+        }
+        else
+        {
+            *--p = (char)('0' + u);
+        }
+
+        while (p < &tmp[20])
+        {
+            *out++ = *p++;
+        }
+
+        *out = 0;
+        return str;
+    }
+
     char *buf = str;
     int is_negative = 0;
 
@@ -144,6 +244,392 @@ char *opa_itoa(long long i, char *str, int base)
     return opa_reverse(str);
 }
 
+// Grisu2 shortest-decimal double formatting (Loitsch, "Printing
+// floating-point numbers quickly and accurately with integers"). The
+// produced string always parses back to the same double; in rare cases it
+// has one more digit than strictly necessary. Integer-only arithmetic, no
+// arbitrary-precision fallback.
+
+typedef struct
+{
+    uint64_t f;
+    int e;
+} opa_diy_fp;
+
+#define OPA_DP_SIGNIFICAND_MASK (0x000fffffffffffffULL)
+#define OPA_DP_EXPONENT_MASK (0x7ff0000000000000ULL)
+#define OPA_DP_HIDDEN_BIT (0x0010000000000000ULL)
+#define OPA_DP_EXPONENT_BIAS (1075)
+
+// 10^k for k = -348, -340, ..., 340, as normalized 64-bit significands and
+// binary exponents.
+static const uint64_t grisu_cache_f[] = {
+    0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL,
+    0xcf42894a5dce35eaULL, 0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL,
+    0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL, 0xbe5691ef416bd60cULL,
+    0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+    0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL,
+    0xc21094364dfb5637ULL, 0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL,
+    0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL, 0xb23867fb2a35b28eULL,
+    0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+    0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL,
+    0xb5b5ada8aaff80b8ULL, 0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL,
+    0x964e858c91ba2655ULL, 0xdff9772470297ebdULL, 0xa6dfbd9fb8e5b88fULL,
+    0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+    0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL,
+    0xaa242499697392d3ULL, 0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL,
+    0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL, 0x9c40000000000000ULL,
+    0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+    0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL,
+    0x9f4f2726179a2245ULL, 0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL,
+    0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL, 0x924d692ca61be758ULL,
+    0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+    0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL,
+    0x952ab45cfa97a0b3ULL, 0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL,
+    0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL, 0x88fcf317f22241e2ULL,
+    0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+    0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL,
+    0x8bab8eefb6409c1aULL, 0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL,
+    0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL, 0x80444b5e7aa7cf85ULL,
+    0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+    0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL,
+};
+
+static const short grisu_cache_e[] = {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954, -927,
+    -901, -874, -847, -821, -794, -768, -741, -715, -688, -661, -635, -608,
+    -582, -555, -529, -502, -475, -449, -422, -396, -369, -343, -316, -289,
+    -263, -236, -210, -183, -157, -130, -103, -77, -50, -24, 3, 30,
+    56, 83, 109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+    375, 402, 428, 455, 481, 508, 534, 561, 588, 614, 641, 667,
+    694, 720, 747, 774, 800, 827, 853, 880, 907, 933, 960, 986,
+    1013, 1039, 1066,
+};
+
+static opa_diy_fp grisu_mul(opa_diy_fp x, opa_diy_fp y)
+{
+    unsigned __int128 p = (unsigned __int128)x.f * y.f;
+    uint64_t h = (uint64_t)(p >> 64);
+
+    if ((uint64_t)p & (1ULL << 63)) // round up
+    {
+        h++;
+    }
+
+    return (opa_diy_fp){h, x.e + y.e + 64};
+}
+
+static opa_diy_fp grisu_cached_power(int e, int *k)
+{
+    double dk = (-61 - e) * 0.30102999566398114 + 347;
+    int ik = (int)dk;
+
+    if (dk - ik > 0.0)
+    {
+        ik++;
+    }
+
+    unsigned int index = (unsigned int)((ik >> 3) + 1);
+
+    *k = -(-348 + (int)(index << 3));
+    return (opa_diy_fp){grisu_cache_f[index], grisu_cache_e[index]};
+}
+
+static const unsigned int grisu_pow10[] = {1, 10, 100, 1000, 10000, 100000,
+    1000000, 10000000, 100000000, 1000000000};
+
+static void grisu_round(char *buffer, int len, uint64_t delta, uint64_t rest,
+                        uint64_t ten_kappa, uint64_t wp_w)
+{
+    while (rest < wp_w && delta - rest >= ten_kappa &&
+           (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w))
+    {
+        buffer[len-1]--;
+        rest += ten_kappa;
+    }
+}
+
+static int grisu_digit_gen(opa_diy_fp w, opa_diy_fp mp, uint64_t delta, char *buffer, int *k)
+{
+    opa_diy_fp one = {1ULL << -mp.e, mp.e};
+    uint64_t wp_w = mp.f - w.f;
+    uint32_t p1 = (uint32_t)(mp.f >> -one.e);
+    uint64_t p2 = mp.f & (one.f - 1);
+    int kappa = 10;
+    int len = 0;
+
+    while (kappa > 1 && p1 < grisu_pow10[kappa - 1])
+    {
+        kappa--;
+    }
+
+    while (kappa > 0)
+    {
+        uint32_t d = p1 / grisu_pow10[kappa - 1];
+
+        p1 %= grisu_pow10[kappa - 1];
+
+        if (d != 0 || len != 0)
+        {
+            buffer[len++] = (char)('0' + d);
+        }
+
+        kappa--;
+
+        uint64_t tmp = ((uint64_t)p1 << -one.e) + p2;
+
+        if (tmp <= delta)
+        {
+            *k += kappa;
+            grisu_round(buffer, len, delta, tmp, (uint64_t)grisu_pow10[kappa] << -one.e, wp_w);
+            return len;
+        }
+    }
+
+    for (;;)
+    {
+        p2 *= 10;
+        delta *= 10;
+
+        char d = (char)(p2 >> -one.e);
+
+        if (d != 0 || len != 0)
+        {
+            buffer[len++] = (char)('0' + d);
+        }
+
+        p2 &= one.f - 1;
+        kappa--;
+
+        if (p2 < delta)
+        {
+            *k += kappa;
+            grisu_round(buffer, len, delta, p2, one.f, wp_w * grisu_pow10[-kappa]);
+            return len;
+        }
+    }
+}
+
+// Writes the shortest digit string for finite, positive 'value' and returns
+// its length; afterwards value = 0.digits... * 10^(len + *k).
+static int grisu2(double value, char *buffer, int *k)
+{
+    union { double d; uint64_t u; } du = {value};
+    int biased_e = (int)((du.u & OPA_DP_EXPONENT_MASK) >> 52);
+    uint64_t significand = du.u & OPA_DP_SIGNIFICAND_MASK;
+    opa_diy_fp v, pl, mi;
+
+    if (biased_e != 0)
+    {
+        v.f = significand + OPA_DP_HIDDEN_BIT;
+        v.e = biased_e - OPA_DP_EXPONENT_BIAS;
+    }
+    else
+    {
+        v.f = significand;
+        v.e = 1 - OPA_DP_EXPONENT_BIAS;
+    }
+
+    // normalized boundaries of the rounding interval around v
+    pl.f = (v.f << 1) + 1;
+    pl.e = v.e - 1;
+
+    while ((pl.f & (OPA_DP_HIDDEN_BIT << 1)) == 0)
+    {
+        pl.f <<= 1;
+        pl.e--;
+    }
+
+    pl.f <<= 64 - 54;
+    pl.e -= 64 - 54;
+
+    if (v.f == OPA_DP_HIDDEN_BIT)
+    {
+        mi.f = (v.f << 2) - 1;
+        mi.e = v.e - 2;
+    }
+    else
+    {
+        mi.f = (v.f << 1) - 1;
+        mi.e = v.e - 1;
+    }
+
+    mi.f <<= mi.e - pl.e;
+    mi.e = pl.e;
+
+    while ((v.f & OPA_DP_HIDDEN_BIT) == 0)
+    {
+        v.f <<= 1;
+        v.e--;
+    }
+
+    v.f <<= 64 - 53;
+    v.e -= 64 - 53;
+
+    int kk;
+    opa_diy_fp c_mk = grisu_cached_power(pl.e, &kk);
+    opa_diy_fp w = grisu_mul(v, c_mk);
+    opa_diy_fp wp = grisu_mul(pl, c_mk);
+    opa_diy_fp wm = grisu_mul(mi, c_mk);
+
+    wm.f++;
+    wp.f--;
+    *k = kk;
+
+    return grisu_digit_gen(w, wp, wp.f - wm.f, buffer, k);
+}
+
+// Lays out 'len' digits with decimal exponent 'k' as plain or exponent
+// notation, mirroring what JSON encoders conventionally produce.
+static void grisu_prettify(char *str, int len, int k)
+{
+    int kk = len + k; // position of the decimal point
+
+    if (0 < kk && kk <= 21 && k >= 0)
+    {
+        // whole number: pad with zeros
+        for (int i = len; i < kk; i++)
+        {
+            str[i] = '0';
+        }
+
+        str[kk] = 0;
+    }
+    else if (0 < kk && kk <= 21)
+    {
+        // decimal point between the digits
+        for (int i = len; i > kk; i--)
+        {
+            str[i] = str[i-1];
+        }
+
+        str[kk] = '.';
+        str[len+1] = 0;
+    }
+    else if (-6 < kk && kk <= 0)
+    {
+        // leading "0.000..." form
+        int offset = 2 - kk;
+
+        for (int i = len - 1; i >= 0; i--)
+        {
+            str[i + offset] = str[i];
+        }
+
+        str[0] = '0';
+        str[1] = '.';
+
+        for (int i = 2; i < offset; i++)
+        {
+            str[i] = '0';
+        }
+
+        str[len + offset] = 0;
+    }
+    else
+    {
+        // exponent notation d.dddde[-]X
+        char *p;
+        int e_out = kk - 1;
+
+        if (len == 1)
+        {
+            str[1] = 'e';
+            p = &str[2];
+        }
+        else
+        {
+            for (int i = len; i > 1; i--)
+            {
+                str[i] = str[i-1];
+            }
+
+            str[1] = '.';
+            str[len+1] = 'e';
+            p = &str[len+2];
+        }
+
+        if (e_out < 0)
+        {
+            *p++ = '-';
+            e_out = -e_out;
+        }
+
+        if (e_out >= 100)
+        {
+            *p++ = (char)('0' + e_out / 100);
+            e_out %= 100;
+            *p++ = (char)('0' + e_out / 10);
+            *p++ = (char)('0' + e_out % 10);
+        }
+        else if (e_out >= 10)
+        {
+            *p++ = (char)('0' + e_out / 10);
+            *p++ = (char)('0' + e_out % 10);
+        }
+        else
+        {
+            *p++ = (char)('0' + e_out);
+        }
+
+        *p = 0;
+    }
+}
+
+// Formats a finite double as its shortest round-tripping decimal string.
+// 'str' must have room for at least 32 bytes.
+char *opa_ftoa(double d, char *str)
+{
+    char *p = str;
+
+    if (d == 0.0) // covers -0.0
+    {
+        p[0] = '0';
+        p[1] = 0;
+        return str;
+    }
+
+    if (d < 0)
+    {
+        *p++ = '-';
+        d = -d;
+    }
+
+    int k;
+    int len = grisu2(d, p, &k);
+
+    grisu_prettify(p, len, k);
+    return str;
+}
+
+// Exposes the digit kernel on its own: writes the shortest round-tripping
+// digit string for finite, positive 'd' (at least 18 bytes, no
+// terminator) and returns its length; afterwards
+// d = 0.digits... * 10^(len + *k). printf's float specifiers lay these
+// digits out under an explicit precision instead of deriving them with
+// floating-point division loops.
+int opa_dtoa(double d, char *digits, int *k)
+{
+    return grisu2(d, digits, k);
+}
+
+// Eight ASCII digits check and convert at once. The bytes are loaded
+// little-endian, so the first character sits in the low byte; each
+// multiply-and-shift folds adjacent digit groups into bases 100, 10000
+// and 100000000.
+static int swar_is_digits8(uint64_t w)
+{
+    return ((w & 0xf0f0f0f0f0f0f0f0ULL) |
+            (((w + 0x0606060606060606ULL) & 0xf0f0f0f0f0f0f0f0ULL) >> 4)) == 0x3333333333333333ULL;
+}
+
+static uint32_t swar_parse_digits8(uint64_t w)
+{
+    w = (w & 0x0f0f0f0f0f0f0f0fULL) * ((10ULL << 8) + 1) >> 8;
+    w = (w & 0x00ff00ff00ff00ffULL) * ((100ULL << 16) + 1) >> 16;
+    return (uint32_t)((w & 0x0000ffff0000ffffULL) * ((10000ULL << 32) + 1) >> 32);
+}
+
 int opa_atoi64(const char *str, int len, long long *result)
 {
     if (len <= 0)
@@ -160,7 +646,22 @@ int opa_atoi64(const char *str, int len, long long *result)
         i++;
     }
 
-    long long n = 0;
+    uint64_t n = 0;
+
+    // eight digits per step; a block containing a non-digit drops to the
+    // per-byte loop below, which rejects it
+    for (; i + 8 <= len; i += 8)
+    {
+        uint64_t w;
+        memcpy(&w, &str[i], 8);
+
+        if (!swar_is_digits8(w))
+        {
+            break;
+        }
+
+        n = (n * 100000000) + swar_parse_digits8(w);
+    }
 
     for (; i < len; i++)
     {
@@ -169,14 +670,33 @@ int opa_atoi64(const char *str, int len, long long *result)
             return -2;
         }
 
-        n = (n * 10) + (long long)(str[i] - '0');
+        n = (n * 10) + (uint64_t)(str[i] - '0');
     }
 
-    *result = n * sign;
+    *result = (long long)n * sign;
 
     return 0;
 }
 
+// 10^0 .. 10^22, the powers of ten a double represents exactly.
+static const double atof_pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+static double atof_scale(int e)
+{
+    double p = 1.0;
+
+    while (e > 22)
+    {
+        p *= 1e22; // large exponents saturate to infinity here
+        e -= 22;
+    }
+
+    return p * atof_pow10[e];
+}
+
 int opa_atof64(const char *str, int len, double *result)
 {
     if (len <= 0)
@@ -194,83 +714,148 @@ int opa_atof64(const char *str, int len, double *result)
         i++;
     }
 
-    // Handle integer component.
-    double d = 0.0;
+    // The digits of the integer and fraction components accumulate
+    // exactly in a 64-bit mantissa — eight at a time, then per byte —
+    // with the fraction's contribution folded into a decimal exponent.
+    // Nineteen significant digits always fit; digits past that only
+    // adjust the exponent. For the common case of few digits and a small
+    // exponent the final scaling is a single exact multiply or divide, so
+    // the result is correctly rounded.
 
-    for (; i < len && opa_isdigit(str[i]); i++)
+    uint64_t mant = 0;
+    int digits = 0;
+    int exp10 = 0;
+
+    // Handle integer component.
+    for (; i + 8 <= len && digits + 8 <= 19; i += 8)
     {
-        d = (10.0 * d) + (double)(str[i] - '0');
-    }
+        uint64_t w;
+        memcpy(&w, &str[i], 8);
+
+        if (!swar_is_digits8(w))
+        {
+            break;
+        }
 
-    d *= sign;
+        uint32_t v = swar_parse_digits8(w);
+
+        if (mant != 0 || v != 0) // leading zeros are not significant
+        {
+            mant = (mant * 100000000) + v;
+            digits += 8;
+        }
+    }
 
-    if (i == len)
+    for (; i < len && opa_isdigit(str[i]); i++)
     {
-        *result = d;
-        return 0;
+        if (digits < 19)
+        {
+            if (mant != 0 || str[i] != '0')
+            {
+                mant = (mant * 10) + (uint64_t)(str[i] - '0');
+                digits++;
+            }
+        }
+        else
+        {
+            exp10++; // excess digits keep the magnitude, not the precision
+        }
     }
 
     // Handle fraction component.
-    if (str[i] == '.')
+    if (i < len && str[i] == '.')
     {
         i++;
 
-        double b = 0.1;
-        double frac = 0;
+        for (; i + 8 <= len && digits + 8 <= 19; i += 8)
+        {
+            uint64_t w;
+            memcpy(&w, &str[i], 8);
+
+            if (!swar_is_digits8(w))
+            {
+                break;
+            }
+
+            uint32_t v = swar_parse_digits8(w);
+
+            if (mant != 0 || v != 0)
+            {
+                mant = (mant * 100000000) + v;
+                digits += 8;
+            }
+
+            exp10 -= 8;
+        }
 
         for (; i < len && opa_isdigit(str[i]); i++)
         {
-            frac += b * (str[i] - '0');
-            b /= 10.0;
-        }
+            if (digits < 19)
+            {
+                if (mant != 0 || str[i] != '0')
+                {
+                    mant = (mant * 10) + (uint64_t)(str[i] - '0');
+                    digits++;
+                }
 
-        d += (frac * sign);
+                exp10--;
+            }
 
-        if (i == len)
-        {
-            *result = d;
-            return 0;
+            // excess fraction digits are dropped
         }
-
     }
 
     // Handle exponent component.
-    if (str[i] == 'e' || str[i] == 'E')
+    if (i < len && (str[i] == 'e' || str[i] == 'E'))
     {
         i++;
         int exp_sign = 1;
 
-        if (str[i] == '-')
+        if (i < len && str[i] == '-')
         {
             exp_sign = -1;
             i++;
         }
-        else if (str[i] == '+')
+        else if (i < len && str[i] == '+')
         {
             i++;
         }
 
+        int start = i;
         int e = 0;
 
         for (; i < len && opa_isdigit(str[i]); i++)
         {
-            e = 10 * e + (int)(str[i] - '0');
+            if (e < 10000) // clamped: the scaling saturates anyway
+            {
+                e = 10 * e + (int)(str[i] - '0');
+            }
         }
 
-        if (i == len)
+        if (i == start)
         {
-            // Calculate pow(10, e).
-            int x = 1;
+            return -2;
+        }
 
-            for (; e > 0; e--)
-            {
-                x *= 10;
-            }
+        exp10 += exp_sign * e;
+    }
 
-            *result = d * (double)(exp_sign * x);
-            return 0;
-        }
+    if (i != len)
+    {
+        return -2;
     }
 
-    return -2;
+    double d = (double)mant;
+
+    if (exp10 > 0)
+    {
+        d *= atof_scale(exp10);
+    }
+    else if (exp10 < 0)
+    {
+        d /= atof_scale(-exp10);
+    }
+
+    *result = d * sign;
+    return 0;
 }
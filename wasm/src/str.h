@@ -1,19 +1,34 @@
 #ifndef OPA_STR_H
 #define OPA_STR_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// Byte classification table: one load classifies a byte for the lexer and
+// string-builtin hot loops, instead of a chain of compares per call. The
+// Latin-1 White_Space class serves opa_unicode_is_space below 0x100; code
+// points above it go through the sorted range table in unicode.c.
+#define OPA_CT_SPACE (1 << 0)        // ' ' \t \n \r: the JSON lexer's set
+#define OPA_CT_DIGIT (1 << 1)
+#define OPA_CT_HEX (1 << 2)
+#define OPA_CT_LATIN1_SPACE (1 << 3) // unicode White_Space below 0x100
+
+extern const unsigned char opa_ctype[256];
+
 size_t opa_strlen(const char *s);
 int opa_strncmp(const char *a, const char *b, int num);
 int opa_strcmp(const char *a, const char *b);
+const char *opa_memmem(const char *haystack, size_t n, const char *needle, size_t m);
 int opa_isdigit(char b);
 int opa_isspace(char b);
 int opa_ishex(char b);
 char *opa_itoa(long long i, char *str, int base);
+char *opa_ftoa(double d, char *str);
+int opa_dtoa(double d, char *digits, int *k);
 char *opa_reverse(char *str);
 int opa_atoi64(const char *str, int len, long long *i);
 int opa_atof64(const char *str, int len, double *d);
@@ -6,6 +6,14 @@
 #include "strings.h"
 #include "unicode.h"
 
+#ifdef __wasm_simd128__
+#include <wasm_simd128.h>
+#endif
+
+// Results shorter than this are copied flat: a rope node plus segment table
+// costs more than the copy it saves.
+#define OPA_STRING_ROPE_MIN (256)
+
 OPA_BUILTIN
 opa_value *opa_strings_concat(opa_value *a, opa_value *b)
 {
@@ -20,35 +28,73 @@ opa_value *opa_strings_concat(opa_value *a, opa_value *b)
     switch (opa_value_type(b))
     {
     case OPA_ARRAY: {
-        opa_array_t *a = opa_cast_array(b);
+        opa_array_t *arr = opa_cast_array(b);
 
-        for (int i = 0; i < a->len; i++)
+        for (int i = 0; i < arr->len; i++)
         {
-            opa_value *v = a->elems[i].v;
-            if (opa_value_type(v) != OPA_STRING) {
+            opa_value *v = arr->elems[i].v;
+
+            // raw type check: classifying through opa_value_type would
+            // flatten rope arguments, defeating the accumulator pattern
+            // the rope exists for
+            if (v->type != OPA_STRING && v->type != OPA_STRING_INTERNED &&
+                v->type != OPA_STRING_ROPE)
+            {
                 return NULL;
             }
 
+            // valid for ropes too: the rope head is an opa_string_t
+            // carrying the total byte length
             len += opa_cast_string(v)->len;
         }
 
-        if (a->len > 0)
+        if (arr->len == 1)
+        {
+            // no separator involved: share the sole element
+            return arr->elems[0].v;
+        }
+
+        if (arr->len > 0)
+        {
+            len += (arr->len - 1) * join->len;
+        }
+
+        if (len - 1 >= OPA_STRING_ROPE_MIN)
         {
-            len += (a->len - 1) * join->len;
+            // defer the copy: reference the arguments as rope segments, so
+            // a policy that re-concatenates the result in a loop copies
+            // each byte once, at first byte-wise access, instead of once
+            // per iteration
+            size_t nsegs = join->len > 0 ? 2 * arr->len - 1 : arr->len;
+            opa_array_t *segs = opa_cast_array(opa_array_with_cap(nsegs));
+
+            for (int i = 0; i < arr->len; i++)
+            {
+                if (i > 0 && join->len > 0)
+                {
+                    opa_array_append(segs, a);
+                }
+
+                opa_array_append(segs, arr->elems[i].v);
+            }
+
+            return opa_string_rope(segs, len - 1);
         }
 
         char *str = opa_malloc(len);
         size_t j = 0;
 
-        for (int i = 0; i < a->len; i++)
+        for (int i = 0; i < arr->len; i++)
         {
+            opa_value_type(arr->elems[i].v); // flattens a small rope in place
+
             if (i > 0)
             {
                 memcpy(&str[j], join->v, join->len);
                 j += join->len;
             }
 
-            opa_string_t *s = opa_cast_string(a->elems[i].v);
+            opa_string_t *s = opa_cast_string(arr->elems[i].v);
             memcpy(&str[j], s->v, s->len);
             j += s->len;
         }
@@ -77,6 +123,18 @@ opa_value *opa_strings_concat(opa_value *a, opa_value *b)
             }
         }
 
+        if (s->len == 1)
+        {
+            for (int i = 0; i < s->n; i++)
+            {
+                if (s->buckets[i] != NULL)
+                {
+                    // no separator involved: share the sole element
+                    return s->buckets[i]->v;
+                }
+            }
+        }
+
         if (s->len > 0)
         {
             len += (s->len - 1) * join->len;
@@ -116,13 +174,41 @@ opa_value *opa_strings_concat(opa_value *a, opa_value *b)
     }
 }
 
+// Shared substring search behind indexof, contains, split and replace:
+// returns the byte offset of the first occurrence of substr at or after
+// pos, or -1. Candidate positions come from the vectorized memchr kernel
+// in src/lib/string.c; checking the second byte up front rejects most
+// false candidates before the full comparison.
 static int strings_indexof(opa_string_t *s, int pos, opa_string_t *substr)
 {
-    // TODO: Implement Karp-Rabin string search.
+    int last = (int)s->len - (int)substr->len;
 
-    for (int i = pos; i <= (int)s->len - (int)substr->len; i++)
+    if (pos > last)
     {
-        if (opa_strncmp(&s->v[i], substr->v, substr->len) == 0)
+        return -1;
+    }
+
+    if (substr->len == 0)
+    {
+        return pos;
+    }
+
+    const char *hay = s->v;
+    unsigned char c0 = (unsigned char)substr->v[0];
+
+    for (int i = pos; i <= last; i++)
+    {
+        const char *p = memchr(&hay[i], c0, (size_t)(last - i) + 1);
+
+        if (p == NULL)
+        {
+            return -1;
+        }
+
+        i = (int)(p - hay);
+
+        if ((substr->len == 1 || hay[i+1] == substr->v[1]) &&
+            opa_strncmp(&hay[i], substr->v, substr->len) == 0)
         {
             return i;
         }
@@ -172,6 +258,72 @@ opa_value *opa_strings_endswith(opa_value *a, opa_value *b)
     return opa_boolean(true);
 }
 
+// Digit-pair table: two decimal digits per lookup halves the number of
+// divisions when formatting base 10.
+static const char format_int_pairs[] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static const char format_int_hex[] = "0123456789abcdef";
+
+// Writes 'u' backwards into the end of buf[cap] without any division
+// for the power-of-two bases, and two digits per division for base 10.
+// Returns the offset of the first digit.
+static int format_int_lltoa(unsigned long long u, int base, char *buf, int cap)
+{
+    int i = cap;
+
+    switch (base)
+    {
+    case 2:
+        do
+        {
+            buf[--i] = '0' + (u & 1);
+            u >>= 1;
+        } while (u != 0);
+        break;
+    case 8:
+        do
+        {
+            buf[--i] = '0' + (u & 7);
+            u >>= 3;
+        } while (u != 0);
+        break;
+    case 16:
+        do
+        {
+            buf[--i] = format_int_hex[u & 0xf];
+            u >>= 4;
+        } while (u != 0);
+        break;
+    default:
+        while (u >= 100)
+        {
+            const char *p = &format_int_pairs[(u % 100) * 2];
+            buf[--i] = p[1];
+            buf[--i] = p[0];
+            u /= 100;
+        }
+
+        if (u >= 10)
+        {
+            const char *p = &format_int_pairs[u * 2];
+            buf[--i] = p[1];
+            buf[--i] = p[0];
+        }
+        else
+        {
+            buf[--i] = '0' + u;
+        }
+        break;
+    }
+
+    return i;
+}
+
 OPA_BUILTIN
 opa_value *opa_strings_format_int(opa_value *a, opa_value *b)
 {
@@ -206,13 +358,35 @@ opa_value *opa_strings_format_int(opa_value *a, opa_value *b)
         return NULL;
     }
 
+    long long x;
+
+    if (opa_number_try_int(opa_cast_number(a), &x) == 0)
+    {
+        // Integer-representable input: convert directly into an
+        // exactly sized result, skipping libmpdec entirely.
+        char digits[66];
+        unsigned long long u = x < 0 ? -(unsigned long long)x : (unsigned long long)x;
+        int i = format_int_lltoa(u, v, digits, sizeof(digits));
+
+        if (x < 0)
+        {
+            digits[--i] = '-';
+        }
+
+        int n = sizeof(digits) - i;
+        char *str = opa_malloc(n + 1);
+        memcpy(str, &digits[i], n);
+        str[n] = '\0';
+        return opa_string_allocated(str, n);
+    }
+
     mpd_t *input = opa_number_to_bf(a);
     if (input == NULL)
     {
         return NULL;
     }
 
-    mpd_t *i = mpd_qnew();
+    mpd_t *i = opa_mpd_new();
     uint32_t status = 0;
     mpd_qtrunc(i, input, mpd_max_ctx(), &status);
     if (status != 0)
@@ -280,75 +454,299 @@ opa_value *opa_strings_replace(opa_value *a, opa_value *b, opa_value *c)
     opa_string_t *old = opa_cast_string(b);
     opa_string_t *new = opa_cast_string(c);
 
-    int cap = s->len + 1;
-    char *r = opa_malloc(cap);
+    // Count the occurrences first so the output length is known exactly:
+    // the result is filled in one forward pass with a single allocation,
+    // and a string without any occurrence is returned shared.
 
-    int j = 0;
-    for (int i = 0; i < s->len; ) {
-        int match = strings_indexof(s, i, old);
-        int copy_len = match == -1 ? s->len - i : match - i;
-        int new_r_len = j + copy_len + new->len + 1; // Optimistic allocation for new string.
+    if (old->len == 0)
+    {
+        return a;
+    }
+
+    size_t count = 0;
+
+    for (int i = strings_indexof(s, 0, old); i >= 0; i = strings_indexof(s, i + old->len, old))
+    {
+        count++;
+    }
+
+    if (count == 0)
+    {
+        return a;
+    }
+
+    size_t len = s->len - count * old->len + count * new->len;
+    char *r = opa_malloc(len + 1);
+    size_t j = 0;
+    int i = 0;
+
+    for (int match = strings_indexof(s, 0, old); match >= 0; match = strings_indexof(s, i, old))
+    {
+        memcpy(&r[j], &s->v[i], match - i);
+        j += match - i;
+        memcpy(&r[j], new->v, new->len);
+        j += new->len;
+        i = match + old->len;
+    }
+
+    memcpy(&r[j], &s->v[i], s->len - i);
+    r[len] = '\0';
+
+    return opa_string_allocated(r, len);
+}
+
+// Multi-pattern replacement. Applying the pairs of strings.replace_n one
+// by one scans the string once per pattern and allocates an intermediate
+// copy per replacement. Instead the patterns are compiled into an
+// Aho-Corasick automaton — a byte trie whose failure links are folded into
+// the child tables, so matching is one table load per input byte — and the
+// string is rewritten in a single pass with one output allocation. The
+// match that ends first wins, ties going to the longest pattern, and
+// replaced text is not rescanned. Built automatons are kept in a builtin
+// cache slot keyed by object identity, so repeated calls against the same
+// pattern object reuse the automaton until the next heap reset.
+
+#define STR_REPLACER_CACHE_SIZE (4)
+
+typedef struct str_ac_node
+{
+    struct str_ac_node *child[256];
+    struct str_ac_node *fail; // build-time only; folded into child below
+    opa_string_t *new;        // replacement for the pattern ending here
+    size_t old_len;           // that pattern's length
+} str_ac_node;
+
+typedef struct
+{
+    opa_value *pairs; // object the automaton was built from
+    size_t len;       // its length when built, to catch reuse of the address
+    str_ac_node *root;
+} str_replacer;
+
+typedef struct
+{
+    size_t next;
+    str_replacer replacers[STR_REPLACER_CACHE_SIZE];
+} str_replacer_cache;
+
+static str_ac_node *ac_node(void)
+{
+    str_ac_node *n = opa_malloc(sizeof(str_ac_node));
+    memset(n, 0, sizeof(str_ac_node));
+    return n;
+}
+
+static void ac_insert(str_ac_node *root, opa_string_t *old, opa_string_t *new)
+{
+    str_ac_node *n = root;
 
-        if (cap < new_r_len)
+    for (size_t i = 0; i < old->len; i++)
+    {
+        unsigned char b = old->v[i];
+        if (n->child[b] == NULL)
         {
-            cap = new_r_len;
-            r = opa_realloc(r, cap);
+            n->child[b] = ac_node();
         }
 
-        memcpy(&r[j], &s->v[i], copy_len);
-        i += copy_len + old->len;
-        j += copy_len;
+        n = n->child[b];
+    }
+
+    if (n->new == NULL)
+    {
+        n->new = new;
+        n->old_len = old->len;
+    }
+}
+
+// ac_finish computes the failure links breadth-first and folds them into
+// the child tables, turning the trie into a DFA: every node answers every
+// byte. A node without a pattern of its own inherits the one from its
+// failure link, so each state carries the longest pattern ending there.
+static void ac_finish(str_ac_node *root, size_t nodes)
+{
+    str_ac_node **queue = opa_malloc(sizeof(str_ac_node *) * nodes);
+    size_t head = 0, tail = 0;
 
-        if (match != -1)
+    for (int b = 0; b < 256; b++)
+    {
+        if (root->child[b] == NULL)
+        {
+            root->child[b] = root;
+        }
+        else
         {
-            memcpy(&r[j], new->v, new->len);
-            j += new->len;
+            root->child[b]->fail = root;
+            queue[tail++] = root->child[b];
         }
     }
 
-    r[j] = '\0';
+    while (head < tail)
+    {
+        str_ac_node *n = queue[head++];
+
+        if (n->new == NULL)
+        {
+            n->new = n->fail->new;
+            n->old_len = n->fail->old_len;
+        }
+
+        for (int b = 0; b < 256; b++)
+        {
+            if (n->child[b] == NULL)
+            {
+                n->child[b] = n->fail->child[b];
+            }
+            else
+            {
+                n->child[b]->fail = n->fail->child[b];
+                queue[tail++] = n->child[b];
+            }
+        }
+    }
 
-    return opa_string_allocated(r, j);
+    opa_free(queue);
 }
 
-OPA_BUILTIN
-opa_value *opa_strings_replace_n(opa_value *a, opa_value *b)
+// replacer_for resolves the pattern object through the cache, compiling
+// the automaton on a miss. Returns NULL when a key or value is not a
+// string. Empty patterns never match and are skipped, as the sequential
+// implementation skipped them.
+static size_t str_replacer_slot = OPA_BUILTIN_CACHE_UNREGISTERED;
+
+static str_replacer *replacer_for(opa_value *pairs)
 {
-    if (opa_value_type(a) != OPA_OBJECT || opa_value_type(b) != OPA_STRING)
+    if (str_replacer_slot == OPA_BUILTIN_CACHE_UNREGISTERED)
     {
-        return NULL;
+        str_replacer_slot = opa_builtin_cache_register(NULL);
     }
 
-    opa_object_t *old_new = opa_cast_object(a);
-    opa_string_t *s = opa_cast_string(b);
+    str_replacer_cache *c = opa_builtin_cache_get(str_replacer_slot);
+    if (c == NULL)
+    {
+        c = opa_malloc(sizeof(str_replacer_cache));
+        memset(c, 0, sizeof(str_replacer_cache));
+        opa_builtin_cache_set(str_replacer_slot, c);
+    }
 
-    char *buf = opa_malloc(s->len + 1);
-    memcpy(buf, s->v, s->len + 1);
-    opa_value *result = opa_string_allocated(buf, s->len);
+    opa_object_t *old_new = opa_cast_object(pairs);
+    size_t len = opa_value_length(pairs);
 
-    for (int i = 0; i < old_new->n; i++)
+    for (size_t i = 0; i < STR_REPLACER_CACHE_SIZE; i++)
     {
-        opa_object_elem_t *elem = old_new->buckets[i];
+        if (c->replacers[i].pairs == pairs && c->replacers[i].len == len)
+        {
+            return &c->replacers[i];
+        }
+    }
 
-        while (elem != NULL)
+    // type check the pairs and size the BFS queue before building anything
+    size_t nodes = 1;
+
+    for (int i = 0; i < old_new->n; i++)
+    {
+        for (opa_object_elem_t *elem = old_new->buckets[i]; elem != NULL; elem = elem->next)
         {
-            opa_value *old = elem->k;
-            opa_value *new = elem->v;
-            if (opa_value_type(old) != OPA_STRING || opa_value_type(new) != OPA_STRING)
+            if (opa_value_type(elem->k) != OPA_STRING || opa_value_type(elem->v) != OPA_STRING)
             {
-                opa_value_free(result);
                 return NULL;
             }
 
-            opa_value *r = opa_strings_replace(result, old, new);
-            opa_value_free(result);
-            result = r;
+            nodes += opa_cast_string(elem->k)->len;
+        }
+    }
+
+    str_replacer *r = &c->replacers[c->next];
+    c->next = (c->next + 1) % STR_REPLACER_CACHE_SIZE;
+
+    r->pairs = NULL;
+    r->len = len;
+    r->root = ac_node();
+
+    for (int i = 0; i < old_new->n; i++)
+    {
+        for (opa_object_elem_t *elem = old_new->buckets[i]; elem != NULL; elem = elem->next)
+        {
+            opa_string_t *old = opa_cast_string(elem->k);
+            if (old->len > 0)
+            {
+                ac_insert(r->root, old, opa_cast_string(elem->v));
+            }
+        }
+    }
+
+    ac_finish(r->root, nodes);
+    r->pairs = pairs;
+    return r;
+}
+
+// ac_replace runs the string through the automaton, returning the output
+// length and the number of matches. With out == NULL it only sizes the
+// result; with a buffer it fills it in.
+static size_t ac_replace(str_ac_node *root, opa_string_t *s, char *out, size_t *matches)
+{
+    str_ac_node *state = root;
+    size_t j = 0;    // output length
+    size_t from = 0; // first input byte not yet accounted for
+    *matches = 0;
+
+    for (size_t i = 0; i < s->len;)
+    {
+        state = state->child[(unsigned char)s->v[i++]];
+
+        if (state->new != NULL)
+        {
+            size_t start = i - state->old_len;
+
+            if (out != NULL)
+            {
+                memcpy(&out[j], &s->v[from], start - from);
+                memcpy(&out[j + (start - from)], state->new->v, state->new->len);
+            }
 
-            elem = elem->next;
+            j += (start - from) + state->new->len;
+            from = i;
+            state = root;
+            (*matches)++;
         }
     }
 
-    return result;
+    if (out != NULL)
+    {
+        memcpy(&out[j], &s->v[from], s->len - from);
+    }
+
+    return j + (s->len - from);
+}
+
+OPA_BUILTIN
+opa_value *opa_strings_replace_n(opa_value *a, opa_value *b)
+{
+    if (opa_value_type(a) != OPA_OBJECT || opa_value_type(b) != OPA_STRING)
+    {
+        return NULL;
+    }
+
+    str_replacer *r = replacer_for(a);
+    if (r == NULL)
+    {
+        return NULL;
+    }
+
+    opa_string_t *s = opa_cast_string(b);
+
+    size_t matches = 0;
+    size_t len = ac_replace(r->root, s, NULL, &matches);
+
+    if (matches == 0)
+    {
+        return b;
+    }
+
+    char *out = opa_malloc(len + 1);
+    ac_replace(r->root, s, out, &matches);
+    out[len] = '\0';
+
+    return opa_string_allocated(out, len);
 }
 
 OPA_BUILTIN
@@ -361,11 +759,24 @@ opa_value *opa_strings_split(opa_value *a, opa_value *b)
 
     opa_string_t *s = opa_cast_string(a);
     opa_string_t *d = opa_cast_string(b);
-    opa_array_t *arr = opa_cast_array(opa_array());
+
+    // The pieces are non-owning references into the source string, like
+    // strings produced by the borrowing JSON parser, so splitting copies
+    // no bytes; the result array is sized by a counting pass first.
 
     if (d->len == 0)
     {
-        // Split at UTF-8 character boundaries.
+        // Split at UTF-8 character boundaries. Runes are counted by
+        // their leading bytes, so the array is allocated exactly once.
+        size_t runes = 0;
+
+        for (size_t i = 0; i < s->len; i++)
+        {
+            runes += (s->v[i] & 0xc0) != 0x80;
+        }
+
+        opa_array_t *arr = opa_cast_array(opa_array_with_cap(runes));
+
         for (int i = 0; i < s->len; )
         {
             int len = 0;
@@ -374,190 +785,729 @@ opa_value *opa_strings_split(opa_value *a, opa_value *b)
                 opa_abort("string: invalid unicode");
             }
 
-            char *str = opa_malloc(len + 1);
-            memcpy(str, &s->v[i], len);
-            str[len] = '\0';
-
-            opa_array_append(arr, opa_string_allocated(str, len));
-
+            opa_array_append(arr, opa_string(&s->v[i], len));
             i += len;
         }
 
         return &arr->hdr;
     }
 
-    int j = 0;
-    for (int i = 0; s->len >= d->len && i <= (s->len - d->len); )
+    size_t parts = 1;
+
+    for (int i = strings_indexof(s, 0, d); i >= 0; i = strings_indexof(s, i + d->len, d))
     {
-        if (opa_strncmp(&s->v[i], d->v, d->len) == 0)
-        {
-            char *str = opa_malloc(i - j + 1);
-            memcpy(str, &s->v[j], i - j);
-            str[i - j] = '\0';
+        parts++;
+    }
 
-            opa_array_append(arr, opa_string_allocated(str, i - j));
+    opa_array_t *arr = opa_cast_array(opa_array_with_cap(parts));
+    int j = 0;
 
-            i += d->len;
-            j = i;
-        }
-        else
-        {
-            i++;
-        }
+    for (int i = strings_indexof(s, 0, d); i >= 0; i = strings_indexof(s, j, d))
+    {
+        opa_array_append(arr, opa_string(&s->v[j], i - j));
+        j = i + d->len;
     }
 
-    char *str = opa_malloc(s->len - j + 1);
-    memcpy(str, &s->v[j], s->len - j);
-    str[s->len - j] = '\0';
-
-    opa_array_append(arr, opa_string_allocated(str, s->len - j));
+    opa_array_append(arr, opa_string(&s->v[j], s->len - j));
 
     return &arr->hdr;
 }
 
-OPA_BUILTIN
-opa_value *opa_strings_startswith(opa_value *a, opa_value *b)
+// Appends n bytes to the sprintf output, growing it as needed.
+static void sprintf_append(char **out, size_t *len, size_t *cap, const char *p, size_t n)
 {
-    if (opa_value_type(a) != OPA_STRING || opa_value_type(b) != OPA_STRING)
+    if (*len + n + 1 > *cap)
     {
-        return NULL;
-    }
-
-    opa_string_t *s = opa_cast_string(a);
-    opa_string_t *prefix = opa_cast_string(b);
+        while (*len + n + 1 > *cap)
+        {
+            *cap *= 2;
+        }
 
-    if (s->len < prefix->len)
-    {
-        return opa_boolean(false);
+        *out = opa_realloc(*out, *cap);
     }
 
-    return opa_boolean(opa_strncmp(s->v, prefix->v, prefix->len) == 0);
+    memcpy(*out + *len, p, n);
+    *len += n;
 }
 
-OPA_BUILTIN
-opa_value *opa_strings_substring(opa_value *a, opa_value *b, opa_value *c)
+// Appends a conversion body space-padded to the requested width ('-'
+// flag pads on the right, as in Go).
+static void sprintf_pad(char **out, size_t *len, size_t *cap, const char *body, size_t n, int width, int left)
 {
-    if (opa_value_type(a) != OPA_STRING || opa_value_type(b) != OPA_NUMBER || opa_value_type(c) != OPA_NUMBER)
+    for (int pad = width - (int)n; !left && pad > 0; pad--)
     {
-        return NULL;
+        sprintf_append(out, len, cap, " ", 1);
     }
 
-    opa_string_t *base = opa_cast_string(a);
+    sprintf_append(out, len, cap, body, n);
 
-    long long start, length;
-    if (opa_number_try_int(opa_cast_number(b), &start))
+    for (int pad = width - (int)n; left && pad > 0; pad--)
     {
-        return NULL;
+        sprintf_append(out, len, cap, " ", 1);
     }
+}
 
-    if (opa_number_try_int(opa_cast_number(c), &length))
+// Implements the common core of Go's fmt verbs natively so that
+// compiled policies do not have to call out to the SDK: flags
+// '-+ 0#', numeric width and precision, and the verbs %v %s %d %b %o
+// %x %X %e %E %f %F %g %G %t %%. Numbers format as integers when they
+// are integer-representable (big integers print their decimal digits),
+// composite values format through opa_value_dump for both %v and %s.
+// Unsupported conversions return NULL like any other type error.
+OPA_BUILTIN
+opa_value *opa_strings_sprintf(opa_value *a, opa_value *b)
+{
+    if (opa_value_type(a) != OPA_STRING || opa_value_type(b) != OPA_ARRAY)
     {
         return NULL;
     }
 
-    if (start < 0)
-    {
-        return NULL;
-    }
+    opa_string_t *f = opa_cast_string(a);
+    opa_array_t *args = opa_cast_array(b);
 
-    if (length == 0)
-    {
-        return opa_string_terminated("");
-    }
+    size_t cap = f->len + 32;
+    size_t len = 0;
+    char *out = opa_malloc(cap);
+    size_t next = 0;
 
-    size_t spos = base->len, epos = base->len;
-    for (int i = 0, units = 0, len = 0; i < base->len; units++, i += len)
+    for (size_t i = 0; i < f->len; )
     {
-        if (units == start)
+        if (f->v[i] != '%')
         {
-            spos = i;
-        }
+            size_t run = i;
 
-        if (opa_unicode_decode_utf8(base->v, i, base->len, &len) == -1)
-        {
-            opa_abort("string: invalid unicode");
+            while (run < f->len && f->v[run] != '%')
+            {
+                run++;
+            }
+
+            sprintf_append(&out, &len, &cap, &f->v[i], run - i);
+            i = run;
+            continue;
         }
 
-        if (units < start)
+        i++;
+
+        if (i < f->len && f->v[i] == '%')
         {
-            // Start index not reached yet.
+            sprintf_append(&out, &len, &cap, "%", 1);
+            i++;
             continue;
         }
 
-        if (length < 0)
+        // collect the conversion spec, reusable with snprintf
+        char spec[48];
+        int sp = 0;
+        int width = 0, prec = -1, left = 0;
+        spec[sp++] = '%';
+
+        while (i < f->len && (f->v[i] == '-' || f->v[i] == '+' || f->v[i] == ' ' ||
+                              f->v[i] == '0' || f->v[i] == '#'))
         {
-            // Everything from start to end.
-            break;
+            left |= f->v[i] == '-';
+            spec[sp++] = f->v[i++];
         }
 
-        if (length == (units - start))
+        while (i < f->len && f->v[i] >= '0' && f->v[i] <= '9' && sp < 40)
         {
-            epos = i;
-            break;
+            width = width * 10 + (f->v[i] - '0');
+            spec[sp++] = f->v[i++];
         }
-    }
 
-    char *str = opa_malloc(epos - spos + 1);
-    memcpy(str, &base->v[spos], epos - spos);
-    str[epos - spos] = 0;
-    return opa_string_allocated(str, epos - spos);
+        if (i < f->len && f->v[i] == '.')
+        {
+            prec = 0;
+            spec[sp++] = f->v[i++];
+
+            while (i < f->len && f->v[i] >= '0' && f->v[i] <= '9' && sp < 44)
+            {
+                prec = prec * 10 + (f->v[i] - '0');
+                spec[sp++] = f->v[i++];
+            }
+        }
+
+        if (i >= f->len)
+        {
+            goto err;
+        }
+
+        char verb = f->v[i++];
+        opa_value *arg = next < args->len ? args->elems[next].v : NULL;
+        next++;
+
+        if (arg == NULL)
+        {
+            sprintf_append(&out, &len, &cap, "%!", 2);
+            sprintf_append(&out, &len, &cap, &verb, 1);
+            sprintf_append(&out, &len, &cap, "(MISSING)", 9);
+            continue;
+        }
+
+        size_t need = (size_t)width + (prec > 0 ? (size_t)prec : 0) + 348; // fits %f of any double
+        char small[64];
+        char *tmp = need > sizeof(small) ? opa_scratch_alloc(need) : small;
+        int n = -1;
+
+        switch (verb)
+        {
+        case 'd':
+        case 'o':
+        case 'x':
+        case 'X': {
+            if (opa_value_type(arg) != OPA_NUMBER)
+            {
+                goto err;
+            }
+
+            opa_number_t *num = opa_cast_number(arg);
+            long long x;
+
+            if (opa_number_try_int(num, &x) == 0)
+            {
+                spec[sp++] = 'l';
+                spec[sp++] = 'l';
+                spec[sp++] = verb;
+                spec[sp] = '\0';
+                n = snprintf(tmp, need, spec, x);
+                break;
+            }
+
+            // big decimal integers print their digits; everything else
+            // (floats, or big values in a non-decimal base) is a type error
+            if (verb != 'd' || num->repr != OPA_NUMBER_REPR_REF ||
+                memchr(num->v.ref.s, '.', num->v.ref.len) != NULL ||
+                memchr(num->v.ref.s, 'e', num->v.ref.len) != NULL ||
+                memchr(num->v.ref.s, 'E', num->v.ref.len) != NULL)
+            {
+                goto err;
+            }
+
+            sprintf_pad(&out, &len, &cap, num->v.ref.s, num->v.ref.len, width, left);
+            n = 0;
+            break;
+        }
+        case 'b': {
+            long long x;
+
+            if (opa_value_type(arg) != OPA_NUMBER ||
+                opa_number_try_int(opa_cast_number(arg), &x) != 0)
+            {
+                goto err;
+            }
+
+            char digits[66];
+            int d = 66;
+            unsigned long long u = x < 0 ? -(unsigned long long)x : (unsigned long long)x;
+
+            do
+            {
+                digits[--d] = '0' + (u & 1);
+                u >>= 1;
+            } while (u != 0);
+
+            if (x < 0)
+            {
+                digits[--d] = '-';
+            }
+
+            sprintf_pad(&out, &len, &cap, &digits[d], 66 - d, width, left);
+            n = 0;
+            break;
+        }
+        case 'e':
+        case 'E':
+        case 'f':
+        case 'F':
+        case 'g':
+        case 'G': {
+            if (opa_value_type(arg) != OPA_NUMBER)
+            {
+                goto err;
+            }
+
+            spec[sp++] = verb;
+            spec[sp] = '\0';
+            n = snprintf(tmp, need, spec, opa_number_as_float(opa_cast_number(arg)));
+            break;
+        }
+        case 't': {
+            if (opa_value_type(arg) != OPA_BOOLEAN)
+            {
+                goto err;
+            }
+
+            bool v = opa_cast_boolean(arg)->v;
+            sprintf_pad(&out, &len, &cap, v ? "true" : "false", v ? 4 : 5, width, left);
+            n = 0;
+            break;
+        }
+        case 'v':
+        case 's': {
+            switch (opa_value_type(arg))
+            {
+            case OPA_STRING: {
+                opa_string_t *s = opa_cast_string(arg);
+                size_t sn = s->len;
+
+                if (prec >= 0 && (size_t)prec < sn)
+                {
+                    sn = prec;
+                }
+
+                sprintf_pad(&out, &len, &cap, s->v, sn, width, left);
+                break;
+            }
+            case OPA_NUMBER: {
+                if (verb == 's')
+                {
+                    goto err;
+                }
+
+                opa_number_t *num = opa_cast_number(arg);
+                long long x;
+
+                if (opa_number_try_int(num, &x) == 0)
+                {
+                    n = snprintf(tmp, need, "%lld", x);
+                    sprintf_pad(&out, &len, &cap, tmp, n, width, left);
+                }
+                else
+                {
+                    sprintf_pad(&out, &len, &cap, num->v.ref.s, num->v.ref.len, width, left);
+                }
+
+                break;
+            }
+            default: {
+                char *d = opa_value_dump(arg);
+                sprintf_pad(&out, &len, &cap, d, opa_strlen(d), width, left);
+                opa_free(d);
+                break;
+            }
+            }
+
+            n = 0;
+            break;
+        }
+        default:
+            goto err;
+        }
+
+        if (n > 0)
+        {
+            sprintf_append(&out, &len, &cap, tmp, n);
+        }
+
+        continue;
+    }
+
+    out[len] = '\0';
+    opa_scratch_reset();
+    return opa_string_allocated(out, len);
+
+err:
+    opa_scratch_reset();
+    opa_free(out);
+    return NULL;
 }
 
 OPA_BUILTIN
-opa_value *opa_strings_trim(opa_value *a, opa_value *b)
+opa_value *opa_strings_startswith(opa_value *a, opa_value *b)
 {
     if (opa_value_type(a) != OPA_STRING || opa_value_type(b) != OPA_STRING)
     {
         return NULL;
     }
 
-    opa_value *s = opa_strings_trim_left(a, b);
-    opa_value *r = opa_strings_trim_right(s, b);
-    opa_value_free(s);
-    return r;
+    opa_string_t *s = opa_cast_string(a);
+    opa_string_t *prefix = opa_cast_string(b);
+
+    if (s->len < prefix->len)
+    {
+        return opa_boolean(false);
+    }
+
+    return opa_boolean(opa_strncmp(s->v, prefix->v, prefix->len) == 0);
+}
+
+// Advances *i (byte offset) and *units (rune index) forward to the
+// given rune index or the end of the string, whichever comes first.
+// ASCII runs are classified in bulk and stepped over arithmetically.
+static void strings_seek_rune(opa_string_t *s, long long target, int *i, long long *units)
+{
+    while (*i < s->len && *units < target)
+    {
+        int run = opa_unicode_ascii_run(s->v, *i, s->len);
+
+        if (run > *i)
+        {
+            long long n = run - *i;
+
+            if (n > target - *units)
+            {
+                n = target - *units;
+            }
+
+            *i += n;
+            *units += n;
+            continue;
+        }
+
+        int len;
+        if (opa_unicode_decode_utf8(s->v, *i, s->len, &len) == -1)
+        {
+            opa_abort("string: invalid unicode");
+        }
+
+        *i += len;
+        (*units)++;
+    }
+}
+
+// runes between consecutive checkpoints in a cached rune index
+#define STRINGS_RUNE_STRIDE 64
+
+// Returns the string's rune index, building and caching it on first
+// use. All-ASCII strings carry just the count (stride 0); others get a
+// byte offset checkpoint every STRINGS_RUNE_STRIDE runes, so later
+// rune-addressed calls seek from the nearest checkpoint instead of
+// decoding from the start of the string.
+static opa_string_rune_index_t *strings_rune_index(opa_string_t *s)
+{
+    if (s->runes != NULL && s->runes_epoch == opa_heap_epoch())
+    {
+        return s->runes;
+    }
+
+    size_t n = 0;
+
+    for (int i = 0; i < s->len; )
+    {
+        int run = opa_unicode_ascii_run(s->v, i, s->len);
+        n += run - i;
+        i = run;
+
+        if (i < s->len)
+        {
+            int len;
+            if (opa_unicode_decode_utf8(s->v, i, s->len, &len) == -1)
+            {
+                opa_abort("string: invalid unicode");
+            }
+
+            i += len;
+            n++;
+        }
+    }
+
+    size_t checkpoints = n == s->len ? 0 : n / STRINGS_RUNE_STRIDE;
+    opa_string_rune_index_t *idx = (opa_string_rune_index_t *)
+        opa_malloc(sizeof(opa_string_rune_index_t) + checkpoints * sizeof(size_t));
+
+    idx->n = n;
+    idx->stride = n == s->len ? 0 : STRINGS_RUNE_STRIDE;
+
+    int i = 0;
+    long long units = 0;
+
+    for (size_t k = 0; k < checkpoints; k++)
+    {
+        strings_seek_rune(s, (long long)(k + 1) * STRINGS_RUNE_STRIDE, &i, &units);
+        idx->offsets[k] = i;
+    }
+
+    s->runes = idx;
+    s->runes_epoch = opa_heap_epoch();
+    return idx;
+}
+
+// Like strings_seek_rune, but first jumps *i / *units ahead to the
+// nearest index checkpoint at or before the target (never backwards).
+static void strings_seek_rune_indexed(opa_string_t *s, opa_string_rune_index_t *idx,
+                                      long long target, int *i, long long *units)
+{
+    if (idx->stride == 0)
+    {
+        // 1:1 bytes to runes
+        long long t = target < (long long)idx->n ? target : (long long)idx->n;
+        *i = t;
+        *units = t;
+        return;
+    }
+
+    size_t checkpoints = idx->n / idx->stride;
+    size_t k = target > 0 ? (size_t)(target / (long long)idx->stride) : 0;
+
+    if (k > checkpoints)
+    {
+        k = checkpoints;
+    }
+
+    if (k > 0 && (long long)(k * idx->stride) > *units)
+    {
+        *i = idx->offsets[k-1];
+        *units = (long long)(k * idx->stride);
+    }
+
+    strings_seek_rune(s, target, i, units);
 }
 
 OPA_BUILTIN
-opa_value *opa_strings_trim_left(opa_value *a, opa_value *b)
+opa_value *opa_strings_substring(opa_value *a, opa_value *b, opa_value *c)
 {
-    if (opa_value_type(a) != OPA_STRING || opa_value_type(b) != OPA_STRING)
+    if (opa_value_type(a) != OPA_STRING || opa_value_type(b) != OPA_NUMBER || opa_value_type(c) != OPA_NUMBER)
     {
         return NULL;
     }
 
-    opa_string_t *s = opa_cast_string(a);
-    opa_string_t *l = opa_cast_string(b);
+    opa_string_t *base = opa_cast_string(a);
+
+    long long start, length;
+    if (opa_number_try_int(opa_cast_number(b), &start))
+    {
+        return NULL;
+    }
+
+    if (opa_number_try_int(opa_cast_number(c), &length))
+    {
+        return NULL;
+    }
+
+    if (start < 0)
+    {
+        return NULL;
+    }
+
+    if (length == 0)
+    {
+        return opa_string_terminated("");
+    }
+
+    opa_string_rune_index_t *idx = strings_rune_index(base);
+    int i = 0;
+    long long units = 0;
+
+    strings_seek_rune_indexed(base, idx, start, &i, &units);
+    size_t spos = i;
+    size_t epos = base->len;
+
+    if (length > 0)
+    {
+        strings_seek_rune_indexed(base, idx, start + length, &i, &units);
+        epos = i;
+    }
 
+    char *str = opa_malloc(epos - spos + 1);
+    memcpy(str, &base->v[spos], epos - spos);
+    str[epos - spos] = 0;
+    return opa_string_allocated(str, epos - spos);
+}
+
+// Cutset built once per trim call: ASCII membership is a 128-bit map
+// indexed by code point, non-ASCII code points go to a small array
+// scanned linearly (cutsets are short and almost always pure ASCII).
+// Trimming then costs one lookup per input character instead of a
+// rescan of the cutset string.
+typedef struct
+{
+    unsigned int ascii[4];
+    int *runes;
+    int n;
+} strings_cutset_t;
+
+static void strings_cutset_init(strings_cutset_t *cut, opa_string_t *c)
+{
+    memset(cut->ascii, 0, sizeof(cut->ascii));
+    cut->runes = NULL;
+    cut->n = 0;
+
+    int non_ascii = 0;
+
+    for (int i = 0; i < c->len; i++)
+    {
+        non_ascii += (c->v[i] & 0x80) != 0;
+    }
+
+    if (non_ascii > 0)
+    {
+        // Upper bound: every non-ASCII byte starts a code point. The array
+        // never outlives the trim call, so it comes off the scratch stack.
+        cut->runes = (int *)opa_scratch_alloc(non_ascii * sizeof(int));
+    }
+
+    for (int i = 0, len = 0; i < c->len; i += len)
+    {
+        int cp = opa_unicode_decode_utf8(c->v, i, c->len, &len);
+        if (cp == -1)
+        {
+            opa_abort("string: invalid unicode");
+        }
+
+        if (cp < 0x80)
+        {
+            cut->ascii[cp >> 5] |= 1u << (cp & 31);
+        }
+        else
+        {
+            cut->runes[cut->n++] = cp;
+        }
+    }
+}
+
+static void strings_cutset_free(strings_cutset_t *cut)
+{
+    if (cut->runes != NULL)
+    {
+        opa_scratch_reset();
+    }
+}
+
+static int strings_cutset_has(strings_cutset_t *cut, int cp)
+{
+    if (cp < 0x80)
+    {
+        return (cut->ascii[cp >> 5] >> (cp & 31)) & 1;
+    }
+
+    for (int i = 0; i < cut->n; i++)
+    {
+        if (cut->runes[i] == cp)
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// returns the first byte offset in s not covered by leading cutset characters
+static int strings_trim_start(opa_string_t *s, strings_cutset_t *cut)
+{
     int j = 0;
+
     while (j < s->len)
     {
-        int i = 0;
-        while (i < l->len)
+        unsigned char ch = s->v[j];
+
+        if (ch < 0x80)
         {
-            int len;
-            if (opa_unicode_decode_utf8(l->v, i, l->len, &len) == -1)
+            if (!strings_cutset_has(cut, ch))
             {
-                opa_abort("string: invalid unicode");
+                break;
             }
 
-            if ((j + len) <= s->len && opa_strncmp(&l->v[i], &s->v[j], len) == 0)
+            j++;
+            continue;
+        }
+
+        int len;
+        int cp = opa_unicode_decode_utf8(s->v, j, s->len, &len);
+        if (cp == -1)
+        {
+            opa_abort("string: invalid unicode");
+        }
+
+        if (!strings_cutset_has(cut, cp))
+        {
+            break;
+        }
+
+        j += len;
+    }
+
+    return j;
+}
+
+// returns the byte offset in s past the last character not covered by
+// trailing cutset characters, scanning no further back than 'start'
+static int strings_trim_end(opa_string_t *s, int start, strings_cutset_t *cut)
+{
+    int j = s->len;
+
+    while (j > start)
+    {
+        unsigned char ch = s->v[j-1];
+
+        if (ch < 0x80)
+        {
+            if (!strings_cutset_has(cut, ch))
             {
-                j += len; // trim codepoint.
                 break;
             }
 
-            i += len;
+            j--;
+            continue;
+        }
+
+        int last = opa_unicode_last_utf8(s->v, start, j);
+        if (last == -1)
+        {
+            opa_abort("string: invalid unicode");
+        }
+
+        int len;
+        int cp = opa_unicode_decode_utf8(s->v, last, j, &len);
+        if (cp == -1)
+        {
+            opa_abort("string: invalid unicode");
         }
 
-        if (i == l->len) {
-            // Nothing to trim.
+        if (!strings_cutset_has(cut, cp))
+        {
             break;
         }
+
+        j = last;
+    }
+
+    return j;
+}
+
+static opa_value *strings_trim_copy(opa_string_t *s, int start, int end)
+{
+    char *str = opa_malloc(end - start + 1);
+    memcpy(str, &s->v[start], end - start);
+    str[end - start] = '\0';
+    return opa_string_allocated(str, end - start);
+}
+
+OPA_BUILTIN
+opa_value *opa_strings_trim(opa_value *a, opa_value *b)
+{
+    if (opa_value_type(a) != OPA_STRING || opa_value_type(b) != OPA_STRING)
+    {
+        return NULL;
+    }
+
+    opa_string_t *s = opa_cast_string(a);
+
+    strings_cutset_t cut;
+    strings_cutset_init(&cut, opa_cast_string(b));
+
+    int start = strings_trim_start(s, &cut);
+    int end = strings_trim_end(s, start, &cut);
+
+    strings_cutset_free(&cut);
+    return strings_trim_copy(s, start, end);
+}
+
+OPA_BUILTIN
+opa_value *opa_strings_trim_left(opa_value *a, opa_value *b)
+{
+    if (opa_value_type(a) != OPA_STRING || opa_value_type(b) != OPA_STRING)
+    {
+        return NULL;
     }
 
-    char *str = opa_malloc(s->len - j + 1);
-    memcpy(str, &s->v[j], s->len - j + 1);
-    return opa_string_allocated(str, s->len - j);
+    opa_string_t *s = opa_cast_string(a);
+
+    strings_cutset_t cut;
+    strings_cutset_init(&cut, opa_cast_string(b));
+
+    int start = strings_trim_start(s, &cut);
+
+    strings_cutset_free(&cut);
+    return strings_trim_copy(s, start, s->len);
 }
 
 OPA_BUILTIN
@@ -592,45 +1542,14 @@ opa_value *opa_strings_trim_right(opa_value *a, opa_value *b)
     }
 
     opa_string_t *s = opa_cast_string(a);
-    opa_string_t *r = opa_cast_string(b);
 
-    int j = s->len;
-    while (j > 0)
-    {
-        int last = opa_unicode_last_utf8(s->v, 0, j);
-        if (last == -1)
-        {
-            opa_abort("string: invalid unicode");
-        }
+    strings_cutset_t cut;
+    strings_cutset_init(&cut, opa_cast_string(b));
 
-        int i = 0;
-        while (i < r->len)
-        {
-            int len;
-            if (opa_unicode_decode_utf8(r->v, i, r->len, &len) == -1)
-            {
-                opa_abort("string: invalid unicode");
-            }
-
-            if ((last + len) <= s->len && opa_strncmp(&r->v[i], &s->v[last], len) == 0)
-            {
-                j -= len; // trim codepoint.
-                break;
-            }
-
-            i += len;
-        }
+    int end = strings_trim_end(s, 0, &cut);
 
-        if (i == r->len) {
-            // Nothing to trim.
-            break;
-        }
-    }
-
-    char *str = opa_malloc(j + 1);
-    memcpy(str, s->v, j);
-    str[j] = '\0';
-    return opa_string_allocated(str, j);
+    strings_cutset_free(&cut);
+    return strings_trim_copy(s, 0, end);
 }
 
 OPA_BUILTIN
@@ -658,6 +1577,13 @@ opa_value *opa_strings_trim_suffix(opa_value *a, opa_value *b)
 
 static opa_value *trim_space(const char *s, int start, int end)
 {
+    // ASCII bytes classify straight off the table, no decoding
+    while (start < end && !(s[start] & 0x80) &&
+           (opa_ctype[(unsigned char)s[start]] & OPA_CT_LATIN1_SPACE))
+    {
+        start++;
+    }
+
     while (start < end)
     {
         int len = 0;
@@ -675,6 +1601,12 @@ static opa_value *trim_space(const char *s, int start, int end)
         start += len;
     }
 
+    while (start < end && !(s[end-1] & 0x80) &&
+           (opa_ctype[(unsigned char)s[end-1]] & OPA_CT_LATIN1_SPACE))
+    {
+        end--;
+    }
+
     while (start < end)
     {
         int last = opa_unicode_last_utf8(s, start, end);
@@ -750,47 +1682,62 @@ opa_value *opa_strings_trim_space(opa_value *a)
     return opa_string_allocated(str, stop - start);
 }
 
-OPA_BUILTIN
-opa_value *opa_strings_lower(opa_value *a)
+// Case-folds s in a single left-to-right pass ('upper' selects the
+// direction). ASCII runs fold 16 bytes at a time when SIMD is
+// available; the first non-ASCII byte drops to the rune
+// decode/fold/encode path for the remainder of the string.
+static opa_value *strings_case(opa_string_t *s, int upper)
 {
-    if (opa_value_type(a) != OPA_STRING)
+    char *out = opa_malloc(s->len + 1);
+    size_t i = 0;
+
+#ifdef __wasm_simd128__
+    while (i + 16 <= s->len)
     {
-        return NULL;
-    }
+        v128_t chunk = wasm_v128_load(&s->v[i]);
 
-    opa_string_t *s = opa_cast_string(a);
-    int is_ascii = true;
+        if (wasm_i8x16_bitmask(chunk) != 0)
+        {
+            // a non-ASCII byte somewhere in the block
+            break;
+        }
 
-    for (int i = 0; i < s->len && is_ascii; i++)
-    {
-        unsigned char c = s->v[i];
-        is_ascii = c < 0x80;
+        v128_t ge = wasm_i8x16_ge(chunk, wasm_i8x16_splat(upper ? 'a' : 'A'));
+        v128_t le = wasm_i8x16_le(chunk, wasm_i8x16_splat(upper ? 'z' : 'Z'));
+        v128_t flip = wasm_v128_and(wasm_v128_and(ge, le), wasm_i8x16_splat(0x20));
+
+        wasm_v128_store(&out[i], wasm_v128_xor(chunk, flip));
+        i += 16;
     }
+#endif
 
-    if (is_ascii)
+    for (; i < s->len; i++)
     {
-        char *str = opa_malloc(s->len + 1);
+        unsigned char c = s->v[i];
 
-        for (int i = 0; i < s->len; i++)
+        if (c >= 0x80)
         {
-            unsigned char c = s->v[i];
-            if ('A' <= c && c <= 'Z')
-            {
-                c += 'a' - 'A';
-            }
+            break;
+        }
 
-            str[i] = c;
+        if (upper ? ('a' <= c && c <= 'z') : ('A' <= c && c <= 'Z'))
+        {
+            c ^= 0x20;
         }
 
-        str[s->len] = '\0';
-        return opa_string_allocated(str, s->len);
+        out[i] = c;
     }
 
-    int j = 0;
-    char *out = malloc(s->len + 1);
-    int cap = s->len;
+    if (i == s->len)
+    {
+        out[i] = '\0';
+        return opa_string_allocated(out, s->len);
+    }
 
-    for (int i = 0; i < s->len; )
+    size_t j = i;
+    size_t cap = s->len;
+
+    while (i < s->len)
     {
         int len;
         int cp = opa_unicode_decode_utf8(s->v, i, s->len, &len);
@@ -799,7 +1746,7 @@ opa_value *opa_strings_lower(opa_value *a)
             opa_abort("string: invalid unicode");
         }
 
-        cp = opa_unicode_to_lower(cp);
+        cp = upper ? opa_unicode_to_upper(cp) : opa_unicode_to_lower(cp);
         if (cp == -1)
         {
             opa_abort("string: invalid unicode");
@@ -825,6 +1772,17 @@ opa_value *opa_strings_lower(opa_value *a)
     return opa_string_allocated(out, j);
 }
 
+OPA_BUILTIN
+opa_value *opa_strings_lower(opa_value *a)
+{
+    if (opa_value_type(a) != OPA_STRING)
+    {
+        return NULL;
+    }
+
+    return strings_case(opa_cast_string(a), 0);
+}
+
 OPA_BUILTIN
 opa_value *opa_strings_upper(opa_value *a)
 {
@@ -833,69 +1791,105 @@ opa_value *opa_strings_upper(opa_value *a)
         return NULL;
     }
 
-    opa_string_t *s = opa_cast_string(a);
-    int is_ascii = true;
+    return strings_case(opa_cast_string(a), 1);
+}
+
+// equal_fold_word lowercases the ASCII letters of a word of eight bytes
+// at once: a byte is in 'A'..'Z' exactly when adding 0x3f sets its high
+// bit and adding 0x25 does not, and setting bit 5 of those bytes is the
+// case flip. Only valid when no input byte has its high bit set.
+static uint64_t equal_fold_word(uint64_t w)
+{
+    uint64_t upper = (w + 0x3f3f3f3f3f3f3f3fULL) & ~(w + 0x2525252525252525ULL) & 0x8080808080808080ULL;
+    return w | (upper >> 2);
+}
 
-    for (int i = 0; i < s->len && is_ascii; i++)
+OPA_BUILTIN
+opa_value *opa_strings_equal_fold(opa_value *a, opa_value *b)
+{
+    if (opa_value_type(a) != OPA_STRING || opa_value_type(b) != OPA_STRING)
     {
-        unsigned char c = s->v[i];
-        is_ascii = c < 0x80;
+        return NULL;
     }
 
-    if (is_ascii)
+    opa_string_t *x = opa_cast_string(a);
+    opa_string_t *y = opa_cast_string(b);
+
+    // Case-insensitive comparison equivalent to lower(x) == lower(y) but
+    // without materializing either copy: ASCII prefixes compare a word at
+    // a time, the first non-ASCII byte drops to the rune
+    // decode/fold/compare path for the remainder of both strings.
+
+    size_t i = 0, j = 0;
+
+    while (i + 8 <= x->len && j + 8 <= y->len)
     {
-        char *str = opa_malloc(s->len + 1);
+        uint64_t wx, wy;
+        memcpy(&wx, &x->v[i], 8);
+        memcpy(&wy, &y->v[j], 8);
 
-        for (int i = 0; i < s->len; i++)
+        if ((wx | wy) & 0x8080808080808080ULL)
         {
-            unsigned char c = s->v[i];
-            if ('a' <= c && c <= 'z')
-            {
-                c -= 'a' - 'A';
-            }
+            // a non-ASCII byte somewhere in the block
+            break;
+        }
 
-            str[i] = c;
+        if (equal_fold_word(wx) != equal_fold_word(wy))
+        {
+            return opa_boolean(false);
         }
 
-        str[s->len] = '\0';
-        return opa_string_allocated(str, s->len);
+        i += 8;
+        j += 8;
     }
 
-    int j = 0;
-    char *out = malloc(s->len + 1);
-    int cap = s->len;
-
-    for (int i = 0; i < s->len; )
+    while (i < x->len && j < y->len)
     {
-        int len;
-        int cp = opa_unicode_decode_utf8(s->v, i, s->len, &len);
-        if (cp == -1)
+        unsigned char cx = x->v[i];
+        unsigned char cy = y->v[j];
+
+        if ((cx | cy) >= 0x80)
         {
-            opa_abort("string: invalid unicode");
+            break;
         }
 
-        cp = opa_unicode_to_upper(cp);
-        if (cp == -1)
+        if ('A' <= cx && cx <= 'Z')
         {
-            opa_abort("string: invalid unicode");
+            cx |= 0x20;
         }
 
-        if (cap < (j + 4)) // Space for the longest possible UTF-8 character (4 bytes).
+        if ('A' <= cy && cy <= 'Z')
         {
-            cap *= 2;
+            cy |= 0x20;
+        }
 
-            if (cap < (j + 4))
-            {
-                cap = j + 4;
-            }
+        if (cx != cy)
+        {
+            return opa_boolean(false);
+        }
 
-            out = opa_realloc(out, cap + 1);
+        i++;
+        j++;
+    }
+
+    while (i < x->len && j < y->len)
+    {
+        int lx, ly;
+        int cpx = opa_unicode_decode_utf8(x->v, i, x->len, &lx);
+        int cpy = opa_unicode_decode_utf8(y->v, j, y->len, &ly);
+        if (cpx == -1 || cpy == -1)
+        {
+            opa_abort("string: invalid unicode");
         }
 
-        j += opa_unicode_encode_utf8(cp, &out[j]);
-        i += len;
+        if (opa_unicode_to_lower(cpx) != opa_unicode_to_lower(cpy))
+        {
+            return opa_boolean(false);
+        }
+
+        i += lx;
+        j += ly;
     }
 
-    out[j] = '\0';
-    return opa_string_allocated(out, j);
+    return opa_boolean(i == x->len && j == y->len);
 }
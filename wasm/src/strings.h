@@ -6,12 +6,14 @@
 opa_value *opa_strings_concat(opa_value *a, opa_value *b);
 opa_value *opa_strings_contains(opa_value *a, opa_value *b);
 opa_value *opa_strings_endswith(opa_value *a, opa_value *b);
+opa_value *opa_strings_equal_fold(opa_value *a, opa_value *b);
 opa_value *opa_strings_format_int(opa_value *a, opa_value *b);
 opa_value *opa_strings_indexof(opa_value *a, opa_value *b);
 opa_value *opa_strings_lower(opa_value *a);
 opa_value *opa_strings_replace(opa_value *a, opa_value *b, opa_value *c);
 opa_value *opa_strings_replace_n(opa_value *a, opa_value *b);
 opa_value *opa_strings_split(opa_value *a, opa_value *b);
+opa_value *opa_strings_sprintf(opa_value *a, opa_value *b);
 opa_value *opa_strings_startswith(opa_value *a, opa_value *b);
 opa_value *opa_strings_substring(opa_value *a, opa_value *b, opa_value *c);
 opa_value *opa_strings_trim(opa_value *a, opa_value *b);
@@ -43,26 +43,30 @@ opa_value *opa_types_is_null(opa_value *v)
     return opa_value_type(v) == OPA_NULL ? opa_boolean(true) : NULL;
 }
 
+// The seven type names are data-segment singletons, like the interned
+// booleans in value.c: opa_value_free and shallow copy leave interned
+// strings alone, so handing out the statics from a tight type-dispatch
+// loop allocates nothing. The cached hash and rune index fill in on
+// first use like any other string.
+static opa_string_t opa_type_names[OPA_SET + 1] = {
+    [OPA_NULL]    = { .hdr = { .type = OPA_STRING_INTERNED }, .len = 4, .v = "null" },
+    [OPA_BOOLEAN] = { .hdr = { .type = OPA_STRING_INTERNED }, .len = 7, .v = "boolean" },
+    [OPA_NUMBER]  = { .hdr = { .type = OPA_STRING_INTERNED }, .len = 6, .v = "number" },
+    [OPA_STRING]  = { .hdr = { .type = OPA_STRING_INTERNED }, .len = 6, .v = "string" },
+    [OPA_ARRAY]   = { .hdr = { .type = OPA_STRING_INTERNED }, .len = 5, .v = "array" },
+    [OPA_OBJECT]  = { .hdr = { .type = OPA_STRING_INTERNED }, .len = 6, .v = "object" },
+    [OPA_SET]     = { .hdr = { .type = OPA_STRING_INTERNED }, .len = 3, .v = "set" },
+};
+
 OPA_BUILTIN
 opa_value *opa_types_name(opa_value *v)
 {
-    switch (opa_value_type(v))
+    int type = opa_value_type(v);
+
+    if (type < OPA_NULL || type > OPA_SET)
     {
-    case OPA_NULL:
-        return opa_string("null", 4);
-    case OPA_BOOLEAN:
-        return opa_string("boolean", 7);
-    case OPA_NUMBER:
-        return opa_string("number", 6);
-    case OPA_STRING:
-        return opa_string("string", 6);
-    case OPA_ARRAY:
-        return opa_string("array", 5);
-    case OPA_OBJECT:
-        return opa_string("object", 6);
-    case OPA_SET:
-        return opa_string("set", 3);
-    default:
         return NULL;
     }
+
+    return &opa_type_names[type].hdr;
 }
@@ -3,6 +3,13 @@
 #include <stdio.h>
 #include <stdint.h>
 #include "std.h"
+#include "stdlib.h"
+#include "str.h"
+#include "string.h"
+
+#ifdef __wasm_simd128__
+#include <wasm_simd128.h>
+#endif
 
 // Tests whether the code point is an utf-16 surrogate (encoded
 // representation of low or high bits).
@@ -150,6 +157,48 @@ int opa_unicode_decode_utf8(const char *in, int i, int len, int *olen)
     return -1;
 }
 
+// Returns the end offset of the run of ASCII bytes starting at 'i':
+// every byte in [i, end) is a complete one-byte character. Whole blocks
+// of the input are classified at once, so rune-aware callers can step
+// over ASCII runs without decoding them a code point at a time.
+int opa_unicode_ascii_run(const char *in, int i, int len)
+{
+#ifdef __wasm_simd128__
+    while (i + 16 <= len)
+    {
+        int mask = wasm_i8x16_bitmask(wasm_v128_load(&in[i]));
+
+        if (mask != 0)
+        {
+            return i + __builtin_ctz(mask);
+        }
+
+        i += 16;
+    }
+#else
+    while (i + 8 <= len)
+    {
+        uint64_t w;
+        memcpy(&w, &in[i], sizeof(w));
+        w &= UINT64_C(0x8080808080808080);
+
+        if (w != 0)
+        {
+            return i + __builtin_ctzll(w) / 8;
+        }
+
+        i += 8;
+    }
+#endif
+
+    while (i < len && !(in[i] & 0x80))
+    {
+        i++;
+    }
+
+    return i;
+}
+
 // Writes the code point as UTF-8.
 int opa_unicode_encode_utf8(int codepoint, char *out)
 {
@@ -272,7 +321,7 @@ static bool is(const range16_t *r16, int l16, int cp)
 bool opa_unicode_is_space(int cp)
 {
     if (cp <= 0xff) { // Latin1
-        return cp == '\t' || cp == '\n' || cp == '\v' || cp ==  '\f' || cp ==  '\r' || cp == ' ' || cp == 0x85 || cp == 0xa0;
+        return opa_ctype[cp] & OPA_CT_LATIN1_SPACE;
     }
 
     return is(white_spaces, sizeof(white_spaces) / sizeof(range16_t), cp);
@@ -656,12 +705,90 @@ static int to(int case_, uint32_t cp)
     return cp;
 }
 
+// Two-level case mapping tables, built once from the ranges above so the
+// per-rune lookup in the opa_strings_lower/upper loops is two dependent
+// loads instead of a binary search. The top level indexes 256-codepoint
+// blocks; the few dozen blocks that contain case-mapped characters get a
+// dense mapping array, all others map to themselves through the -1 entry.
+// The tables are statics — they survive heap resets and add nothing to the
+// data segment — and cost about a kilobyte per populated block.
+
+#define CASE_BLOCK_COUNT (0x110000 >> 8)
+#define CASE_BLOCK_MAX (64) // 47 populated blocks as of unicode 12.0.0
+
+static int16_t case_top[2][CASE_BLOCK_COUNT];
+static int32_t case_blocks[CASE_BLOCK_MAX][256];
+static int case_blocks_used = 0;
+static bool case_tables_ready = false;
+
+static void case_tables_build(void)
+{
+    for (int case_ = UPPER_CASE; case_ <= LOWER_CASE; case_++)
+    {
+        for (size_t i = 0; i < CASE_BLOCK_COUNT; i++)
+        {
+            case_top[case_][i] = -1;
+        }
+
+        for (size_t i = 0; i < sizeof(case_ranges) / sizeof(case_range_t); i++)
+        {
+            for (uint32_t cp = case_ranges[i].lo; cp <= case_ranges[i].hi; cp++)
+            {
+                int mapped = to(case_, cp);
+
+                if (mapped == (int)cp)
+                {
+                    continue;
+                }
+
+                int16_t b = case_top[case_][cp >> 8];
+
+                if (b == -1)
+                {
+                    if (case_blocks_used == CASE_BLOCK_MAX)
+                    {
+                        opa_abort("opa_unicode: case table overflow");
+                    }
+
+                    b = case_blocks_used++;
+                    case_top[case_][cp >> 8] = b;
+
+                    for (int j = 0; j < 256; j++)
+                    {
+                        case_blocks[b][j] = ((cp >> 8) << 8) | j;
+                    }
+                }
+
+                case_blocks[b][cp & 0xff] = mapped;
+            }
+        }
+    }
+
+    case_tables_ready = true;
+}
+
+static int case_lookup(int case_, int codepoint)
+{
+    if (codepoint < 0 || codepoint > 0x10FFFF)
+    {
+        return codepoint;
+    }
+
+    if (!case_tables_ready)
+    {
+        case_tables_build();
+    }
+
+    int16_t b = case_top[case_][codepoint >> 8];
+    return b < 0 ? codepoint : case_blocks[b][codepoint & 0xff];
+}
+
 int opa_unicode_to_lower(int codepoint)
 {
-    return to(LOWER_CASE, codepoint);
+    return case_lookup(LOWER_CASE, codepoint);
 }
 
 int opa_unicode_to_upper(int codepoint)
 {
-    return to(UPPER_CASE, codepoint);
+    return case_lookup(UPPER_CASE, codepoint);
 }
@@ -7,6 +7,7 @@
 extern "C" {
 #endif
 
+int opa_unicode_ascii_run(const char *in, int i, int len);
 int opa_unicode_decode_surrogate(int codepoint1, int codepoint2);
 int opa_unicode_decode_unit(const char *in, int i, int len);
 int opa_unicode_decode_utf8(const char *in, int i, int len, int *olen);
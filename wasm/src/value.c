@@ -4,25 +4,46 @@
 #include "malloc.h"
 #include "mpd.h"
 #include "str.h"
+#include "string.h"
 #include "value.h"
 
 #define OPA_ARRAY_INITIAL_CAP (10)
 #define OPA_OBJECT_MIN_BUCKETS (8)
 #define OPA_OBJECT_LOAD_FACTOR (0.7)
+#define OPA_SET_BITMAP_MAX_RANGE (65536) // at most an 8 KiB bitmap
+#define OPA_SET_BITMAP_MIN_LEN (32)      // below this a probe is cheap enough
+#define OPA_OBJECT_BLOOM_MIN_LEN (32)    // below this a probe is cheap enough
 #define OPA_SET_MIN_BUCKETS (8)
 #define OPA_SET_LOAD_FACTOR (0.7)
 
+#define OPA_NUMBER_INTERNED_MIN (-128)
+#define OPA_NUMBER_INTERNED_MAX (1024)
+
+// Interned small integers, initialized on first use. Shared, immutable and
+// never freed.
+static opa_number_t opa_numbers_interned[OPA_NUMBER_INTERNED_MAX - OPA_NUMBER_INTERNED_MIN + 1];
+
 static opa_value *__opa_object_with_buckets(size_t buckets);
 static opa_value *__opa_set_with_buckets(size_t buckets);
 static opa_array_t *__opa_set_values(opa_set_t *set);
 static void __opa_object_insert_elem(opa_object_t *obj, opa_object_elem_t *new, size_t hash);
+static void __opa_object_keys_invalidate(opa_object_t *obj);
+static void __opa_object_dump_invalidate(opa_object_t *obj);
+static void __opa_object_bloom_invalidate(opa_object_t *obj);
+opa_object_elem_t *__opa_object_elem_alloc(opa_value *k, opa_value *v);
+opa_set_elem_t *__opa_set_elem_alloc(opa_value *v);
 static void __opa_set_add_elem(opa_set_t *set, opa_set_elem_t *new, size_t hash);
+static void __opa_set_bitmap_invalidate(opa_set_t *set);
+static size_t __opa_object_slot(opa_object_t *obj, opa_value *key, size_t hash);
+static void __opa_string_rope_flatten(opa_string_rope_t *rope);
+static void __opa_cap_profile_observe(opa_value *v, size_t len);
+void __opa_object_grow(opa_object_t *obj, size_t n);
 
 OPA_INTERNAL
 int opa_value_type(opa_value *node)
 {
     // For all intents and purposes, interned strings are strings,
-    // interned booleans are booleans.
+    // interned booleans are booleans, interned numbers are numbers.
     // Only opa_value_free and opa_value_shallow_copy handle them
     // separately, by refering to node->type directly.
     switch (node->type)
@@ -31,6 +52,15 @@ int opa_value_type(opa_value *node)
         return OPA_STRING;
     case OPA_BOOLEAN_INTERNED:
         return OPA_BOOLEAN;
+    case OPA_NUMBER_INTERNED:
+        return OPA_NUMBER;
+    case OPA_NULL_INTERNED:
+        return OPA_NULL;
+    case OPA_STRING_ROPE:
+        // first byte-wise access: flatten the rope in place, after which
+        // the node is a plain string (see opa_string_rope)
+        __opa_string_rope_flatten(opa_cast_string_rope(node));
+        return OPA_STRING;
     default:
         return node->type;
     }
@@ -39,7 +69,19 @@ int opa_value_type(opa_value *node)
 opa_value *opa_value_get_object(opa_object_t *obj, opa_value *key)
 {
     opa_object_elem_t *elem = opa_object_get(obj, key);
-    return elem == NULL ? NULL : elem->v;
+
+    if (elem == NULL)
+    {
+        return NULL;
+    }
+
+    if (elem->v->type == OPA_LAZY)
+    {
+        // materialize in place so later hits skip the indirection
+        elem->v = opa_value_force(elem->v);
+    }
+
+    return elem->v;
 }
 
 opa_value *opa_value_get_set(opa_set_t *set, opa_value *key)
@@ -55,7 +97,7 @@ opa_value *opa_value_get_array_native(opa_array_t *arr, long long i)
 
 opa_value *opa_value_get_array(opa_array_t *arr, opa_value *key)
 {
-    if (key->type != OPA_NUMBER)
+    if (opa_value_type(key) != OPA_NUMBER)
     {
         return NULL;
     }
@@ -90,11 +132,92 @@ opa_value *opa_value_get(opa_value *node, opa_value *key)
             return opa_value_get_object(opa_cast_object(node), key);
         case OPA_SET:
             return opa_value_get_set(opa_cast_set(node), key);
+        case OPA_LAZY:
+            return opa_value_get(opa_value_force(node), key);
         }
     }
     return NULL;
 }
 
+// Inline-cached opa_value_get for hot call sites that look the same key up
+// in the same object over and over. A hit revalidates the slot — same
+// object, same key handle, same heap epoch — and loads the remembered
+// bucket directly, skipping the hash and the probe sequence. Only frozen
+// objects fill the cache: they cannot rebucket, so a validated slot cannot
+// be stale. Everything else (misses, unfrozen objects, non-objects) takes
+// the ordinary path, and an absent key is not cached.
+OPA_INTERNAL
+WASM_EXPORT(opa_value_get_cached)
+opa_value *opa_value_get_cached(opa_value *node, opa_value *key, opa_value_ic_t *ic)
+{
+    if (node != NULL && ic->node == node && ic->key == key &&
+        ic->epoch == opa_heap_epoch())
+    {
+        opa_object_elem_t *elem = opa_cast_object(node)->buckets[ic->i];
+
+        if (elem->v->type == OPA_LAZY)
+        {
+            elem->v = opa_value_force(elem->v);
+        }
+
+        return elem->v;
+    }
+
+    if (node != NULL && node->type == OPA_OBJECT && node->frozen)
+    {
+        opa_object_t *obj = opa_cast_object(node);
+        size_t i = __opa_object_slot(obj, key, opa_value_hash(key));
+
+        if (obj->buckets[i] != NULL)
+        {
+            ic->node = node;
+            ic->key = key;
+            ic->i = i;
+            ic->epoch = opa_heap_epoch();
+
+            if (obj->buckets[i]->v->type == OPA_LAZY)
+            {
+                obj->buckets[i]->v = opa_value_force(obj->buckets[i]->v);
+            }
+
+            return obj->buckets[i]->v;
+        }
+
+        return NULL;
+    }
+
+    return opa_value_get(node, key);
+}
+
+// Walks a multi-segment reference (data.a.b.c) in one call. The compiler
+// precomputes the key hashes, so an object step probes its table directly
+// instead of rehashing the key; non-object steps ignore the hash and defer
+// to opa_value_get. Returns NULL as soon as a segment is missing.
+OPA_INTERNAL
+opa_value *opa_value_get_path(opa_value *node, opa_value **keys, size_t *hashes, size_t n)
+{
+    for (size_t i = 0; node != NULL && i < n; i++)
+    {
+        if (node->type == OPA_OBJECT)
+        {
+            opa_object_t *obj = opa_cast_object(node);
+            opa_object_elem_t *elem = obj->buckets[__opa_object_slot(obj, keys[i], hashes[i])];
+
+            if (elem != NULL && elem->v->type == OPA_LAZY)
+            {
+                elem->v = opa_value_force(elem->v);
+            }
+
+            node = elem == NULL ? NULL : elem->v;
+            continue;
+        }
+
+        node = opa_value_get(node, keys[i]);
+    }
+
+    return node;
+}
+
 opa_object_elem_t *__opa_object_next_bucket(opa_object_t *obj, size_t i)
 {
     for (; i < obj->n; i++) {
@@ -107,16 +230,20 @@ opa_object_elem_t *__opa_object_next_bucket(opa_object_t *obj, size_t i)
     return NULL;
 }
 
-opa_object_elem_t *__opa_object_get_bucket_elem(opa_object_elem_t *bucket, opa_value *key) {
-    for (opa_object_elem_t *curr = bucket; curr != NULL; curr = curr->next)
+// probes for the slot holding the key, or the empty slot where it would be
+// inserted. The load factor guarantees an empty slot terminates every probe
+// sequence.
+static size_t __opa_object_slot(opa_object_t *obj, opa_value *key, size_t hash)
+{
+    size_t i = hash % obj->n;
+
+    while (obj->buckets[i] != NULL &&
+           (obj->buckets[i]->hash != hash || !opa_value_eq(obj->buckets[i]->k, key)))
     {
-        if (opa_value_compare(curr->k, key) == 0)
-        {
-            return curr;
-        }
+        i = (i + 1) % obj->n;
     }
 
-    return NULL;
+    return i;
 }
 
 opa_value *opa_value_iter_object(opa_object_t *obj, opa_value *prev)
@@ -131,14 +258,8 @@ opa_value *opa_value_iter_object(opa_object_t *obj, opa_value *prev)
         return NULL;
     }
 
-    size_t i = opa_value_hash(prev) % obj->n;
-    opa_object_elem_t *elem = __opa_object_get_bucket_elem(obj->buckets[i], prev);
-    opa_object_elem_t *next = elem->next;
-    if (next != NULL) {
-        return next->k;
-    }
-
-    next = __opa_object_next_bucket(obj, i+1);
+    size_t i = __opa_object_slot(obj, prev, opa_value_hash(prev));
+    opa_object_elem_t *next = __opa_object_next_bucket(obj, i+1);
     if (next != NULL) {
             return next->k;
     }
@@ -158,16 +279,53 @@ opa_set_elem_t *__opa_set_next_bucket(opa_set_t *set, size_t i)
     return NULL;
 }
 
-opa_set_elem_t *__opa_set_get_bucket_elem(opa_set_elem_t *bucket, opa_value *v) {
-    for (opa_set_elem_t *curr = bucket; curr != NULL; curr = curr->next)
+// binary search over a sorted set's dense prefix: returns the position of
+// the value, or the insertion point that keeps the prefix ordered, with
+// 'found' set accordingly.
+static size_t __opa_set_sorted_pos(opa_set_t *set, opa_value *v, bool *found)
+{
+    size_t lo = 0;
+    size_t hi = set->len;
+
+    while (lo < hi)
     {
-        if (opa_value_compare(curr->v, v) == 0)
+        size_t mid = lo + (hi - lo) / 2;
+        int cmp = opa_value_compare(set->buckets[mid]->v, v);
+
+        if (cmp == 0)
+        {
+            *found = true;
+            return mid;
+        }
+
+        if (cmp < 0)
         {
-            return curr;
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
         }
     }
 
-    return NULL;
+    *found = false;
+    return lo;
+}
+
+// probes for the slot holding the value, or the empty slot where it would be
+// inserted. The load factor guarantees an empty slot terminates every probe
+// sequence.
+static size_t __opa_set_slot(opa_set_t *set, opa_value *v, size_t hash)
+{
+    size_t i = hash % set->n;
+
+    while (set->buckets[i] != NULL &&
+           (set->buckets[i]->hash != hash || !opa_value_eq(set->buckets[i]->v, v)))
+    {
+        i = (i + 1) % set->n;
+    }
+
+    return i;
 }
 
 opa_value *opa_value_iter_set(opa_set_t *set, opa_value *prev)
@@ -182,14 +340,15 @@ opa_value *opa_value_iter_set(opa_set_t *set, opa_value *prev)
         return NULL;
     }
 
-    size_t i = opa_value_hash(prev) % set->n;
-    opa_set_elem_t *elem = __opa_set_get_bucket_elem(set->buckets[i], prev);
-    opa_set_elem_t *next = elem->next;
-    if (next != NULL) {
-        return next->v;
+    if (set->sorted)
+    {
+        bool found;
+        size_t i = __opa_set_sorted_pos(set, prev, &found);
+        return found && i+1 < set->len ? set->buckets[i+1]->v : NULL;
     }
 
-    next = __opa_set_next_bucket(set, i+1);
+    size_t i = __opa_set_slot(set, prev, opa_value_hash(prev));
+    opa_set_elem_t *next = __opa_set_next_bucket(set, i+1);
     if (next != NULL) {
             return next->v;
     }
@@ -206,10 +365,10 @@ opa_value *opa_value_iter_array(opa_array_t *arr, opa_value *prev)
             return NULL;
         }
 
-        return arr->elems[0].i;
+        return opa_number_interned(0);
     }
 
-    if (prev->type != OPA_NUMBER)
+    if (opa_value_type(prev) != OPA_NUMBER)
     {
         return NULL;
     }
@@ -230,7 +389,7 @@ opa_value *opa_value_iter_array(opa_array_t *arr, opa_value *prev)
         return NULL;
     }
 
-    return arr->elems[i].i;
+    return opa_number_interned(i);
 }
 
 opa_value *opa_value_iter(opa_value *node, opa_value *prev)
@@ -245,12 +404,132 @@ opa_value *opa_value_iter(opa_value *node, opa_value *prev)
             return opa_value_iter_object(opa_cast_object(node), prev);
         case OPA_SET:
             return opa_value_iter_set(opa_cast_set(node), prev);
+        case OPA_LAZY:
+            return opa_value_iter(opa_value_force(node), prev);
+        }
+    }
+
+    return NULL;
+}
+
+OPA_INTERNAL
+opa_value_cursor_t *opa_value_cursor(opa_value *node)
+{
+    opa_value_cursor_t *cur = (opa_value_cursor_t *)opa_malloc(sizeof(opa_value_cursor_t));
+    cur->node = node;
+    cur->i = 0;
+    cur->v = NULL;
+    return cur;
+}
+
+// returns the next key (the element itself for sets), or NULL when the
+// iteration is done. The matching value is available from
+// opa_value_cursor_value without a further lookup.
+OPA_INTERNAL
+opa_value *opa_value_cursor_next(opa_value_cursor_t *cur)
+{
+    if (cur->node == NULL)
+    {
+        return NULL;
+    }
+
+    switch (cur->node->type)
+    {
+    case OPA_ARRAY:
+    {
+        opa_array_t *arr = opa_cast_array(cur->node);
+
+        if (cur->i >= arr->len)
+        {
+            return NULL;
+        }
+
+        cur->v = arr->elems[cur->i].v;
+        return opa_number_interned((long long)cur->i++);
+    }
+    case OPA_OBJECT:
+    {
+        opa_object_t *obj = opa_cast_object(cur->node);
+
+        for (; cur->i < obj->n; cur->i++)
+        {
+            opa_object_elem_t *elem = obj->buckets[cur->i];
+
+            if (elem != NULL)
+            {
+                if (elem->v->type == OPA_LAZY)
+                {
+                    elem->v = opa_value_force(elem->v);
+                }
+
+                cur->v = elem->v;
+                cur->i++;
+                return elem->k;
+            }
         }
+
+        return NULL;
+    }
+    case OPA_SET:
+    {
+        opa_set_t *set = opa_cast_set(cur->node);
+
+        for (; cur->i < set->n; cur->i++)
+        {
+            if (set->buckets[cur->i] != NULL)
+            {
+                cur->v = set->buckets[cur->i]->v;
+                return set->buckets[cur->i++]->v;
+            }
+        }
+
+        return NULL;
+    }
     }
 
     return NULL;
 }
 
+OPA_INTERNAL
+opa_value *opa_value_cursor_value(opa_value_cursor_t *cur)
+{
+    return cur->v;
+}
+
+// Materializes a lazy subtree: the stored span is parsed on the first call
+// (itself lazily, so large subtrees nested inside it stay deferred) and the
+// result cached on the lazy node. The node is not freed — transient
+// references to it may exist — and is reclaimed by the next heap reset.
+OPA_INTERNAL
+opa_value *opa_value_force(opa_value *node)
+{
+    if (node == NULL || node->type != OPA_LAZY)
+    {
+        return node;
+    }
+
+    opa_lazy_t *l = opa_cast_lazy(node);
+
+    if (l->parsed == NULL)
+    {
+        l->parsed = opa_json_parse_lazy(l->v, l->len);
+
+        if (l->parsed == NULL)
+        {
+            // the span lexed cleanly when it was captured, so only input
+            // that opa_json_parse would have rejected anyway lands here
+            opa_abort("opa_value_force: invalid lazy span");
+        }
+
+        if (l->hdr.frozen)
+        {
+            opa_value_freeze(l->parsed);
+        }
+    }
+
+    return l->parsed;
+}
+
 size_t opa_value_length_object(opa_object_t *obj)
 {
     return obj->len;
@@ -284,6 +563,8 @@ size_t opa_value_length(opa_value *node)
         return opa_value_length_set(opa_cast_set(node));
     case OPA_STRING:
         return opa_value_length_string(opa_cast_string(node));
+    case OPA_LAZY:
+        return opa_value_length(opa_value_force(node));
     default:
         return 0;
     }
@@ -302,6 +583,102 @@ int opa_value_compare_float(double a, double b)
     return 0;
 }
 
+// The sign, integer and fraction digits of a plain decimal literal
+// ([-]digits[.digits]), pointing into the stored text. Leading integer
+// zeros and trailing fraction zeros are stripped so the digit strings
+// compare positionally.
+typedef struct
+{
+    const char *i;
+    size_t ni;
+    const char *f;
+    size_t nf;
+    bool neg;
+} opa_number_parts_t;
+
+static bool __opa_number_ref_parts(opa_number_t *n, opa_number_parts_t *p)
+{
+    const char *s = n->v.ref.s;
+    size_t len = n->v.ref.len;
+
+    p->neg = len > 0 && s[0] == '-';
+
+    if (p->neg)
+    {
+        s++;
+        len--;
+    }
+
+    const char *dot = memchr(s, '.', len);
+
+    p->i = s;
+    p->ni = dot != NULL ? (size_t)(dot - s) : len;
+    p->f = dot != NULL ? dot + 1 : s + len;
+    p->nf = dot != NULL ? len - p->ni - 1 : 0;
+
+    for (size_t k = 0; k < p->ni; k++)
+    {
+        if (p->i[k] < '0' || p->i[k] > '9')
+        {
+            return false;
+        }
+    }
+
+    for (size_t k = 0; k < p->nf; k++)
+    {
+        if (p->f[k] < '0' || p->f[k] > '9')
+        {
+            return false;
+        }
+    }
+
+    while (p->ni > 0 && p->i[0] == '0')
+    {
+        p->i++;
+        p->ni--;
+    }
+
+    while (p->nf > 0 && p->f[p->nf-1] == '0')
+    {
+        p->nf--;
+    }
+
+    return true;
+}
+
+// Compares magnitudes digit-wise: a longer integer part is larger, equal
+// lengths compare lexicographically, and ties extend into the fraction
+// digits where the shorter (zero-stripped) fraction is smaller.
+static int __opa_number_parts_cmp_abs(opa_number_parts_t *a, opa_number_parts_t *b)
+{
+    if (a->ni != b->ni)
+    {
+        return a->ni < b->ni ? -1 : 1;
+    }
+
+    int cmp = opa_strncmp(a->i, b->i, a->ni);
+
+    if (cmp != 0)
+    {
+        return cmp;
+    }
+
+    size_t min = a->nf < b->nf ? a->nf : b->nf;
+    cmp = opa_strncmp(a->f, b->f, min);
+
+    if (cmp != 0)
+    {
+        return cmp;
+    }
+
+    if (a->nf != b->nf)
+    {
+        return a->nf < b->nf ? -1 : 1;
+    }
+
+    return 0;
+}
+
 int opa_value_compare_number(opa_number_t *a, opa_number_t *b)
 {
     long long la, lb;
@@ -319,6 +696,29 @@ int opa_value_compare_number(opa_number_t *a, opa_number_t *b)
         return 0;
     }
 
+    // Two plain decimal literals compare on their stored digits without
+    // converting either side; exponent forms fall through to libmpdec.
+    if (a->repr == OPA_NUMBER_REPR_REF && b->repr == OPA_NUMBER_REPR_REF)
+    {
+        opa_number_parts_t pa, pb;
+
+        if (__opa_number_ref_parts(a, &pa) && __opa_number_ref_parts(b, &pb))
+        {
+            if (pa.neg != pb.neg)
+            {
+                if (pa.ni == 0 && pa.nf == 0 && pb.ni == 0 && pb.nf == 0)
+                {
+                    return 0; // zeros compare equal whatever their signs
+                }
+
+                return pa.neg ? -1 : 1;
+            }
+
+            int cmp = __opa_number_parts_cmp_abs(&pa, &pb);
+            return pa.neg ? -cmp : cmp;
+        }
+    }
+
     mpd_t *ba = opa_number_to_bf(&a->hdr);
     mpd_t *bb = opa_number_to_bf(&b->hdr);
 
@@ -329,8 +729,8 @@ int opa_value_compare_number(opa_number_t *a, opa_number_t *b)
         opa_abort("opa_value_compare_number");
     }
 
-    mpd_del(ba);
-    mpd_del(bb);
+    opa_mpd_del(ba);
+    opa_mpd_del(bb);
 
     return c;
 }
@@ -344,7 +744,27 @@ int opa_value_compare_string(opa_string_t *a, opa_string_t *b)
         min = b->len;
     }
 
-    int cmp = opa_strncmp(a->v, b->v, min);
+    const unsigned char *pa = (const unsigned char *)a->v;
+    const unsigned char *pb = (const unsigned char *)b->v;
+    size_t n = min;
+
+    // Compare a word per iteration, like murmur3_32 hashes: assembling
+    // the words big-endian makes the unsigned word comparison agree with
+    // byte-wise lexicographic order.
+    for (; n >= 4; n -= 4, pa += 4, pb += 4)
+    {
+        uint32_t wa = ((uint32_t)pa[0] << 24) | ((uint32_t)pa[1] << 16) |
+                      ((uint32_t)pa[2] << 8) | (uint32_t)pa[3];
+        uint32_t wb = ((uint32_t)pb[0] << 24) | ((uint32_t)pb[1] << 16) |
+                      ((uint32_t)pb[2] << 8) | (uint32_t)pb[3];
+
+        if (wa != wb)
+        {
+            return wa < wb ? -1 : 1;
+        }
+    }
+
+    int cmp = opa_strncmp((const char *)pa, (const char *)pb, n);
 
     if (cmp != 0)
     {
@@ -442,8 +862,6 @@ int opa_value_compare_object(opa_object_t *a, opa_object_t *b)
     }
 
 finish:
-    opa_array_free(a_keys);
-    opa_array_free(b_keys);
     return cmp;
 }
 
@@ -486,16 +904,26 @@ int opa_value_compare(opa_value *a, opa_value *b)
     {
         return -1;
     }
-    if (opa_value_type(a) < opa_value_type(b))
+    if (a->type == OPA_LAZY)
     {
-        return -1;
+        a = opa_value_force(a);
     }
-    if (opa_value_type(b) < opa_value_type(a))
+    if (b->type == OPA_LAZY)
     {
-        return 1;
+        b = opa_value_force(b);
+    }
+    // Read both types once and dispatch through a single switch: the
+    // switch lowers to one br_table, where a per-type-pair function
+    // table would cost an indirect call per comparison.
+    int ta = opa_value_type(a);
+    int tb = opa_value_type(b);
+
+    if (ta != tb)
+    {
+        return ta < tb ? -1 : 1;
     }
 
-    switch (opa_value_type(a))
+    switch (ta)
     {
     case OPA_NULL:
         return 0;
@@ -543,43 +971,240 @@ int opa_value_compare(opa_value *a, opa_value *b)
     }
 }
 
-#define FNV32_INIT ((size_t)0x811c9dc5)
-
-static size_t
-fnv1a32(size_t hash, const void *input, size_t len)
+// Equality without ordering. opa_value_compare on objects sorts both key
+// arrays before walking them; a hash-bucket probe needs neither the order
+// nor the sort, so unordered containers are compared by cardinality and
+// per-element membership instead.
+OPA_INTERNAL
+bool opa_value_eq(opa_value *a, opa_value *b)
 {
-    const unsigned char *data = input;
-    const unsigned char *end = data + len;
-
-    for (; data != end; ++data)
+    if (a == b)
     {
-        hash += (hash<<1) + (hash<<4) + (hash<<7) + (hash<<8) + (hash<<24); // *= 0x01000193
-        hash ^= *data;
+        return true;
+    }
+    if (a == NULL || b == NULL)
+    {
+        return false;
     }
 
-    return hash;
-}
-
-size_t opa_boolean_hash(opa_boolean_t *b) {
-    return b->v ? 0 : 1;
-}
-
-size_t opa_number_hash(opa_number_t *n) {
-    double d = opa_number_as_float(n);
-    return fnv1a32(FNV32_INIT, &d, sizeof(d));
-}
+    if (a->type == OPA_LAZY)
+    {
+        a = opa_value_force(a);
+    }
 
-size_t opa_string_hash(opa_string_t *s) {
-    return fnv1a32(FNV32_INIT, s->v, s->len);
-}
+    if (b->type == OPA_LAZY)
+    {
+        b = opa_value_force(b);
+    }
 
-size_t opa_array_hash(opa_array_t *a) {
-    size_t len = opa_value_length_array(a);
-    size_t hash = 0;
+    int ta = opa_value_type(a);
 
-    for (long long i = 0; i < len; i++)
+    if (ta != opa_value_type(b))
     {
-        hash += opa_value_hash(opa_value_get_array_native(a, i));
+        return false;
+    }
+
+    // frozen containers carry cached structural digests: differing digests
+    // settle inequality without walking either tree, and the walk below
+    // runs only on a digest match, as collision insurance
+    if (a->frozen && b->frozen &&
+        (ta == OPA_ARRAY || ta == OPA_OBJECT || ta == OPA_SET))
+    {
+        opa_value_digest_t da;
+        opa_value_digest_t db;
+        opa_value_digest(a, &da);
+        opa_value_digest(b, &db);
+
+        if (da.lo != db.lo || da.hi != db.hi)
+        {
+            return false;
+        }
+    }
+
+    switch (ta)
+    {
+    case OPA_NULL:
+        return true;
+    case OPA_BOOLEAN:
+        return opa_cast_boolean(a)->v == opa_cast_boolean(b)->v;
+    case OPA_NUMBER:
+        return opa_value_compare_number(opa_cast_number(a), opa_cast_number(b)) == 0;
+    case OPA_STRING:
+    {
+        opa_string_t *a1 = opa_cast_string(a);
+        opa_string_t *b1 = opa_cast_string(b);
+        return a1->len == b1->len && opa_value_compare_string(a1, b1) == 0;
+    }
+    case OPA_ARRAY:
+    {
+        opa_array_t *a1 = opa_cast_array(a);
+        opa_array_t *b1 = opa_cast_array(b);
+
+        if (a1->len != b1->len)
+        {
+            return false;
+        }
+
+        for (size_t i = 0; i < a1->len; i++)
+        {
+            if (!opa_value_eq(a1->elems[i].v, b1->elems[i].v))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+    case OPA_OBJECT:
+    {
+        opa_object_t *a1 = opa_cast_object(a);
+        opa_object_t *b1 = opa_cast_object(b);
+
+        if (a1->len != b1->len)
+        {
+            return false;
+        }
+
+        for (size_t i = 0; i < a1->n; i++)
+        {
+            opa_object_elem_t *elem = a1->buckets[i];
+
+            if (elem == NULL)
+            {
+                continue;
+            }
+
+            opa_object_elem_t *other = opa_object_get(b1, elem->k);
+
+            if (other == NULL || !opa_value_eq(elem->v, other->v))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+    case OPA_SET:
+    {
+        opa_set_t *a1 = opa_cast_set(a);
+        opa_set_t *b1 = opa_cast_set(b);
+
+        if (a1->len != b1->len)
+        {
+            return false;
+        }
+
+        for (size_t i = 0; i < a1->n; i++)
+        {
+            opa_set_elem_t *elem = a1->buckets[i];
+
+            if (elem != NULL && opa_set_get(b1, elem->v) == NULL)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+    default:
+    {
+        opa_abort("illegal value");
+        return false;
+    }
+    }
+}
+
+#define FNV32_INIT ((size_t)0x811c9dc5)
+
+static size_t
+fnv1a32(size_t hash, const void *input, size_t len)
+{
+    const unsigned char *data = input;
+    const unsigned char *end = data + len;
+
+    for (; data != end; ++data)
+    {
+        hash += (hash<<1) + (hash<<4) + (hash<<7) + (hash<<8) + (hash<<24); // *= 0x01000193
+        hash ^= *data;
+    }
+
+    return hash;
+}
+
+size_t opa_boolean_hash(opa_boolean_t *b) {
+    return b->v ? 0 : 1;
+}
+
+size_t opa_number_hash(opa_number_t *n) {
+    double d = opa_number_as_float(n);
+    return fnv1a32(FNV32_INIT, &d, sizeof(d));
+}
+
+// murmur3 (32-bit): processes a word per iteration instead of the byte loop
+// in fnv1a32, which matters for the key strings hashed during opa_json_parse
+// of large data documents.
+static uint32_t murmur3_32(const void *input, size_t len)
+{
+    const unsigned char *data = input;
+    uint32_t h = 0x811c9dc5 ^ (uint32_t)len;
+    uint32_t k;
+    size_t n = len;
+
+    for (; n >= 4; n -= 4, data += 4)
+    {
+        k = (uint32_t)data[0] | ((uint32_t)data[1] << 8) |
+            ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+        k *= 0xcc9e2d51;
+        k = (k << 15) | (k >> 17);
+        k *= 0x1b873593;
+        h ^= k;
+        h = (h << 13) | (h >> 19);
+        h = h * 5 + 0xe6546b64;
+    }
+
+    k = 0;
+
+    switch (n)
+    {
+    case 3:
+        k ^= (uint32_t)data[2] << 16;
+        // fallthrough
+    case 2:
+        k ^= (uint32_t)data[1] << 8;
+        // fallthrough
+    case 1:
+        k ^= (uint32_t)data[0];
+        k *= 0xcc9e2d51;
+        k = (k << 15) | (k >> 17);
+        k *= 0x1b873593;
+        h ^= k;
+    }
+
+    h ^= (uint32_t)len;
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+}
+
+size_t opa_string_hash(opa_string_t *s) {
+    if (s->hash == 0)
+    {
+        s->hash = murmur3_32(s->v, s->len);
+    }
+
+    return s->hash;
+}
+
+size_t opa_array_hash(opa_array_t *a) {
+    size_t len = opa_value_length_array(a);
+    size_t hash = 0;
+
+    for (long long i = 0; i < len; i++)
+    {
+        hash += opa_value_hash(opa_value_get_array_native(a, i));
     }
 
     return hash;
@@ -637,993 +1262,3169 @@ size_t opa_value_hash(opa_value *node) {
         return opa_object_hash(opa_cast_object(node));
     case OPA_SET:
         return opa_set_hash(opa_cast_set(node));
+    case OPA_LAZY:
+        return opa_value_hash(opa_value_force(node));
     }
 
     return 0;
 }
 
-OPA_INTERNAL
-void opa_value_free(opa_value *node)
-{
-    switch (node->type) // bypass opa_value_type: don't free OPA_STRING_INTERNED
-    {
-    case OPA_NULL:
-        opa_free(node);
-        return;
-    case OPA_BOOLEAN:
-        opa_free(opa_cast_boolean(node));
-        return;
-    case OPA_NUMBER:
-        opa_number_free(opa_cast_number(node));
-        return;
-    case OPA_STRING:
-        opa_string_free(opa_cast_string(node));
-        return;
-    case OPA_ARRAY:
-        opa_array_free(opa_cast_array(node));
-        return;
-    case OPA_OBJECT:
-        opa_object_free(opa_cast_object(node));
-        return;
-    case OPA_SET:
-        opa_set_free(opa_cast_set(node));
-        return;
-    }
-}
+// Structural digests (opa_value_digest). The 32-bit hashes above collide
+// too readily to decide equality, so the digest widens to 128 bits:
+// differing digests settle inequality outright, and matching digests fall
+// back to the full structural walk only as collision insurance. Container
+// digests combine child digests — commutatively for objects and sets,
+// chained for arrays — and numbers are digested by numeric value like
+// opa_number_hash, so equal values digest equally regardless of
+// representation or insertion order.
+//
+// Digests of frozen containers are memoized in an open-addressed side
+// table keyed by node address: a frozen node cannot change and dies only
+// at a heap reset, so an entry stays valid for the node's whole life. As
+// with the intern table, the table records the heap epoch it was built in
+// and is abandoned wholesale once the epoch moves on.
 
-OPA_INTERNAL
-opa_value *opa_value_merge(opa_value *a, opa_value *b)
+#define FNV64_INIT (0xcbf29ce484222325ULL)
+#define FNV64_INIT2 (0x84222325cbf29ce4ULL)
+
+static unsigned long long fnv1a64(unsigned long long hash, const void *input, size_t len)
 {
-    if (a == NULL)
-    {
-        return b;
-    }
-    if (opa_value_type(a) != OPA_OBJECT || opa_value_type(b) != OPA_OBJECT)
+    const unsigned char *data = input;
+    const unsigned char *end = data + len;
+
+    for (; data != end; ++data)
     {
-        return a;
+        hash ^= *data;
+        hash *= 0x100000001b3ULL;
     }
 
-    opa_object_t *obj = opa_cast_object(a);
-    opa_object_t *result = opa_cast_object(opa_object());
-
-    for (int i = 0; i < obj->n; i++)
-    {
-        opa_object_elem_t *elem = obj->buckets[i];
+    return hash;
+}
 
-        while (elem != NULL)
-        {
-            opa_value *other = opa_value_get(b, elem->k);
+static unsigned long long __opa_digest_mix(unsigned long long x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
 
-            if (other == NULL)
-            {
-                opa_object_insert(result, elem->k, elem->v);
-            }
-            else
-            {
-                opa_value *merged = opa_value_merge(elem->v, other);
+#define OPA_DIGEST_INIT_BUCKETS (256)
+#define OPA_DIGEST_LOAD_FACTOR (0.7)
 
-                if (merged == NULL)
-                {
-                    return NULL;
-                }
+typedef struct
+{
+    opa_value *v; // NULL marks an empty slot
+    opa_value_digest_t d;
+} opa_digest_entry_t;
 
-                opa_object_insert(result, elem->k, merged);
-            }
+static opa_digest_entry_t *digest_table = NULL;
+static size_t digest_n = 0; // buckets, always a power of two
+static size_t digest_len = 0;
+static unsigned int digest_epoch = 0;
 
-            elem = elem->next;
-        }
-    }
+static size_t __opa_digest_slot(opa_digest_entry_t *table, size_t n, opa_value *v)
+{
+    size_t i = (size_t)__opa_digest_mix((unsigned long long)(uintptr_t)v) & (n - 1);
 
-    obj = opa_cast_object(b);
-    for (int i = 0; i < obj->n; i++)
+    while (table[i].v != NULL && table[i].v != v)
     {
-        opa_object_elem_t *elem = obj->buckets[i];
-
-        while (elem != NULL)
-        {
-            opa_value *other = opa_value_get(a, elem->k);
-
-            if (other == NULL)
-            {
-                opa_object_insert(result, elem->k, elem->v);
-            }
-
-            elem = elem->next;
-        }
+        i = (i + 1) & (n - 1);
     }
 
-    return &result->hdr;
-}
-
-opa_value *opa_value_shallow_copy_boolean(opa_boolean_t *b)
-{
-    return opa_boolean(b->v);
+    return i;
 }
 
-opa_value *opa_value_shallow_copy_number(opa_number_t *n)
+static bool __opa_digest_lookup(opa_value *v, opa_value_digest_t *d)
 {
-    switch (n->repr)
+    if (digest_table == NULL || digest_epoch != opa_heap_epoch())
     {
-    case OPA_NUMBER_REPR_REF:
-        return opa_number_ref(n->v.ref.s, n->v.ref.len);
-    case OPA_NUMBER_REPR_INT:
-        return opa_number_int(n->v.i);
-    default:
-        opa_abort("opa_value_shallow_copy_number: illegal repr");
-        return NULL;
+        return false;
     }
-}
-
-opa_value *opa_value_shallow_copy_string(opa_string_t *s)
-{
-    return opa_string(s->v, s->len);
-}
 
-opa_value *opa_value_shallow_copy_array(opa_array_t *a)
-{
-    opa_array_elem_t *cpy = (opa_array_elem_t *)opa_malloc(sizeof(opa_array_elem_t) * a->cap);
+    size_t i = __opa_digest_slot(digest_table, digest_n, v);
 
-    for (size_t idx = 0; idx < a->cap; idx++)
+    if (digest_table[i].v == NULL)
     {
-        cpy[idx] = a->elems[idx];
+        return false;
     }
 
-    return opa_array_with_elems(cpy, a->len, a->cap);
+    *d = digest_table[i].d;
+    return true;
 }
 
-opa_value *opa_value_shallow_copy_object(opa_object_t *o)
+static void __opa_digest_store(opa_value *v, opa_value_digest_t *d)
 {
-    opa_value *node = &o->hdr;
-    opa_object_t *cpy = opa_cast_object(__opa_object_with_buckets(o->n));
-    opa_value *prev = NULL;
-    opa_value *curr = NULL;
+    if (digest_table == NULL || digest_epoch != opa_heap_epoch())
+    {
+        // on an epoch change the old table is left behind for the reset
+        // that moved the epoch to reclaim
+        digest_n = OPA_DIGEST_INIT_BUCKETS;
+        digest_len = 0;
+        digest_table = (opa_digest_entry_t *)opa_malloc(digest_n * sizeof(opa_digest_entry_t));
+        memset(digest_table, 0, digest_n * sizeof(opa_digest_entry_t));
+        digest_epoch = opa_heap_epoch();
+    }
 
-    while ((curr = opa_value_iter(node, prev)) != NULL)
+    if (digest_len + 1 > (size_t)(digest_n * OPA_DIGEST_LOAD_FACTOR))
     {
-        opa_value *v = opa_value_get(node, curr);
-        opa_object_insert(cpy, curr, v);
-        prev = curr;
+        size_t n = digest_n * 2;
+        opa_digest_entry_t *table = (opa_digest_entry_t *)opa_malloc(n * sizeof(opa_digest_entry_t));
+        memset(table, 0, n * sizeof(opa_digest_entry_t));
+
+        for (size_t i = 0; i < digest_n; i++)
+        {
+            if (digest_table[i].v != NULL)
+            {
+                table[__opa_digest_slot(table, n, digest_table[i].v)] = digest_table[i];
+            }
+        }
+
+        opa_free(digest_table);
+        digest_table = table;
+        digest_n = n;
     }
 
-    return &cpy->hdr;
+    size_t i = __opa_digest_slot(digest_table, digest_n, v);
+
+    if (digest_table[i].v == NULL)
+    {
+        digest_table[i].v = v;
+        digest_table[i].d = *d;
+        digest_len++;
+    }
 }
 
-opa_value *opa_value_shallow_copy_set(opa_set_t *s)
+// Recursion depth follows the document's nesting, as in opa_value_freeze
+// and the parser that produced the document.
+void opa_value_digest(opa_value *v, opa_value_digest_t *d)
 {
-    opa_value *node = &s->hdr;
-    opa_set_t *cpy = opa_cast_set(__opa_set_with_buckets(s->n));
-    opa_value *prev = NULL;
-    opa_value *curr = NULL;
-
-    while ((curr = opa_value_iter(node, prev)) != NULL)
+    if (v->type == OPA_LAZY)
     {
-        opa_set_add(cpy, curr);
-        prev = curr;
+        v = opa_value_force(v);
     }
 
-    return &cpy->hdr;
-}
+    int t = opa_value_type(v);
 
-opa_value *opa_value_shallow_copy(opa_value *node)
-{
-    switch (node->type) // bypass opa_value_type: pass OPA_STRING_INTERNED along as-is
+    switch (t)
     {
     case OPA_NULL:
-        return node;
     case OPA_BOOLEAN:
-        return opa_value_shallow_copy_boolean(opa_cast_boolean(node));
+    {
+        unsigned long long val = t == OPA_BOOLEAN ? (unsigned long long)opa_cast_boolean(v)->v : 0;
+        d->lo = __opa_digest_mix(FNV64_INIT ^ ((unsigned long long)t << 8) ^ val);
+        d->hi = __opa_digest_mix(FNV64_INIT2 ^ ((unsigned long long)t << 8) ^ val);
+        return;
+    }
     case OPA_NUMBER:
-        return opa_value_shallow_copy_number(opa_cast_number(node));
+    {
+        // by numeric value, like opa_number_hash: "1.0" and "1" digest
+        // equally
+        double f = opa_number_as_float(opa_cast_number(v));
+        d->lo = fnv1a64(FNV64_INIT ^ t, &f, sizeof(f));
+        d->hi = fnv1a64(FNV64_INIT2 ^ t, &f, sizeof(f));
+        return;
+    }
     case OPA_STRING:
-        return opa_value_shallow_copy_string(opa_cast_string(node));
+    {
+        opa_string_t *s = opa_cast_string(v);
+        d->lo = fnv1a64(FNV64_INIT ^ t, s->v, s->len);
+        d->hi = fnv1a64(FNV64_INIT2 ^ t, s->v, s->len);
+        return;
+    }
+    }
+
+    if (v->frozen && __opa_digest_lookup(v, d))
+    {
+        return;
+    }
+
+    unsigned long long lo = __opa_digest_mix(FNV64_INIT ^ ((unsigned long long)t << 32) ^ opa_value_length(v));
+    unsigned long long hi = __opa_digest_mix(FNV64_INIT2 ^ ((unsigned long long)t << 32) ^ opa_value_length(v));
+
+    switch (t)
+    {
     case OPA_ARRAY:
-        return opa_value_shallow_copy_array(opa_cast_array(node));
+    {
+        opa_array_t *arr = opa_cast_array(v);
+
+        for (size_t i = 0; i < arr->len; i++)
+        {
+            opa_value_digest_t cd;
+            opa_value_digest(arr->elems[i].v, &cd);
+            lo = __opa_digest_mix(lo ^ cd.lo);
+            hi = __opa_digest_mix(hi ^ cd.hi);
+        }
+
+        break;
+    }
     case OPA_OBJECT:
-        return opa_value_shallow_copy_object(opa_cast_object(node));
+    {
+        opa_object_t *obj = opa_cast_object(v);
+
+        for (size_t i = 0; i < obj->n; i++)
+        {
+            for (opa_object_elem_t *elem = obj->buckets[i]; elem != NULL; elem = elem->next)
+            {
+                opa_value_digest_t kd;
+                opa_value_digest_t vd;
+                opa_value_digest(elem->k, &kd);
+                opa_value_digest(elem->v, &vd);
+
+                // the pair mix is asymmetric in key and value; summing the
+                // pairs keeps the digest independent of bucket order
+                lo += __opa_digest_mix(kd.lo ^ (vd.lo * 0x9e3779b97f4a7c15ULL));
+                hi += __opa_digest_mix(kd.hi ^ (vd.hi * 0x9e3779b97f4a7c15ULL));
+            }
+        }
+
+        break;
+    }
     case OPA_SET:
-        return opa_value_shallow_copy_set(opa_cast_set(node));
-    case OPA_STRING_INTERNED:
-    case OPA_BOOLEAN_INTERNED:
-        return node;
+    {
+        opa_set_t *set = opa_cast_set(v);
+
+        for (size_t i = 0; i < set->n; i++)
+        {
+            for (opa_set_elem_t *elem = set->buckets[i]; elem != NULL; elem = elem->next)
+            {
+                opa_value_digest_t cd;
+                opa_value_digest(elem->v, &cd);
+                lo += __opa_digest_mix(cd.lo ^ FNV64_INIT);
+                hi += __opa_digest_mix(cd.hi ^ FNV64_INIT2);
+            }
+        }
+
+        break;
+    }
+    }
+
+    d->lo = __opa_digest_mix(lo);
+    d->hi = __opa_digest_mix(hi);
+
+    if (v->frozen)
+    {
+        __opa_digest_store(v, d);
+    }
+}
+
+OPA_INTERNAL
+void opa_value_free(opa_value *node)
+{
+    switch (node->type) // bypass opa_value_type: interned values are never freed
+    {
+    case OPA_NULL:
+        opa_free(node);
+        return;
+    case OPA_BOOLEAN:
+        opa_free(opa_cast_boolean(node));
+        return;
+    case OPA_NUMBER:
+        opa_number_free(opa_cast_number(node));
+        return;
+    case OPA_STRING:
+        opa_string_free(opa_cast_string(node));
+        return;
+    case OPA_ARRAY:
+        opa_array_free(opa_cast_array(node));
+        return;
+    case OPA_OBJECT:
+        opa_object_free(opa_cast_object(node));
+        return;
+    case OPA_SET:
+        opa_set_free(opa_cast_set(node));
+        return;
+    case OPA_LAZY:
+        // the cached materialization may be referenced elsewhere (accessors
+        // swap it into the containing element); shallow free leaves it be
+        opa_free(opa_cast_lazy(node));
+        return;
+    case OPA_STRING_ROPE:
+    {
+        // the segment values are shared; only the table is owned
+        opa_string_rope_t *rope = opa_cast_string_rope(node);
+        opa_array_free(rope->segments);
+        opa_free(rope);
+        return;
+    }
+    }
+}
+
+// opa_value_free_deep frees a value and every node reachable from it in
+// one sweep. Iterative with an explicit pointer stack: recursing per node
+// would exhaust the wasm stack on deep documents. The caller must own the
+// whole subtree — values sharing structure (shallow copies, references
+// inserted elsewhere) must be freed shallowly with opa_value_free
+// instead. Fixed-size nodes return to their per-class slab free lists in
+// constant time; only varying-size blocks (string data, element arrays)
+// take the coalescing path.
+OPA_INTERNAL
+void opa_value_free_deep(opa_value *node)
+{
+    size_t cap = 64;
+    opa_value **stack = (opa_value **)opa_malloc(cap * sizeof(opa_value *));
+    size_t n = 0;
+
+    stack[n++] = node;
+
+    while (n > 0)
+    {
+        opa_value *v = stack[--n];
+
+        switch (v->type) // bypass opa_value_type: interned values are never freed
+        {
+        case OPA_ARRAY:
+        {
+            opa_array_t *arr = opa_cast_array(v);
+
+            for (size_t i = 0; i < arr->len; i++)
+            {
+                if (n == cap)
+                {
+                    cap *= 2;
+                    stack = (opa_value **)opa_realloc(stack, cap * sizeof(opa_value *));
+                }
+
+                stack[n++] = arr->elems[i].v;
+            }
+
+            opa_array_free(arr);
+            break;
+        }
+        case OPA_OBJECT:
+        {
+            opa_object_t *obj = opa_cast_object(v);
+
+            for (size_t i = 0; i < obj->n; i++)
+            {
+                opa_object_elem_t *elem = obj->buckets[i];
+
+                if (elem != NULL)
+                {
+                    if (n + 2 > cap)
+                    {
+                        cap *= 2;
+                        stack = (opa_value **)opa_realloc(stack, cap * sizeof(opa_value *));
+                    }
+
+                    stack[n++] = elem->k;
+                    stack[n++] = elem->v;
+                }
+            }
+
+            opa_object_free(obj);
+            break;
+        }
+        case OPA_SET:
+        {
+            opa_set_t *set = opa_cast_set(v);
+
+            for (size_t i = 0; i < set->n; i++)
+            {
+                opa_set_elem_t *elem = set->buckets[i];
+
+                if (elem != NULL)
+                {
+                    if (n == cap)
+                    {
+                        cap *= 2;
+                        stack = (opa_value **)opa_realloc(stack, cap * sizeof(opa_value *));
+                    }
+
+                    stack[n++] = elem->v;
+                }
+            }
+
+            opa_set_free(set);
+            break;
+        }
+        case OPA_LAZY:
+        {
+            opa_lazy_t *l = opa_cast_lazy(v);
+
+            if (l->parsed != NULL)
+            {
+                if (n == cap)
+                {
+                    cap *= 2;
+                    stack = (opa_value **)opa_realloc(stack, cap * sizeof(opa_value *));
+                }
+
+                stack[n++] = l->parsed;
+            }
+
+            opa_free(l);
+            break;
+        }
+        default:
+            // scalars; interned types fall through opa_value_free untouched.
+            // Ropes land here too: their segment values are shared with the
+            // concatenation's arguments, so only the node and its segment
+            // table are freed.
+            opa_value_free(v);
+        }
+    }
+
+    opa_free(stack);
+}
+
+// Clones just the object's table: the bucket array is copied and the
+// element nodes stay shared with the source, so neither object may be
+// mutated through plain opa_object_insert afterwards.
+static opa_object_t *__opa_object_clone_shared(opa_object_t *o)
+{
+    opa_object_t *cpy = opa_cast_object(__opa_object_with_buckets(o->n));
+
+    for (size_t i = 0; i < o->n; i++)
+    {
+        cpy->buckets[i] = o->buckets[i];
+    }
+
+    cpy->len = o->len;
+    return cpy;
+}
+
+// Like opa_object_insert, but safe on tables whose element nodes are
+// shared with another object: a matching element is replaced with a
+// fresh node instead of being updated in place.
+static void __opa_object_insert_shared(opa_object_t *obj, opa_value *k, opa_value *v)
+{
+    size_t hash = opa_value_hash(k);
+    size_t i = __opa_object_slot(obj, k, hash);
+
+    __opa_object_dump_invalidate(obj);
+
+    if (obj->buckets[i] != NULL)
+    {
+        opa_object_elem_t *elem = __opa_object_elem_alloc(obj->buckets[i]->k, v);
+
+        elem->hash = obj->buckets[i]->hash;
+        obj->buckets[i] = elem;
+        return;
+    }
+
+    __opa_object_keys_invalidate(obj);
+    __opa_object_bloom_invalidate(obj);
+    __opa_object_grow(obj, obj->len+1);
+    __opa_object_insert_elem(obj, __opa_object_elem_alloc(k, v), hash);
+}
+
+OPA_INTERNAL
+opa_value *opa_value_merge(opa_value *a, opa_value *b)
+{
+    if (a == NULL)
+    {
+        return b;
+    }
+    if (opa_value_type(a) != OPA_OBJECT || opa_value_type(b) != OPA_OBJECT)
+    {
+        return a;
+    }
+
+    opa_object_t *obj = opa_cast_object(a);
+
+    // Merged values share subtrees with both operands, so when one operand
+    // contributes nothing the other can be returned as-is instead of being
+    // rebuilt level by level.
+
+    if (opa_cast_object(b)->len == 0)
+    {
+        return a;
+    }
+
+    if (obj->len == 0)
+    {
+        return b;
+    }
+
+    // Start from a table clone of the base that shares its element nodes:
+    // the merge then allocates one bucket array per merged level plus a
+    // node per override entry, regardless of how large the base is.
+
+    opa_object_t *result = __opa_object_clone_shared(obj);
+
+    obj = opa_cast_object(b);
+
+    for (int i = 0; i < obj->n; i++)
+    {
+        opa_object_elem_t *elem = obj->buckets[i];
+
+        while (elem != NULL)
+        {
+            opa_value *base = opa_value_get(a, elem->k);
+
+            if (base == NULL)
+            {
+                __opa_object_insert_shared(result, elem->k, elem->v);
+            }
+            else
+            {
+                opa_value *merged = opa_value_merge(base, elem->v);
+
+                if (merged == NULL)
+                {
+                    return NULL;
+                }
+
+                __opa_object_insert_shared(result, elem->k, merged);
+            }
+
+            elem = elem->next;
+        }
+    }
+
+    return &result->hdr;
+}
+
+opa_value *opa_value_shallow_copy_boolean(opa_boolean_t *b)
+{
+    return opa_boolean(b->v);
+}
+
+opa_value *opa_value_shallow_copy_number(opa_number_t *n)
+{
+    switch (n->repr)
+    {
+    case OPA_NUMBER_REPR_REF:
+        return opa_number_ref(n->v.ref.s, n->v.ref.len);
+    case OPA_NUMBER_REPR_INT:
+        return opa_number_int(n->v.i);
+    default:
+        opa_abort("opa_value_shallow_copy_number: illegal repr");
+        return NULL;
+    }
+}
+
+opa_value *opa_value_shallow_copy_string(opa_string_t *s)
+{
+    opa_value *cpy = opa_string(s->v, s->len);
+    opa_cast_string(cpy)->hash = s->hash;
+    return cpy;
+}
+
+opa_value *opa_value_shallow_copy_array(opa_array_t *a)
+{
+    opa_array_elem_t *cpy = (opa_array_elem_t *)opa_malloc(sizeof(opa_array_elem_t) * a->cap);
+
+    for (size_t idx = 0; idx < a->cap; idx++)
+    {
+        cpy[idx] = a->elems[idx];
+    }
+
+    return opa_array_with_elems(cpy, a->len, a->cap);
+}
+
+opa_value *opa_value_shallow_copy_object(opa_object_t *o)
+{
+    // Clone the table structurally: the copy shares keys and values with the
+    // source, so slot positions and cached hashes carry over without
+    // rehashing anything.
+
+    opa_object_t *cpy = opa_cast_object(__opa_object_with_buckets(o->n));
+
+    for (size_t i = 0; i < o->n; i++)
+    {
+        if (o->buckets[i] != NULL)
+        {
+            opa_object_elem_t *elem = __opa_object_elem_alloc(o->buckets[i]->k, o->buckets[i]->v);
+            elem->hash = o->buckets[i]->hash;
+            cpy->buckets[i] = elem;
+        }
+    }
+
+    cpy->len = o->len;
+    return &cpy->hdr;
+}
+
+opa_value *opa_value_shallow_copy_set(opa_set_t *s)
+{
+    opa_set_t *cpy = opa_cast_set(__opa_set_with_buckets(s->n));
+
+    for (size_t i = 0; i < s->n; i++)
+    {
+        if (s->buckets[i] != NULL)
+        {
+            opa_set_elem_t *elem = __opa_set_elem_alloc(s->buckets[i]->v);
+            elem->hash = s->buckets[i]->hash;
+            cpy->buckets[i] = elem;
+        }
+    }
+
+    cpy->len = s->len;
+    cpy->sorted = s->sorted;
+    return &cpy->hdr;
+}
+
+opa_value *opa_value_shallow_copy(opa_value *node)
+{
+    switch (node->type) // bypass opa_value_type: pass OPA_STRING_INTERNED along as-is
+    {
+    case OPA_NULL:
+        return node;
+    case OPA_BOOLEAN:
+        return opa_value_shallow_copy_boolean(opa_cast_boolean(node));
+    case OPA_NUMBER:
+        return opa_value_shallow_copy_number(opa_cast_number(node));
+    case OPA_STRING:
+        return opa_value_shallow_copy_string(opa_cast_string(node));
+    case OPA_ARRAY:
+        return opa_value_shallow_copy_array(opa_cast_array(node));
+    case OPA_OBJECT:
+        return opa_value_shallow_copy_object(opa_cast_object(node));
+    case OPA_SET:
+        return opa_value_shallow_copy_set(opa_cast_set(node));
+    case OPA_STRING_INTERNED:
+    case OPA_BOOLEAN_INTERNED:
+    case OPA_NUMBER_INTERNED:
+    case OPA_NULL_INTERNED:
+        return node;
+    case OPA_LAZY:
+        // the copy shares the span but re-parses on demand: a shared
+        // materialization would double-free under opa_value_free_deep
+        return opa_lazy(opa_cast_lazy(node)->v, opa_cast_lazy(node)->len);
+    case OPA_STRING_ROPE:
+        // shallow copies get inserted into containers, which hash the
+        // bytes right away: flatten first and share the flat data
+        __opa_string_rope_flatten(opa_cast_string_rope(node));
+        return opa_value_shallow_copy_string(opa_cast_string(node));
+    }
+
+    return NULL;
+}
+
+static opa_value *__opa_tuple(opa_value *a, opa_value *b)
+{
+    opa_value *ret = opa_array_with_cap(2);
+    opa_array_t *tuple = opa_cast_array(ret);
+    opa_array_append(tuple, a);
+    opa_array_append(tuple, b);
+    return ret;
+}
+
+OPA_BUILTIN
+opa_value *opa_value_transitive_closure(opa_value *v)
+{
+    opa_array_t *result = opa_cast_array(opa_array());
+
+    // Iterative depth-first walk with an explicit frame stack: recursing per
+    // node would exhaust the wasm stack on deep documents. The frame at
+    // index i is a cursor over the children of the node at depth i; the
+    // path to those children is the first i elements of the shared path
+    // buffer plus their own key at index i.
+
+    size_t cap = 64;
+    opa_value_cursor_t *stack = (opa_value_cursor_t *)opa_malloc(cap * sizeof(opa_value_cursor_t));
+    size_t depth = 1;
+
+    opa_array_append(result, __opa_tuple(opa_array(), v));
+    stack[0].node = v;
+    stack[0].i = 0;
+    stack[0].v = NULL;
+
+    // The path arrays of the emitted tuples share storage. Along a
+    // descending chain every path is a prefix of the next, so each is a
+    // frozen view over one frozen buffer; emitted tracks the longest
+    // view handed out. When the walk moves to a sibling the buffer is
+    // forked — siblings reuse the prefix but diverge at their own index
+    // — and when it outgrows its capacity it is copied rather than
+    // reallocated, since storage must not move under the views. Either
+    // way the old buffer stays behind the views already emitted over it
+    // until the next heap reset.
+    opa_array_t *buf = opa_cast_array(opa_array_with_cap(64));
+    buf->hdr.frozen = 1;
+    size_t emitted = 0;
+
+    while (depth > 0)
+    {
+        opa_value_cursor_t *frame = &stack[depth-1];
+        opa_value *key = opa_value_cursor_next(frame);
+
+        if (key == NULL)
+        {
+            depth--;
+            continue;
+        }
+
+        size_t d = depth - 1; // the index the key takes in the path
+
+        if (emitted > d || buf->cap < d + 1)
+        {
+            size_t ncap = buf->cap;
+
+            while (ncap < d + 1)
+            {
+                ncap *= 2;
+            }
+
+            opa_array_t *nbuf = opa_cast_array(opa_array_with_cap(ncap));
+            memcpy(nbuf->elems, buf->elems, d * sizeof(opa_array_elem_t));
+            nbuf->hdr.frozen = 1;
+            buf = nbuf;
+            emitted = d;
+        }
+
+        buf->elems[d].v = key;
+        buf->len = d + 1;
+
+        opa_value *child = opa_value_cursor_value(frame);
+        opa_array_append(result, __opa_tuple(opa_array_view(buf, 0, d + 1), child));
+        emitted = d + 1;
+
+        if (depth == cap)
+        {
+            cap *= 2;
+            stack = (opa_value_cursor_t *)opa_realloc(stack, cap * sizeof(opa_value_cursor_t));
+        }
+
+        stack[depth].node = child;
+        stack[depth].i = 0;
+        stack[depth].v = NULL;
+        depth++;
+    }
+
+    opa_free(stack);
+    return &result->hdr;
+}
+
+
+// Hash-consing of duplicate subtrees. The table is open addressed like the
+// container tables, keyed by opa_value_hash with opa_value_compare ruling
+// out collisions, and lives only for the duration of one opa_value_dedup
+// pass.
+typedef struct
+{
+    struct
+    {
+        size_t hash;
+        opa_value *v; // NULL marks an empty slot
+    } *buckets;
+    size_t n;
+    size_t len;
+} opa_value_dedup_table_t;
+
+static size_t __opa_dedup_slot(opa_value_dedup_table_t *t, opa_value *v, size_t hash)
+{
+    size_t i = hash % t->n;
+
+    while (t->buckets[i].v != NULL &&
+           (t->buckets[i].hash != hash || !opa_value_eq(t->buckets[i].v, v)))
+    {
+        i = (i + 1) % t->n;
+    }
+
+    return i;
+}
+
+static void __opa_dedup_grow(opa_value_dedup_table_t *t)
+{
+    if (t->len <= (t->n * OPA_OBJECT_LOAD_FACTOR))
+    {
+        return;
+    }
+
+    opa_value_dedup_table_t old = *t;
+
+    t->n = old.n * 2;
+    t->buckets = opa_malloc(t->n * sizeof(t->buckets[0]));
+    memset(t->buckets, 0, t->n * sizeof(t->buckets[0]));
+
+    for (size_t i = 0; i < old.n; i++)
+    {
+        if (old.buckets[i].v != NULL)
+        {
+            t->buckets[__opa_dedup_slot(t, old.buckets[i].v, old.buckets[i].hash)] = old.buckets[i];
+        }
+    }
+
+    opa_free(old.buckets);
+}
+
+// canonicalizes the subtree bottom-up: children are replaced by their
+// canonical versions first, then the node itself either becomes the
+// canonical instance of its value or is freed shallowly in favor of the
+// instance seen earlier. Recursion depth follows the document's nesting,
+// as in the parser that produced it.
+static opa_value *__opa_dedup(opa_value_dedup_table_t *t, opa_value *v)
+{
+    switch (v->type)
+    {
+    case OPA_NULL_INTERNED:
+    case OPA_BOOLEAN_INTERNED:
+    case OPA_NUMBER_INTERNED:
+    case OPA_STRING_INTERNED:
+        return v; // already shared
+
+    case OPA_ARRAY:
+    {
+        opa_array_t *arr = opa_cast_array(v);
+
+        for (size_t i = 0; i < arr->len; i++)
+        {
+            arr->elems[i].v = __opa_dedup(t, arr->elems[i].v);
+        }
+
+        break;
+    }
+    case OPA_OBJECT:
+    {
+        opa_object_t *obj = opa_cast_object(v);
+
+        for (size_t i = 0; i < obj->n; i++)
+        {
+            for (opa_object_elem_t *elem = obj->buckets[i]; elem != NULL; elem = elem->next)
+            {
+                elem->k = __opa_dedup(t, elem->k);
+                elem->v = __opa_dedup(t, elem->v);
+            }
+        }
+
+        break;
+    }
+    case OPA_SET:
+    {
+        opa_set_t *set = opa_cast_set(v);
+
+        for (size_t i = 0; i < set->n; i++)
+        {
+            for (opa_set_elem_t *elem = set->buckets[i]; elem != NULL; elem = elem->next)
+            {
+                elem->v = __opa_dedup(t, elem->v);
+            }
+        }
+
+        break;
+    }
+    }
+
+    size_t hash = opa_value_hash(v);
+    size_t i = __opa_dedup_slot(t, v, hash);
+
+    if (t->buckets[i].v != NULL)
+    {
+        if (t->buckets[i].v != v)
+        {
+            opa_value_free(v); // the children are shared now: shallow
+        }
+
+        return t->buckets[i].v;
+    }
+
+    t->buckets[i].hash = hash;
+    t->buckets[i].v = v;
+    t->len++;
+    __opa_dedup_grow(t);
+    return v;
+}
+
+// Deduplicates structurally identical subtrees in a freshly loaded
+// document, returning the canonical tree: equal subtrees collapse to one
+// shared instance, which routinely halves the resident size of documents
+// holding many copies of the same object. The result is a DAG, so it
+// carries the frozen-document contract: treat it as read-only, never pass
+// it to opa_value_free_deep, and discard it by resetting the heap pointer.
+OPA_INTERNAL
+opa_value *opa_value_dedup(opa_value *node)
+{
+    if (node == NULL)
+    {
+        return NULL;
+    }
+
+    opa_value_dedup_table_t t = { .n = 1024, .len = 0 };
+
+    t.buckets = opa_malloc(t.n * sizeof(t.buckets[0]));
+    memset(t.buckets, 0, t.n * sizeof(t.buckets[0]));
+
+    opa_value *ret = __opa_dedup(&t, node);
+
+    opa_free(t.buckets);
+    return ret;
+}
+
+// Frozen documents. opa_value_freeze marks every value of a loaded tree
+// immutable: the flag declares that the tree will not be mutated until it
+// is discarded wholesale by a heap reset. The performance layers — cached
+// hashes, memoized key orders, subtree sharing in opa_value_merge and
+// opa_value_dedup — already treat values as immutable between mutations,
+// so what freezing adds is enforcement: DEBUG builds abort any mutator
+// pointed at a frozen value. The flag lives in the padding byte after the
+// type, so freezing costs no space.
+OPA_INTERNAL
+WASM_EXPORT(opa_value_freeze)
+void opa_value_freeze(opa_value *v)
+{
+    switch (v->type)
+    {
+    case OPA_NULL_INTERNED:
+    case OPA_BOOLEAN_INTERNED:
+    case OPA_NUMBER_INTERNED:
+    case OPA_STRING_INTERNED:
+        return; // shared singletons stay as they are
+
+    case OPA_ARRAY:
+    {
+        opa_array_t *arr = opa_cast_array(v);
+
+        for (size_t i = 0; i < arr->len; i++)
+        {
+            opa_value_freeze(arr->elems[i].v);
+        }
+
+        break;
+    }
+    case OPA_OBJECT:
+    {
+        opa_object_t *obj = opa_cast_object(v);
+
+        for (size_t i = 0; i < obj->n; i++)
+        {
+            for (opa_object_elem_t *elem = obj->buckets[i]; elem != NULL; elem = elem->next)
+            {
+                opa_value_freeze(elem->k);
+                opa_value_freeze(elem->v);
+            }
+        }
+
+        break;
+    }
+    case OPA_SET:
+    {
+        opa_set_t *set = opa_cast_set(v);
+
+        for (size_t i = 0; i < set->n; i++)
+        {
+            for (opa_set_elem_t *elem = set->buckets[i]; elem != NULL; elem = elem->next)
+            {
+                opa_value_freeze(elem->v);
+            }
+        }
+
+        break;
+    }
+    case OPA_LAZY:
+    {
+        // spans materialized later inherit the mark from opa_value_force
+        opa_lazy_t *l = opa_cast_lazy(v);
+
+        if (l->parsed != NULL)
+        {
+            opa_value_freeze(l->parsed);
+        }
+
+        break;
+    }
+    case OPA_STRING_ROPE:
+        // frozen trees are built to be kept: flatten now so the mark
+        // covers a plain string and the segments are released
+        __opa_string_rope_flatten(opa_cast_string_rope(v));
+        break;
+    }
+
+    v->frozen = 1;
+}
+
+OPA_INTERNAL
+bool opa_value_frozen(opa_value *v)
+{
+    return v->frozen != 0;
+}
+
+#ifdef DEBUG
+#define OPA_FROZEN_CHECK(v, what) \
+    if (opa_value_frozen(v)) { opa_abort(what ": frozen value"); }
+#else
+#define OPA_FROZEN_CHECK(v, what)
+#endif
+
+OPA_INTERNAL
+// null and the two booleans are singletons: opa_value_free leaves the
+// interned types alone, so handing out the statics is safe.
+static opa_value opa_null_interned = { .type = OPA_NULL_INTERNED };
+
+static opa_boolean_t opa_booleans_interned[2] = {
+    { .hdr = { .type = OPA_BOOLEAN_INTERNED }, .v = false },
+    { .hdr = { .type = OPA_BOOLEAN_INTERNED }, .v = true },
+};
+
+opa_value *opa_null()
+{
+    return &opa_null_interned;
+}
+
+opa_value *opa_boolean(bool v)
+{
+    return &opa_booleans_interned[v ? 1 : 0].hdr;
+}
+
+OPA_INTERNAL
+opa_value *opa_number_size(size_t v)
+{
+    opa_number_t *ret = (opa_number_t *)opa_malloc(sizeof(opa_number_t));
+    ret->hdr.type = OPA_NUMBER;
+    ret->hdr.frozen = 0;
+    ret->repr = OPA_NUMBER_REPR_INT;
+    ret->v.i = (long long)v;
+    ret->bf = NULL;
+    return &ret->hdr;
+}
+
+OPA_INTERNAL
+opa_value *opa_number_int(long long v)
+{
+    opa_number_t *ret = (opa_number_t *)opa_malloc(sizeof(opa_number_t));
+    ret->hdr.type = OPA_NUMBER;
+    ret->hdr.frozen = 0;
+    ret->repr = OPA_NUMBER_REPR_INT;
+    ret->v.i = v;
+    ret->bf = NULL;
+    return &ret->hdr;
+}
+
+// returns an interned number for small integers, falling back to a heap
+// allocation outside the interned range. Callers must treat the result as
+// immutable: interned numbers are shared, and opa_value_free leaves them
+// untouched. Not safe for values handed to opa_value_number_set_int.
+OPA_INTERNAL
+opa_value *opa_number_interned(long long v)
+{
+    if (v < OPA_NUMBER_INTERNED_MIN || v > OPA_NUMBER_INTERNED_MAX)
+    {
+        return opa_number_int(v);
+    }
+
+    opa_number_t *ret = &opa_numbers_interned[v - OPA_NUMBER_INTERNED_MIN];
+
+    if (ret->hdr.type == 0)
+    {
+        ret->hdr.type = OPA_NUMBER_INTERNED;
+        ret->repr = OPA_NUMBER_REPR_INT;
+        ret->v.i = v;
+        ret->bf = NULL;
+    }
+
+    return &ret->hdr;
+}
+
+// opa_value_intern_init fills the interned-number table eagerly. The
+// entries are otherwise populated on first use; opa_initialize calls this
+// so a pre-initialized memory snapshot starts fully warmed.
+OPA_INTERNAL
+void opa_value_intern_init(void)
+{
+    for (long long v = OPA_NUMBER_INTERNED_MIN; v <= OPA_NUMBER_INTERNED_MAX; v++)
+    {
+        opa_number_interned(v);
+    }
+}
+
+OPA_INTERNAL
+opa_value *opa_number_ref(const char *s, size_t len)
+{
+    opa_number_t *ret = (opa_number_t *)opa_malloc(sizeof(opa_number_t));
+    ret->hdr.type = OPA_NUMBER;
+    ret->hdr.frozen = 0;
+    ret->repr = OPA_NUMBER_REPR_REF;
+    ret->v.ref.s = s;
+    ret->v.ref.len = len;
+    ret->v.ref.free = 0;
+    ret->bf = NULL;
+    return &ret->hdr;
+}
+
+opa_value *opa_number_float(double v)
+{
+    if (v == (double)(long long)v)
+    {
+        return opa_number_int((long long)v);
+    }
+
+    char buf[32];
+
+    opa_ftoa(v, buf);
+
+    size_t len = opa_strlen(buf);
+    char *cpy = (char *)opa_malloc(len);
+
+    for (size_t i = 0; i < len; i++)
+    {
+        cpy[i] = buf[i];
+    }
+
+    return opa_number_ref_allocated(cpy, len);
+}
+
+opa_value *opa_number_ref_allocated(const char *s, size_t len)
+{
+    opa_number_t *ret = (opa_number_t *)opa_malloc(sizeof(opa_number_t));
+    ret->hdr.type = OPA_NUMBER;
+    ret->hdr.frozen = 0;
+    ret->repr = OPA_NUMBER_REPR_REF;
+    ret->v.ref.s = s;
+    ret->v.ref.len = len;
+    ret->v.ref.free = 1;
+    ret->bf = NULL;
+    return &ret->hdr;
+}
+
+void opa_number_init_int(opa_number_t *n, long long v)
+{
+    n->hdr.type = OPA_NUMBER;
+    n->hdr.frozen = 0;
+    n->repr = OPA_NUMBER_REPR_INT;
+    n->v.i = v;
+    n->bf = NULL;
+}
+
+void opa_number_free(opa_number_t *n)
+{
+    if (n->bf != NULL && n->bf_epoch == opa_heap_epoch())
+    {
+        opa_mpd_del(n->bf);
+    }
+
+    if (n->repr == OPA_NUMBER_REPR_REF)
+    {
+        if (n->v.ref.free)
+        {
+            opa_free((void *)n->v.ref.s);
+        }
+    }
+
+    opa_free(n);
+}
+
+int opa_number_try_int(opa_number_t *n, long long *i)
+{
+    switch (n->repr)
+    {
+    case OPA_NUMBER_REPR_INT:
+        *i = n->v.i;
+        return 0;
+    case OPA_NUMBER_REPR_REF:
+        return opa_atoi64(n->v.ref.s, n->v.ref.len, i);
+    default:
+        opa_abort("opa_number_try_int: illegal repr");
+        return -1;
+    }
+}
+
+double opa_number_as_float(opa_number_t *n)
+{
+    switch (n->repr)
+    {
+    case OPA_NUMBER_REPR_INT:
+        return (double)n->v.i;
+    case OPA_NUMBER_REPR_REF:
+    {
+        double d;
+        int rc = opa_atof64(n->v.ref.s, n->v.ref.len, &d);
+        if (rc != 0)
+        {
+            opa_abort("opa_number_as_float: illegal ref");
+        }
+        return d;
+    }
+    default:
+        opa_abort("opa_number_as_float: illegal repr");
+        return 0.0;
+    }
+}
+
+opa_value *opa_string(const char *v, size_t len)
+{
+    opa_string_t *ret = (opa_string_t *)opa_malloc(sizeof(opa_string_t));
+    ret->hdr.type = OPA_STRING;
+    ret->hdr.frozen = 0;
+    ret->hash = 0;
+    ret->runes = NULL;
+    ret->free = 0;
+    ret->len = len;
+    ret->v = v;
+    return &ret->hdr;
+}
+
+OPA_INTERNAL
+opa_value *opa_string_terminated(const char *v)
+{
+    opa_string_t *ret = (opa_string_t *)opa_malloc(sizeof(opa_string_t));
+    ret->hdr.type = OPA_STRING;
+    ret->hdr.frozen = 0;
+    ret->hash = 0;
+    ret->runes = NULL;
+    ret->free = 0;
+    ret->len = opa_strlen(v);
+    ret->v = v;
+    return &ret->hdr;
+}
+
+opa_value *opa_string_allocated(const char *v, size_t len)
+{
+    opa_string_t *ret = (opa_string_t *)opa_malloc(sizeof(opa_string_t));
+    ret->hdr.type = OPA_STRING;
+    ret->hdr.frozen = 0;
+    ret->hash = 0;
+    ret->runes = NULL;
+    ret->free = 1;
+    ret->len = len;
+    ret->v = v;
+    return &ret->hdr;
+}
+
+opa_value *opa_lazy(const char *v, size_t len)
+{
+    opa_lazy_t *ret = (opa_lazy_t *)opa_malloc(sizeof(opa_lazy_t));
+    ret->hdr.type = OPA_LAZY;
+    ret->hdr.frozen = 0;
+    ret->v = v;
+    ret->len = len;
+    ret->parsed = NULL;
+    return &ret->hdr;
+}
+
+// Takes ownership of the segments array (the segment values themselves stay
+// shared); 'len' must be the total byte length of the segments. The rope
+// flattens in place on first byte-wise access — see opa_value_type.
+opa_value *opa_string_rope(opa_array_t *segments, size_t len)
+{
+    opa_string_rope_t *ret = (opa_string_rope_t *)opa_malloc(sizeof(opa_string_rope_t));
+    ret->str.hdr.type = OPA_STRING_ROPE;
+    ret->str.hdr.frozen = 0;
+    ret->str.hash = 0;
+    ret->str.runes = NULL;
+    ret->str.runes_epoch = 0;
+    ret->str.free = 0;
+    ret->str.len = len;
+    ret->str.v = NULL;
+    ret->segments = segments;
+    return &ret->str.hdr;
+}
+
+static void __opa_string_rope_flatten(opa_string_rope_t *rope)
+{
+    char *buf = (char *)opa_malloc(rope->str.len + 1);
+    size_t off = 0;
+
+    // Iterative with an explicit stack: under the accumulator pattern the
+    // rope nests one level per concatenation, so recursing per segment
+    // would exhaust the wasm stack. Segments are pushed in reverse so they
+    // pop in document order. Nested ropes are read without being converted
+    // themselves — they are usually unreachable once the outer rope exists
+    // and get reclaimed by the next heap reset.
+    size_t cap = 64;
+
+    while (cap < rope->segments->len)
+    {
+        cap *= 2;
+    }
+
+    opa_value **stack = (opa_value **)opa_malloc(cap * sizeof(opa_value *));
+    size_t n = 0;
+
+    for (size_t i = rope->segments->len; i > 0; i--)
+    {
+        stack[n++] = rope->segments->elems[i-1].v;
+    }
+
+    while (n > 0)
+    {
+        opa_value *v = stack[--n];
+
+        if (v->type == OPA_STRING_ROPE)
+        {
+            opa_array_t *segs = opa_cast_string_rope(v)->segments;
+
+            while (n + segs->len > cap)
+            {
+                cap *= 2;
+                stack = (opa_value **)opa_realloc(stack, cap * sizeof(opa_value *));
+            }
+
+            for (size_t i = segs->len; i > 0; i--)
+            {
+                stack[n++] = segs->elems[i-1].v;
+            }
+
+            continue;
+        }
+
+        opa_string_t *s = opa_cast_string(v);
+        memcpy(&buf[off], s->v, s->len);
+        off += s->len;
+    }
+
+    opa_free(stack);
+    buf[off] = '\0';
+    opa_array_free(rope->segments);
+    rope->segments = NULL;
+    rope->str.v = buf;
+    rope->str.free = 1;
+    rope->str.hdr.type = OPA_STRING;
+}
+
+// String interning. Object keys recur across data documents — a few hundred
+// distinct keys repeated millions of times is typical — so opa_string_intern
+// maintains a global open-addressed table mapping string content to a single
+// shared OPA_STRING_INTERNED value. Interned values are skipped by
+// opa_value_free, so a shared key safely outlives any one container.
+//
+// The table and its entries live on the heap like any other value, which
+// means a heap reset can reclaim them out from under the table. As with the
+// rune and key caches, the table records the heap epoch it was built in and
+// is abandoned wholesale once the epoch moves on.
+
+#define OPA_STRING_INTERN_INIT_BUCKETS (256)
+#define OPA_STRING_INTERN_LOAD_FACTOR (0.7)
+
+static opa_string_t **string_intern_table = NULL;
+static size_t string_intern_n = 0; // buckets, always a power of two
+static size_t string_intern_len = 0;
+static unsigned int string_intern_epoch = 0;
+
+static size_t __opa_string_intern_slot(opa_string_t **table, size_t n,
+                                       const char *v, size_t len, size_t hash)
+{
+    size_t i = hash & (n - 1);
+
+    while (table[i] != NULL)
+    {
+        if (table[i]->hash == hash && table[i]->len == len &&
+            memcmp(table[i]->v, v, len) == 0)
+        {
+            return i;
+        }
+
+        i = (i + 1) & (n - 1);
+    }
+
+    return i;
+}
+
+OPA_INTERNAL
+opa_value *opa_string_intern(const char *v, size_t len)
+{
+    if (len > OPA_STRING_INTERN_MAX_LEN)
+    {
+        return NULL;
+    }
+
+    if (string_intern_table == NULL || string_intern_epoch != opa_heap_epoch())
+    {
+        // A new epoch means a heap reset may have reclaimed the entries:
+        // start over rather than hand out dangling pointers.
+        string_intern_n = OPA_STRING_INTERN_INIT_BUCKETS;
+        string_intern_len = 0;
+        string_intern_table = (opa_string_t **)opa_malloc(string_intern_n * sizeof(opa_string_t *));
+        memset(string_intern_table, 0, string_intern_n * sizeof(opa_string_t *));
+        string_intern_epoch = opa_heap_epoch();
+    }
+
+    if ((string_intern_len + 1) > (string_intern_n * OPA_STRING_INTERN_LOAD_FACTOR))
+    {
+        size_t n = string_intern_n * 2;
+        opa_string_t **table = (opa_string_t **)opa_malloc(n * sizeof(opa_string_t *));
+        memset(table, 0, n * sizeof(opa_string_t *));
+
+        for (size_t i = 0; i < string_intern_n; i++)
+        {
+            opa_string_t *s = string_intern_table[i];
+
+            if (s != NULL)
+            {
+                table[__opa_string_intern_slot(table, n, s->v, s->len, s->hash)] = s;
+            }
+        }
+
+        opa_free(string_intern_table);
+        string_intern_table = table;
+        string_intern_n = n;
+    }
+
+    size_t hash = murmur3_32(v, len);
+    size_t i = __opa_string_intern_slot(string_intern_table, string_intern_n, v, len, hash);
+
+    if (string_intern_table[i] != NULL)
+    {
+        return &string_intern_table[i]->hdr;
+    }
+
+    char *cpy = (char *)opa_malloc(len);
+    memcpy(cpy, v, len);
+
+    opa_string_t *s = opa_cast_string(opa_string_allocated(cpy, len));
+    s->hdr.type = OPA_STRING_INTERNED;
+    s->hash = hash;
+    string_intern_table[i] = s;
+    string_intern_len++;
+
+    return &s->hdr;
+}
+
+void opa_string_free(opa_string_t *s)
+{
+    if (s->free)
+    {
+        opa_free((void *)s->v);
+    }
+
+    if (s->runes != NULL && s->runes_epoch == opa_heap_epoch())
+    {
+        opa_free(s->runes);
+    }
+
+    opa_free(s);
+}
+
+void __opa_array_grow(opa_array_t *arr)
+{
+    __opa_cap_profile_observe(&arr->hdr, arr->len + 1);
+
+    if (arr->cap == 0)
+    {
+        arr->cap = OPA_ARRAY_INITIAL_CAP;
+    }
+    else
+    {
+        arr->cap *= 2;
+    }
+
+    opa_array_elem_t *elems = (opa_array_elem_t *)opa_malloc(arr->cap * sizeof(opa_array_elem_t));
+
+    for (int i = 0; i < arr->len; i++)
+    {
+        elems[i] = arr->elems[i];
+    }
+
+    if (arr->elems != NULL && arr->free)
+    {
+        opa_free(arr->elems);
+    }
+    arr->elems = elems;
+    arr->free = 1;
+}
+
+// Profile-feedback capacity seeding (opa_array_site and friends). The same
+// rules build the same-shaped containers every eval, yet plain constructors
+// start at default capacity and double their way up. The compiler assigns
+// construction sites small dense ids and emits the *_site constructors for
+// containers observed to grow; each site keeps a ring of the sizes its
+// containers actually reached, and later constructions seed the capacity
+// with the second-largest of the ring — close to a p90, so one outlier
+// does not pin the seed — eliminating steady-state growth reallocations.
+//
+// The profile is static storage, so it survives the heap resets between
+// evals. Sizes are observed by the growth paths through a side table
+// mapping container address to site; the table lives on the heap with the
+// containers it describes and is abandoned when the heap epoch moves, like
+// the intern table. Growth that the seed already covers records nothing,
+// so a warmed-up profile costs the lookups nothing.
+
+#define OPA_CAP_PROFILE_SITES (1024)
+#define OPA_CAP_PROFILE_SAMPLES (8)
+
+typedef struct
+{
+    unsigned int samples[OPA_CAP_PROFILE_SAMPLES]; // reached sizes, a ring
+    unsigned char n; // samples recorded, up to the ring size
+    unsigned char i; // next ring position
+} opa_cap_profile_t;
+
+static opa_cap_profile_t cap_profile[OPA_CAP_PROFILE_SITES];
+
+typedef struct
+{
+    opa_value *v; // NULL marks an empty slot
+    int32_t site;
+    unsigned char slot;    // ring position this container samples into
+    unsigned char sampled; // set once the first growth claimed a position
+} opa_cap_site_entry_t;
+
+#define OPA_CAP_SITE_INIT_BUCKETS (256)
+#define OPA_CAP_SITE_LOAD_FACTOR (0.7)
+
+static opa_cap_site_entry_t *cap_site_table = NULL;
+static size_t cap_site_n = 0; // buckets, always a power of two
+static size_t cap_site_len = 0;
+static unsigned int cap_site_epoch = 0;
+
+static size_t __opa_cap_site_slot(opa_cap_site_entry_t *table, size_t n, opa_value *v)
+{
+    size_t i = (size_t)((uintptr_t)v * 0x9e3779b9UL) & (n - 1);
+
+    while (table[i].v != NULL && table[i].v != v)
+    {
+        i = (i + 1) & (n - 1);
+    }
+
+    return i;
+}
+
+static void __opa_cap_site_register(opa_value *v, int32_t site)
+{
+    if (site < 0 || site >= OPA_CAP_PROFILE_SITES)
+    {
+        return;
+    }
+
+    if (cap_site_table == NULL || cap_site_epoch != opa_heap_epoch())
+    {
+        // on an epoch change the old table is left behind for the reset
+        // that moved the epoch to reclaim
+        cap_site_n = OPA_CAP_SITE_INIT_BUCKETS;
+        cap_site_len = 0;
+        cap_site_table = (opa_cap_site_entry_t *)opa_malloc(cap_site_n * sizeof(opa_cap_site_entry_t));
+        memset(cap_site_table, 0, cap_site_n * sizeof(opa_cap_site_entry_t));
+        cap_site_epoch = opa_heap_epoch();
+    }
+
+    if (cap_site_len + 1 > (size_t)(cap_site_n * OPA_CAP_SITE_LOAD_FACTOR))
+    {
+        size_t n = cap_site_n * 2;
+        opa_cap_site_entry_t *table = (opa_cap_site_entry_t *)opa_malloc(n * sizeof(opa_cap_site_entry_t));
+        memset(table, 0, n * sizeof(opa_cap_site_entry_t));
+
+        for (size_t i = 0; i < cap_site_n; i++)
+        {
+            if (cap_site_table[i].v != NULL)
+            {
+                table[__opa_cap_site_slot(table, n, cap_site_table[i].v)] = cap_site_table[i];
+            }
+        }
+
+        opa_free(cap_site_table);
+        cap_site_table = table;
+        cap_site_n = n;
+    }
+
+    size_t i = __opa_cap_site_slot(cap_site_table, cap_site_n, v);
+
+    if (cap_site_table[i].v == NULL)
+    {
+        cap_site_table[i].v = v;
+        cap_site_table[i].site = site;
+        cap_site_table[i].sampled = 0;
+        cap_site_len++;
+    }
+}
+
+// called from the growth paths with the size the container is reaching;
+// successive growths of one container update its sample in place, so the
+// ring holds one reached size per container, not one per doubling.
+static void __opa_cap_profile_observe(opa_value *v, size_t len)
+{
+    if (cap_site_table == NULL || cap_site_epoch != opa_heap_epoch())
+    {
+        return;
+    }
+
+    size_t i = __opa_cap_site_slot(cap_site_table, cap_site_n, v);
+
+    if (cap_site_table[i].v == NULL)
+    {
+        return;
+    }
+
+    opa_cap_site_entry_t *e = &cap_site_table[i];
+    opa_cap_profile_t *p = &cap_profile[e->site];
+
+    if (!e->sampled)
+    {
+        e->slot = p->i;
+        e->sampled = 1;
+        p->i = (p->i + 1) % OPA_CAP_PROFILE_SAMPLES;
+
+        if (p->n < OPA_CAP_PROFILE_SAMPLES)
+        {
+            p->n++;
+        }
+
+        p->samples[e->slot] = (unsigned int)len;
+    }
+    else if (len > p->samples[e->slot])
+    {
+        p->samples[e->slot] = (unsigned int)len;
+    }
+}
+
+static size_t __opa_cap_profile_seed(int32_t site)
+{
+    if (site < 0 || site >= OPA_CAP_PROFILE_SITES)
+    {
+        return 0;
+    }
+
+    opa_cap_profile_t *p = &cap_profile[site];
+
+    if (p->n == 0)
+    {
+        return 0;
+    }
+
+    unsigned int max1 = 0;
+    unsigned int max2 = 0;
+
+    for (int i = 0; i < p->n; i++)
+    {
+        if (p->samples[i] >= max1)
+        {
+            max2 = max1;
+            max1 = p->samples[i];
+        }
+        else if (p->samples[i] > max2)
+        {
+            max2 = p->samples[i];
+        }
+    }
+
+    return p->n > 1 ? max2 : max1;
+}
+
+OPA_INTERNAL
+WASM_EXPORT(opa_array_site)
+opa_value *opa_array_site(int32_t site)
+{
+    opa_value *v = opa_array_with_cap(__opa_cap_profile_seed(site));
+    __opa_cap_site_register(v, site);
+    return v;
+}
+
+OPA_INTERNAL
+WASM_EXPORT(opa_object_site)
+opa_value *opa_object_site(int32_t site)
+{
+    opa_value *v = opa_object_with_cap(__opa_cap_profile_seed(site));
+    __opa_cap_site_register(v, site);
+    return v;
+}
+
+OPA_INTERNAL
+WASM_EXPORT(opa_set_site)
+opa_value *opa_set_site(int32_t site)
+{
+    opa_value *v = opa_set_with_cap(__opa_cap_profile_seed(site));
+    __opa_cap_site_register(v, site);
+    return v;
+}
+
+opa_value *opa_array()
+{
+    return opa_array_with_cap(0);
+}
+
+OPA_INTERNAL
+opa_value *opa_array_with_cap(size_t cap)
+{
+    opa_array_t *ret = (opa_array_t *)opa_malloc(sizeof(opa_array_t));
+    ret->hdr.type = OPA_ARRAY;
+    ret->hdr.frozen = 0;
+    ret->free = 1;
+    ret->len = 0;
+    ret->cap = cap;
+    ret->elems = NULL;
+
+    if (ret->cap != 0)
+    {
+        __opa_array_grow(ret);
+    }
+
+    return &ret->hdr;
+}
+
+opa_value *opa_array_with_elems(opa_array_elem_t *elems, size_t len, size_t cap)
+{
+    opa_array_t *ret = (opa_array_t *)opa_malloc(sizeof(opa_array_t));
+
+    ret->hdr.type = OPA_ARRAY;
+    ret->hdr.frozen = 0;
+    ret->free = 1;
+    ret->len = len;
+    ret->cap = cap;
+    ret->elems = elems;
+
+    return &ret->hdr;
+}
+
+// opa_array_view returns an O(1) slice of a frozen array: the view borrows
+// the parent's element storage instead of copying it. The parent must be
+// frozen, so its elements cannot move or be freed before a heap reset
+// discards both; the view is frozen in turn, keeping mutators away from the
+// shared storage.
+opa_value *opa_array_view(opa_array_t *arr, size_t start, size_t len)
+{
+    opa_array_t *ret = (opa_array_t *)opa_malloc(sizeof(opa_array_t));
+
+    ret->hdr.type = OPA_ARRAY;
+    ret->hdr.frozen = 1;
+    ret->free = 0;
+    ret->len = len;
+    ret->cap = len;
+    ret->elems = arr->elems + start;
+
+    return &ret->hdr;
+}
+
+static opa_value *__opa_object_with_buckets(size_t buckets)
+{
+    opa_object_t *ret = (opa_object_t *)opa_malloc(sizeof(opa_object_t));
+    ret->hdr.type = OPA_OBJECT;
+    ret->hdr.frozen = 0;
+    ret->buckets = buckets <= OPA_VALUE_INLINE_BUCKETS ? ret->inline_buckets :
+        (opa_object_elem_t **)opa_malloc(sizeof(opa_object_elem_t *) * buckets);
+    ret->n = buckets;
+    ret->keys = NULL;
+    ret->dump = NULL;
+    ret->bloom = NULL;
+    ret->bloom_words = 0;
+    ret->bloom_epoch = 0;
+    ret->len = 0;
+
+    for (size_t i = 0; i < buckets; i++) {
+        ret->buckets[i] = NULL;
+    }
+
+    return &ret->hdr;
+}
+
+opa_value *opa_object()
+{
+    return __opa_object_with_buckets(OPA_OBJECT_MIN_BUCKETS);
+}
+
+opa_value *opa_object_with_cap(size_t n)
+{
+    size_t buckets = OPA_OBJECT_MIN_BUCKETS;
+
+    while (n > (buckets * OPA_OBJECT_LOAD_FACTOR))
+    {
+        buckets *= 2;
+    }
+
+    return __opa_object_with_buckets(buckets);
+}
+
+static opa_value *__opa_set_with_buckets(size_t buckets)
+{
+    opa_set_t *ret = (opa_set_t *)opa_malloc(sizeof(opa_set_t));
+    ret->hdr.type = OPA_SET;
+    ret->hdr.frozen = 0;
+    ret->buckets = buckets <= OPA_VALUE_INLINE_BUCKETS ? ret->inline_buckets :
+        (opa_set_elem_t **)opa_malloc(sizeof(opa_set_elem_t *) * buckets);
+    ret->n = buckets;
+    ret->len = 0;
+    ret->sorted = 0;
+    ret->bitmap = NULL;
+    ret->bitmap_base = 0;
+    ret->bitmap_words = 0;
+    ret->bitmap_epoch = 0;
+
+    for (size_t i = 0; i < buckets; i++) {
+        ret->buckets[i] = NULL;
+    }
+
+    return &ret->hdr;
+}
+
+OPA_INTERNAL
+opa_value *opa_set()
+{
+    // the sorted-vector form fills all of its inline slots: no load factor
+    opa_set_t *ret = opa_cast_set(__opa_set_with_buckets(OPA_VALUE_INLINE_BUCKETS));
+    ret->sorted = 1;
+    return &ret->hdr;
+}
+
+opa_value *opa_set_with_cap(size_t n)
+{
+    if (n <= OPA_VALUE_INLINE_BUCKETS)
+    {
+        return opa_set();
+    }
+
+    size_t buckets = OPA_SET_MIN_BUCKETS;
+
+    while (n > (buckets * OPA_SET_LOAD_FACTOR))
+    {
+        buckets *= 2;
+    }
+
+    return __opa_set_with_buckets(buckets);
+}
+
+OPA_INTERNAL
+void opa_value_number_set_int(opa_value *v, long long i)
+{
+	OPA_FROZEN_CHECK(v, "opa_value_number_set_int");
+#ifdef DEBUG
+	if (v->type == OPA_NUMBER_INTERNED)
+	{
+		opa_abort("opa_value_number_set_int: interned number");
+	}
+#endif
+	opa_number_t *ret = opa_cast_number(v);
+
+	if (ret->bf != NULL && ret->bf_epoch == opa_heap_epoch())
+	{
+		opa_mpd_del(ret->bf);
+	}
+
+	ret->bf = NULL;
+	ret->repr = OPA_NUMBER_REPR_INT;
+	ret->v.i = i;
+}
+
+void opa_array_free(opa_array_t *arr)
+{
+    if (arr->elems != NULL && arr->free)
+    {
+        opa_free(arr->elems);
+    }
+
+    opa_free(arr);
+}
+
+OPA_INTERNAL
+void opa_array_append(opa_array_t *arr, opa_value *v)
+{
+    OPA_FROZEN_CHECK(&arr->hdr, "opa_array_append");
+    if (arr->len >= arr->cap)
+    {
+        __opa_array_grow(arr);
     }
 
-    return NULL;
+    arr->elems[arr->len++].v = v;
 }
 
-static opa_value *__opa_tuple(opa_value *a, opa_value *b)
+// Stable bottom-up merge sort over the element values. Replaces an
+// insertion sort that was quadratic and underflowed its unsigned index
+// whenever a new minimum moved to the front.
+void opa_array_sort(opa_array_t *arr, opa_compare_fn cmp_fn)
 {
-    opa_value *ret = opa_array_with_cap(2);
-    opa_array_t *tuple = opa_cast_array(ret);
-    opa_array_append(tuple, a);
-    opa_array_append(tuple, b);
-    return ret;
+    size_t n = arr->len;
+
+    if (n < 2)
+    {
+        return;
+    }
+
+    opa_value **a = (opa_value **)opa_malloc(2 * n * sizeof(opa_value *));
+    opa_value **b = a + n;
+    opa_value **buf = a;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        a[i] = arr->elems[i].v;
+    }
+
+    for (size_t width = 1; width < n; width *= 2)
+    {
+        for (size_t lo = 0; lo < n; lo += 2 * width)
+        {
+            size_t mid = lo + width < n ? lo + width : n;
+            size_t hi = lo + 2 * width < n ? lo + 2 * width : n;
+            size_t i = lo, j = mid, k = lo;
+
+            while (i < mid && j < hi)
+            {
+                // ties take the left run, keeping the sort stable
+                b[k++] = cmp_fn(a[j], a[i]) < 0 ? a[j++] : a[i++];
+            }
+
+            while (i < mid)
+            {
+                b[k++] = a[i++];
+            }
+
+            while (j < hi)
+            {
+                b[k++] = a[j++];
+            }
+        }
+
+        opa_value **t = a;
+        a = b;
+        b = t;
+    }
+
+    for (size_t i = 0; i < n; i++)
+    {
+        arr->elems[i].v = a[i];
+    }
+
+    opa_free(buf);
 }
 
-static void __opa_value_transitive_closure(opa_array_t *result, opa_array_t *path, opa_value *node)
+void __opa_object_buckets_free(opa_object_t *obj)
 {
-    opa_array_append(result, __opa_tuple(&path->hdr, node));
-    opa_value *prev = NULL;
-    opa_value *curr = NULL;
+    for (int i = 0; i < obj->n; i++)
+    {
+        if (obj->buckets[i] != NULL)
+        {
+            opa_free_node(obj->buckets[i], sizeof(opa_object_elem_t));
+        }
+    }
 
-    while ((curr = opa_value_iter(node, prev)) != NULL)
+    if (obj->buckets != obj->inline_buckets)
     {
-        opa_array_t *cpy = opa_cast_array(opa_value_shallow_copy_array(path));
-        opa_array_append(cpy, curr);
-        opa_value *child = opa_value_get(node, curr);
-        __opa_value_transitive_closure(result, cpy, child);
-        prev = curr;
+        opa_free(obj->buckets);
     }
 }
 
-OPA_BUILTIN
-opa_value *opa_value_transitive_closure(opa_value *v)
+void opa_object_free(opa_object_t *obj)
 {
-    opa_array_t *result = opa_cast_array(opa_array());
-    opa_array_t *path = opa_cast_array(opa_array());
-    __opa_value_transitive_closure(result, path, v);
-    return &result->hdr;
+    __opa_object_keys_invalidate(obj);
+    __opa_object_bloom_invalidate(obj);
+    __opa_object_dump_invalidate(obj);
+    __opa_object_buckets_free(obj);
+    opa_free(obj);
 }
 
+// drops the memoized sorted keys; called whenever the key set changes.
+static void __opa_object_keys_invalidate(opa_object_t *obj)
+{
+    if (obj->keys != NULL)
+    {
+        if (obj->keys_epoch == opa_heap_epoch())
+        {
+            opa_array_free(obj->keys);
+        }
 
-OPA_INTERNAL
-opa_value *opa_null()
+        obj->keys = NULL;
+    }
+}
+
+// drops the negative-lookup filter; called whenever the key set changes.
+static void __opa_object_bloom_invalidate(opa_object_t *obj)
 {
-    opa_value *ret = (opa_value *)opa_malloc(sizeof(opa_value));
-    ret->type = OPA_NULL;
-    return ret;
+    if (obj->bloom != NULL)
+    {
+        if (obj->bloom_epoch == opa_heap_epoch())
+        {
+            opa_free(obj->bloom);
+        }
+
+        obj->bloom = NULL;
+    }
 }
 
-opa_value *opa_boolean_allocated(bool v)
+// drops the memoized serialization; called whenever a key or value changes.
+// Unlike the keys cache this also goes on value overwrites that leave the
+// key set intact.
+static void __opa_object_dump_invalidate(opa_object_t *obj)
 {
-    opa_boolean_t *ret = (opa_boolean_t *)opa_malloc(sizeof(opa_boolean_t));
-    ret->hdr.type = OPA_BOOLEAN;
-    ret->v = v;
-    return &ret->hdr;
+    if (obj->dump != NULL)
+    {
+        if (obj->dump_epoch == opa_heap_epoch())
+        {
+            opa_free(obj->dump);
+        }
+
+        obj->dump = NULL;
+    }
 }
 
-opa_value *opa_boolean(bool v)
+// returns the object's keys in sorted order. The array is memoized on the
+// object and owned by it: callers must not free or mutate it, and must not
+// hold onto it across inserts or removals.
+opa_array_t *opa_object_keys(opa_object_t *obj)
+{
+    if (obj->keys != NULL && obj->keys_epoch == opa_heap_epoch())
+    {
+        return obj->keys;
+    }
+
+    opa_array_t *keys = opa_cast_array(opa_array_with_cap(opa_value_length_object(obj)));
+
+    for (int i = 0; i < obj->n; i++)
+    {
+        opa_object_elem_t *elem = obj->buckets[i];
+
+        while (elem != NULL)
+        {
+            opa_array_append(keys, elem->k);
+            elem = elem->next;
+        }
+    }
+
+    opa_array_sort(keys, opa_value_compare);
+    obj->keys = keys;
+    obj->keys_epoch = opa_heap_epoch();
+    return keys;
+}
+
+opa_object_elem_t *__opa_object_elem_alloc(opa_value *k, opa_value *v)
 {
-    return opa_boolean_allocated(v);
+    opa_object_elem_t *elem = (opa_object_elem_t *)opa_malloc_node(sizeof(opa_object_elem_t));
+    elem->next = NULL;
+    elem->k = k;
+    elem->v = v;
+    return elem;
 }
 
-OPA_INTERNAL
-opa_value *opa_number_size(size_t v)
+// Rebuilds the table with the given bucket count in a single re-bucket
+// pass. Shared by growth, the removal-triggered shrink and
+// opa_object_compact.
+static void __opa_object_rebucket(opa_object_t *obj, size_t buckets)
 {
-    opa_number_t *ret = (opa_number_t *)opa_malloc(sizeof(opa_number_t));
-    ret->hdr.type = OPA_NUMBER;
-    ret->repr = OPA_NUMBER_REPR_INT;
-    ret->v.i = (long long)v;
-    return &ret->hdr;
+    opa_object_t *dst = opa_cast_object(__opa_object_with_buckets(buckets));
+
+    for (size_t i = 0; i < obj->n; i++)
+    {
+        if (obj->buckets[i] != NULL)
+        {
+            __opa_object_insert_elem(dst, obj->buckets[i], obj->buckets[i]->hash);
+        }
+    }
+
+    if (obj->buckets != obj->inline_buckets)
+    {
+        opa_free(obj->buckets);
+    }
+
+    if (dst->buckets == dst->inline_buckets)
+    {
+        // small tables move back into the object's own inline array
+        memcpy(obj->inline_buckets, dst->inline_buckets, buckets * sizeof(obj->buckets[0]));
+        obj->buckets = obj->inline_buckets;
+    }
+    else
+    {
+        obj->buckets = dst->buckets;
+    }
+
+    obj->n = dst->n;
+    opa_free(dst);
+}
+
+void __opa_object_grow(opa_object_t *obj, size_t n) {
+    if (n <= (obj->n * OPA_OBJECT_LOAD_FACTOR))
+    {
+        return;
+    }
+
+    __opa_cap_profile_observe(&obj->hdr, n);
+
+    // size for the requested length in one step, so a bulk insert
+    // rehashes the existing elements only once.
+    size_t buckets = obj->n * 2;
+
+    while (n > (buckets * OPA_OBJECT_LOAD_FACTOR))
+    {
+        buckets *= 2;
+    }
+
+    __opa_object_rebucket(obj, buckets);
 }
 
 OPA_INTERNAL
-opa_value *opa_number_int(long long v)
+void opa_object_insert(opa_object_t *obj, opa_value *k, opa_value *v)
 {
-    opa_number_t *ret = (opa_number_t *)opa_malloc(sizeof(opa_number_t));
-    ret->hdr.type = OPA_NUMBER;
-    ret->repr = OPA_NUMBER_REPR_INT;
-    ret->v.i = v;
-    return &ret->hdr;
+    OPA_FROZEN_CHECK(&obj->hdr, "opa_object_insert");
+    size_t hash = opa_value_hash(k);
+    size_t i = __opa_object_slot(obj, k, hash);
+
+    __opa_object_dump_invalidate(obj);
+
+    if (obj->buckets[i] != NULL)
+    {
+        obj->buckets[i]->v = v;
+        return;
+    }
+
+    __opa_object_keys_invalidate(obj);
+    __opa_object_bloom_invalidate(obj);
+    __opa_object_grow(obj, obj->len+1);
+    __opa_object_insert_elem(obj, __opa_object_elem_alloc(k, v), hash);
 }
 
+// opa_object_insert_bulk inserts n key/value pairs with a single growth
+// check: the table is sized for the final length up front and the pairs
+// hash and link in one tight pass. Duplicate keys keep the last value,
+// matching repeated opa_object_insert.
 OPA_INTERNAL
-opa_value *opa_number_ref(const char *s, size_t len)
+void opa_object_insert_bulk(opa_object_t *obj, opa_value **ks, opa_value **vs, size_t n)
 {
-    opa_number_t *ret = (opa_number_t *)opa_malloc(sizeof(opa_number_t));
-    ret->hdr.type = OPA_NUMBER;
-    ret->repr = OPA_NUMBER_REPR_REF;
-    ret->v.ref.s = s;
-    ret->v.ref.len = len;
-    ret->v.ref.free = 0;
-    return &ret->hdr;
+    OPA_FROZEN_CHECK(&obj->hdr, "opa_object_insert_bulk");
+    __opa_object_dump_invalidate(obj);
+    __opa_object_keys_invalidate(obj);
+    __opa_object_bloom_invalidate(obj);
+    __opa_object_grow(obj, obj->len + n);
+
+    for (size_t j = 0; j < n; j++)
+    {
+        size_t hash = opa_value_hash(ks[j]);
+        size_t i = __opa_object_slot(obj, ks[j], hash);
+
+        if (obj->buckets[i] != NULL)
+        {
+            obj->buckets[i]->v = vs[j];
+            continue;
+        }
+
+        __opa_object_insert_elem(obj, __opa_object_elem_alloc(ks[j], vs[j]), hash);
+    }
 }
 
-opa_value *opa_number_ref_allocated(const char *s, size_t len)
+static void __opa_object_insert_elem(opa_object_t *obj, opa_object_elem_t *new, size_t hash)
 {
-    opa_number_t *ret = (opa_number_t *)opa_malloc(sizeof(opa_number_t));
-    ret->hdr.type = OPA_NUMBER;
-    ret->repr = OPA_NUMBER_REPR_REF;
-    ret->v.ref.s = s;
-    ret->v.ref.len = len;
-    ret->v.ref.free = 1;
-    return &ret->hdr;
+    size_t i = hash % obj->n;
+
+    while (obj->buckets[i] != NULL)
+    {
+        i = (i + 1) % obj->n;
+    }
+
+    new->hash = hash;
+    new->next = NULL;
+    obj->buckets[i] = new;
+    obj->len++;
+}
+
+// Unlinks the element with the given key from the table and returns it,
+// or NULL when the key is absent. Shared by the removal variants below.
+static opa_object_elem_t *__opa_object_unlink(opa_object_t *obj, opa_value *k)
+{
+    size_t i = __opa_object_slot(obj, k, opa_value_hash(k));
+    opa_object_elem_t *curr = obj->buckets[i];
+
+    if (curr == NULL)
+    {
+        return NULL;  // Key wasn't found, consider it deleted.
+    }
+
+    obj->buckets[i] = NULL;
+    obj->len--;
+    __opa_object_keys_invalidate(obj);
+    __opa_object_bloom_invalidate(obj);
+    __opa_object_dump_invalidate(obj);
+
+    // Shift displaced entries backwards so no probe sequence is broken by
+    // the emptied slot.
+
+    for (size_t j = (i + 1) % obj->n; obj->buckets[j] != NULL; j = (j + 1) % obj->n)
+    {
+        size_t h = obj->buckets[j]->hash % obj->n;
+
+        if (((j + obj->n - h) % obj->n) >= ((j + obj->n - i) % obj->n))
+        {
+            obj->buckets[i] = obj->buckets[j];
+            obj->buckets[j] = NULL;
+            i = j;
+        }
+    }
+
+    // Shrink when occupancy falls to a quarter of the grow threshold, so
+    // tables that ballooned transiently stop paying peak-capacity
+    // iteration for their lifetime. The hysteresis gap keeps a
+    // remove/insert cycle at the boundary from rehashing back and forth.
+    if (obj->n > OPA_OBJECT_MIN_BUCKETS &&
+        obj->len <= (size_t)(obj->n * OPA_OBJECT_LOAD_FACTOR) / 4)
+    {
+        size_t buckets = OPA_OBJECT_MIN_BUCKETS;
+
+        while (obj->len > (buckets * OPA_OBJECT_LOAD_FACTOR))
+        {
+            buckets *= 2;
+        }
+
+        __opa_object_rebucket(obj, buckets);
+    }
+
+    return curr;
+}
+
+void opa_object_remove(opa_object_t *obj, opa_value *k)
+{
+    OPA_FROZEN_CHECK(&obj->hdr, "opa_object_remove");
+    opa_object_elem_t *curr = __opa_object_unlink(obj, k);
+
+    if (curr == NULL)
+    {
+        return;
+    }
+
+    opa_value_free(curr->k);
+    opa_value_free(curr->v);
+    opa_free_node(curr, sizeof(opa_object_elem_t));
+}
+
+// Rebuilds an object's table at the minimum size for its length and
+// recurses into object and array members, so a data tree that went
+// through a batch of opa_value_remove_path calls drops its peak-size
+// tables in one pass. Frozen (shared) subtrees are left alone.
+OPA_INTERNAL
+WASM_EXPORT(opa_object_compact)
+void opa_object_compact(opa_value *v)
+{
+    if (v == NULL)
+    {
+        return;
+    }
+
+    switch (opa_value_type(v))
+    {
+    case OPA_OBJECT: {
+        opa_object_t *obj = opa_cast_object(v);
+
+        if (obj->hdr.frozen)
+        {
+            return;
+        }
+
+        size_t buckets = OPA_OBJECT_MIN_BUCKETS;
+
+        while (obj->len > (buckets * OPA_OBJECT_LOAD_FACTOR))
+        {
+            buckets *= 2;
+        }
+
+        if (buckets < obj->n)
+        {
+            __opa_object_rebucket(obj, buckets);
+        }
+
+        for (size_t i = 0; i < obj->n; i++)
+        {
+            if (obj->buckets[i] != NULL)
+            {
+                opa_object_compact(obj->buckets[i]->v);
+            }
+        }
+
+        break;
+    }
+    case OPA_ARRAY: {
+        opa_array_t *arr = opa_cast_array(v);
+
+        if (arr->hdr.frozen)
+        {
+            return;
+        }
+
+        for (size_t i = 0; i < arr->len; i++)
+        {
+            opa_object_compact(arr->elems[i].v);
+        }
+
+        break;
+    }
+    }
 }
 
-void opa_number_init_int(opa_number_t *n, long long v)
+// Like opa_object_remove, but leaves the removed key and value alone: they
+// may be shared with another object, as in tables produced by
+// opa_value_shallow_copy.
+void opa_object_remove_keep(opa_object_t *obj, opa_value *k)
 {
-    n->hdr.type = OPA_NUMBER;
-    n->repr = OPA_NUMBER_REPR_INT;
-    n->v.i = v;
+    OPA_FROZEN_CHECK(&obj->hdr, "opa_object_remove_keep");
+    opa_object_elem_t *curr = __opa_object_unlink(obj, k);
+
+    if (curr != NULL)
+    {
+        opa_free_node(curr, sizeof(opa_object_elem_t));
+    }
 }
 
-void opa_number_free(opa_number_t *n)
+// returns the object's negative-lookup filter, building it if the key set
+// has changed since the last build: two bits derived from each key's cached
+// hash, sized at roughly eight bits per key.
+static unsigned long long *__opa_object_bloom(opa_object_t *obj)
 {
-    if (n->repr == OPA_NUMBER_REPR_REF)
+    if (obj->bloom != NULL && obj->bloom_epoch == opa_heap_epoch())
     {
-        if (n->v.ref.free)
+        return obj->bloom;
+    }
+
+    size_t words = 1;
+
+    while (words * 64 < obj->len * 8)
+    {
+        words *= 2;
+    }
+
+    unsigned long long *bloom = (unsigned long long *)opa_malloc(words * sizeof(unsigned long long));
+    size_t m = words * 64;
+
+    memset(bloom, 0, words * sizeof(unsigned long long));
+
+    for (size_t i = 0; i < obj->n; i++)
+    {
+        if (obj->buckets[i] != NULL)
         {
-            opa_free((void *)n->v.ref.s);
+            size_t hash = obj->buckets[i]->hash;
+            size_t h1 = hash & (m - 1);
+            size_t h2 = (hash * 0x9e3779b9U) & (m - 1);
+
+            bloom[h1 / 64] |= 1ULL << (h1 % 64);
+            bloom[h2 / 64] |= 1ULL << (h2 % 64);
         }
     }
 
-    opa_free(n);
+    obj->bloom = bloom;
+    obj->bloom_words = words;
+    obj->bloom_epoch = opa_heap_epoch();
+    return bloom;
 }
 
-int opa_number_try_int(opa_number_t *n, long long *i)
+opa_object_elem_t *opa_object_get(opa_object_t *obj, opa_value *key)
 {
-    switch (n->repr)
+    size_t hash = opa_value_hash(key);
+
+    // most probes on large sparse maps miss: a clear filter bit proves the
+    // key absent with two word tests instead of a probe sequence.
+    if (obj->len >= OPA_OBJECT_BLOOM_MIN_LEN)
     {
-    case OPA_NUMBER_REPR_INT:
-        *i = n->v.i;
-        return 0;
-    case OPA_NUMBER_REPR_REF:
-        return opa_atoi64(n->v.ref.s, n->v.ref.len, i);
-    default:
-        opa_abort("opa_number_try_int: illegal repr");
-        return -1;
+        unsigned long long *bloom = __opa_object_bloom(obj);
+        size_t m = obj->bloom_words * 64;
+        size_t h1 = hash & (m - 1);
+        size_t h2 = (hash * 0x9e3779b9U) & (m - 1);
+
+        if (!((bloom[h1 / 64] >> (h1 % 64)) & 1) ||
+            !((bloom[h2 / 64] >> (h2 % 64)) & 1))
+        {
+            return NULL;
+        }
     }
+
+    return obj->buckets[__opa_object_slot(obj, key, hash)];
 }
 
-double opa_number_as_float(opa_number_t *n)
+void __opa_set_buckets_free(opa_set_t *set)
 {
-    switch (n->repr)
-    {
-    case OPA_NUMBER_REPR_INT:
-        return (double)n->v.i;
-    case OPA_NUMBER_REPR_REF:
+    for (int i = 0; i < set->n; i++)
     {
-        double d;
-        int rc = opa_atof64(n->v.ref.s, n->v.ref.len, &d);
-        if (rc != 0)
+        if (set->buckets[i] != NULL)
         {
-            opa_abort("opa_number_as_float: illegal ref");
+            opa_free_node(set->buckets[i], sizeof(opa_set_elem_t));
         }
-        return d;
     }
-    default:
-        opa_abort("opa_number_as_float: illegal repr");
-        return 0.0;
+
+    if (set->buckets != set->inline_buckets)
+    {
+        opa_free(set->buckets);
     }
 }
 
-opa_value *opa_string(const char *v, size_t len)
+void opa_set_free(opa_set_t *set)
 {
-    opa_string_t *ret = (opa_string_t *)opa_malloc(sizeof(opa_string_t));
-    ret->hdr.type = OPA_STRING;
-    ret->free = 0;
-    ret->len = len;
-    ret->v = v;
-    return &ret->hdr;
+    __opa_set_bitmap_invalidate(set);
+    __opa_set_buckets_free(set);
+    opa_free(set);
 }
 
-OPA_INTERNAL
-opa_value *opa_string_terminated(const char *v)
+opa_array_t *__opa_set_values(opa_set_t *set)
 {
-    opa_string_t *ret = (opa_string_t *)opa_malloc(sizeof(opa_string_t));
-    ret->hdr.type = OPA_STRING;
-    ret->free = 0;
-    ret->len = opa_strlen(v);
-    ret->v = v;
-    return &ret->hdr;
-}
+    opa_array_t *values = opa_cast_array(opa_array_with_cap(opa_value_length_set(set)));
 
-opa_value *opa_string_allocated(const char *v, size_t len)
-{
-    opa_string_t *ret = (opa_string_t *)opa_malloc(sizeof(opa_string_t));
-    ret->hdr.type = OPA_STRING;
-    ret->free = 1;
-    ret->len = len;
-    ret->v = v;
-    return &ret->hdr;
-}
+    for (int i = 0; i < set->n; i++)
+    {
+        opa_set_elem_t *elem = set->buckets[i];
 
-void opa_string_free(opa_string_t *s)
-{
-    if (s->free)
+        while (elem != NULL)
+        {
+            opa_array_append(values, elem->v);
+            elem = elem->next;
+        }
+    }
+
+    if (!set->sorted)
     {
-        opa_free((void *)s->v);
+        opa_array_sort(values, opa_value_compare);
     }
 
-    opa_free(s);
+    return values;
 }
 
-void __opa_array_grow(opa_array_t *arr)
+opa_set_elem_t *__opa_set_elem_alloc(opa_value *v)
 {
-    if (arr->cap == 0)
+    opa_set_elem_t *elem = (opa_set_elem_t *)opa_malloc_node(sizeof(opa_set_elem_t));
+    elem->next = NULL;
+    elem->v = v;
+    elem->hash = 0; // unused (and unset) until the set is in the hash form
+    return elem;
+}
+
+void __opa_set_grow(opa_set_t *set, size_t n) {
+    if (set->sorted ? n <= set->n : n <= (set->n * OPA_SET_LOAD_FACTOR))
     {
-        arr->cap = OPA_ARRAY_INITIAL_CAP;
+        return;
     }
-    else
+
+    __opa_cap_profile_observe(&set->hdr, n);
+
+    // size for the requested length in one step, so a bulk add rehashes
+    // the existing elements only once.
+    size_t buckets = set->n * 2;
+
+    while (n > (buckets * OPA_SET_LOAD_FACTOR))
     {
-        arr->cap *= 2;
+        buckets *= 2;
     }
 
-    opa_array_elem_t *elems = (opa_array_elem_t *)opa_malloc(arr->cap * sizeof(opa_array_elem_t));
+    opa_set_t *dst = opa_cast_set(__opa_set_with_buckets(buckets));
 
-    for (int i = 0; i < arr->len; i++)
+    for (int i = 0; i < set->n; i++)
     {
-        elems[i] = arr->elems[i];
+        if (set->buckets[i] != NULL)
+        {
+            // sorted-vector elements carry no hash: promotion computes it
+            __opa_set_add_elem(dst, set->buckets[i], set->sorted ?
+                opa_value_hash(set->buckets[i]->v) : set->buckets[i]->hash);
+        }
     }
 
-    if (arr->elems != NULL)
+    set->sorted = 0;
+
+    if (set->buckets != set->inline_buckets)
     {
-        opa_free(arr->elems);
+        opa_free(set->buckets);
     }
-    arr->elems = elems;
-}
 
-opa_value *opa_array()
-{
-    return opa_array_with_cap(0);
+    set->buckets = dst->buckets;
+    set->n = dst->n;
+    opa_free(dst);
 }
 
 OPA_INTERNAL
-opa_value *opa_array_with_cap(size_t cap)
+void opa_set_add(opa_set_t *set, opa_value *v)
 {
-    opa_array_t *ret = (opa_array_t *)opa_malloc(sizeof(opa_array_t));
-    ret->hdr.type = OPA_ARRAY;
-    ret->len = 0;
-    ret->cap = cap;
-    ret->elems = NULL;
-
-    if (ret->cap != 0)
+    OPA_FROZEN_CHECK(&set->hdr, "opa_set_add");
+    if (set->sorted)
     {
-        __opa_array_grow(ret);
-    }
-
-    return &ret->hdr;
-}
+        bool found;
+        size_t i = __opa_set_sorted_pos(set, v, &found);
 
-opa_value *opa_array_with_elems(opa_array_elem_t *elems, size_t len, size_t cap)
-{
-    opa_array_t *ret = (opa_array_t *)opa_malloc(sizeof(opa_array_t));
+        if (found)
+        {
+            return;
+        }
 
-    ret->hdr.type = OPA_ARRAY;
-    ret->len = len;
-    ret->cap = cap;
-    ret->elems = elems;
+        if (set->len < set->n)
+        {
+            __opa_set_bitmap_invalidate(set);
+            memmove(&set->buckets[i+1], &set->buckets[i],
+                    (set->len - i) * sizeof(opa_set_elem_t *));
+            set->buckets[i] = __opa_set_elem_alloc(v);
+            set->len++;
+            return;
+        }
 
-    return &ret->hdr;
-}
+        // the vector is full: promote to the hash form and fall through
+        __opa_set_grow(set, set->len+1);
+    }
 
-static opa_value *__opa_object_with_buckets(size_t buckets)
-{
-    opa_object_t *ret = (opa_object_t *)opa_malloc(sizeof(opa_object_t));
-    ret->hdr.type = OPA_OBJECT;
-    ret->buckets = (opa_object_elem_t **)opa_malloc(sizeof(opa_object_elem_t *) * buckets);
-    ret->n = buckets;
-    ret->len = 0;
+    size_t hash = opa_value_hash(v);
 
-    for (size_t i = 0; i < buckets; i++) {
-        ret->buckets[i] = NULL;
+    if (set->buckets[__opa_set_slot(set, v, hash)] != NULL)
+    {
+        return;
     }
 
-    return &ret->hdr;
+    __opa_set_bitmap_invalidate(set);
+    __opa_set_grow(set, set->len+1);
+    __opa_set_add_elem(set, __opa_set_elem_alloc(v), hash);
 }
 
-opa_value *opa_object()
+// opa_set_add_bulk adds n values with a single growth check. Because
+// opa_array_elem_t is just the value pointer, an array's element vector
+// can be handed over directly.
+OPA_INTERNAL
+void opa_set_add_bulk(opa_set_t *set, opa_value **vs, size_t n)
 {
-    return __opa_object_with_buckets(OPA_OBJECT_MIN_BUCKETS);
-}
+    OPA_FROZEN_CHECK(&set->hdr, "opa_set_add_bulk");
+    __opa_set_grow(set, set->len + n); // promotes a sorted set that would overflow
 
-static opa_value *__opa_set_with_buckets(size_t buckets)
-{
-    opa_set_t *ret = (opa_set_t *)opa_malloc(sizeof(opa_set_t));
-    ret->hdr.type = OPA_SET;
-    ret->buckets = (opa_set_elem_t **)opa_malloc(sizeof(opa_set_elem_t *) * buckets);
-    ret->n = buckets;
-    ret->len = 0;
+    if (set->sorted)
+    {
+        for (size_t j = 0; j < n; j++)
+        {
+            opa_set_add(set, vs[j]);
+        }
 
-    for (size_t i = 0; i < buckets; i++) {
-        ret->buckets[i] = NULL;
+        return;
     }
 
-    return &ret->hdr;
-}
+    for (size_t j = 0; j < n; j++)
+    {
+        size_t hash = opa_value_hash(vs[j]);
 
-OPA_INTERNAL
-opa_value *opa_set()
-{
-    return __opa_set_with_buckets(OPA_SET_MIN_BUCKETS);
+        if (set->buckets[__opa_set_slot(set, vs[j], hash)] != NULL)
+        {
+            continue;
+        }
+
+        __opa_set_bitmap_invalidate(set);
+        __opa_set_add_elem(set, __opa_set_elem_alloc(vs[j]), hash);
+    }
 }
 
-opa_value *opa_set_with_cap(size_t n)
+static void __opa_set_add_elem(opa_set_t *set, opa_set_elem_t *new, size_t hash)
 {
-    size_t buckets = OPA_SET_MIN_BUCKETS;
+    size_t i = hash % set->n;
 
-    while (n > (buckets * OPA_SET_LOAD_FACTOR))
+    while (set->buckets[i] != NULL)
     {
-        buckets *= 2;
+        i = (i + 1) % set->n;
     }
 
-    return __opa_set_with_buckets(buckets);
+    new->hash = hash;
+    new->next = NULL;
+    set->buckets[i] = new;
+    set->len++;
 }
 
-OPA_INTERNAL
-void opa_value_number_set_int(opa_value *v, long long i)
+// drops the memoized bitmap ahead of a membership change.
+static void __opa_set_bitmap_invalidate(opa_set_t *set)
 {
-	opa_number_t *ret = opa_cast_number(v);
-	ret->repr = OPA_NUMBER_REPR_INT;
-	ret->v.i = i;
+    if (set->bitmap != NULL && set->bitmap_epoch == opa_heap_epoch())
+    {
+        opa_free(set->bitmap);
+    }
+
+    set->bitmap = NULL;
+    set->bitmap_words = 0;
 }
 
-void opa_array_free(opa_array_t *arr)
+// returns the set's dense-int bitmap, building it if the membership has
+// changed since the last build: bit (v - base) is set for every member v.
+// Returns NULL when the set is unsuitable — empty, holding a non-integer,
+// or spanning more than OPA_SET_BITMAP_MAX_RANGE — and marks the set so
+// that lookups do not rescan it until the next mutation.
+unsigned long long *opa_set_bitmap(opa_set_t *set, long long *base, size_t *words)
 {
-    if (arr->elems != NULL)
+    if (set->bitmap_epoch == opa_heap_epoch())
     {
-        for (size_t i = 0; i < arr->len; i++)
+        if (set->bitmap != NULL)
         {
-            opa_free(arr->elems[i].i);
+            *base = set->bitmap_base;
+            *words = set->bitmap_words;
+            return set->bitmap;
         }
 
-        opa_free(arr->elems);
+        if (set->bitmap_words == OPA_SET_BITMAP_INELIGIBLE)
+        {
+            return NULL;
+        }
     }
 
-    opa_free(arr);
-}
+    set->bitmap = NULL;
+    set->bitmap_epoch = opa_heap_epoch();
+    set->bitmap_words = OPA_SET_BITMAP_INELIGIBLE;
 
-OPA_INTERNAL
-void opa_array_append(opa_array_t *arr, opa_value *v)
-{
-    if (arr->len >= arr->cap)
+    if (set->len == 0)
+    {
+        return NULL;
+    }
+
+    long long min = 0;
+    long long max = 0;
+    bool first = true;
+
+    for (size_t i = 0; i < set->n; i++)
+    {
+        opa_set_elem_t *elem = set->buckets[i];
+        long long v;
+
+        if (elem == NULL)
+        {
+            continue;
+        }
+
+        if (opa_value_type(elem->v) != OPA_NUMBER ||
+            opa_number_try_int(opa_cast_number(elem->v), &v) != 0)
+        {
+            return NULL;
+        }
+
+        min = first || v < min ? v : min;
+        max = first || v > max ? v : max;
+        first = false;
+    }
+
+    if ((unsigned long long)(max - min) >= OPA_SET_BITMAP_MAX_RANGE)
     {
-        __opa_array_grow(arr);
+        return NULL;
     }
 
-    size_t i = arr->len++;
-    arr->elems[i].i = opa_number_int(i);
-    arr->elems[i].v = v;
-}
+    size_t n = ((size_t)(max - min) + 64) / 64;
+    unsigned long long *bits = (unsigned long long *)opa_malloc(n * sizeof(unsigned long long));
 
-void opa_array_sort(opa_array_t *arr, opa_compare_fn cmp_fn)
-{
-    for (size_t i = 1; i < arr->len; i++)
-    {
-        opa_value *elem = arr->elems[i].v;
-        size_t j = i - 1;
+    memset(bits, 0, n * sizeof(unsigned long long));
 
-        while (j >= 0 && cmp_fn(arr->elems[j].v, elem) > 0)
+    for (size_t i = 0; i < set->n; i++)
+    {
+        if (set->buckets[i] != NULL)
         {
-            arr->elems[j + 1].v = arr->elems[j].v;
-            j = j - 1;
-        }
+            long long v;
 
-        arr->elems[j + 1].v = elem;
+            opa_number_try_int(opa_cast_number(set->buckets[i]->v), &v);
+            bits[(size_t)(v - min) / 64] |= 1ULL << ((size_t)(v - min) % 64);
+        }
     }
+
+    set->bitmap = bits;
+    set->bitmap_base = min;
+    set->bitmap_words = n;
+    *base = min;
+    *words = n;
+    return bits;
 }
 
-void __opa_object_buckets_free(opa_object_t *obj)
+opa_set_elem_t *opa_set_get(opa_set_t *set, opa_value *v)
 {
-    for (int i = 0; i < obj->n; i++)
+    // misses on large integer sets are answered by a couple of word tests
+    // against the memoized bitmap instead of a probe.
+    if (!set->sorted && set->len >= OPA_SET_BITMAP_MIN_LEN &&
+        opa_value_type(v) == OPA_NUMBER)
     {
-        opa_object_elem_t *prev = NULL;
+        long long i;
+        long long base;
+        size_t words;
+        unsigned long long *bits;
 
-        for (opa_object_elem_t *curr = obj->buckets[i]; curr != NULL; curr = curr->next)
+        if (opa_number_try_int(opa_cast_number(v), &i) == 0 &&
+            (bits = opa_set_bitmap(set, &base, &words)) != NULL)
         {
-            if (prev != NULL)
+            if (i < base || i >= base + (long long)(words * 64) ||
+                !(bits[(size_t)(i - base) / 64] >> ((size_t)(i - base) % 64) & 1))
             {
-                opa_free(prev);
+                return NULL;
             }
-
-            prev = curr;
-        }
-
-        if (prev != NULL)
-        {
-            opa_free(prev);
         }
     }
 
-    opa_free(obj->buckets);
-}
+    if (set->sorted)
+    {
+        bool found;
+        size_t i = __opa_set_sorted_pos(set, v, &found);
+        return found ? set->buckets[i] : NULL;
+    }
 
-void opa_object_free(opa_object_t *obj)
-{
-    __opa_object_buckets_free(obj);
-    opa_free(obj);
+    return set->buckets[__opa_set_slot(set, v, opa_value_hash(v))];
 }
 
-opa_array_t *opa_object_keys(opa_object_t *obj)
+// Validate that a path is non-null, an array value type,
+// has a length >0, and only contains strings.
+// Returns the size of the path, or -1 for an invalid path
+int _validate_json_path(opa_value *path)
 {
-    opa_array_t *keys = opa_cast_array(opa_array_with_cap(opa_value_length_object(obj)));
+    if (path == NULL || opa_value_type(path) != OPA_ARRAY)
+    {
+        return -1;
+    }
 
-    for (int i = 0; i < obj->n; i++)
+    int path_len = opa_value_length(path);
+    if (path_len == 0)
     {
-        opa_object_elem_t *elem = obj->buckets[i];
+        return -1;
+    }
 
-        while (elem != NULL)
+    for (int i = 0; i < path_len-1; i++)
+    {
+        opa_value *v = opa_value_get_array_native(opa_cast_array(path), i);
+        if (opa_value_type(v) != OPA_STRING)
         {
-            opa_array_append(keys, elem->k);
-            elem = elem->next;
+            return -1;
         }
     }
 
-    opa_array_sort(keys, opa_value_compare);
-    return keys;
+    return path_len;
 }
 
-opa_object_elem_t *__opa_object_elem_alloc(opa_value *k, opa_value *v)
+// Data generation counter: every mutation of the data document through the
+// path API bumps it, so caches keyed on the data's content — retained rule
+// memo entries, notably — can tell whether the data they were computed
+// against is still current. Bumps are unconditional: a failed operation may
+// have created intermediate containers, and over-invalidation is harmless.
+static unsigned int data_generation = 1;
+
+OPA_INTERNAL
+unsigned int opa_value_data_generation(void)
 {
-    opa_object_elem_t *elem = (opa_object_elem_t *)opa_malloc(sizeof(opa_object_elem_t));
-    elem->next = NULL;
-    elem->k = k;
-    elem->v = v;
-    return elem;
+    return data_generation;
 }
 
-void __opa_object_grow(opa_object_t *obj, size_t n) {
-    if (n <= (obj->n * OPA_OBJECT_LOAD_FACTOR))
+// For the given `data` value set the provided value `v` at
+// the specified `path`. Requires objects for containers,
+// any portion of the path that is missing will be created.
+// The `path` must be an `opa_array_t` with at least one
+// element.
+//
+// Replaced objects will be freed.
+WASM_EXPORT(opa_value_add_path)
+opa_errc opa_value_add_path(opa_value *data, opa_value *path, opa_value *v)
+{
+    data_generation++;
+
+    int path_len = _validate_json_path(path);
+
+    if (path_len < 1)
     {
-        return;
+        return OPA_ERR_INVALID_PATH;
     }
 
-    opa_object_t *dst = opa_cast_object(__opa_object_with_buckets(obj->n * 2));
+    // Follow the path, creating objects as needed.
+    opa_array_t *p = opa_cast_array(path);
+    opa_value *curr = data;
 
-    for (int i = 0; i < obj->n; i++)
+    for (int i = 0; i < path_len-1; i++)
     {
-        opa_object_elem_t *elem = obj->buckets[i];
+        opa_value *k = opa_value_get_array_native(p, i);
 
-        while (elem != NULL)
+        opa_value *next = opa_value_get(curr, k);
+
+        if (next == NULL)
         {
-            opa_object_elem_t *next = elem->next;
-            __opa_object_insert_elem(dst, elem, opa_value_hash(elem->k));
-            elem = next;
+            switch (curr->type)
+            {
+                case OPA_OBJECT:
+                    next = opa_object();
+                    opa_object_insert(opa_cast_object(curr), k, next);
+                    break;
+                default:
+                    return OPA_ERR_INVALID_TYPE;
+            }
         }
+
+        curr = next;
     }
 
-    opa_free(obj->buckets);
-    obj->buckets = dst->buckets;
-    obj->n = dst->n;
-    opa_free(dst);
-}
+    opa_value *k = opa_value_get_array_native(p, path_len-1);
 
-OPA_INTERNAL
-void opa_object_insert(opa_object_t *obj, opa_value *k, opa_value *v)
-{
-    size_t hash = opa_value_hash(k);
+    opa_value *old = opa_value_get(curr, k);
 
-    for (opa_object_elem_t *curr = obj->buckets[hash % obj->n]; curr != NULL; curr = curr->next)
+    switch (curr->type)
     {
-        if (opa_value_compare(curr->k, k) == 0)
-        {
-            curr->v = v;
-            return;
-        }
+        case OPA_OBJECT:
+            opa_object_insert(opa_cast_object(curr), k, v);
+            break;
+        default:
+            return OPA_ERR_INVALID_TYPE;
     }
 
-    __opa_object_grow(obj, obj->len+1);
-    __opa_object_insert_elem(obj, __opa_object_elem_alloc(k, v), hash);
+    if (old != NULL)
+    {
+        opa_value_free(old);
+    }
+
+    return OPA_ERR_OK;
 }
 
-static void __opa_object_insert_elem(opa_object_t *obj, opa_object_elem_t *new, size_t hash)
+// For the given `data` object delete the entry specified by `path`.
+// The `path` must be an `opa_array_t` with at least one
+// element.
+//
+// Deleted values will be freed.
+WASM_EXPORT(opa_value_remove_path)
+opa_errc opa_value_remove_path(opa_value *data, opa_value *path)
 {
-    size_t i = hash % obj->n;
-    opa_object_elem_t **prev = &obj->buckets[i];
-    opa_object_elem_t *curr = obj->buckets[i];
+    data_generation++;
 
-    while (1) {
-        if (curr == NULL || opa_value_compare(new->k, curr->k) < 0) {
-            *prev = new;
-            new->next = curr;
-            break;
-        }
+    int path_len = _validate_json_path(path);
 
-        prev = &curr->next;
-        curr = curr->next;
+    if (path_len < 1)
+    {
+        return OPA_ERR_INVALID_PATH;
     }
 
-    obj->len++;
-}
-
-void opa_object_remove(opa_object_t *obj, opa_value *k)
-{
-    size_t hash = opa_value_hash(k);
+    // Follow the path into data
+    opa_array_t *p = opa_cast_array(path);
+    opa_value *curr = data;
 
-    size_t i = hash % obj->n;
-    opa_object_elem_t **prev = &obj->buckets[i];
-    opa_object_elem_t *curr = obj->buckets[i];
-    while (curr != NULL)
+    for (int i = 0; i < path_len-1; i++)
     {
-        if (opa_value_compare(curr->k, k) == 0)
-        {
-            *prev = curr->next;
-            obj->len--;
-
-            opa_value_free(curr->k);
-            opa_value_free(curr->v);
-            opa_free(curr);
+        opa_value *k = opa_value_get_array_native(p, i);
 
-            // TODO: Consider shrinking the object size. For now it will remain
-            // with its current size.
+        opa_value *next = opa_value_get(curr, k);
 
-            return;
+        if (next == NULL)
+        {
+            // We were unable to follow the full
+            // path, consider the target deleted
+            return OPA_ERR_OK;
         }
-        prev = &curr->next;
-        curr = curr->next;
+
+       curr = next;
     }
-    return;  // Key wasn't found, consider it deleted.
+
+    opa_object_remove(opa_cast_object(curr), opa_value_get_array_native(p, path_len-1));
+
+    return OPA_ERR_OK;
 }
 
-opa_object_elem_t *opa_object_get(opa_object_t *obj, opa_value *key)
+// Decodes one JSON Pointer (RFC 6901) reference token in s[0..len) into
+// buf, rewriting the ~0 and ~1 escapes, and returns the decoded length.
+// buf needs at most len bytes.
+static size_t opa_pointer_token(const char *s, size_t len, char *buf)
 {
-    size_t hash = opa_value_hash(key) % obj->n;
+    size_t n = 0;
 
-    for (opa_object_elem_t *curr = obj->buckets[hash]; curr != NULL; curr = curr->next)
+    for (size_t i = 0; i < len; i++)
     {
-        if (opa_value_compare(curr->k, key) == 0)
+        if (s[i] == '~' && i + 1 < len && (s[i+1] == '0' || s[i+1] == '1'))
         {
-            return curr;
+            buf[n++] = s[i+1] == '0' ? '~' : '/';
+            i++;
+        }
+        else
+        {
+            buf[n++] = s[i];
         }
     }
 
-    return NULL;
+    return n;
 }
 
-void __opa_set_buckets_free(opa_set_t *set)
+// the container a JSON Pointer refers into, plus the final token
+typedef struct
 {
-    for (int i = 0; i < set->n; i++)
+    opa_value *parent;
+    opa_value *key;  // string for objects, number for arrays, NULL for "-"
+    int append;      // pointer ended in "-": the array append position
+} opa_patch_loc;
+
+static opa_errc opa_patch_resolve(opa_value *data, opa_string_t *ptr, opa_patch_loc *loc)
+{
+    if (ptr->len == 0 || ptr->v[0] != '/')
+    {
+        // Whole-document pointers cannot be applied in place.
+        return OPA_ERR_INVALID_PATH;
+    }
+
+    opa_value *curr = data;
+    size_t i = 1;
+
+    while (1)
     {
-        opa_set_elem_t *prev = NULL;
+        size_t j = i;
+
+        while (j < ptr->len && ptr->v[j] != '/')
+        {
+            j++;
+        }
 
-        for (opa_set_elem_t *curr = set->buckets[i]; curr != NULL; curr = curr->next)
+        opa_value *key = NULL;
+        int append = 0;
+        char *buf = (char *)opa_malloc(j - i);
+        size_t n = opa_pointer_token(&ptr->v[i], j - i, buf);
+
+        if (opa_value_type(curr) == OPA_ARRAY)
         {
-            if (prev != NULL)
+            if (n == 1 && buf[0] == '-')
             {
-                opa_free(prev);
+                append = 1;
             }
+            else
+            {
+                long long idx;
 
-            prev = curr;
-        }
+                if (n == 0 || opa_atoi64(buf, n, &idx) != 0 || idx < 0)
+                {
+                    opa_free(buf);
+                    return OPA_ERR_INVALID_PATH;
+                }
+
+                key = opa_number_int(idx);
+            }
 
-        if (prev != NULL)
+            opa_free(buf);
+        }
+        else if (opa_value_type(curr) == OPA_OBJECT)
         {
-            opa_free(prev);
+            key = opa_string_allocated(buf, n);
+        }
+        else
+        {
+            opa_free(buf);
+            return OPA_ERR_INVALID_TYPE;
         }
-    }
-
-    opa_free(set->buckets);
-}
 
-void opa_set_free(opa_set_t *set)
-{
-    __opa_set_buckets_free(set);
-    opa_free(set);
-}
+        if (j == ptr->len)
+        {
+            loc->parent = curr;
+            loc->key = key;
+            loc->append = append;
+            return OPA_ERR_OK;
+        }
 
-opa_array_t *__opa_set_values(opa_set_t *set)
-{
-    opa_array_t *values = opa_cast_array(opa_array_with_cap(opa_value_length_set(set)));
+        if (append)
+        {
+            return OPA_ERR_INVALID_PATH;
+        }
 
-    for (int i = 0; i < set->n; i++)
-    {
-        opa_set_elem_t *elem = set->buckets[i];
+        curr = opa_value_get(curr, key);
+        opa_value_free(key);
 
-        while (elem != NULL)
+        if (curr == NULL)
         {
-            opa_array_append(values, elem->v);
-            elem = elem->next;
+            return OPA_ERR_INVALID_PATH;
         }
-    }
 
-    opa_array_sort(values, opa_value_compare);
-    return values;
+        i = j + 1;
+    }
 }
 
-opa_set_elem_t *__opa_set_elem_alloc(opa_value *v)
+// Inserts v at loc, shifting later array elements up. Objects follow
+// opa_value_add_path semantics: a replaced member is freed.
+static opa_errc opa_patch_insert(opa_patch_loc *loc, opa_value *v)
 {
-    opa_set_elem_t *elem = (opa_set_elem_t *)opa_malloc(sizeof(opa_set_elem_t));
-    elem->next = NULL;
-    elem->v = v;
-    return elem;
-}
-
-void __opa_set_grow(opa_set_t *set, size_t n) {
-    if (n <= (set->n * OPA_SET_LOAD_FACTOR))
+    if (opa_value_type(loc->parent) == OPA_ARRAY)
     {
-        return;
-    }
+        opa_array_t *arr = opa_cast_array(loc->parent);
+        size_t i = loc->append ? arr->len : (size_t)opa_cast_number(loc->key)->v.i;
 
-    opa_set_t *dst = opa_cast_set(__opa_set_with_buckets(set->n * 2));
+        if (i > arr->len)
+        {
+            return OPA_ERR_INVALID_PATH;
+        }
 
-    for (int i = 0; i < set->n; i++)
-    {
-        opa_set_elem_t *elem = set->buckets[i];
+        opa_array_append(arr, v);
 
-        while (elem != NULL)
+        for (size_t j = arr->len - 1; j > i; j--)
         {
-            opa_set_elem_t *next = elem->next;
-            __opa_set_add_elem(dst, elem, opa_value_hash(elem->v));
-            elem = next;
+            arr->elems[j].v = arr->elems[j-1].v;
         }
+
+        arr->elems[i].v = v;
+        return OPA_ERR_OK;
     }
 
-    opa_free(set->buckets);
-    set->buckets = dst->buckets;
-    set->n = dst->n;
-    opa_free(dst);
-}
+    opa_value *old = opa_value_get(loc->parent, loc->key);
 
-OPA_INTERNAL
-void opa_set_add(opa_set_t *set, opa_value *v)
-{
-    size_t hash = opa_value_hash(v);
+    opa_object_insert(opa_cast_object(loc->parent), loc->key, v);
 
-    for (opa_set_elem_t *curr = set->buckets[hash % set->n]; curr != NULL; curr = curr->next)
+    if (old != NULL)
     {
-        if (opa_value_compare(curr->v, v) == 0)
-        {
-            return;
-        }
+        opa_value_free(old);
     }
 
-    __opa_set_grow(set, set->len+1);
-    __opa_set_add_elem(set, __opa_set_elem_alloc(v), hash);
+    return OPA_ERR_OK;
 }
 
-static void __opa_set_add_elem(opa_set_t *set, opa_set_elem_t *new, size_t hash)
+// Removes the value at loc, shifting later array elements down. The
+// removed value is freed, or handed to the caller when out is non-NULL.
+static opa_errc opa_patch_detach(opa_patch_loc *loc, opa_value **out)
 {
-    size_t i = hash % set->n;
-    opa_set_elem_t **prev = &set->buckets[i];
-    opa_set_elem_t *curr = set->buckets[i];
+    if (opa_value_type(loc->parent) == OPA_ARRAY)
+    {
+        opa_array_t *arr = opa_cast_array(loc->parent);
 
-    while (1) {
-        if (curr == NULL || opa_value_compare(new->v, curr->v) < 0) {
-            *prev = new;
-            new->next = curr;
-            break;
+        if (loc->append || (size_t)opa_cast_number(loc->key)->v.i >= arr->len)
+        {
+            return OPA_ERR_INVALID_PATH;
         }
 
-        prev = &curr->next;
-        curr = curr->next;
-    }
+        size_t i = (size_t)opa_cast_number(loc->key)->v.i;
+        opa_value *v = arr->elems[i].v;
 
-    set->len++;
-}
+        for (size_t j = i; j + 1 < arr->len; j++)
+        {
+            arr->elems[j].v = arr->elems[j+1].v;
+        }
 
-opa_set_elem_t *opa_set_get(opa_set_t *set, opa_value *v)
-{
-    size_t hash = opa_value_hash(v) % set->n;
+        arr->len--;
 
-    for (opa_set_elem_t *curr = set->buckets[hash]; curr != NULL; curr = curr->next)
-    {
-        if (opa_value_compare(curr->v, v) == 0)
+        if (out != NULL)
         {
-            return curr;
+            *out = v;
+        }
+        else
+        {
+            opa_value_free(v);
         }
-    }
-
-    return NULL;
-}
 
-// Validate that a path is non-null, an array value type,
-// has a length >0, and only contains strings.
-// Returns the size of the path, or -1 for an invalid path
-int _validate_json_path(opa_value *path)
-{
-    if (path == NULL || opa_value_type(path) != OPA_ARRAY)
-    {
-        return -1;
+        return OPA_ERR_OK;
     }
 
-    int path_len = opa_value_length(path);
-    if (path_len == 0)
+    opa_object_t *obj = opa_cast_object(loc->parent);
+    opa_object_elem_t *elem = opa_object_get(obj, loc->key);
+
+    if (elem == NULL)
     {
-        return -1;
+        return OPA_ERR_INVALID_PATH;
     }
 
-    for (int i = 0; i < path_len-1; i++)
+    if (out != NULL)
     {
-        opa_value *v = opa_value_get_array_native(opa_cast_array(path), i);
-        if (opa_value_type(v) != OPA_STRING)
-        {
-            return -1;
-        }
+        // Swap in a placeholder so opa_object_remove frees that instead.
+        *out = elem->v;
+        elem->v = opa_null();
     }
 
-    return path_len;
+    opa_object_remove(obj, loc->key);
+    return OPA_ERR_OK;
 }
 
-// For the given `data` value set the provided value `v` at
-// the specified `path`. Requires objects for containers,
-// any portion of the path that is missing will be created.
-// The `path` must be an `opa_array_t` with at least one
-// element.
+// Applies a JSON Patch (RFC 6902) document to 'data' in place: the patch
+// is parsed once and all operations run in a single pass, without the
+// per-operation call and path parsing overhead of opa_value_add_path.
 //
-// Replaced objects will be freed.
-WASM_EXPORT(opa_value_add_path)
-opa_errc opa_value_add_path(opa_value *data, opa_value *path, opa_value *v)
+// Values added by the patch reference the parsed patch document, and
+// "copy" shares the copied subtree instead of deep-copying it, so a
+// patched document must be discarded by resetting the heap pointer (as
+// SDK-managed data documents are) rather than opa_value_free.
+//
+// A failed operation (including a failed "test") aborts the patch with
+// an error; already applied operations are not rolled back.
+OPA_INTERNAL
+WASM_EXPORT(opa_value_apply_patch)
+opa_errc opa_value_apply_patch(opa_value *data, const char *patch, size_t len)
 {
-    int path_len = _validate_json_path(path);
+    data_generation++;
 
-    if (path_len < 1)
+    opa_value *ops = opa_json_parse(patch, len);
+
+    if (ops == NULL || opa_value_type(ops) != OPA_ARRAY)
     {
-        return OPA_ERR_INVALID_PATH;
+        return OPA_ERR_INVALID_TYPE;
     }
 
-    // Follow the path, creating objects as needed.
-    opa_array_t *p = opa_cast_array(path);
-    opa_value *curr = data;
+    opa_array_t *arr = opa_cast_array(ops);
 
-    for (int i = 0; i < path_len-1; i++)
+    for (size_t i = 0; i < arr->len; i++)
     {
-        opa_value *k = opa_value_get_array_native(p, i);
+        opa_value *op = arr->elems[i].v;
 
-        opa_value *next = opa_value_get(curr, k);
+        if (opa_value_type(op) != OPA_OBJECT)
+        {
+            return OPA_ERR_INVALID_TYPE;
+        }
 
-        if (next == NULL)
+        opa_value *name = opa_value_get(op, opa_string_terminated("op"));
+        opa_value *path = opa_value_get(op, opa_string_terminated("path"));
+
+        if (name == NULL || opa_value_type(name) != OPA_STRING ||
+            path == NULL || opa_value_type(path) != OPA_STRING)
         {
-            switch (curr->type)
+            return OPA_ERR_INVALID_TYPE;
+        }
+
+        opa_string_t *o = opa_cast_string(name);
+        opa_patch_loc loc;
+        opa_errc rc;
+
+        if ((o->len == 3 && opa_strncmp(o->v, "add", 3) == 0) ||
+            (o->len == 7 && opa_strncmp(o->v, "replace", 7) == 0))
+        {
+            opa_value *v = opa_value_get(op, opa_string_terminated("value"));
+
+            if (v == NULL)
             {
-                case OPA_OBJECT:
-                    next = opa_object();
-                    opa_object_insert(opa_cast_object(curr), k, next);
-                    break;
-                default:
-                    return OPA_ERR_INVALID_TYPE;
+                return OPA_ERR_INVALID_TYPE;
+            }
+
+            if ((rc = opa_patch_resolve(data, opa_cast_string(path), &loc)) != OPA_ERR_OK)
+            {
+                return rc;
+            }
+
+            if (o->len == 7) // replace requires the target to exist
+            {
+                if ((rc = opa_patch_detach(&loc, NULL)) != OPA_ERR_OK)
+                {
+                    return rc;
+                }
+            }
+
+            if ((rc = opa_patch_insert(&loc, v)) != OPA_ERR_OK)
+            {
+                return rc;
             }
         }
+        else if (o->len == 6 && opa_strncmp(o->v, "remove", 6) == 0)
+        {
+            if ((rc = opa_patch_resolve(data, opa_cast_string(path), &loc)) != OPA_ERR_OK)
+            {
+                return rc;
+            }
 
-        curr = next;
-    }
+            if ((rc = opa_patch_detach(&loc, NULL)) != OPA_ERR_OK)
+            {
+                return rc;
+            }
+        }
+        else if ((o->len == 4 && opa_strncmp(o->v, "move", 4) == 0) ||
+                 (o->len == 4 && opa_strncmp(o->v, "copy", 4) == 0))
+        {
+            opa_value *from = opa_value_get(op, opa_string_terminated("from"));
 
-    opa_value *k = opa_value_get_array_native(p, path_len-1);
+            if (from == NULL || opa_value_type(from) != OPA_STRING)
+            {
+                return OPA_ERR_INVALID_TYPE;
+            }
 
-    opa_value *old = opa_value_get(curr, k);
+            opa_string_t *f = opa_cast_string(from);
+            opa_string_t *p = opa_cast_string(path);
+            int move = o->v[0] == 'm';
 
-    switch (curr->type)
-    {
-        case OPA_OBJECT:
-            opa_object_insert(opa_cast_object(curr), k, v);
-            break;
-        default:
-            return OPA_ERR_INVALID_TYPE;
-    }
+            // moving a value into one of its own children cannot work
+            if (move && f->len < p->len && opa_strncmp(f->v, p->v, f->len) == 0 &&
+                p->v[f->len] == '/')
+            {
+                return OPA_ERR_INVALID_PATH;
+            }
 
-    if (old != NULL)
-    {
-        opa_value_free(old);
-    }
+            if ((rc = opa_patch_resolve(data, f, &loc)) != OPA_ERR_OK)
+            {
+                return rc;
+            }
 
-    return OPA_ERR_OK;
-}
+            opa_value *v;
 
-// For the given `data` object delete the entry specified by `path`.
-// The `path` must be an `opa_array_t` with at least one
-// element.
-//
-// Deleted values will be freed.
-WASM_EXPORT(opa_value_remove_path)
-opa_errc opa_value_remove_path(opa_value *data, opa_value *path)
-{
-    int path_len = _validate_json_path(path);
+            if (move)
+            {
+                if ((rc = opa_patch_detach(&loc, &v)) != OPA_ERR_OK)
+                {
+                    return rc;
+                }
+            }
+            else
+            {
+                v = loc.append ? NULL : opa_value_get(loc.parent, loc.key);
 
-    if (path_len < 1)
-    {
-        return OPA_ERR_INVALID_PATH;
-    }
+                if (v == NULL)
+                {
+                    return OPA_ERR_INVALID_PATH;
+                }
+            }
 
-    // Follow the path into data
-    opa_array_t *p = opa_cast_array(path);
-    opa_value *curr = data;
+            if ((rc = opa_patch_resolve(data, p, &loc)) != OPA_ERR_OK)
+            {
+                return rc;
+            }
 
-    for (int i = 0; i < path_len-1; i++)
-    {
-        opa_value *k = opa_value_get_array_native(p, i);
+            if ((rc = opa_patch_insert(&loc, v)) != OPA_ERR_OK)
+            {
+                return rc;
+            }
+        }
+        else if (o->len == 4 && opa_strncmp(o->v, "test", 4) == 0)
+        {
+            opa_value *v = opa_value_get(op, opa_string_terminated("value"));
 
-        opa_value *next = opa_value_get(curr, k);
+            if (v == NULL)
+            {
+                return OPA_ERR_INVALID_TYPE;
+            }
 
-        if (next == NULL)
+            if ((rc = opa_patch_resolve(data, opa_cast_string(path), &loc)) != OPA_ERR_OK)
+            {
+                return rc;
+            }
+
+            opa_value *target = loc.append ? NULL : opa_value_get(loc.parent, loc.key);
+
+            if (target == NULL || opa_value_compare(target, v) != 0)
+            {
+                return OPA_ERR_INTERNAL;
+            }
+        }
+        else
         {
-            // We were unable to follow the full
-            // path, consider the target deleted
-            return OPA_ERR_OK;
+            return OPA_ERR_INVALID_TYPE;
         }
-
-       curr = next;
     }
 
-    opa_object_remove(opa_cast_object(curr), opa_value_get_array_native(p, path_len-1));
-
     return OPA_ERR_OK;
 }
 
@@ -1649,7 +4450,7 @@ int opa_lookup(opa_value *mapping, opa_value *path) {
         }
         curr = next;
     }
-    if (curr->type == OPA_NUMBER) {
+    if (opa_value_type(curr) == OPA_NUMBER) {
         long long i;
         if (opa_number_try_int(opa_cast_number(curr), &i) == 0) {
             return i;
@@ -1661,19 +4462,173 @@ int opa_lookup(opa_value *mapping, opa_value *path) {
 // global variable used for storing the parsed mapping JSON
 static opa_value *mapping;
 
+// The mapping is fixed at compile time, so resolving an entrypoint need
+// not walk the parsed object per path segment: opa_mapping_init flattens
+// the tree once into an open-addressed table keyed by a hash combined
+// over the segments, and opa_mapping_lookup is a single probe plus one
+// path comparison. Index 0 marks an empty slot; the generated code
+// already treats a 0 result as "not mapped".
+struct opa_mapping_entry
+{
+    opa_array_t *path; // full segment path of the leaf
+    size_t hash;       // combined segment hash
+    int index;         // function table index; 0 = empty slot
+};
+
+static struct opa_mapping_entry *mapping_table;
+static size_t mapping_table_n; // power of two
+
+static size_t __opa_mapping_hash(opa_array_t *path)
+{
+    size_t hash = 0;
+
+    for (size_t i = 0; i < path->len; i++)
+    {
+        hash = 31 * hash + opa_value_hash(path->elems[i].v);
+    }
+
+    return hash;
+}
+
+static size_t __opa_mapping_leaves(opa_value *node)
+{
+    if (opa_value_type(node) != OPA_OBJECT)
+    {
+        return 1;
+    }
+
+    size_t total = 0;
+    opa_object_t *obj = opa_cast_object(node);
+
+    for (size_t i = 0; i < obj->n; i++)
+    {
+        if (obj->buckets[i] != NULL)
+        {
+            total += __opa_mapping_leaves(obj->buckets[i]->v);
+        }
+    }
+
+    return total;
+}
+
+static void __opa_mapping_insert(opa_array_t *path, int index)
+{
+    size_t hash = __opa_mapping_hash(path);
+    size_t i = hash & (mapping_table_n - 1);
+
+    while (mapping_table[i].index != 0)
+    {
+        i = (i + 1) & (mapping_table_n - 1);
+    }
+
+    mapping_table[i].path = path;
+    mapping_table[i].hash = hash;
+    mapping_table[i].index = index;
+}
+
+// depth-first over the mapping tree; prefix holds the segments leading to
+// node. Recursion depth is the entrypoint path depth, which is small.
+static void __opa_mapping_flatten(opa_value *node, opa_array_t *prefix)
+{
+    opa_object_t *obj = opa_cast_object(node);
+
+    for (size_t i = 0; i < obj->n; i++)
+    {
+        opa_object_elem_t *elem = obj->buckets[i];
+
+        if (elem == NULL)
+        {
+            continue;
+        }
+
+        if (opa_value_type(elem->v) == OPA_OBJECT)
+        {
+            opa_array_append(prefix, elem->k);
+            __opa_mapping_flatten(elem->v, prefix);
+            prefix->len--;
+            continue;
+        }
+
+        long long index;
+
+        if (opa_value_type(elem->v) != OPA_NUMBER ||
+            opa_number_try_int(opa_cast_number(elem->v), &index) != 0 || index == 0)
+        {
+            continue;
+        }
+
+        opa_array_t *path = opa_cast_array(opa_array_with_cap(prefix->len + 1));
+
+        for (size_t j = 0; j < prefix->len; j++)
+        {
+            opa_array_append(path, prefix->elems[j].v);
+        }
+
+        opa_array_append(path, elem->k);
+        __opa_mapping_insert(path, (int)index);
+    }
+}
+
 // Called from the WASM-generated '_initialize' function with the
 // address of the mapping string and its length. Parses the JSON
-// string it expects, sets the *mapping variable accordingly.
+// string it expects, sets the *mapping variable accordingly and builds
+// the flat lookup table from it.
 OPA_INTERNAL
 void opa_mapping_init(const char *s, const int l) {
-    if (mapping == NULL) {
-        mapping = opa_json_parse(s, l);
+    if (mapping != NULL) {
+        return;
+    }
+
+    mapping = opa_json_parse(s, l);
+
+    if (mapping == NULL || opa_value_type(mapping) != OPA_OBJECT)
+    {
+        return;
+    }
+
+    size_t leaves = __opa_mapping_leaves(mapping);
+
+    if (leaves == 0)
+    {
+        return;
     }
+
+    for (mapping_table_n = 8; leaves * 2 > mapping_table_n; mapping_table_n *= 2);
+
+    mapping_table = (struct opa_mapping_entry *)opa_malloc(mapping_table_n * sizeof(struct opa_mapping_entry));
+    memset(mapping_table, 0, mapping_table_n * sizeof(struct opa_mapping_entry));
+
+    opa_array_t *prefix = opa_cast_array(opa_array());
+    __opa_mapping_flatten(mapping, prefix);
+    opa_array_free(prefix);
 }
 
-// Lookup mapped function index from global mapping (initialized by
-// opa_mapping_init).
+// Lookup mapped function index from the table built by opa_mapping_init;
+// falls back to the generic walk when no table was built.
 OPA_INTERNAL
 int opa_mapping_lookup(opa_value *path) {
-    return opa_lookup(mapping, path);
+    if (mapping_table == NULL)
+    {
+        return opa_lookup(mapping, path);
+    }
+
+    if (opa_value_type(path) != OPA_ARRAY)
+    {
+        return 0;
+    }
+
+    opa_array_t *arr = opa_cast_array(path);
+    size_t hash = __opa_mapping_hash(arr);
+
+    for (size_t i = hash & (mapping_table_n - 1); mapping_table[i].index != 0;
+         i = (i + 1) & (mapping_table_n - 1))
+    {
+        if (mapping_table[i].hash == hash &&
+            opa_value_compare(&mapping_table[i].path->hdr, path) == 0)
+        {
+            return mapping_table[i].index;
+        }
+    }
+
+    return 0;
 }
@@ -18,6 +18,10 @@ extern "C" {
 #define OPA_SET (7)
 #define OPA_STRING_INTERNED (8)
 #define OPA_BOOLEAN_INTERNED (9) // TODO(sr): make an "interned" bitmask?
+#define OPA_NUMBER_INTERNED (10)
+#define OPA_NULL_INTERNED (11)
+#define OPA_LAZY (12)
+#define OPA_STRING_ROPE (13)
 
 #define OPA_NUMBER_REPR_INT (1)
 #define OPA_NUMBER_REPR_REF (2)
@@ -27,6 +31,9 @@ typedef struct opa_value opa_value;
 struct opa_value
 {
     unsigned char type;
+    unsigned char frozen; // set by opa_value_freeze: the value is immutable
+                          // until discarded by a heap reset. DEBUG builds
+                          // abort mutators pointed at a frozen value.
 };
 
 typedef struct
@@ -50,45 +57,93 @@ typedef struct
         long long i;
         opa_number_ref_t ref;
     } v;
+    struct mpd_t *bf;      // cached big-decimal conversion, built on first
+                           // arithmetic use; only valid while bf_epoch
+                           // matches opa_heap_epoch()
+    unsigned int bf_epoch;
 } opa_number_t;
 
+typedef struct
+{
+    size_t n;         // rune (code point) count
+    size_t stride;    // runes between checkpoints; 0 when the string is all ASCII
+    size_t offsets[]; // byte offset of runes stride, 2*stride, ...
+} opa_string_rune_index_t;
+
 typedef struct
 {
     opa_value hdr;
     unsigned char free; // if set 'v' is not a reference and should be freed
     size_t len;
     const char *v;
+    size_t hash; // cached hash, computed on first use (0 = not yet computed)
+    opa_string_rune_index_t *runes; // cached rune index, built on first
+                                    // rune-addressed use; only valid while
+                                    // runes_epoch matches opa_heap_epoch()
+    unsigned int runes_epoch;
 } opa_string_t;
 
+// Array elements store no index value: the position is implicit, and
+// iteration synthesizes index numbers on demand from the interned-int
+// table (see opa_number_interned).
 typedef struct
 {
-    opa_value *i;
     opa_value *v;
 } opa_array_elem_t;
 
 typedef struct
 {
     opa_value hdr;
+    unsigned char free; // if set 'elems' is owned and freed with the array;
+                        // unset when they are borrowed, as in slice views of
+                        // frozen arrays and snapshot-restored arrays
     opa_array_elem_t *elems;
     size_t len;
     size_t cap;
 } opa_array_t;
 
+// Object and set tables are open addressed: every bucket holds at most one
+// element and 'next' is always NULL. The field remains so that code walking
+// buckets as (now singleton) chains keeps working.
 typedef struct opa_object_elem_t opa_object_elem_t;
 
 struct opa_object_elem_t
 {
     opa_value *k;
     opa_value *v;
+    size_t hash; // cached opa_value_hash(k)
     opa_object_elem_t *next;
 };
 
+// Small tables live in the inline bucket array so constructing an object or
+// set costs a single allocation; 'buckets' points at it until the table
+// grows past OPA_VALUE_INLINE_BUCKETS and switches to a heap array.
+#define OPA_VALUE_INLINE_BUCKETS (8)
+
 typedef struct
 {
     opa_value hdr;
     opa_object_elem_t **buckets;
     size_t n;
     size_t len;
+    opa_array_t *keys; // memoized sorted keys; NULL until built, owned by the
+                       // object and dropped when a key is added or removed;
+                       // only valid while keys_epoch matches opa_heap_epoch()
+    unsigned int keys_epoch;
+    char *dump;        // memoized opa_json_dump output, built when the object
+                       // is the root of a dump and dropped whenever a key or
+                       // value changes; only valid while dump_epoch matches
+                       // opa_heap_epoch()
+    size_t dump_len;
+    unsigned int dump_epoch;
+    unsigned long long *bloom; // memoized negative-lookup filter: two bits
+                               // per key derived from its cached hash, built
+                               // lazily by lookups on large tables, dropped
+                               // when the key set changes; only valid while
+                               // bloom_epoch matches opa_heap_epoch()
+    size_t bloom_words;        // always a power of two
+    unsigned int bloom_epoch;
+    opa_object_elem_t *inline_buckets[OPA_VALUE_INLINE_BUCKETS];
 } opa_object_t;
 
 typedef struct opa_set_elem_t opa_set_elem_t;
@@ -96,17 +151,62 @@ typedef struct opa_set_elem_t opa_set_elem_t;
 struct opa_set_elem_t
 {
     opa_value *v;
+    size_t hash; // cached opa_value_hash(v)
     opa_set_elem_t *next;
 };
 
+// Sets start out as a sorted vector: 'sorted' is set and buckets[0..len-1]
+// hold the elements densely in opa_value_compare order, looked up by binary
+// search without hashing. Adding a ninth element promotes the set to the
+// hash form. Code that walks buckets skipping NULL entries works on both
+// forms, since the dense prefix is just a bucket array with no holes.
 typedef struct
 {
     opa_value hdr;
     opa_set_elem_t **buckets;
     size_t n;
     size_t len;
+    unsigned char sorted;
+    unsigned long long *bitmap; // memoized dense-int index built by
+                                // opa_set_bitmap when every member is an
+                                // integer in a narrow range; dropped when a
+                                // value is added; only valid while
+                                // bitmap_epoch matches opa_heap_epoch()
+    long long bitmap_base;      // member value of bit 0
+    size_t bitmap_words;        // or OPA_SET_BITMAP_INELIGIBLE
+    unsigned int bitmap_epoch;
+    opa_set_elem_t *inline_buckets[OPA_VALUE_INLINE_BUCKETS];
 } opa_set_t;
 
+// records that a membership scan found the set unsuitable for the bitmap, so
+// lookups do not rescan it until the next mutation.
+#define OPA_SET_BITMAP_INELIGIBLE ((size_t)-1)
+
+// An unparsed subtree: opa_json_parse_lazy stores the raw JSON span of a
+// large object value and opa_value_force parses it on first access, caching
+// the result. The span references the parse input, so the input buffer must
+// stay pinned for as long as the value is in use.
+typedef struct
+{
+    opa_value hdr;
+    const char *v;     // raw JSON span in the lazy parse's input buffer
+    size_t len;
+    opa_value *parsed; // cached materialization; NULL until first access
+} opa_lazy_t;
+
+// A string under construction: the segments array holds the pieces (plain
+// strings, or nested ropes when an accumulator is re-concatenated) and
+// 'str' carries their total byte length with a NULL data pointer. The rope
+// is layout-compatible with opa_string_t, and opa_value_type flattens it in
+// place into a plain OPA_STRING, so any code that classifies a value before
+// casting only ever sees flat strings. Building a string from n fragments
+// this way copies each byte once instead of once per concatenation.
+typedef struct
+{
+    opa_string_t str;      // becomes the flat string in place when flattened
+    opa_array_t *segments; // string and nested rope handles; shared, not owned
+} opa_string_rope_t;
+
 typedef int (*opa_compare_fn)(opa_value *, opa_value *t);
 
 #define opa_cast_boolean(v) container_of(v, opa_boolean_t, hdr)
@@ -115,24 +215,85 @@ typedef int (*opa_compare_fn)(opa_value *, opa_value *t);
 #define opa_cast_array(v) container_of(v, opa_array_t, hdr)
 #define opa_cast_object(v) container_of(v, opa_object_t, hdr)
 #define opa_cast_set(v) container_of(v, opa_set_t, hdr)
+#define opa_cast_lazy(v) container_of(v, opa_lazy_t, hdr)
+#define opa_cast_string_rope(v) container_of(v, opa_string_rope_t, str.hdr)
 
 int opa_value_type(opa_value *node);
 int opa_value_compare(opa_value *a, opa_value *b);
+int opa_value_compare_string(opa_string_t *a, opa_string_t *b);
+bool opa_value_eq(opa_value *a, opa_value *b);
 size_t opa_value_hash(opa_value *node);
+
+// 128-bit structural digest: equal values always digest equally, so
+// differing digests prove two values unequal without walking them.
+// Digests of frozen containers are cached (valid until the next heap
+// reset), which makes repeated deep-equality checks between large frozen
+// documents O(1) after the first walk. opa_value_eq uses them
+// automatically.
+typedef struct
+{
+    unsigned long long lo;
+    unsigned long long hi;
+} opa_value_digest_t;
+
+void opa_value_digest(opa_value *v, opa_value_digest_t *d);
 opa_value *opa_value_get(opa_value *node, opa_value *key);
+
+// Per-call-site inline cache for opa_value_get. The compiler reserves one
+// zero-initialized slot per hot lookup site; a hit is a pointer and epoch
+// check plus a direct bucket load. Only frozen objects are cached — they
+// cannot rebucket — and the epoch invalidates the slot across heap resets.
+typedef struct
+{
+    opa_value *node;    // object last probed from this site
+    opa_value *key;     // key handle it was probed with
+    size_t i;           // bucket slot that held the key
+    unsigned int epoch; // heap epoch the pointers belong to
+} opa_value_ic_t;
+
+opa_value *opa_value_get_cached(opa_value *node, opa_value *key, opa_value_ic_t *ic);
+opa_value *opa_value_get_path(opa_value *node, opa_value **keys, size_t *hashes, size_t n);
+// Materializes an OPA_LAZY subtree (parsing its span on the first call and
+// caching the result); anything else passes through unchanged.
+opa_value *opa_value_force(opa_value *node);
 opa_value *opa_value_iter(opa_value *node, opa_value *prev);
+
+// Cursor-based iteration. Unlike opa_value_iter, which locates the previous
+// element by hashing it on every step, a cursor remembers its position.
+typedef struct
+{
+    opa_value *node; // container being iterated
+    size_t i;        // resume position: array index or bucket slot
+    opa_value *v;    // value at the key last returned
+} opa_value_cursor_t;
+
+opa_value_cursor_t *opa_value_cursor(opa_value *node);
+opa_value *opa_value_cursor_next(opa_value_cursor_t *cur);
+opa_value *opa_value_cursor_value(opa_value_cursor_t *cur);
 size_t opa_value_length(opa_value *node);
 void opa_value_free(opa_value *node);
+void opa_value_free_deep(opa_value *node);
 opa_value *opa_value_merge(opa_value *a, opa_value *b);
+// Collapses structurally identical subtrees to shared instances. The result
+// is a DAG: read-only, never free_deep, discard by resetting the heap.
+opa_value *opa_value_dedup(opa_value *node);
+// Marks a loaded tree immutable until discarded by a heap reset; DEBUG
+// builds abort mutators pointed at a frozen value.
+void opa_value_freeze(opa_value *v);
+bool opa_value_frozen(opa_value *v);
 opa_value *opa_value_shallow_copy(opa_value *node);
 opa_value *opa_value_transitive_closure(opa_value *node);
+unsigned int opa_value_data_generation(void); // bumped by the path mutators below
 opa_errc opa_value_add_path(opa_value *data, opa_value *path, opa_value *v);
 opa_errc opa_value_remove_path(opa_value *data, opa_value *path);
+opa_errc opa_value_apply_patch(opa_value *data, const char *patch, size_t len);
 
 opa_value *opa_null();
 opa_value *opa_boolean(bool v);
 opa_value *opa_number_size(size_t v);
 opa_value *opa_number_int(long long v);
+opa_value *opa_number_interned(long long v);
+void opa_value_intern_init(void);
 opa_value *opa_number_float(double v);
 opa_value *opa_number_ref(const char *s, size_t len);
 opa_value *opa_number_ref_allocated(const char *s, size_t len);
@@ -140,10 +301,28 @@ void opa_number_init_int(opa_number_t *n, long long v);
 opa_value *opa_string(const char *v, size_t len);
 opa_value *opa_string_terminated(const char *v);
 opa_value *opa_string_allocated(const char *v, size_t len);
+// Strings longer than this are not worth deduplicating: they are unlikely to
+// repeat and would bloat the intern table's probe chains.
+#define OPA_STRING_INTERN_MAX_LEN (64)
+
+opa_value *opa_string_intern(const char *v, size_t len); // NULL if not internable
+opa_value *opa_lazy(const char *v, size_t len);
+opa_value *opa_string_rope(opa_array_t *segments, size_t len);
 opa_value *opa_array();
 opa_value *opa_array_with_cap(size_t cap);
+
+// Site-keyed constructors for compiler-assigned construction sites: the
+// capacity is seeded from a persistent per-site profile of the sizes
+// earlier containers from the same site actually reached, so steady-state
+// evals skip the growth reallocations. Sites without a profile yet behave
+// like the plain constructors.
+opa_value *opa_array_site(int32_t site);
+opa_value *opa_object_site(int32_t site);
+opa_value *opa_set_site(int32_t site);
 opa_value *opa_array_with_elems(opa_array_elem_t *elems, size_t len, size_t cap);
+opa_value *opa_array_view(opa_array_t *arr, size_t start, size_t len);
 opa_value *opa_object();
+opa_value *opa_object_with_cap(size_t cap);
 opa_value *opa_set();
 opa_value *opa_set_with_cap(size_t cap);
 
@@ -162,12 +341,17 @@ void opa_array_sort(opa_array_t *arr, opa_compare_fn cmp_fn);
 void opa_object_free(opa_object_t *obj);
 opa_array_t *opa_object_keys(opa_object_t *obj);
 void opa_object_insert(opa_object_t *obj, opa_value *k, opa_value *v);
+void opa_object_insert_bulk(opa_object_t *obj, opa_value **ks, opa_value **vs, size_t n);
 void opa_object_remove(opa_object_t *obj, opa_value *k);
+void opa_object_remove_keep(opa_object_t *obj, opa_value *k);
+void opa_object_compact(opa_value *v);
 opa_object_elem_t *opa_object_get(opa_object_t *obj, opa_value *key);
 
 void opa_set_free(opa_set_t *set);
 void opa_set_add(opa_set_t *set, opa_value *v);
+void opa_set_add_bulk(opa_set_t *set, opa_value **vs, size_t n);
 opa_set_elem_t *opa_set_get(opa_set_t *set, opa_value *v);
+unsigned long long *opa_set_bitmap(opa_set_t *set, long long *base, size_t *words);
 
 int opa_lookup(opa_value *mapping, opa_value *path);
 int opa_mapping_lookup(opa_value *path);
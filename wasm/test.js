@@ -78,6 +78,10 @@ async function test(executable) {
                 let key = func + '/' + note
                 report(true, undefined, key);
             },
+            // benchmark imports (bench.c is linked into the test module;
+            // run the benchmarks with bench.js)
+            opa_clock: () => { return 0n; },
+            opa_bench_report: (name, iterations, ns) => { },
             opa_test_fail: (note, func, file, line) => {
                 note = addr2string(note);
                 func = addr2string(func);
@@ -0,0 +1,269 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "json.h"
+#include "malloc.h"
+#include "std.h"
+#include "str.h"
+#include "strings.h"
+#include "value.h"
+
+// Microbenchmarks. Each bench_* export times one operation with the
+// wall clock the host provides and reports through opa_bench_report, so
+// the driver (bench.js) can emit machine-readable results. Iteration
+// counts auto-scale until a run is long enough to measure; the heap is
+// reset between runs so repeated runs see the same allocator state.
+
+unsigned long long opa_clock(void) __attribute__((import_name("opa_clock")));
+void opa_bench_report(const char *name, unsigned int iterations, unsigned long long ns) __attribute__((import_name("opa_bench_report")));
+
+#define BENCH_MIN_NS (50000000ULL) // run each measurement for at least 50ms
+#define BENCH_MAX_ITERATIONS (1U << 24)
+
+static void bench(const char *name, void (*fn)(unsigned int))
+{
+    // the mark below is only valid once the allocator has initialized
+    // itself, which happens on the first allocation.
+    opa_free(opa_malloc(0));
+
+    unsigned int heap = opa_heap_ptr_get();
+    unsigned int n = 1;
+
+    for (;;)
+    {
+        opa_heap_ptr_set(heap);
+
+        unsigned long long start = opa_clock();
+        fn(n);
+        unsigned long long elapsed = opa_clock() - start;
+
+        if (elapsed >= BENCH_MIN_NS || n >= BENCH_MAX_ITERATIONS)
+        {
+            opa_heap_ptr_set(heap);
+            opa_bench_report(name, n, elapsed);
+            return;
+        }
+
+        n *= 2;
+    }
+}
+
+// representative input document: the nesting, key counts and value mix of
+// a typical authorization request.
+static const char *bench_doc =
+    "{\"input\":{\"method\":\"POST\",\"path\":[\"api\",\"v1\",\"products\",\"widgets\"],"
+    "\"user\":{\"name\":\"alice\",\"roles\":[\"developer\",\"ops\"],\"id\":17,"
+    "\"attributes\":{\"region\":\"us-east-1\",\"clearance\":3,\"active\":true}},"
+    "\"headers\":{\"content-type\":\"application/json\",\"x-request-id\":"
+    "\"7f6c8a2e-0b1d-4c5f-9e8a-2d3b4c5d6e7f\"},\"payload\":{\"quantity\":42,"
+    "\"tags\":[\"internal\",\"beta\",\"priority\"],\"note\":\"routine restock \\u00e9\"}}}";
+
+static void bench_json_parse_fn(unsigned int n)
+{
+    size_t len = opa_strlen(bench_doc);
+
+    for (unsigned int i = 0; i < n; i++)
+    {
+        opa_json_parse(bench_doc, len);
+    }
+}
+
+WASM_EXPORT(bench_json_parse)
+void bench_json_parse(void)
+{
+    bench("json_parse", bench_json_parse_fn);
+}
+
+static opa_value *bench_value;
+
+static void bench_json_dump_fn(unsigned int n)
+{
+    for (unsigned int i = 0; i < n; i++)
+    {
+        opa_json_dump(bench_value);
+    }
+}
+
+WASM_EXPORT(bench_json_dump)
+void bench_json_dump(void)
+{
+    bench_value = opa_json_parse(bench_doc, opa_strlen(bench_doc));
+    bench("json_dump", bench_json_dump_fn);
+}
+
+// object scaling: insertion and lookup at several sizes to expose
+// super-linear behavior in the table growth or collision handling.
+
+static unsigned int bench_object_size;
+
+static void bench_object_insert_fn(unsigned int n)
+{
+    for (unsigned int i = 0; i < n; i++)
+    {
+        opa_object_t *obj = opa_cast_object(opa_object());
+
+        for (unsigned int k = 0; k < bench_object_size; k++)
+        {
+            opa_object_insert(obj, opa_number_int(k), opa_number_int(k));
+        }
+    }
+}
+
+static void bench_object_insert(const char *name, unsigned int size)
+{
+    bench_object_size = size;
+    bench(name, bench_object_insert_fn);
+}
+
+WASM_EXPORT(bench_object_insert_16)
+void bench_object_insert_16(void)
+{
+    bench_object_insert("object_insert/16", 16);
+}
+
+WASM_EXPORT(bench_object_insert_256)
+void bench_object_insert_256(void)
+{
+    bench_object_insert("object_insert/256", 256);
+}
+
+WASM_EXPORT(bench_object_insert_4096)
+void bench_object_insert_4096(void)
+{
+    bench_object_insert("object_insert/4096", 4096);
+}
+
+// keys are built during setup so the timed loop measures the lookup, not
+// key allocation.
+static opa_value **bench_keys;
+
+static void bench_value_get_fn(unsigned int n)
+{
+    for (unsigned int i = 0; i < n; i++)
+    {
+        opa_value_get(bench_value, bench_keys[i % bench_object_size]);
+    }
+}
+
+static void bench_value_get(const char *name, unsigned int size)
+{
+    opa_object_t *obj = opa_cast_object(opa_object());
+    bench_keys = (opa_value **)opa_malloc(sizeof(opa_value *) * size);
+
+    for (unsigned int k = 0; k < size; k++)
+    {
+        bench_keys[k] = opa_number_int(k);
+        opa_object_insert(obj, bench_keys[k], opa_number_int(k));
+    }
+
+    bench_value = &obj->hdr;
+    bench_object_size = size;
+    bench(name, bench_value_get_fn);
+}
+
+WASM_EXPORT(bench_value_get_16)
+void bench_value_get_16(void)
+{
+    bench_value_get("value_get/16", 16);
+}
+
+WASM_EXPORT(bench_value_get_4096)
+void bench_value_get_4096(void)
+{
+    bench_value_get("value_get/4096", 4096);
+}
+
+// deep comparison: two structurally equal values so the walk cannot take
+// an early exit.
+
+static opa_value *bench_deep(int depth)
+{
+    if (depth == 0)
+    {
+        return opa_string_terminated("leaf");
+    }
+
+    opa_object_t *obj = opa_cast_object(opa_object());
+    opa_array_t *arr = opa_cast_array(opa_array());
+
+    for (int i = 0; i < 4; i++)
+    {
+        opa_array_append(arr, bench_deep(depth - 1));
+    }
+
+    opa_object_insert(obj, opa_string_terminated("children"), &arr->hdr);
+    opa_object_insert(obj, opa_string_terminated("depth"), opa_number_int(depth));
+    return &obj->hdr;
+}
+
+static opa_value *bench_value_b;
+
+static void bench_value_compare_fn(unsigned int n)
+{
+    for (unsigned int i = 0; i < n; i++)
+    {
+        opa_value_compare(bench_value, bench_value_b);
+    }
+}
+
+WASM_EXPORT(bench_value_compare)
+void bench_value_compare(void)
+{
+    bench_value = bench_deep(5);
+    bench_value_b = bench_deep(5);
+    bench("value_compare", bench_value_compare_fn);
+}
+
+// string builtins on operands sized like real policy data.
+
+static void bench_strings_split_fn(unsigned int n)
+{
+    opa_value *s = opa_string_terminated("api/v1/products/widgets/17/reviews/recent/page/3");
+    opa_value *d = opa_string_terminated("/");
+
+    for (unsigned int i = 0; i < n; i++)
+    {
+        opa_strings_split(s, d);
+    }
+}
+
+WASM_EXPORT(bench_strings_split)
+void bench_strings_split(void)
+{
+    bench("strings_split", bench_strings_split_fn);
+}
+
+static void bench_strings_replace_fn(unsigned int n)
+{
+    opa_value *s = opa_string_terminated("the quick brown fox jumps over the lazy dog and the sleeping cat");
+    opa_value *old = opa_string_terminated("the");
+    opa_value *new = opa_string_terminated("THE");
+
+    for (unsigned int i = 0; i < n; i++)
+    {
+        opa_strings_replace(s, old, new);
+    }
+}
+
+WASM_EXPORT(bench_strings_replace)
+void bench_strings_replace(void)
+{
+    bench("strings_replace", bench_strings_replace_fn);
+}
+
+static void bench_strings_contains_fn(unsigned int n)
+{
+    opa_value *s = opa_string_terminated("7f6c8a2e-0b1d-4c5f-9e8a-2d3b4c5d6e7f");
+    opa_value *sub = opa_string_terminated("4c5d");
+
+    for (unsigned int i = 0; i < n; i++)
+    {
+        opa_strings_contains(s, sub);
+    }
+}
+
+WASM_EXPORT(bench_strings_contains)
+void bench_strings_contains(void)
+{
+    bench("strings_contains", bench_strings_contains_fn);
+}
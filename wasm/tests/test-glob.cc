@@ -1,3 +1,4 @@
+#include "glob.h"
 #include "glob-compiler.h"
 #include "glob-lexer.h"
 #include "glob-parser.h"
@@ -257,3 +258,34 @@ void test_glob_translate()
     TEST("glob/translate", "api.**.com", "^api\\..*\\.com$", ".", ","); // and "," does not matter here
 #undef TEST
 }
+
+WASM_EXPORT(test_glob_match)
+extern "C"
+void test_glob_match()
+{
+    opa_value *empty = opa_array();
+
+#define TEST(test_case, pattern, match, expected) {                     \
+        opa_value *result = opa_glob_match(opa_string_terminated(pattern), \
+                                           empty, opa_string_terminated(match)); \
+        test(test_case, opa_value_compare(result, opa_boolean(expected)) == 0); \
+    }
+
+    // flat patterns take the direct matcher
+    TEST("glob/match", "abc", "abc", true);
+    TEST("glob/match", "abc*", "abcdef", true);
+    TEST("glob/match", "abc*", "abc.def", false);
+    TEST("glob/match", "api.**.com", "api.a.b.com", true);
+    TEST("glob/match", "a?c", "aXc", true);
+    TEST("glob/match", "a?c", "a.c", false);
+
+    // ranges and alternates still go through the regex engine
+    TEST("glob/match", "[a-z]*", "hello", true);
+    TEST("glob/match", "{https://*.google.*,*yandex.*}", "https://mail.google.com", true);
+#undef TEST
+
+    opa_value *delims = opa_array();
+    opa_array_append(opa_cast_array(delims), opa_string_terminated("/"));
+    test("glob/match", opa_value_compare(opa_glob_match(opa_string_terminated("a/*/c"), delims, opa_string_terminated("a/b/c")), opa_boolean(true)) == 0);
+    test("glob/match", opa_value_compare(opa_glob_match(opa_string_terminated("a/*/c"), delims, opa_string_terminated("a/b/b/c")), opa_boolean(false)) == 0);
+}
@@ -5,10 +5,14 @@
 #include "array.h"
 #include "bits-builtins.h"
 #include "cidr.h"
+#include "comparisons.h"
+#include "context.h"
 #include "conversions.h"
 #include "encoding.h"
+#include "error.h"
 #include "glob.h"
 #include "graphs.h"
+#include "cbor.h"
 #include "json.h"
 #include "malloc.h"
 #include "memoize.h"
@@ -16,11 +20,14 @@
 #include "numbers.h"
 #include "object.h"
 #include "regex.h"
+#include "result.h"
 #include "set.h"
+#include "snapshot.h"
 #include "str.h"
 #include "strings.h"
 #include "test.h"
 #include "types.h"
+#include "unicode.h"
 
 // NOTE(sr): we've removed the float number representation, so this helper
 // is to make our tests less annoying:
@@ -55,14 +62,109 @@ void test_opa_malloc(void)
     }
 }
 
+static int cache_torn_down = 0;
+static void cache_teardown(void *p) { cache_torn_down++; }
+
+WASM_EXPORT(test_opa_builtin_cache_registry)
+void test_opa_builtin_cache_registry(void)
+{
+    reset_heap();
+
+    size_t a = opa_builtin_cache_register(NULL);
+    size_t b = opa_builtin_cache_register(cache_teardown);
+    test("registry/distinct slots", a != b);
+    test("registry/slots start empty", opa_builtin_cache_get(a) == NULL && opa_builtin_cache_get(b) == NULL);
+
+    opa_builtin_cache_set(a, opa_malloc(16));
+    opa_builtin_cache_set(b, opa_malloc(16));
+    test("registry/set", opa_builtin_cache_get(a) != NULL);
+
+    // a heap reset clears the values, running teardown hooks, but keeps
+    // the registrations
+    reset_heap();
+    test("registry/reset clears values", opa_builtin_cache_get(a) == NULL && opa_builtin_cache_get(b) == NULL);
+    test("registry/teardown ran", cache_torn_down == 1);
+    test("registry/registration persists", opa_builtin_cache_register(NULL) > b);
+}
+
+WASM_EXPORT(test_opa_malloc_bump_arena)
+void test_opa_malloc_bump_arena(void)
+{
+    reset_heap();
+
+    unsigned int base = opa_heap_ptr_get();
+
+    opa_heap_bump_set(true);
+
+    void *p = opa_malloc(128);
+    test("arena allocation", p != NULL);
+
+    opa_free(p);
+    test("arena free is a no-op", opa_heap_free_blocks() == 0);
+
+    void *q = opa_malloc(128);
+    test("arena allocations bump the heap pointer", q > p);
+
+    opa_heap_bump_set(false);
+
+    // Releasing the arena is a heap pointer reset.
+    opa_heap_ptr_set(base);
+    test("arena released", opa_heap_ptr_get() == base);
+}
+
+WASM_EXPORT(test_opa_scratch)
+void test_opa_scratch(void)
+{
+    char *a = (char *)opa_scratch_alloc(10);
+    char *b = (char *)opa_scratch_alloc(24);
+    test("scratch allocations are 8-aligned bumps",
+         ((uintptr_t)a % 8) == 0 && b == a + 16);
+
+    opa_scratch_reset();
+    test("reset reuses the chunk", (char *)opa_scratch_alloc(8) == a);
+    opa_scratch_reset();
+
+    // oversized requests spill to their own chunk; both stay valid until
+    // the reset
+    char *big = (char *)opa_scratch_alloc(100 * 1024);
+    big[100 * 1024 - 1] = 1;
+    test("spill chunk", big != NULL && opa_scratch_alloc(64) != NULL);
+    opa_scratch_reset();
+
+    // a cutset with non-ASCII code points builds its rune array on the
+    // scratch stack
+    opa_value *trimmed = opa_strings_trim(opa_string_terminated("\xc3\xa9hi\xc3\xa9"),
+                                          opa_string_terminated("\xc3\xa9"));
+    test("trim through scratch cutset",
+         trimmed != NULL && opa_value_compare(trimmed, opa_string_terminated("hi")) == 0);
+}
+
+WASM_EXPORT(test_opa_malloc_node_pool)
+void test_opa_malloc_node_pool(void)
+{
+    reset_heap();
+
+    void *a = opa_malloc_node(12);
+    void *b = opa_malloc_node(12);
+    test("pool allocations", a != NULL && b != NULL && a != b);
+
+    opa_free_node(a, 12);
+    test("pooled nodes are not heap blocks", opa_heap_free_blocks() == 0);
+
+    void *c = opa_malloc_node(12);
+    test("freed node is reused", c == a);
+
+    opa_free_node(b, 12);
+    opa_free_node(c, 12);
+}
+
 WASM_EXPORT(test_opa_malloc_min_size)
 void test_opa_malloc_min_size(void)
 {
     reset_heap();
 
-    // Ensure that allocations less than the minimum size
-    // are creating blocks large enough to be re-used by
-    // the minimum size.
+    // Ensure that allocations less than the minimum size are served from the
+    // same size class, so freed ones are re-used by minimum sized requests.
     void *too_small = opa_malloc(2);
     test("allocated min block", too_small != NULL);
 
@@ -70,10 +172,11 @@ void test_opa_malloc_min_size(void)
 
     opa_free(too_small);
 
-    test("new free block", opa_heap_free_blocks() == 1);
+    // Class allocations are header-less slab nodes, not heap blocks.
+    test("no heap free blocks", opa_heap_free_blocks() == 0);
 
     void *min_sized = opa_malloc(4);
-    test("reused block", opa_heap_free_blocks() == 0);
+    test("reused node", min_sized == too_small);
     opa_free(min_sized);
     opa_free(barrier);
 }
@@ -140,12 +243,29 @@ void test_opa_free(void)
 {
     reset_heap();
 
+    // check that fixed class allocations are freed onto the class freelist
+    // and re-used LIFO, without creating heap free blocks.
 
-    // check the heap shrinks with a single malloc and free.
+    void *p1 = opa_malloc(0);
+    void *p2 = opa_malloc(0);
+    test("free blocks", opa_heap_free_blocks() == 0);
+
+    opa_free(p1);
+    test("free blocks", opa_heap_free_blocks() == 0);
+
+    opa_free(p2);
+
+    void *p3 = opa_malloc(1);
+    void *p4 = opa_malloc(1);
+    test("nodes reused", p3 == p2 && p4 == p1);
+    opa_free(p3);
+    opa_free(p4);
+
+    // check the heap shrinks with a single varying-size malloc and free.
 
     size_t blocks = opa_heap_free_blocks();
     unsigned int base = opa_heap_ptr_get();
-    opa_free(opa_malloc(0));
+    opa_free(opa_malloc(128));
 
     test("heap ptr", base == opa_heap_ptr_get());
     test("free blocks", blocks == 0 && opa_heap_free_blocks() == 0);
@@ -153,8 +273,8 @@ void test_opa_free(void)
     // check the double malloc, followed with frees in identical order
     // results in eventual heap shrinking.
 
-    void *p1 = opa_malloc(0);
-    void *p2 = opa_malloc(0);
+    p1 = opa_malloc(128);
+    p2 = opa_malloc(128);
     unsigned int high = opa_heap_ptr_get();
     test("free blocks", opa_heap_free_blocks() == 0);
 
@@ -169,8 +289,8 @@ void test_opa_free(void)
     // check the double malloc, followed with frees in reverse order
     // results in gradual heap shrinking.
 
-    p1 = opa_malloc(0);
-    p2 = opa_malloc(0);
+    p1 = opa_malloc(128);
+    p2 = opa_malloc(128);
     high = opa_heap_ptr_get();
     test("free blocks", opa_heap_free_blocks() == 0);
 
@@ -182,24 +302,6 @@ void test_opa_free(void)
     test("free blocks", opa_heap_free_blocks() == 0);
     test("heap ptr", base == opa_heap_ptr_get());
 
-    // check the free re-use (without splitting).
-
-    p1 = opa_malloc(1);
-    p2 = opa_malloc(1);
-    high = opa_heap_ptr_get();
-
-    opa_free(p1);
-    test("free blocks", opa_heap_free_blocks() == 1);
-
-    p1 = opa_malloc(1);
-    test("free blocks", opa_heap_free_blocks() == 0);
-    test("heap ptr", high == opa_heap_ptr_get());
-
-    opa_free(p2);
-    opa_free(p1);
-    test("free blocks", opa_heap_free_blocks() == 0);
-    test("heap ptr", base == opa_heap_ptr_get());
-
     // check the free re-use (with splitting).
 
     p1 = opa_malloc(512);
@@ -221,10 +323,283 @@ void test_opa_free(void)
     test("heap ptr", base == opa_heap_ptr_get());
 }
 
+WASM_EXPORT(test_opa_heap_save_restore)
+void test_opa_heap_save_restore(void)
+{
+    reset_heap();
+
+    // free-list state below the mark survives a restore.
+
+    void *a = opa_malloc(128);
+    void *b = opa_malloc(128);
+    opa_free(a);
+    test("free block below mark", opa_heap_free_blocks() == 1);
+
+    unsigned int token = opa_heap_save();
+
+    void *scratch = opa_malloc(300);
+    void *node = opa_malloc(16);
+    opa_free(scratch);
+
+    opa_heap_restore(token);
+
+    test("heap ptr popped", opa_heap_ptr_get() == token);
+    test("free list below mark preserved", opa_heap_free_blocks() == 1);
+
+    void *c = opa_malloc(128);
+    test("free block below mark reused", c == a);
+
+    opa_free(c);
+    opa_free(b);
+}
+
+WASM_EXPORT(test_opa_heap_stats)
+void test_opa_heap_stats(void)
+{
+    reset_heap();
+
+    unsigned int allocs = opa_heap_alloc_count_get();
+    unsigned int frees = opa_heap_free_count_get();
+    unsigned int bytes = opa_heap_alloc_bytes_get();
+
+    void *p = opa_malloc(256);
+    test("alloc count", opa_heap_alloc_count_get() == allocs + 1);
+    test("alloc bytes", opa_heap_alloc_bytes_get() == bytes + 256);
+    test("high water", opa_heap_high_water_get() == opa_heap_ptr_get());
+
+    opa_free(p);
+    test("free count", opa_heap_free_count_get() == frees + 1);
+    test("alloc bytes returned", opa_heap_alloc_bytes_get() == bytes);
+
+    // the high-water mark is rearmed by a heap pointer reset.
+    unsigned int high = opa_heap_high_water_get();
+    opa_heap_ptr_set(opa_heap_ptr_get());
+    test("high water rearmed", opa_heap_high_water_get() <= high);
+}
+
+// Allocation budgets: a heap-statistics snapshot around a builtin call
+// guards against silent allocation regressions — an extra copy in a hot
+// builtin fails its budget here long before it shows up in a profile.
+// Budgets are gross allocation counts and net retained bytes, set with
+// headroom over the observed cost so routine changes don't trip them;
+// tighten a budget when its builtin gets cheaper. Callers must warm the
+// builtin first so one-time work (interning, cache fills, pool chunks)
+// stays out of the measurement.
+
+static unsigned int budget_alloc_count;
+static size_t budget_alloc_bytes;
+
+static void alloc_budget_begin(void)
+{
+    budget_alloc_count = opa_heap_alloc_count_get();
+    budget_alloc_bytes = opa_heap_alloc_bytes_get();
+}
+
+static void alloc_budget_check(const char *note, unsigned int max_allocs, size_t max_bytes)
+{
+    unsigned int allocs = opa_heap_alloc_count_get() - budget_alloc_count;
+    size_t bytes = opa_heap_alloc_bytes_get() - budget_alloc_bytes;
+    test(note, allocs <= max_allocs && bytes <= max_bytes);
+}
+
+WASM_EXPORT(test_alloc_budgets)
+void test_alloc_budgets(void)
+{
+    reset_heap();
+
+    opa_value *str = opa_string_terminated("a,b,c,d");
+    opa_value *delim = opa_string_terminated(",");
+    opa_strings_split(str, delim);
+
+    alloc_budget_begin();
+    opa_strings_split(str, delim);
+    alloc_budget_check("budget/split", 12, 1024);
+
+    opa_value *doc = opa_string_terminated("{\"a\": [1, 2, 3]}");
+    opa_json_unmarshal(doc);
+
+    // a memo hit returns the cached value: no allocation at all.
+    alloc_budget_begin();
+    opa_json_unmarshal(doc);
+    alloc_budget_check("budget/unmarshal memoized", 0, 0);
+
+    opa_value *arr = opa_array_with_cap(8);
+    for (int i = 0; i < 8; i++)
+    {
+        opa_array_append(opa_cast_array(arr), opa_number_int(i));
+    }
+    opa_value_freeze(arr);
+    opa_value *two = opa_number_int(2);
+    opa_value *six = opa_number_int(6);
+    opa_array_slice(arr, two, six);
+
+    // a frozen slice is a borrowed view: one header, no element copies.
+    alloc_budget_begin();
+    opa_array_slice(arr, two, six);
+    alloc_budget_check("budget/slice frozen", 2, 128);
+
+    opa_value *x = opa_string_terminated("OPA rules");
+    opa_value *y = opa_string_terminated("opa RULES");
+    opa_strings_equal_fold(x, y);
+
+    alloc_budget_begin();
+    opa_strings_equal_fold(x, y);
+    alloc_budget_check("budget/equal_fold", 0, 0);
+
+    opa_value *pairs = opa_object();
+    opa_object_insert(opa_cast_object(pairs), opa_string_terminated("b"), opa_string_terminated("x"));
+    opa_value *subject = opa_string_terminated("abcabc");
+    opa_strings_replace_n(pairs, subject);
+
+    alloc_budget_begin();
+    opa_strings_replace_n(pairs, subject);
+    alloc_budget_check("budget/replace_n warm", 4, 256);
+
+    opa_value *b64 = opa_string_terminated("aGVsbG8gd29ybGQ=");
+    opa_base64_decode(b64);
+
+    alloc_budget_begin();
+    opa_base64_decode(b64);
+    alloc_budget_check("budget/base64 decode", 2, 128);
+}
+
+WASM_EXPORT(test_opa_value_free_deep)
+void test_opa_value_free_deep(void)
+{
+    reset_heap();
+
+    // warm up the element node pool: the first object allocation carves a
+    // pool chunk that stays behind for reuse and would skew the baseline.
+    char warm[] = "{\"w\": 1}";
+    opa_value_free_deep(opa_json_parse(warm, sizeof(warm)-1));
+
+    unsigned int bytes = opa_heap_alloc_bytes_get();
+
+    char doc[] = "{\"a\": [1, 2000, {\"b\": \"xyz\"}], \"c\": {\"d\": [true, null]}}";
+    opa_value *v = opa_json_parse(doc, sizeof(doc)-1);
+    test("allocated", opa_heap_alloc_bytes_get() > bytes);
+
+    opa_value_free_deep(v);
+    test("all bytes returned", opa_heap_alloc_bytes_get() == bytes);
+
+    // a deeply nested document must not exhaust the stack.
+    opa_value *deep = opa_number_interned(0);
+
+    for (int i = 0; i < 10000; i++)
+    {
+        opa_value *arr = opa_array();
+        opa_array_append(opa_cast_array(arr), deep);
+        deep = arr;
+    }
+
+    opa_value_free_deep(deep);
+}
+
+WASM_EXPORT(test_opa_initialize)
+void test_opa_initialize(void)
+{
+    opa_initialize();
+    test("allocator initialized", opa_heap_ptr_get() != 0);
+
+    // a second call finds everything already warmed: the only allocation
+    // is the zero-byte probe, which returns to the free list it came from.
+    unsigned int ptr = opa_heap_ptr_get();
+    opa_initialize();
+    test("idempotent", opa_heap_ptr_get() == ptr);
+}
+
+WASM_EXPORT(test_opa_heap_fuel)
+void test_opa_heap_fuel(void)
+{
+    reset_heap();
+
+    opa_heap_fuel_set(1024);
+    test("fuel armed", opa_heap_fuel_get() == 1024);
+
+    void *p = opa_malloc(256);
+    test("fuel charged", opa_heap_fuel_get() == 1024 - 256);
+
+    // freeing does not refund fuel: the budget bounds total work, not
+    // resident memory.
+    opa_free(p);
+    test("fuel not refunded", opa_heap_fuel_get() == 1024 - 256);
+
+    opa_heap_fuel_set(0);
+}
+
+WASM_EXPORT(test_opa_heap_blocks_dump)
+void test_opa_heap_blocks_dump(void)
+{
+    reset_heap();
+
+    char *buf = opa_heap_blocks_dump();
+    opa_value *v = opa_json_parse(buf, opa_strlen(buf));
+    test("parses", v != NULL);
+    test("has classes", opa_value_get(v, opa_string_terminated("classes")) != NULL);
+
+    // free a varying-size block behind a pinned one so it cannot be
+    // released to the heap top, and see it reported.
+    void *p = opa_malloc(512);
+    opa_malloc(512);
+    opa_free(p);
+
+    buf = opa_heap_blocks_dump();
+    v = opa_json_parse(buf, opa_strlen(buf));
+    // the dump's own buffer and parse temporaries may add blocks of their
+    // own, so assert lower bounds.
+    opa_value *varying = opa_value_get(opa_value_get(v, opa_string_terminated("classes")), opa_number_int(4));
+    test("free block reported", opa_value_compare(opa_value_get(varying, opa_string_terminated("blocks")), opa_number_int(1)) >= 0);
+    test("largest reported", opa_value_compare(opa_value_get(varying, opa_string_terminated("largest")), opa_number_int(512)) >= 0);
+}
+
+WASM_EXPORT(test_opa_realloc)
+void test_opa_realloc(void)
+{
+    reset_heap();
+
+    // check that a block at the end of the heap grows in place.
+
+    char *buf = opa_malloc(256);
+
+    for (int i = 0; i < 256; i++)
+    {
+        buf[i] = i % 255;
+    }
+
+    char *grown = opa_realloc(buf, 512);
+    test("grown in place at heap end", grown == buf);
+
+    bool ok = true;
+
+    for (int i = 0; i < 256; i++)
+    {
+        ok &= grown[i] == (char)(i % 255);
+    }
+
+    test("contents preserved", ok);
+
+    // check that a trailing free block is absorbed without copying.
+
+    char *a = opa_malloc(256);
+    char *b = opa_malloc(256);
+    char *barrier = opa_malloc(128);
+
+    opa_free(b);
+    test("trailing free block", opa_heap_free_blocks() == 1);
+
+    char *c = opa_realloc(a, 400);
+    test("grown into trailing free block", c == a);
+    test("free block absorbed", opa_heap_free_blocks() == 0);
+
+    opa_free(c);
+    opa_free(barrier);
+    opa_free(grown);
+}
+
 WASM_EXPORT(test_opa_memoize)
 void test_opa_memoize(void)
 {
-    opa_memoize_init();
+    opa_memoize_init(256);
 
     opa_memoize_insert(100, opa_number_int(1));
     opa_memoize_insert(200, opa_number_int(2));
@@ -250,6 +625,89 @@ void test_opa_memoize(void)
     test("get-a-after-pop", opa_value_compare(e, exp_e) == 0);
 }
 
+WASM_EXPORT(test_opa_error_status)
+void test_opa_error_status(void)
+{
+    opa_error_clear();
+    test("no error recorded", opa_error_message() == NULL);
+
+    opa_error_record("something failed");
+    test("recorded message", opa_strcmp(opa_error_message(), "something failed") == 0);
+
+    opa_error_clear();
+    test("cleared", opa_error_message() == NULL);
+
+    test("traps by default", !opa_error_recoverable());
+    opa_error_recoverable_set(true);
+    test("recoverable after opt-in", opa_error_recoverable());
+    opa_error_recoverable_set(false);
+}
+
+WASM_EXPORT(test_opa_memoize_retained)
+void test_opa_memoize_retained(void)
+{
+    unsigned int mark = opa_heap_ptr_get();
+    unsigned int gen = opa_value_data_generation();
+
+    // first eval: miss, compute, commit
+    opa_heap_ptr_set(opa_memoize_retained_floor(mark));
+    test("retained/miss at first", opa_memoize_get_retained(0) == NULL);
+
+    opa_value *v = opa_json_parse("{\"a\": [1, 2, 3]}", 16);
+    opa_memoize_insert_retained(0, v);
+    test("retained/visible within eval", opa_memoize_get_retained(0) == v);
+    opa_memoize_retain_commit(NULL);
+
+    // second eval: the entry survives the heap reset as a mounted copy
+    opa_heap_ptr_set(opa_memoize_retained_floor(mark));
+    opa_value *kept = opa_memoize_get_retained(0);
+    test("retained/survives reset", kept != NULL && opa_value_compare(kept, opa_json_parse("{\"a\": [1, 2, 3]}", 16)) == 0);
+
+    // a data mutation bumps the generation and drops the entries
+    opa_value *data = opa_object();
+    opa_value *path = opa_array();
+    opa_array_append(opa_cast_array(path), opa_string_terminated("x"));
+    opa_value_add_path(data, path, opa_number_int(1));
+    test("retained/generation bumped", opa_value_data_generation() != gen);
+
+    opa_heap_ptr_set(opa_memoize_retained_floor(mark));
+    test("retained/dropped on data change", opa_memoize_get_retained(0) == NULL);
+
+    opa_heap_ptr_set(mark);
+}
+
+WASM_EXPORT(test_opa_memoize_input_delta)
+void test_opa_memoize_input_delta(void)
+{
+    unsigned int mark = opa_heap_ptr_get();
+
+    // slot 10 depends on input.user, slot 11 registers nothing and is
+    // input-independent
+    opa_memoize_input_depend(10, "user");
+
+    opa_heap_ptr_set(opa_memoize_retained_floor(mark));
+    opa_memoize_input_delta(opa_json_parse("{\"user\": \"alice\"}", 17));
+    opa_memoize_insert_retained(10, opa_number_int(1));
+    opa_memoize_insert_retained(11, opa_number_int(2));
+    opa_memoize_retain_commit(NULL);
+
+    // same field value: both entries survive the reset
+    opa_heap_ptr_set(opa_memoize_retained_floor(mark));
+    opa_memoize_input_delta(opa_json_parse("{\"user\": \"alice\"}", 17));
+    test("delta/unchanged field kept", opa_memoize_get_retained(10) != NULL);
+    test("delta/independent kept", opa_memoize_get_retained(11) != NULL);
+    opa_memoize_retain_commit(NULL);
+
+    // changed field: only the dependent entry is dropped
+    opa_heap_ptr_set(opa_memoize_retained_floor(mark));
+    opa_memoize_input_delta(opa_json_parse("{\"user\": \"bob\"}", 15));
+    test("delta/changed field dropped", opa_memoize_get_retained(10) == NULL);
+    test("delta/independent unaffected", opa_memoize_get_retained(11) != NULL);
+    opa_memoize_retain_commit(NULL);
+
+    opa_heap_ptr_set(mark);
+}
+
 // NOTE(sr): These tests are run in order. If they weren't, every test that
 // depends on mpd's state being initialized would have to call `opa_mpd_init`
 // first. When the Wasm module is used, the `Start` function (`_initialize`,
@@ -319,6 +777,61 @@ void test_opa_itoa(void)
     test("itoa/base16", opa_strcmp(opa_itoa(0xFFFFFFFFFFFFFFFF, buf, 16), "-1") == 0);
 }
 
+WASM_EXPORT(test_opa_ftoa)
+void test_opa_ftoa(void)
+{
+    char buf[32];
+
+    test("ftoa/zero", opa_strcmp(opa_ftoa(0.0, buf), "0") == 0);
+    test("ftoa/neg zero", opa_strcmp(opa_ftoa(-0.0, buf), "0") == 0);
+    test("ftoa/integral", opa_strcmp(opa_ftoa(100.0, buf), "100") == 0);
+    test("ftoa/fraction", opa_strcmp(opa_ftoa(2.5, buf), "2.5") == 0);
+    test("ftoa/negative", opa_strcmp(opa_ftoa(-16.7, buf), "-16.7") == 0);
+    test("ftoa/shortest", opa_strcmp(opa_ftoa(0.1, buf), "0.1") == 0);
+    test("ftoa/leading zeros", opa_strcmp(opa_ftoa(0.00025, buf), "0.00025") == 0);
+    test("ftoa/exponent", opa_strcmp(opa_ftoa(1e30, buf), "1e30") == 0);
+    test("ftoa/tiny", opa_strcmp(opa_ftoa(5e-324, buf), "5e-324") == 0);
+
+    double cases[] = {16.7, 100.3, 12345.678, 0.00025, 3.141592653589793};
+
+    for (int i = 0; i < sizeof(cases)/sizeof(cases[0]); i++)
+    {
+        double d;
+
+        opa_ftoa(cases[i], buf);
+        test("ftoa/roundtrip rc", opa_atof64(buf, opa_strlen(buf), &d) == 0);
+        test("ftoa/roundtrip", d == cases[i]);
+    }
+}
+
+WASM_EXPORT(test_snprintf_float)
+void test_snprintf_float(void)
+{
+    // the printf float specifiers lay out opa_dtoa digits
+    char buf[64];
+
+    snprintf(buf, sizeof(buf), "%f", 1.5);
+    test("printf/f default", opa_strcmp(buf, "1.500000") == 0);
+    snprintf(buf, sizeof(buf), "%.2f", 3.14159);
+    test("printf/f prec", opa_strcmp(buf, "3.14") == 0);
+    snprintf(buf, sizeof(buf), "%.1f", 0.99);
+    test("printf/f carry", opa_strcmp(buf, "1.0") == 0);
+    snprintf(buf, sizeof(buf), "%.0f", 1.6);
+    test("printf/f round", opa_strcmp(buf, "2") == 0);
+    snprintf(buf, sizeof(buf), "%e", 0.0025);
+    test("printf/e", opa_strcmp(buf, "2.500000e-03") == 0);
+    snprintf(buf, sizeof(buf), "%.1e", 9.99e99);
+    test("printf/e exponent carry", opa_strcmp(buf, "1.0e+100") == 0);
+    snprintf(buf, sizeof(buf), "%e", 0.0);
+    test("printf/e zero", opa_strcmp(buf, "0.000000e+00") == 0);
+    snprintf(buf, sizeof(buf), "%g", 123456.789);
+    test("printf/g fixed", opa_strcmp(buf, "123457") == 0);
+    snprintf(buf, sizeof(buf), "%g", 1234567.89);
+    test("printf/g exponential", opa_strcmp(buf, "1.234568e+06") == 0);
+    snprintf(buf, sizeof(buf), "%06.2f", 1.5);
+    test("printf/f zero pad", opa_strcmp(buf, "001.50") == 0);
+}
+
 
 int crunch_opa_atoi64(const char *str, long long exp, int exp_rc)
 {
@@ -340,6 +853,10 @@ void test_opa_atoi64(void)
     test("negative integer", crunch_opa_atoi64("-128", -128, 0));
     test("non integer", crunch_opa_atoi64("-128.3", 0, -2));
     test("empty", crunch_opa_atoi64("", 0, -1));
+    test("eight digit block", crunch_opa_atoi64("12345678", 12345678, 0));
+    test("two blocks and tail", crunch_opa_atoi64("123456781234567890", 123456781234567890LL, 0));
+    test("max", crunch_opa_atoi64("9223372036854775807", 9223372036854775807LL, 0));
+    test("non digit in block", crunch_opa_atoi64("1234x678", 0, -2));
 }
 
 int crunch_opa_atof64(const char *str, double exp, int exp_rc)
@@ -367,6 +884,11 @@ void test_opa_atof64(void)
     test("negative integer", crunch_opa_atof64("-128", -128, 0));
     test("fraction", crunch_opa_atof64("16.7", 16.7, 0));
     test("exponent", crunch_opa_atof64("6e7", 6e7, 0));
+    test("negative exponent", crunch_opa_atof64("1e-2", 0.01, 0));
+    test("signed exponent", crunch_opa_atof64("1e+3", 1000, 0));
+    test("long mantissa", crunch_opa_atof64("3.141592653589793", 3.141592653589793, 0));
+    test("leading fraction zeros", crunch_opa_atof64("0.00000001", 1e-8, 0));
+    test("bare exponent", crunch_opa_atof64("1e", 0, -2));
 }
 
 WASM_EXPORT(test_memchr)
@@ -514,12 +1036,19 @@ void test_opa_value_compare(void)
     test("floats", opa_value_compare(opa_number_float(100.2), opa_number_float(100.1)) > 0);
     test("floats", opa_value_compare(opa_number_float(100.2), opa_number_float(100.3)) < 0);
     test("floats", opa_value_compare(opa_number_float(100.3), opa_number_float(100.3)) == 0);
+    test("refs", opa_value_compare(opa_number_ref("2.5", 3), opa_number_ref("2.45", 4)) > 0);
+    test("refs", opa_value_compare(opa_number_ref("-2.5", 4), opa_number_ref("-2.45", 5)) < 0);
+    test("refs", opa_value_compare(opa_number_ref("2.50", 4), opa_number_ref("2.5", 3)) == 0);
+    test("refs", opa_value_compare(opa_number_ref("10.1", 4), opa_number_ref("9.9", 3)) > 0);
+    test("refs", opa_value_compare(opa_number_ref("-0.0", 4), opa_number_ref("0", 1)) == 0);
     test("string/number", opa_value_compare(opa_string_terminated("foo"), opa_number_float(100)) > 0);
     test("strings", opa_value_compare(opa_string_terminated("foo"), opa_string_terminated("foo")) == 0);
     test("strings", opa_value_compare(opa_string_terminated("foo"), opa_string_terminated("bar")) > 0);
     test("strings", opa_value_compare(opa_string_terminated("bar"), opa_string_terminated("baz")) < 0);
     test("strings", opa_value_compare(opa_string_terminated("foobar"), opa_string_terminated("foo")) > 0);
     test("strings", opa_value_compare(opa_string_terminated("foo"), opa_string_terminated("foobar")) < 0);
+    test("strings (long)", opa_value_compare(opa_string_terminated("aaaaaaaab"), opa_string_terminated("aaaaaaaac")) < 0);
+    test("strings (high bytes)", opa_value_compare(opa_string_terminated("aaaa\xffzzz"), opa_string_terminated("aaaa\x01zzz")) > 0);
 
     opa_array_t *arr1 = opa_cast_array(opa_array());
     opa_array_append(arr1, opa_number_int(1));
@@ -600,6 +1129,62 @@ void test_opa_value_compare(void)
     test("sets", opa_value_compare(v3, v1) > 0);
 }
 
+WASM_EXPORT(test_opa_value_eq)
+void test_opa_value_eq(void)
+{
+    test("null", opa_value_eq(opa_null(), opa_null()));
+    test("null/boolean", !opa_value_eq(opa_null(), opa_boolean(false)));
+    test("integers", opa_value_eq(opa_number_int(100), opa_number_int(100)));
+    test("integers", !opa_value_eq(opa_number_int(100), opa_number_int(101)));
+    test("strings", opa_value_eq(opa_string_terminated("foo"), opa_string_terminated("foo")));
+    test("strings", !opa_value_eq(opa_string_terminated("foo"), opa_string_terminated("foobar")));
+
+    opa_array_t *arr1 = opa_cast_array(opa_array());
+    opa_array_append(arr1, opa_number_int(1));
+    opa_array_append(arr1, opa_number_int(2));
+
+    opa_array_t *arr2 = opa_cast_array(opa_array());
+    opa_array_append(arr2, opa_number_int(1));
+    opa_array_append(arr2, opa_number_int(2));
+
+    opa_array_t *arr3 = opa_cast_array(opa_array());
+    opa_array_append(arr3, opa_number_int(2));
+    opa_array_append(arr3, opa_number_int(1));
+
+    test("arrays", opa_value_eq(&arr1->hdr, &arr2->hdr));
+    test("arrays", !opa_value_eq(&arr1->hdr, &arr3->hdr));
+
+    opa_object_t *obj1 = opa_cast_object(opa_object());
+    opa_object_insert(obj1, opa_string_terminated("a"), opa_number_int(1));
+    opa_object_insert(obj1, opa_string_terminated("b"), opa_number_int(2));
+
+    opa_object_t *obj2 = opa_cast_object(opa_object());
+    opa_object_insert(obj2, opa_string_terminated("b"), opa_number_int(2));
+    opa_object_insert(obj2, opa_string_terminated("a"), opa_number_int(1));
+
+    opa_object_t *obj3 = opa_cast_object(opa_object());
+    opa_object_insert(obj3, opa_string_terminated("a"), opa_number_int(1));
+    opa_object_insert(obj3, opa_string_terminated("b"), opa_number_int(3));
+
+    test("objects", opa_value_eq(&obj1->hdr, &obj2->hdr));
+    test("objects", !opa_value_eq(&obj1->hdr, &obj3->hdr));
+
+    opa_set_t *set1 = opa_cast_set(opa_set());
+    opa_set_add(set1, opa_string_terminated("a"));
+    opa_set_add(set1, opa_string_terminated("b"));
+
+    opa_set_t *set2 = opa_cast_set(opa_set());
+    opa_set_add(set2, opa_string_terminated("b"));
+    opa_set_add(set2, opa_string_terminated("a"));
+
+    opa_set_t *set3 = opa_cast_set(opa_set());
+    opa_set_add(set3, opa_string_terminated("a"));
+    opa_set_add(set3, opa_string_terminated("c"));
+
+    test("sets", opa_value_eq(&set1->hdr, &set2->hdr));
+    test("sets", !opa_value_eq(&set1->hdr, &set3->hdr));
+}
+
 int parse_crunch(const char *s, opa_value *exp)
 {
     opa_value *ret = opa_json_parse(s, opa_strlen(s));
@@ -654,19 +1239,6 @@ void test_opa_json_parse_scalar(void)
     test("exponents", parse_crunch("6e7", opa_number_float(6e7)));
 }
 
-WASM_EXPORT(test_opa_json_max_str_len)
-void test_opa_json_max_str_len(void)
-{
-    test("max str len: a char", opa_json_max_string_len("a", 1) == 1);
-    test("max str len: chars", opa_json_max_string_len("ab", 2) == 2);
-    test("max str len: single char escape", opa_json_max_string_len("ab\nd", 4) == 4);
-    test("max str len: 2 byte utf-8", opa_json_max_string_len("\xc2\xa2", 2) == 2);
-    test("max str len: 3 byte utf-8", opa_json_max_string_len("\xe0\xb8\x81", 3) == 3);
-    test("max str len: 4 byte utf-8", opa_json_max_string_len("\xf0\x90\x8d\x88", 4) == 4);
-    test("max str len: utf-16 no surrogate pair", opa_json_max_string_len(" \\u20AC ", 8) == 6);
-    test("max str len: utf-16 surrogate pair", opa_json_max_string_len(" \\ud801\\udc37 ", 14) == 6);
-}
-
 opa_array_t *fixture_array1(void)
 {
     opa_array_t *arr = opa_cast_array(opa_array());
@@ -730,6 +1302,182 @@ opa_set_t *fixture_set1(void)
     return set;
 }
 
+WASM_EXPORT(test_opa_number_interned)
+void test_opa_number_interned(void)
+{
+    test("interned", opa_number_interned(10) == opa_number_interned(10));
+    test("type", opa_value_type(opa_number_interned(10)) == OPA_NUMBER);
+    test("value", opa_value_compare(opa_number_interned(10), opa_number_int(10)) == 0);
+    test("negative", opa_value_compare(opa_number_interned(-100), opa_number_int(-100)) == 0);
+    test("out of range allocates", opa_number_interned(100000) != opa_number_interned(100000));
+
+    opa_value_free(opa_number_interned(10));
+    test("free is a no-op", opa_value_compare(opa_number_interned(10), opa_number_int(10)) == 0);
+}
+
+WASM_EXPORT(test_opa_value_site_profile)
+void test_opa_value_site_profile(void)
+{
+    // first construction from a fresh site starts at default capacity and
+    // grows; the reached size feeds the site's profile
+    opa_array_t *arr = opa_cast_array(opa_array_site(900));
+    test("cold start", arr->cap <= 10);
+
+    for (int i = 0; i < 100; i++)
+    {
+        opa_array_append(arr, opa_number_int(i));
+    }
+
+    // the next construction from the same site is seeded to absorb the
+    // same workload without reallocating
+    opa_array_t *warm = opa_cast_array(opa_array_site(900));
+    test("warm seed", warm->cap >= 100);
+
+    opa_array_elem_t *elems = warm->elems;
+
+    for (int i = 0; i < 100; i++)
+    {
+        opa_array_append(warm, opa_number_int(i));
+    }
+
+    test("no growth", warm->elems == elems);
+
+    opa_set_t *set = opa_cast_set(opa_set_site(901));
+
+    for (int i = 0; i < 50; i++)
+    {
+        opa_set_add(set, opa_number_int(i));
+    }
+
+    test("set warm buckets", opa_cast_set(opa_set_site(901))->n >= 50);
+
+    // out-of-range sites fall back to the plain constructors
+    test("site out of range", opa_cast_array(opa_array_site(1 << 20))->cap <= 10);
+}
+
+WASM_EXPORT(test_opa_value_digest)
+void test_opa_value_digest(void)
+{
+    opa_object_t *obj1 = opa_cast_object(opa_object());
+    opa_object_insert(obj1, opa_string_terminated("a"), opa_number_int(1));
+    opa_object_insert(obj1, opa_string_terminated("b"), opa_string_terminated("x"));
+
+    opa_object_t *obj2 = opa_cast_object(opa_object());
+    opa_object_insert(obj2, opa_string_terminated("b"), opa_string_terminated("x"));
+    opa_object_insert(obj2, opa_string_terminated("a"), opa_number_int(1));
+
+    opa_object_t *obj3 = opa_cast_object(opa_object());
+    opa_object_insert(obj3, opa_string_terminated("a"), opa_number_int(2));
+    opa_object_insert(obj3, opa_string_terminated("b"), opa_string_terminated("x"));
+
+    opa_value_digest_t d1;
+    opa_value_digest_t d2;
+    opa_value_digest_t d3;
+    opa_value_digest(&obj1->hdr, &d1);
+    opa_value_digest(&obj2->hdr, &d2);
+    opa_value_digest(&obj3->hdr, &d3);
+
+    test("insertion order independent", d1.lo == d2.lo && d1.hi == d2.hi);
+    test("value change", d1.lo != d3.lo || d1.hi != d3.hi);
+
+    // numbers digest by numeric value, like opa_number_hash
+    opa_value_digest_t dn1;
+    opa_value_digest_t dn2;
+    opa_value_digest(opa_number_int(1), &dn1);
+    opa_value_digest(opa_number_ref("1.0", 3), &dn2);
+    test("number canonical", dn1.lo == dn2.lo && dn1.hi == dn2.hi);
+
+    // arrays are order sensitive
+    opa_array_t *arr1 = opa_cast_array(opa_array());
+    opa_array_append(arr1, opa_number_int(1));
+    opa_array_append(arr1, opa_number_int(2));
+
+    opa_array_t *arr2 = opa_cast_array(opa_array());
+    opa_array_append(arr2, opa_number_int(2));
+    opa_array_append(arr2, opa_number_int(1));
+
+    opa_value_digest_t da1;
+    opa_value_digest_t da2;
+    opa_value_digest(&arr1->hdr, &da1);
+    opa_value_digest(&arr2->hdr, &da2);
+    test("array order sensitive", da1.lo != da2.lo || da1.hi != da2.hi);
+
+    // frozen values: the digest is cached and stable, and opa_value_eq
+    // decides inequality from it without walking
+    opa_value *v1 = opa_json_parse("{\"a\": [1, 2, {\"b\": \"c\"}]}", 25);
+    opa_value *v2 = opa_json_parse("{\"a\": [1, 2, {\"b\": \"c\"}]}", 25);
+    opa_value *v3 = opa_json_parse("{\"a\": [1, 2, {\"b\": \"d\"}]}", 25);
+    opa_value_freeze(v1);
+    opa_value_freeze(v2);
+    opa_value_freeze(v3);
+
+    test("frozen eq", opa_value_eq(v1, v2));
+    test("frozen not eq", !opa_value_eq(v1, v3));
+
+    opa_value_digest_t df1;
+    opa_value_digest_t df2;
+    opa_value_digest(v1, &df1);
+    opa_value_digest(v1, &df2);
+    test("cached digest stable", df1.lo == df2.lo && df1.hi == df2.hi);
+}
+
+WASM_EXPORT(test_opa_value_cursor)
+void test_opa_value_cursor(void)
+{
+    opa_object_t *obj = opa_cast_object(opa_object());
+
+    for (int i = 0; i < 100; i++)
+    {
+        opa_object_insert(obj, opa_number_int(i), opa_number_int(i * 2));
+    }
+
+    opa_value_cursor_t *cur = opa_value_cursor(&obj->hdr);
+    int count = 0;
+
+    for (opa_value *k = opa_value_cursor_next(cur); k != NULL; k = opa_value_cursor_next(cur))
+    {
+        opa_value *v = opa_value_cursor_value(cur);
+        test("object cursor value", opa_value_compare(v, opa_value_get(&obj->hdr, k)) == 0);
+        count++;
+    }
+
+    test("object cursor count", count == 100);
+
+    opa_array_t *arr = opa_cast_array(opa_array());
+
+    for (int i = 0; i < 10; i++)
+    {
+        opa_array_append(arr, opa_number_int(i));
+    }
+
+    cur = opa_value_cursor(&arr->hdr);
+
+    for (int i = 0; i < 10; i++)
+    {
+        opa_value *k = opa_value_cursor_next(cur);
+        test("array cursor key", opa_value_compare(k, opa_number_int(i)) == 0);
+        test("array cursor value", opa_value_compare(opa_value_cursor_value(cur), opa_number_int(i)) == 0);
+    }
+
+    test("array cursor end", opa_value_cursor_next(cur) == NULL);
+
+    opa_set_t *set = opa_cast_set(opa_set());
+    opa_set_add(set, opa_string_terminated("a"));
+    opa_set_add(set, opa_string_terminated("b"));
+
+    cur = opa_value_cursor(&set->hdr);
+    count = 0;
+
+    for (opa_value *v = opa_value_cursor_next(cur); v != NULL; v = opa_value_cursor_next(cur))
+    {
+        test("set cursor value", opa_value_cursor_value(cur) == v);
+        count++;
+    }
+
+    test("set cursor count", count == 2);
+    test("scalar cursor", opa_value_cursor_next(opa_value_cursor(opa_number_int(1))) == NULL);
+}
+
 WASM_EXPORT(test_opa_value_length)
 void test_opa_value_length(void)
 {
@@ -897,23 +1645,283 @@ void test_opa_value_parse(void)
 WASM_EXPORT(test_opa_json_parse_memory_ownership)
 void test_opa_json_parse_memory_ownership(void)
 {
-    char s[] = "[1,\"a\"]";
+    char s[] = "[1,\"a\"]";
+
+    opa_value *result = opa_json_parse(s, sizeof(s));
+
+    opa_value *exp = opa_array();
+    opa_array_t *arr = opa_cast_array(exp);
+    opa_array_append(arr, opa_number_int(1));
+    opa_array_append(arr, opa_string("a", 1));
+
+    test("expected value", opa_value_compare(result, exp) == 0);
+
+    for (int i = 0; i < sizeof(s); i++)
+    {
+        s[i] = 0;
+    }
+
+    test("expected value after overwriting buffer", opa_value_compare(result, exp) == 0);
+}
+
+WASM_EXPORT(test_opa_json_parse_borrowed)
+void test_opa_json_parse_borrowed(void)
+{
+    char s[] = "[\"plain\",\"esc\\n\"]";
+
+    opa_value *result = opa_json_parse_borrowed(s, sizeof(s)-1);
+
+    opa_array_t *arr = opa_cast_array(result);
+    opa_string_t *plain = opa_cast_string(arr->elems[0].v);
+    opa_string_t *escaped = opa_cast_string(arr->elems[1].v);
+
+    test("expected values", opa_value_compare(arr->elems[0].v, opa_string("plain", 5)) == 0 &&
+                            opa_value_compare(arr->elems[1].v, opa_string("esc\n", 4)) == 0);
+    test("unescaped string borrows from the input buffer",
+         plain->v >= s && plain->v < s + sizeof(s) && plain->free == 0);
+    test("escaped string is an owned copy",
+         !(escaped->v >= s && escaped->v < s + sizeof(s)));
+
+    opa_value_free(result);
+}
+
+WASM_EXPORT(test_opa_value_parse_trusted)
+void test_opa_value_parse_trusted(void)
+{
+    char s[] = "{\"user\":\"caf\xc3\xa9\",\"n\":3,\"s\":set()}";
+
+    opa_value *result = opa_value_parse_trusted(s, sizeof(s)-1);
+    test("parses", result != NULL && opa_value_type(result) == OPA_OBJECT);
+
+    opa_value *user = opa_value_get(result, opa_string_terminated("user"));
+    test("expected value", user != NULL &&
+                           opa_value_compare(user, opa_string_terminated("caf\xc3\xa9")) == 0);
+
+    // trusted mode borrows unescaped strings unconditionally, raw UTF-8
+    // included: no validation detour, no copy
+    opa_string_t *borrowed = opa_cast_string(user);
+    test("utf-8 string borrows from the input buffer",
+         borrowed->v >= s && borrowed->v < s + sizeof(s) && borrowed->free == 0);
+
+    test("set literals enabled",
+         opa_value_type(opa_value_get(result, opa_string_terminated("s"))) == OPA_SET);
+    test("agrees with opa_value_parse",
+         opa_value_compare(result, opa_value_parse(s, sizeof(s)-1)) == 0);
+    test("structural errors still fail", opa_value_parse_trusted("{\"a\":", 5) == NULL);
+}
+
+WASM_EXPORT(test_opa_json_parse_lazy)
+void test_opa_json_parse_lazy(void)
+{
+    // "cold" spans well over OPA_JSON_LAZY_MIN bytes; "small" does not
+    char buf[1024];
+    size_t n = snprintf(buf, sizeof(buf), "{\"hot\":1,\"small\":{\"a\":1},\"cold\":{");
+
+    for (int i = 0; i < 40; i++)
+    {
+        n += snprintf(&buf[n], sizeof(buf) - n, "%s\"key%d\":%d", i > 0 ? "," : "", i, i);
+    }
+
+    n += snprintf(&buf[n], sizeof(buf) - n, "}}");
+
+    opa_value *v = opa_json_parse_lazy(buf, n);
+    test("lazy/parses", v != NULL && opa_value_type(v) == OPA_OBJECT);
+
+    // the large subtree is deferred, the small ones are built eagerly
+    opa_object_elem_t *cold = opa_object_get(opa_cast_object(v), opa_string_terminated("cold"));
+    test("lazy/deferred", cold != NULL && cold->v->type == OPA_LAZY);
+    test("lazy/small eager",
+         opa_object_get(opa_cast_object(v), opa_string_terminated("small"))->v->type == OPA_OBJECT);
+
+    // first access materializes in place; later hits reuse the same value
+    opa_value *forced = opa_value_get(v, opa_string_terminated("cold"));
+    test("lazy/materialized", forced != NULL && opa_value_type(forced) == OPA_OBJECT &&
+         opa_value_length(forced) == 40 && cold->v == forced);
+    test("lazy/cached", opa_value_get(v, opa_string_terminated("cold")) == forced);
+    test("lazy/member",
+         opa_value_compare(opa_value_get(forced, opa_string_terminated("key7")), opa_number_int(7)) == 0);
+
+    // comparison forces what it reaches: a fresh lazy parse equals the
+    // eager one
+    test("lazy/compare", opa_value_compare(opa_json_parse_lazy(buf, n), opa_json_parse(buf, n)) == 0);
+
+    // balanced-but-malformed input is rejected up front, like opa_json_parse
+    test("lazy/error", opa_json_parse_lazy("{\"a\":", 5) == NULL);
+}
+
+WASM_EXPORT(test_opa_json_parse_push)
+void test_opa_json_parse_push(void)
+{
+    char s[] = "{\"a\": [1, 22, null], \"b\": {\"c\": \"split across chunks\"}}";
+    opa_value *exp = opa_json_parse(s, sizeof(s)-1);
+
+    // one-byte chunks split every token, including multi-byte numbers,
+    // atoms and strings
+    opa_json_parser_t *p = opa_json_parse_begin();
+
+    for (size_t i = 0; i < sizeof(s)-1; i++)
+    {
+        opa_json_parse_feed(p, &s[i], 1);
+    }
+
+    opa_value *result = opa_json_parse_end(p);
+    test("chunked parse equals whole parse", result != NULL && opa_value_compare(result, exp) == 0);
+
+    // a document cut off mid-container is reported at end, not before
+    p = opa_json_parse_begin();
+    opa_json_parse_feed(p, s, 10);
+    test("truncated document", opa_json_parse_end(p) == NULL);
+
+    p = opa_json_parse_begin();
+    opa_json_parse_feed(p, "[1] [2]", 7);
+    test("trailing garbage", opa_json_parse_end(p) == NULL);
+}
+
+WASM_EXPORT(test_opa_value_apply_patch)
+void test_opa_value_apply_patch(void)
+{
+    opa_value *data = opa_json_parse("{\"a\":{\"b\":[1,2]},\"c\":1}", 23);
+    char patch[] = "["
+        "{\"op\":\"test\",\"path\":\"/c\",\"value\":1},"
+        "{\"op\":\"add\",\"path\":\"/a/b/1\",\"value\":9},"
+        "{\"op\":\"remove\",\"path\":\"/c\"},"
+        "{\"op\":\"move\",\"from\":\"/a/b\",\"path\":\"/d\"},"
+        "{\"op\":\"copy\",\"from\":\"/d\",\"path\":\"/e\"},"
+        "{\"op\":\"replace\",\"path\":\"/a\",\"value\":{\"z\":0}}"
+        "]";
+
+    test("patch applies", opa_value_apply_patch(data, patch, sizeof(patch)-1) == OPA_ERR_OK);
+
+    opa_value *exp = opa_json_parse("{\"a\":{\"z\":0},\"d\":[1,9,2],\"e\":[1,9,2]}", 38);
+    test("patched document", opa_value_compare(data, exp) == 0);
+
+    test("failed test stops the patch",
+         opa_value_apply_patch(data, "[{\"op\":\"test\",\"path\":\"/a\",\"value\":0}]", 38) == OPA_ERR_INTERNAL);
+    test("missing target",
+         opa_value_apply_patch(data, "[{\"op\":\"remove\",\"path\":\"/x/y\"}]", 31) == OPA_ERR_INVALID_PATH);
+}
+
+WASM_EXPORT(test_opa_cbor_parse)
+void test_opa_cbor_parse(void)
+{
+    // {"a": [1, -2, "x"], "b": true, "c": null, "d": 2.5}
+    char doc[] = "\xa4\x61\x61\x83\x01\x21\x61\x78\x61\x62\xf5\x61\x63\xf6"
+                 "\x61\x64\xfb\x40\x04\x00\x00\x00\x00\x00\x00";
+    char json[] = "{\"a\":[1,-2,\"x\"],\"b\":true,\"c\":null,\"d\":2.5}";
+
+    opa_value *decoded = opa_cbor_parse(doc, sizeof(doc)-1);
+    opa_value *parsed = opa_json_parse(json, sizeof(json)-1);
+
+    test("decodes like JSON", decoded != NULL &&
+         opa_value_compare(decoded, parsed) == 0);
+
+    // indefinite-length containers and strings, chunked "abc"
+    decoded = opa_cbor_parse("\x9f\x7f\x62\x61\x62\x61\x63\xff\xbf\x61\x6b\x00\xff\xff", 14);
+    parsed = opa_json_parse("[\"abc\",{\"k\":0}]", 15);
+
+    test("indefinite lengths", decoded != NULL &&
+         opa_value_compare(decoded, parsed) == 0);
+
+    test("truncated input rejected", opa_cbor_parse(doc, sizeof(doc)-2) == NULL);
+    test("non-finite float rejected", opa_cbor_parse("\xf9\x7e\x00", 3) == NULL);
+}
+
+WASM_EXPORT(test_opa_value_snapshot)
+void test_opa_value_snapshot(void)
+{
+    opa_value *orig = opa_value_parse("{\"a\": [1, \"x\", true, null], \"b\": {1, 2.5}, \"c\": {}}", 50);
+
+    size_t len = 0;
+    char *blob = opa_value_snapshot(orig, &len);
+
+    test("snapshot produced", blob != NULL && len > 0);
+
+    // restoring must not depend on the blob's address
+    char *moved = opa_malloc(len);
+    memcpy(moved, blob, len);
+    opa_free(blob);
+
+    opa_value *restored = opa_value_restore(moved, len);
+
+    test("restored", restored != NULL);
+    test("restored equals original", opa_value_compare(orig, restored) == 0);
+    test("restored lookup", opa_value_compare(opa_value_get(restored, opa_string_terminated("a")),
+                                              opa_value_get(orig, opa_string_terminated("a"))) == 0);
+    test("restored hash", opa_value_hash(restored) == opa_value_hash(orig));
+    test("garbage rejected", opa_value_restore("not a snapshot blob", 19) == NULL);
+
+    // mounting fixes the blob up where it sits; a second mount of the same
+    // region adopts the stamped blob instead of fixing it up again
+    char *mblob = opa_value_snapshot(orig, &len);
+    opa_value *mounted = opa_value_mount(mblob, len);
+
+    test("mounted equals original", mounted != NULL && opa_value_compare(orig, mounted) == 0);
+    test("remount adopts", opa_value_mount(mblob, len) == mounted);
+
+    // a mounted region that reappears at a different address relocates
+    char *shifted = opa_malloc(len);
+    memcpy(shifted, mblob, len);
+    opa_value *remounted = opa_value_mount(shifted, len);
+
+    test("relocated mount equals original", remounted != NULL &&
+         opa_value_compare(orig, remounted) == 0);
+}
+
+WASM_EXPORT(test_opa_constants)
+void test_opa_constants(void)
+{
+    // stands in for the pool blob 'opa build' embeds in the data segment
+    opa_value *pool = opa_value_parse("[\"admin\", 42, [\"r\", \"w\"]]", 25);
 
-    opa_value *result = opa_json_parse(s, sizeof(s));
+    size_t len = 0;
+    char *blob = opa_value_snapshot(pool, &len);
 
-    opa_value *exp = opa_array();
-    opa_array_t *arr = opa_cast_array(exp);
-    opa_array_append(arr, opa_number_int(1));
-    opa_array_append(arr, opa_string("a", 1));
+    opa_constants_init(blob, len);
 
-    test("expected value", opa_value_compare(result, exp) == 0);
+    opa_value *c0 = opa_constant(0);
+    test("constants/value", opa_value_compare(c0, opa_string_terminated("admin")) == 0);
+    test("constants/frozen", c0 != NULL && opa_value_frozen(c0));
+    test("constants/hash warmed", c0 != NULL && opa_cast_string(c0)->hash != 0);
+    test("constants/stable handle", opa_constant(0) == c0);
+    test("constants/compound", opa_value_length(opa_constant(2)) == 2);
+    test("constants/out of range", opa_constant(3) == NULL);
 
-    for (int i = 0; i < sizeof(s); i++)
-    {
-        s[i] = 0;
-    }
+    // a second init (another instance sharing the segment) is a no-op
+    opa_constants_init(blob, len);
+    test("constants/reinit", opa_constant(0) == c0);
+}
 
-    test("expected value after overwriting buffer", opa_value_compare(result, exp) == 0);
+WASM_EXPORT(test_opa_value_get_cached)
+void test_opa_value_get_cached(void)
+{
+    opa_value *obj = opa_json_parse("{\"a\":1,\"b\":2}", 13);
+    opa_value *a = opa_string_terminated("a");
+    opa_value_ic_t ic = {0};
+
+    // unfrozen objects are served but never cached
+    test("ic/unfrozen", opa_value_compare(opa_value_get_cached(obj, a, &ic), opa_number_int(1)) == 0);
+    test("ic/unfrozen not cached", ic.node == NULL);
+
+    opa_value_freeze(obj);
+
+    // the first frozen lookup fills the slot; the next one hits it
+    opa_value *v = opa_value_get_cached(obj, a, &ic);
+    test("ic/fill", opa_value_compare(v, opa_number_int(1)) == 0 && ic.node == obj && ic.key == a);
+    test("ic/hit", opa_value_get_cached(obj, a, &ic) == v);
+
+    // a different key handle misses and refills
+    opa_value *b = opa_string_terminated("b");
+    test("ic/refill", opa_value_compare(opa_value_get_cached(obj, b, &ic), opa_number_int(2)) == 0 &&
+         ic.key == b);
+
+    // absent keys are not cached
+    opa_value_ic_t miss = {0};
+    test("ic/absent", opa_value_get_cached(obj, opa_string_terminated("c"), &miss) == NULL &&
+         miss.node == NULL);
+
+    // a stale epoch invalidates the slot instead of trusting the pointers
+    ic.epoch--;
+    test("ic/stale epoch", opa_value_compare(opa_value_get_cached(obj, b, &ic), opa_number_int(2)) == 0);
 }
 
 WASM_EXPORT(test_opa_object_insert)
@@ -977,6 +1985,49 @@ void test_opa_object_growth(void)
     }
 }
 
+WASM_EXPORT(test_opa_object_shrink)
+void test_opa_object_shrink(void)
+{
+    opa_object_t *obj = opa_cast_object(opa_object());
+    char buf[16];
+
+    for (int i = 0; i < 100; i++)
+    {
+        snprintf(buf, sizeof(buf), "k%d", i);
+        opa_object_insert(obj, opa_string(buf, opa_strlen(buf)), opa_number_int(i));
+    }
+
+    size_t peak = obj->n;
+    test("object/grew", peak >= 128);
+
+    for (int i = 10; i < 100; i++)
+    {
+        snprintf(buf, sizeof(buf), "k%d", i);
+        opa_object_remove_keep(obj, opa_string_terminated(buf));
+    }
+
+    test("object/shrinks after bulk removal", obj->len == 10 && obj->n < peak);
+    test("object/survivor reachable",
+         opa_value_compare(opa_value_get(&obj->hdr, opa_string_terminated("k5")), opa_number_int(5)) == 0);
+    test("object/removed stays absent",
+         opa_value_get(&obj->hdr, opa_string_terminated("k50")) == NULL);
+
+    int seen = 0;
+    for (opa_value *k = opa_value_iter(&obj->hdr, NULL); k != NULL; k = opa_value_iter(&obj->hdr, k))
+    {
+        seen++;
+    }
+    test("object/iteration after shrink", seen == 10);
+
+    // compaction rebuilds at the exact fit, recursing through the tree
+    opa_object_t *outer = opa_cast_object(opa_object());
+    opa_object_insert(outer, opa_string_terminated("inner"), &obj->hdr);
+    opa_object_compact(&outer->hdr);
+    test("object/compact exact fit", obj->n == 16);
+    test("object/compact keeps members",
+         opa_value_compare(opa_value_get(&obj->hdr, opa_string_terminated("k5")), opa_number_int(5)) == 0);
+}
+
 WASM_EXPORT(test_opa_set_add_and_get)
 void test_opa_set_add_and_get(void)
 {
@@ -1230,6 +2281,25 @@ void test_opa_value_merge_nested(void)
     }
 }
 
+WASM_EXPORT(test_opa_value_merge_shares_base)
+void test_opa_value_merge_shares_base(void)
+{
+    char base_str[] = "{\"a\":{\"x\":1},\"b\":{\"y\":2}}";
+    char override_str[] = "{\"b\":{\"z\":3}}";
+    char exp_str[] = "{\"a\":{\"x\":1},\"b\":{\"y\":2,\"z\":3}}";
+
+    opa_value *base = opa_json_parse(base_str, sizeof(base_str)-1);
+    opa_value *override = opa_json_parse(override_str, sizeof(override_str)-1);
+    opa_value *merged = opa_value_merge(base, override);
+
+    test("merged contents", opa_value_compare(merged, opa_json_parse(exp_str, sizeof(exp_str)-1)) == 0);
+    test("untouched subtree is referenced, not rebuilt",
+         opa_value_get(merged, opa_string_terminated("a")) ==
+         opa_value_get(base, opa_string_terminated("a")));
+    test("operands are not mutated", opa_cast_object(base)->len == 2 &&
+         opa_value_get(opa_value_get(base, opa_string_terminated("b")), opa_string_terminated("z")) == NULL);
+}
+
 WASM_EXPORT(test_opa_value_shallow_copy)
 void test_opa_value_shallow_copy(void)
 {
@@ -1299,6 +2369,18 @@ void test_opa_json_dump(void)
     opa_array_append(arrk, opa_number_int(1));
     opa_object_insert(opa_cast_object(non_string_keys), &arrk->hdr, opa_number_int(1));
     test_str_eq("objects/non string keys", opa_json_dump(non_string_keys), "{\"[1]\":1}");
+
+    // repeated dumps of an unchanged object hit the memoized serialization
+    test("objects/cached dump", opa_strcmp(opa_json_dump(obj), opa_json_dump(obj)) == 0);
+
+    opa_object_insert(opa_cast_object(obj), opa_string_terminated("k2"), opa_string_terminated("v3"));
+    test("objects/cache dropped on overwrite", opa_strcmp(opa_json_dump(obj), "{\"k1\":\"v1\",\"k2\":\"v3\"}") == 0);
+
+    opa_value *with_set = opa_object();
+    opa_object_insert(opa_cast_object(with_set), opa_string_terminated("s"), set);
+    test("objects/cached dump with set", opa_strcmp(opa_json_dump(with_set), "{\"s\":[\"hello\",\"world\"]}") == 0);
+    test("objects/cache not used by value_dump", opa_strcmp(opa_value_dump(with_set), "{\"s\":{\"hello\",\"world\"}}") == 0);
+    test("objects/cache after value_dump", opa_strcmp(opa_json_dump(with_set), "{\"s\":[\"hello\",\"world\"]}") == 0);
 }
 
 WASM_EXPORT(test_opa_value_dump)
@@ -1346,6 +2428,9 @@ void test_arithmetic(void)
     test("floor 1", opa_number_as_float(opa_cast_number(opa_arith_floor(opa_number_int(1)))) == 1);
     test("floor 1.01 (float)", opa_number_as_float(opa_cast_number(opa_arith_floor(opa_number_float(1.01)))) == 1);
     test("floor -1.99999 (float)", opa_number_as_float(opa_cast_number(opa_arith_floor(opa_number_float(-1.99999)))) == -2);
+    test("round 2.45 (ref)", opa_number_as_float(opa_cast_number(opa_arith_round(opa_number_ref("2.45", 4)))) == 2);
+    test("ceil 2.000 (ref)", opa_number_as_float(opa_cast_number(opa_arith_ceil(opa_number_ref("2.000", 5)))) == 2);
+    test("floor -0.5 (ref)", opa_number_as_float(opa_cast_number(opa_arith_floor(opa_number_ref("-0.5", 4)))) == -1);
     test("plus 1+2", opa_number_as_float(opa_cast_number(opa_arith_plus(opa_number_float(1), opa_number_float(2)))) == 3);
     test("minus 3-2", opa_number_as_float(opa_cast_number(opa_arith_minus(opa_number_float(3), opa_number_float(2)))) == 1);
 
@@ -1395,6 +2480,14 @@ void test_set_intersection_union(void)
          opa_set_get(r, opa_number_int(0)) != NULL &&
          opa_set_get(r, opa_number_int(1)) != NULL &&
          opa_set_get(r, opa_number_int(2)) != NULL);
+
+    // empty and identical operands are shared, not copied
+    opa_value *empty = opa_set();
+
+    test("set/union empty shares", opa_set_union(&s1->hdr, empty) == &s1->hdr &&
+                                   opa_set_union(empty, &s1->hdr) == &s1->hdr);
+    test("set/intersection same shares", opa_set_intersection(&s1->hdr, &s1->hdr) == &s1->hdr);
+    test("set/diff empty shares", opa_set_diff(&s1->hdr, empty) == &s1->hdr);
 }
 
 
@@ -1426,6 +2519,13 @@ void test_sets_intersection_union(void)
          opa_set_get(r, opa_number_int(0)) != NULL &&
          opa_set_get(r, opa_number_int(1)) != NULL &&
          opa_set_get(r, opa_number_int(2)) != NULL);
+
+    // a single member set is shared, not copied
+    opa_set_t *single = opa_cast_set(opa_set());
+    opa_set_add(single, &s1->hdr);
+
+    test("sets/union single shares", opa_sets_union(&single->hdr) == &s1->hdr);
+    test("sets/intersection single shares", opa_sets_intersection(&single->hdr) == &s1->hdr);
 }
 
 WASM_EXPORT(test_array)
@@ -1447,11 +2547,33 @@ void test_array(void)
          opa_value_compare(r->elems[2].v, opa_number_int(2)) == 0 &&
          opa_value_compare(r->elems[3].v, opa_number_int(3)) == 0);
 
+    opa_value *moved = opa_array_concat_move(&arr1->hdr, &arr2->hdr);
+
+    test("array_concat_move reuses left", moved == &arr1->hdr);
+    test("array_concat_move", arr1->len == 4 &&
+         opa_value_compare(arr1->elems[0].v, opa_number_int(0)) == 0 &&
+         opa_value_compare(arr1->elems[1].v, opa_number_int(1)) == 0 &&
+         opa_value_compare(arr1->elems[2].v, opa_number_int(2)) == 0 &&
+         opa_value_compare(arr1->elems[3].v, opa_number_int(3)) == 0);
+
     r = opa_cast_array(opa_array_slice(&r->hdr, opa_number_int(1), opa_number_int(3)));
 
     test("array_slice", r->len == 2 &&
          opa_value_compare(r->elems[0].v, opa_number_int(1)) == 0 &&
          opa_value_compare(r->elems[1].v, opa_number_int(2)) == 0);
+
+    opa_array_t *frozen = opa_cast_array(opa_array());
+    opa_array_append(frozen, opa_number_int(0));
+    opa_array_append(frozen, opa_number_int(1));
+    opa_array_append(frozen, opa_number_int(2));
+    opa_value_freeze(&frozen->hdr);
+
+    opa_array_t *view = opa_cast_array(opa_array_slice(&frozen->hdr, opa_number_int(1), opa_number_int(3)));
+
+    test("array_slice/frozen view borrows", view->elems == frozen->elems + 1);
+    test("array_slice/frozen view", view->len == 2 &&
+         opa_value_compare(view->elems[0].v, opa_number_int(1)) == 0 &&
+         opa_value_compare(view->elems[1].v, opa_number_int(2)) == 0);
 }
 
 WASM_EXPORT(test_types)
@@ -1479,6 +2601,12 @@ void test_types(void)
     test("name/array", opa_value_compare(opa_types_name(opa_array()), opa_string("array", 5)) == 0);
     test("name/object", opa_value_compare(opa_types_name(opa_object()), opa_string("object", 6)) == 0);
     test("name/set", opa_value_compare(opa_types_name(opa_set()), opa_string("set", 3)) == 0);
+
+    // the names are data-segment singletons: same handle every call, and
+    // freeing one leaves it intact
+    test("name/interned", opa_types_name(opa_array()) == opa_types_name(opa_array()));
+    opa_value_free(opa_types_name(opa_set()));
+    test("name/free leaves singleton", opa_value_compare(opa_types_name(opa_set()), opa_string("set", 3)) == 0);
 }
 
 static opa_value *number(const char *s)
@@ -1708,6 +2836,13 @@ void test_aggregates(void)
     test("product/array", opa_value_compare(opa_agg_product(&arr->hdr), opa_number_int(8)) == 0);
     test("product/set", opa_value_compare(opa_agg_product(&set->hdr), opa_number_int(8)) == 0);
 
+    // overflow of the integer fast path falls back to arbitrary precision
+    opa_array_t *arr_huge = opa_cast_array(opa_array());
+    opa_array_append(arr_huge, opa_number_int(0x7fffffffffffffffLL));
+    opa_array_append(arr_huge, opa_number_int(0x7fffffffffffffffLL));
+
+    test("sum/overflow", opa_value_compare(opa_agg_sum(&arr_huge->hdr), opa_number_ref("18446744073709551614", 20)) == 0);
+
     test("max/array", opa_value_compare(opa_agg_max(&arr->hdr), opa_number_int(4)) == 0);
     test("max/set", opa_value_compare(opa_agg_max(&set->hdr), opa_number_int(4)) == 0);
 
@@ -1717,6 +2852,37 @@ void test_aggregates(void)
     test("sort/array", opa_value_compare(opa_agg_sort(&arr->hdr), &arr_sorted->hdr) == 0);
     test("sort/set", opa_value_compare(opa_agg_sort(&set->hdr), &arr_sorted->hdr) == 0);
 
+    // all-integer arrays take the radix path; include negatives and
+    // duplicates so the sign-bit bias and counting passes are exercised
+    opa_array_t *arr_ints = opa_cast_array(opa_array());
+    opa_array_append(arr_ints, opa_number_int(7));
+    opa_array_append(arr_ints, opa_number_int(-300));
+    opa_array_append(arr_ints, opa_number_int(0));
+    opa_array_append(arr_ints, opa_number_int(7));
+    opa_array_append(arr_ints, opa_number_int(-1));
+
+    opa_array_t *arr_ints_sorted = opa_cast_array(opa_array());
+    opa_array_append(arr_ints_sorted, opa_number_int(-300));
+    opa_array_append(arr_ints_sorted, opa_number_int(-1));
+    opa_array_append(arr_ints_sorted, opa_number_int(0));
+    opa_array_append(arr_ints_sorted, opa_number_int(7));
+    opa_array_append(arr_ints_sorted, opa_number_int(7));
+
+    test("sort/ints", opa_value_compare(opa_agg_sort(&arr_ints->hdr), &arr_ints_sorted->hdr) == 0);
+
+    // all-string arrays take the specialized comparator
+    opa_array_t *arr_strs = opa_cast_array(opa_array());
+    opa_array_append(arr_strs, opa_string_terminated("ba"));
+    opa_array_append(arr_strs, opa_string_terminated("b"));
+    opa_array_append(arr_strs, opa_string_terminated("a"));
+
+    opa_array_t *arr_strs_sorted = opa_cast_array(opa_array());
+    opa_array_append(arr_strs_sorted, opa_string_terminated("a"));
+    opa_array_append(arr_strs_sorted, opa_string_terminated("b"));
+    opa_array_append(arr_strs_sorted, opa_string_terminated("ba"));
+
+    test("sort/strings", opa_value_compare(opa_agg_sort(&arr_strs->hdr), &arr_strs_sorted->hdr) == 0);
+
     opa_array_t *arr_trues = opa_cast_array(opa_array());
     opa_array_append(arr_trues, opa_boolean(true));
     opa_array_append(arr_trues, opa_boolean(true));
@@ -1760,6 +2926,7 @@ WASM_EXPORT(test_base64)
 void test_base64(void)
 {
     test("base64/is_valid", opa_value_compare(opa_base64_is_valid(opa_string_terminated("YWJjMTIzIT8kKiYoKSctPUB+")), opa_boolean(true)) == 0);
+    test("base64/is_valid invalid padding", opa_value_compare(opa_base64_is_valid(opa_string_terminated("TWFuTWFu====")), opa_boolean(false)) == 0);
     test("base64/encode", opa_value_compare(opa_base64_encode(opa_string_terminated("abc123!?$*&()'-=@~")), opa_string_terminated("YWJjMTIzIT8kKiYoKSctPUB+")) == 0);
     test("base64/encode", opa_value_compare(opa_base64_encode(opa_string_terminated("This is a long string that should not be split to many lines")),
                                             opa_string_terminated("VGhpcyBpcyBhIGxvbmcgc3RyaW5nIHRoYXQgc2hvdWxkIG5vdCBiZSBzcGxpdCB0byBtYW55IGxpbmVz")) == 0);
@@ -1772,11 +2939,38 @@ void test_base64(void)
     test("base64/url_decode", opa_value_compare(opa_base64_url_decode(opa_string_terminated("YWJjMTIzIT8kKiYoKSctPUB-")), opa_string_terminated("abc123!?$*&()'-=@~")) == 0);
 }
 
+WASM_EXPORT(test_hex)
+void test_hex(void)
+{
+    test("hex/encode", opa_value_compare(opa_hex_encode(opa_string_terminated("abc123!?$*&()'-=@~")), opa_string_terminated("616263313233213f242a262829272d3d407e")) == 0);
+    test("hex/encode empty", opa_value_compare(opa_hex_encode(opa_string_terminated("")), opa_string_terminated("")) == 0);
+    test("hex/decode", opa_value_compare(opa_hex_decode(opa_string_terminated("616263313233213f242a262829272d3d407e")), opa_string_terminated("abc123!?$*&()'-=@~")) == 0);
+    test("hex/decode upper", opa_value_compare(opa_hex_decode(opa_string_terminated("616263313233213F242A262829272D3D407E")), opa_string_terminated("abc123!?$*&()'-=@~")) == 0);
+    test("hex/decode odd length", opa_hex_decode(opa_string_terminated("616")) == NULL);
+    test("hex/decode invalid", opa_hex_decode(opa_string_terminated("61zz")) == NULL);
+}
+
+WASM_EXPORT(test_urlquery)
+void test_urlquery(void)
+{
+    test("urlquery/encode", opa_value_compare(opa_urlquery_encode(opa_string_terminated("a=b&c d/e")), opa_string_terminated("a%3Db%26c+d%2Fe")) == 0);
+    test("urlquery/encode unreserved", opa_value_compare(opa_urlquery_encode(opa_string_terminated("Ab0-_.~")), opa_string_terminated("Ab0-_.~")) == 0);
+    test("urlquery/decode", opa_value_compare(opa_urlquery_decode(opa_string_terminated("a%3Db%26c+d%2Fe")), opa_string_terminated("a=b&c d/e")) == 0);
+    test("urlquery/decode lower hex", opa_value_compare(opa_urlquery_decode(opa_string_terminated("a%3db")), opa_string_terminated("a=b")) == 0);
+    test("urlquery/decode truncated escape", opa_urlquery_decode(opa_string_terminated("abc%2")) == NULL);
+    test("urlquery/decode invalid escape", opa_urlquery_decode(opa_string_terminated("abc%zz")) == NULL);
+}
+
 WASM_EXPORT(test_json)
 void test_json(void)
 {
     test("json/marshal", opa_value_compare(opa_json_marshal(opa_string_terminated("string")), opa_string_terminated("\"string\"")) == 0);
     test("json/unmarshal", opa_value_compare(opa_json_unmarshal(opa_string_terminated("\"string\"")), opa_string_terminated("string")) == 0);
+
+    opa_value *doc = opa_string_terminated("{\"a\": [1, 2, 3]}");
+    opa_value *parsed = opa_json_unmarshal(doc);
+    test("json/unmarshal memoized", opa_json_unmarshal(doc) == parsed);
+    test("json/unmarshal distinct argument", opa_json_unmarshal(opa_string_terminated("{\"a\": [1, 2, 3]}")) != parsed);
 }
 
 WASM_EXPORT(test_object)
@@ -1811,6 +3005,331 @@ void test_object(void)
     opa_array_append(arr_keys, opa_string_terminated("a"));
     opa_array_append(arr_keys, opa_string_terminated("c"));
     test("object/filter (array keys)", opa_value_compare(builtin_object_filter(&obj->hdr, &arr_keys->hdr), &expected->hdr) == 0);
+
+    opa_set_t *all_keys = opa_cast_set(opa_set());
+    opa_set_add(all_keys, opa_string_terminated("a"));
+    opa_set_add(all_keys, opa_string_terminated("b"));
+    opa_set_add(all_keys, opa_string_terminated("c"));
+    test("object/filter (nothing filtered shares input)", builtin_object_filter(&obj->hdr, &all_keys->hdr) == &obj->hdr);
+}
+
+WASM_EXPORT(test_insert_bulk)
+void test_insert_bulk(void)
+{
+    opa_value *ks[4] = {
+        opa_string_terminated("a"),
+        opa_string_terminated("b"),
+        opa_string_terminated("c"),
+        opa_string_terminated("a"), // duplicate: keeps the last value
+    };
+    opa_value *vs[4] = {
+        opa_number_int(1),
+        opa_number_int(2),
+        opa_number_int(3),
+        opa_number_int(4),
+    };
+
+    opa_object_t *obj = opa_cast_object(opa_object());
+    opa_object_insert_bulk(obj, ks, vs, 4);
+
+    opa_object_t *expected = opa_cast_object(opa_object());
+    opa_object_insert(expected, opa_string_terminated("a"), opa_number_int(4));
+    opa_object_insert(expected, opa_string_terminated("b"), opa_number_int(2));
+    opa_object_insert(expected, opa_string_terminated("c"), opa_number_int(3));
+    test("object/insert_bulk", opa_value_compare(&obj->hdr, &expected->hdr) == 0);
+
+    opa_array_t *arr = opa_cast_array(opa_array());
+    opa_array_append(arr, opa_number_int(1));
+    opa_array_append(arr, opa_number_int(2));
+    opa_array_append(arr, opa_number_int(1)); // duplicate: added once
+
+    opa_set_t *set = opa_cast_set(opa_set());
+    opa_set_add_bulk(set, (opa_value **)arr->elems, arr->len);
+
+    opa_set_t *expected_set = opa_cast_set(opa_set());
+    opa_set_add(expected_set, opa_number_int(1));
+    opa_set_add(expected_set, opa_number_int(2));
+    test("set/add_bulk", opa_value_compare(&set->hdr, &expected_set->hdr) == 0);
+}
+
+WASM_EXPORT(test_string_intern)
+void test_string_intern(void)
+{
+    opa_value *a = opa_string_intern("foo", 3);
+
+    test("intern/same pointer", a == opa_string_intern("foo", 3));
+    test("intern/type", a->type == OPA_STRING_INTERNED);
+    test("intern/compares as string",
+         opa_value_compare(a, opa_string_terminated("foo")) == 0);
+
+    char big[OPA_STRING_INTERN_MAX_LEN + 1];
+    memset(big, 'x', sizeof(big));
+    test("intern/too long", opa_string_intern(big, sizeof(big)) == NULL);
+
+    // repeated object keys across a parsed document share one value, and an
+    // escaped spelling unifies with the plain one
+    char doc[] = "[{\"alpha\":1},{\"alpha\":2},{\"alp\\u0068a\":3}]";
+    opa_value *v = opa_json_parse(doc, sizeof(doc)-1);
+    opa_value *k = NULL;
+
+    for (int i = 0; i < 3; i++)
+    {
+        opa_object_t *obj = opa_cast_object(opa_value_get(v, opa_number_int(i)));
+        opa_object_elem_t *elem = opa_object_get(obj, opa_string_terminated("alpha"));
+
+        test("intern/parsed key found", elem != NULL);
+        test("intern/parsed key shared", k == NULL || elem->k == k);
+        k = elem->k;
+    }
+
+    test("intern/parsed key interned", k->type == OPA_STRING_INTERNED);
+
+    // interned keys survive freeing their containers: the next parse reuses
+    // them instead of crashing on a dangling table entry
+    opa_value_free_deep(v);
+    v = opa_json_parse(doc, sizeof(doc)-1);
+    opa_object_t *obj = opa_cast_object(opa_value_get(v, opa_number_int(0)));
+    test("intern/key outlives container", opa_object_get(obj, opa_string_terminated("alpha"))->k == k);
+    opa_value_free_deep(v);
+}
+
+WASM_EXPORT(test_value_dedup)
+void test_value_dedup(void)
+{
+    // identical permission objects under two tenants collapse to one
+    char doc[] = "{\"t1\": {\"perm\": {\"read\": true, \"paths\": [\"/a\"]}},"
+                 " \"t2\": {\"perm\": {\"read\": true, \"paths\": [\"/a\"]}}}";
+    char doc2[] = "{\"t1\": {\"perm\": {\"read\": true, \"paths\": [\"/a\"]}},"
+                  " \"t2\": {\"perm\": {\"read\": true, \"paths\": [\"/a\"]}}}";
+    opa_value *v = opa_json_parse_dedup(doc, sizeof(doc)-1);
+    opa_value *plain = opa_json_parse(doc2, sizeof(doc2)-1);
+
+    test("dedup/equal to plain parse", opa_value_compare(v, plain) == 0);
+
+    opa_value *p1 = opa_value_get(opa_value_get(v, opa_string_terminated("t1")),
+                                  opa_string_terminated("perm"));
+    opa_value *p2 = opa_value_get(opa_value_get(v, opa_string_terminated("t2")),
+                                  opa_string_terminated("perm"));
+
+    test("dedup/subtree shared", p1 != NULL && p1 == p2);
+    test("dedup/shared lookup", opa_value_get(p1, opa_string_terminated("read")) != NULL);
+    test("dedup/idempotent", opa_value_dedup(v) == v);
+}
+
+WASM_EXPORT(test_value_freeze)
+void test_value_freeze(void)
+{
+    char doc[] = "{\"roles\": [\"admin\", \"dev\"], \"limits\": {\"rps\": 100}}";
+    opa_value *v = opa_json_parse(doc, sizeof(doc)-1);
+
+    test("freeze/not frozen before", !opa_value_frozen(v));
+
+    opa_value_freeze(v);
+
+    test("freeze/root frozen", opa_value_frozen(v));
+    test("freeze/subtree frozen", opa_value_frozen(opa_value_get(v, opa_string_terminated("limits"))));
+
+    // values allocated after the freeze stay mutable
+    opa_value *scratch = opa_array();
+    test("freeze/later value not frozen", !opa_value_frozen(scratch));
+    opa_array_append(opa_cast_array(scratch), opa_number_int(1));
+    test("freeze/later value mutable", opa_value_length(scratch) == 1);
+
+    // reads and hashing on frozen values work as before
+    test("freeze/read", opa_value_length(opa_value_get(v, opa_string_terminated("roles"))) == 2);
+    test("freeze/hash", opa_value_hash(v) == opa_value_hash(v));
+}
+
+WASM_EXPORT(test_sorted_set)
+void test_sorted_set(void)
+{
+    opa_set_t *set = opa_cast_set(opa_set());
+
+    test("sorted_set/initial form", set->sorted == 1);
+
+    opa_set_add(set, opa_number_int(5));
+    opa_set_add(set, opa_number_int(1));
+    opa_set_add(set, opa_number_int(3));
+    opa_set_add(set, opa_number_int(3)); // duplicate
+
+    test("sorted_set/len", set->len == 3);
+    test("sorted_set/ordered", opa_value_compare(set->buckets[0]->v, set->buckets[1]->v) < 0 &&
+                               opa_value_compare(set->buckets[1]->v, set->buckets[2]->v) < 0);
+    test("sorted_set/get hit", opa_set_get(set, opa_number_int(3)) != NULL);
+    test("sorted_set/get miss", opa_set_get(set, opa_number_int(4)) == NULL);
+
+    size_t count = 0;
+
+    for (opa_value *prev = opa_value_iter(&set->hdr, NULL); prev != NULL;
+         prev = opa_value_iter(&set->hdr, prev))
+    {
+        count++;
+    }
+
+    test("sorted_set/iter", count == 3);
+
+    // the ninth element promotes the vector to the hash form
+    opa_set_t *promoted = opa_cast_set(opa_set());
+
+    for (long long i = 0; i < 9; i++)
+    {
+        opa_set_add(promoted, opa_number_int(i));
+    }
+
+    test("sorted_set/promoted", promoted->sorted == 0 && promoted->len == 9);
+    test("sorted_set/promoted get", opa_set_get(promoted, opa_number_int(8)) != NULL);
+
+    // both forms hold the same value
+    opa_set_t *hashed = opa_cast_set(opa_set_with_cap(100));
+    opa_set_add(hashed, opa_number_int(3));
+    opa_set_add(hashed, opa_number_int(5));
+    opa_set_add(hashed, opa_number_int(1));
+
+    test("sorted_set/cross-form compare", opa_value_compare(&set->hdr, &hashed->hdr) == 0);
+    test("sorted_set/cross-form hash", opa_value_hash(&set->hdr) == opa_value_hash(&hashed->hdr));
+
+    opa_value_free_deep(&set->hdr);
+    opa_value_free_deep(&promoted->hdr);
+    opa_value_free_deep(&hashed->hdr);
+}
+
+WASM_EXPORT(test_opa_value_get_path)
+void test_opa_value_get_path(void)
+{
+    // data -> {"a": {"b": [null, {"c": 1}]}}
+    char doc[] = "{\"a\": {\"b\": [null, {\"c\": 1}]}}";
+    opa_value *data = opa_json_parse(doc, sizeof(doc)-1);
+
+    opa_value *keys[4] = {
+        opa_string_terminated("a"),
+        opa_string_terminated("b"),
+        opa_number_int(1),
+        opa_string_terminated("c"),
+    };
+    size_t hashes[4];
+
+    for (size_t i = 0; i < 4; i++)
+    {
+        hashes[i] = opa_value_hash(keys[i]);
+    }
+
+    opa_value *expected = opa_value_get(opa_value_get(opa_value_get(
+        opa_value_get(data, keys[0]), keys[1]), keys[2]), keys[3]);
+
+    test("get_path/chained equivalent", expected != NULL &&
+         opa_value_get_path(data, keys, hashes, 4) == expected);
+    test("get_path/prefix", opa_value_get_path(data, keys, hashes, 2) ==
+         opa_value_get(opa_value_get(data, keys[0]), keys[1]));
+    test("get_path/empty", opa_value_get_path(data, keys, hashes, 0) == data);
+
+    keys[3] = opa_string_terminated("missing");
+    hashes[3] = opa_value_hash(keys[3]);
+    test("get_path/miss", opa_value_get_path(data, keys, hashes, 4) == NULL);
+
+    opa_value_free_deep(data);
+}
+
+WASM_EXPORT(test_set_bitmap)
+void test_set_bitmap(void)
+{
+    opa_set_t *set = opa_cast_set(opa_set_with_cap(64));
+
+    for (long long i = 0; i < 64; i++)
+    {
+        opa_set_add(set, opa_number_int(i * 2));
+    }
+
+    long long base;
+    size_t words;
+
+    test("set_bitmap/built", opa_set_bitmap(set, &base, &words) != NULL && base == 0);
+    test("set_bitmap/get hit", opa_set_get(set, opa_number_int(10)) != NULL);
+    test("set_bitmap/get miss", opa_set_get(set, opa_number_int(11)) == NULL);
+    test("set_bitmap/get out of range", opa_set_get(set, opa_number_int(-5)) == NULL);
+
+    // a mutation drops the bitmap and the next lookup rebuilds it
+    opa_set_add(set, opa_number_int(11));
+    test("set_bitmap/invalidated", set->bitmap == NULL);
+    test("set_bitmap/rebuilt hit", opa_set_get(set, opa_number_int(11)) != NULL);
+
+    // a non-integer member makes the set ineligible, but lookups still work
+    opa_set_add(set, opa_string_terminated("x"));
+    test("set_bitmap/ineligible", opa_set_bitmap(set, &base, &words) == NULL);
+    test("set_bitmap/fallback hit", opa_set_get(set, opa_number_int(10)) != NULL);
+    test("set_bitmap/fallback miss", opa_set_get(set, opa_number_int(13)) == NULL);
+
+    // word-wise membership in the binary set operations
+    opa_set_t *a = opa_cast_set(opa_set_with_cap(64));
+    opa_set_t *b = opa_cast_set(opa_set_with_cap(64));
+
+    for (long long i = 0; i < 64; i++)
+    {
+        opa_set_add(a, opa_number_int(i));
+        opa_set_add(b, opa_number_int(i + 32));
+    }
+
+    opa_set_t *inter = opa_cast_set(opa_set_intersection(&a->hdr, &b->hdr));
+    opa_set_t *diff = opa_cast_set(opa_set_diff(&a->hdr, &b->hdr));
+
+    test("set_bitmap/intersection", inter->len == 32 &&
+         opa_set_get(inter, opa_number_int(40)) != NULL &&
+         opa_set_get(inter, opa_number_int(10)) == NULL);
+    test("set_bitmap/diff", diff->len == 32 &&
+         opa_set_get(diff, opa_number_int(10)) != NULL &&
+         opa_set_get(diff, opa_number_int(40)) == NULL);
+
+    opa_value_free_deep(&set->hdr);
+    opa_value_free_deep(&a->hdr);
+    opa_value_free_deep(&b->hdr);
+    opa_value_free_deep(&inter->hdr);
+    opa_value_free_deep(&diff->hdr);
+}
+
+WASM_EXPORT(test_object_bloom)
+void test_object_bloom(void)
+{
+    opa_object_t *obj = opa_cast_object(opa_object());
+
+    for (int i = 0; i < 64; i++)
+    {
+        opa_object_insert(obj, opa_number_int(i), opa_number_int(i * 2));
+    }
+
+    bool hits = true;
+
+    for (int i = 0; i < 64; i++)
+    {
+        opa_object_elem_t *elem = opa_object_get(obj, opa_number_int(i));
+        hits &= elem != NULL && opa_value_compare(elem->v, opa_number_int(i * 2)) == 0;
+    }
+
+    test("object_bloom/hits", hits);
+    test("object_bloom/built by lookup", obj->bloom != NULL);
+
+    bool misses = true;
+
+    for (int i = 100; i < 200; i++)
+    {
+        misses &= opa_object_get(obj, opa_number_int(i)) == NULL;
+    }
+
+    test("object_bloom/misses", misses);
+
+    // a new key drops the filter and the next lookup rebuilds it
+    opa_object_insert(obj, opa_number_int(100), opa_number_int(200));
+    test("object_bloom/invalidated", obj->bloom == NULL);
+    test("object_bloom/rebuilt hit", opa_object_get(obj, opa_number_int(100)) != NULL);
+
+    // overwriting a value keeps the key set, and the filter with it
+    unsigned long long *bloom = obj->bloom;
+    opa_object_insert(obj, opa_number_int(0), opa_number_int(42));
+    test("object_bloom/overwrite keeps filter", obj->bloom == bloom);
+
+    opa_object_remove(obj, opa_number_int(5));
+    test("object_bloom/remove invalidates", obj->bloom == NULL);
+    test("object_bloom/removed key miss", opa_object_get(obj, opa_number_int(5)) == NULL);
+
+    opa_value_free_deep(&obj->hdr);
 }
 
 WASM_EXPORT(test_object_remove)
@@ -1890,6 +3409,8 @@ void test_object_remove(void)
     opa_set_add(set_keys3, opa_string_terminated("foo"));
     test("object/remove (key does not exist)", opa_value_compare(builtin_object_remove(&obj3->hdr, &set_keys3->hdr), &obj3->hdr) == 0);
 
+    test("object/remove (nothing removed shares input)", builtin_object_remove(&obj3->hdr, &set_keys3->hdr) == &obj3->hdr);
+
     test("object/remove (second operand not object/set/array)", opa_value_compare(builtin_object_remove(&obj3->hdr, opa_string_terminated("a")), NULL) == 0);
 }
 
@@ -2174,6 +3695,10 @@ void test_json_remove(void)
 
     test("jsonremove/base", opa_value_compare(builtin_json_remove(&obj1->hdr, &set_paths1->hdr), &expected1->hdr) == 0);
 
+    // roots not named by any path are shared with the input, not copied
+    test("jsonremove/untouched root shares", opa_value_get(builtin_json_remove(&obj1->hdr, &set_paths1->hdr), opa_string_terminated("e")) ==
+                                             opa_value_get(&obj1->hdr, opa_string_terminated("e")));
+
     opa_set_add(set_paths1, opa_string_terminated("e"));
 
     opa_object_t *expected2 = opa_cast_object(opa_object());
@@ -2210,6 +3735,11 @@ void test_json_remove(void)
 
     test("jsonremove/empty list", opa_value_compare(builtin_json_remove(&obj4->hdr, opa_set()), &obj4->hdr) == 0);
 
+    opa_set_t *set_paths_nomatch = opa_cast_set(opa_set());
+    opa_set_add(set_paths_nomatch, opa_string_terminated("zz"));
+
+    test("jsonremove/no match shares input", builtin_json_remove(&obj4->hdr, &set_paths_nomatch->hdr) == &obj4->hdr);
+
     test("jsonremove/empty object", opa_value_compare(builtin_json_remove(opa_object(), &set_paths3->hdr), opa_object()) == 0);
 
     opa_object_t *obj5 = json_test_fixture_object1();
@@ -2377,6 +3907,9 @@ void test_json_filter(void)
 
     test("jsonfilter/conflict", opa_value_compare(builtin_json_filter(&obj3->hdr, &set_paths3->hdr), &obj3->hdr) == 0);
 
+    // every key selected by a whole-subtree path: the input is shared
+    test("jsonfilter/whole doc shares input", builtin_json_filter(&obj3->hdr, &set_paths3->hdr) == &obj3->hdr);
+
     test("jsonfilter/empty list", opa_value_compare(builtin_json_filter(&obj3->hdr, opa_set()), opa_object()) == 0);
 
     test("jsonfilter/empty object", opa_value_compare(builtin_json_filter(opa_object(), &set_paths3->hdr), opa_object()) == 0);
@@ -2574,6 +4107,132 @@ void test_builtin_graph_reachable(void)
     test("reachable/null edge", opa_value_compare(builtin_graph_reachable(&graph4->hdr, &initial3->hdr), &expected4->hdr) == 0);
 }
 
+static opa_value *reachable_path2(const char *a, const char *b)
+{
+    opa_array_t *path = opa_cast_array(opa_array());
+    opa_array_append(path, opa_string_terminated(a));
+    opa_array_append(path, opa_string_terminated(b));
+    return &path->hdr;
+}
+
+WASM_EXPORT(test_builtin_graph_reachable_paths)
+void test_builtin_graph_reachable_paths(void)
+{
+    // graph -> {"a": ["b", "c"], "b": ["d"], "c": ["d"], "d": []}
+    opa_object_t *graph = opa_cast_object(opa_object());
+
+    opa_array_t *vertex_a = opa_cast_array(opa_array());
+    opa_array_append(vertex_a, opa_string_terminated("b"));
+    opa_array_append(vertex_a, opa_string_terminated("c"));
+    opa_object_insert(graph, opa_string_terminated("a"), &vertex_a->hdr);
+
+    opa_array_t *vertex_b = opa_cast_array(opa_array());
+    opa_array_append(vertex_b, opa_string_terminated("d"));
+    opa_object_insert(graph, opa_string_terminated("b"), &vertex_b->hdr);
+    opa_object_insert(graph, opa_string_terminated("c"), &vertex_b->hdr);
+    opa_object_insert(graph, opa_string_terminated("d"), opa_array());
+
+    opa_set_t *initial = opa_cast_set(opa_set());
+    opa_set_add(initial, opa_string_terminated("a"));
+
+    opa_value *paths = builtin_graph_reachable_paths(&graph->hdr, &initial->hdr);
+    test("reachable_paths/diamond (len)", paths != NULL && opa_value_length(paths) == 2);
+
+    opa_array_t *abd = opa_cast_array(reachable_path2("a", "b"));
+    opa_array_append(abd, opa_string_terminated("d"));
+    test("reachable_paths/diamond", opa_value_get(paths, &abd->hdr) != NULL);
+
+    // graph -> {"a": ["b"], "b": ["a"]}: the path stops before repeating a.
+    opa_object_t *cyclic = opa_cast_object(opa_object());
+    opa_array_t *to_b = opa_cast_array(opa_array());
+    opa_array_append(to_b, opa_string_terminated("b"));
+    opa_object_insert(cyclic, opa_string_terminated("a"), &to_b->hdr);
+    opa_array_t *to_a = opa_cast_array(opa_array());
+    opa_array_append(to_a, opa_string_terminated("a"));
+    opa_object_insert(cyclic, opa_string_terminated("b"), &to_a->hdr);
+
+    paths = builtin_graph_reachable_paths(&cyclic->hdr, &initial->hdr);
+    test("reachable_paths/cycle (len)", paths != NULL && opa_value_length(paths) == 1);
+    test("reachable_paths/cycle", opa_value_get(paths, reachable_path2("a", "b")) != NULL);
+
+    // Edges to nodes that are not keys end the path there.
+    opa_object_t *dangling = opa_cast_object(opa_object());
+    opa_array_t *to_x = opa_cast_array(opa_array());
+    opa_array_append(to_x, opa_string_terminated("x"));
+    opa_object_insert(dangling, opa_string_terminated("a"), &to_x->hdr);
+
+    paths = builtin_graph_reachable_paths(&dangling->hdr, &initial->hdr);
+    test("reachable_paths/dangling", paths != NULL && opa_value_length(paths) == 1 &&
+         opa_value_get(paths, reachable_path2("a", "x")) != NULL);
+
+    test("reachable_paths/malformed graph", opa_value_compare(builtin_graph_reachable_paths(opa_set(), &initial->hdr), opa_set()) == 0);
+    test("reachable_paths/malformed initial", opa_value_compare(builtin_graph_reachable_paths(&graph->hdr, opa_string_terminated("foo")), opa_set()) == 0);
+}
+
+WASM_EXPORT(test_opa_string_rope)
+void test_opa_string_rope(void)
+{
+    opa_value *sep = opa_string_terminated(",");
+
+    // a fragment large enough that joining two crosses the rope threshold
+    char frag[129];
+
+    for (int i = 0; i < 128; i++)
+    {
+        frag[i] = 'x';
+    }
+
+    frag[128] = 0;
+
+    // small results stay flat strings
+    opa_array_t *small = opa_cast_array(opa_array());
+    opa_array_append(small, opa_string_terminated("a"));
+    opa_array_append(small, opa_string_terminated("b"));
+    test("rope/small flat", opa_strings_concat(sep, &small->hdr)->type == OPA_STRING);
+
+    // accumulator loop: re-concatenating the result must not flatten it
+    opa_value *acc = opa_string_terminated(frag);
+    bool deferred = true;
+
+    for (int i = 0; i < 64; i++)
+    {
+        opa_array_t *args = opa_cast_array(opa_array());
+        opa_array_append(args, acc);
+        opa_array_append(args, opa_string_terminated(frag));
+        acc = opa_strings_concat(sep, &args->hdr);
+        deferred = deferred && acc->type == OPA_STRING_ROPE;
+    }
+
+    test("rope/accumulator deferred", deferred);
+    test("rope/length precomputed", opa_cast_string(acc)->len == 65 * 128 + 64);
+
+    // first byte-wise access flattens in place
+    size_t hash = opa_value_hash(acc);
+    test("rope/flattened in place", acc->type == OPA_STRING && opa_cast_string(acc)->v != NULL);
+
+    // matches the same string built eagerly
+    char *want = (char *)opa_malloc(65 * 128 + 64 + 1);
+    size_t j = 0;
+
+    for (int i = 0; i < 65; i++)
+    {
+        if (i > 0)
+        {
+            want[j++] = ',';
+        }
+
+        for (int k = 0; k < 128; k++)
+        {
+            want[j++] = 'x';
+        }
+    }
+
+    want[j] = 0;
+    opa_value *eager = opa_string_allocated(want, j);
+    test("rope/bytes", opa_value_compare(acc, eager) == 0);
+    test("rope/hash", hash == opa_value_hash(eager));
+}
+
 WASM_EXPORT(test_strings)
 void test_strings(void)
 {
@@ -2677,12 +4336,24 @@ void test_strings(void)
     test("replace/cacab", opa_value_compare(opa_strings_replace(opa_string_terminated("cac"), opa_string_terminated("a"), opa_string_terminated("b")), opa_string_terminated("cbc")) == 0);
     test("replace/cacabd", opa_value_compare(opa_strings_replace(opa_string_terminated("cac"), opa_string_terminated("a"), opa_string_terminated("bd")), opa_string_terminated("cbdc")) == 0);
 
+    opa_value *replace_src = opa_string_terminated("cc");
+    test("replace/no match shares input", opa_strings_replace(replace_src, opa_string_terminated("a"), opa_string_terminated("b")) == replace_src);
+
     opa_object_t *obj2 = opa_cast_object(opa_object());
     opa_object_insert(obj2, opa_string_terminated("a"), opa_string_terminated("b"));
     opa_object_insert(obj2, opa_string_terminated("c"), opa_string_terminated("d"));
 
     test("replace_n/empty", opa_value_compare(opa_strings_replace_n(opa_object(), opa_string_terminated("a")), opa_string_terminated("a")) == 0);
     test("replace_n/two", opa_value_compare(opa_strings_replace_n(&obj2->hdr, opa_string_terminated("ac")), opa_string_terminated("bd")) == 0);
+    test("replace_n/single pass", opa_value_compare(opa_strings_replace_n(&obj2->hdr, opa_string_terminated("xaxcx")), opa_string_terminated("xbxdx")) == 0);
+
+    opa_object_t *obj2b = opa_cast_object(opa_object());
+    opa_object_insert(obj2b, opa_string_terminated("a"), opa_string_terminated("cc"));
+    opa_object_insert(obj2b, opa_string_terminated("cc"), opa_string_terminated("e"));
+    test("replace_n/no rescan of replaced text", opa_value_compare(opa_strings_replace_n(&obj2b->hdr, opa_string_terminated("aa")), opa_string_terminated("cccc")) == 0);
+
+    opa_value *replace_n_src = opa_string_terminated("zz");
+    test("replace_n/no match shares input", opa_strings_replace_n(&obj2->hdr, replace_n_src) == replace_n_src);
 
     opa_array_t *arr2b = opa_cast_array(opa_array());
     opa_array_append(arr2b, opa_string_terminated(""));
@@ -2808,6 +4479,21 @@ void test_strings(void)
     test("upper/AbCd", opa_value_compare(opa_strings_upper(opa_string_terminated("AbCd")), opa_string_terminated("ABCD")) == 0);
     test("upper/utf-8", opa_value_compare(opa_strings_upper(opa_string_terminated("\xc4\x81")), opa_string_terminated("\xc4\x80")) == 0);
     test("upper/utf-8", opa_value_compare(opa_strings_upper(opa_string_terminated("\xc6\x80")), opa_string_terminated("\xc9\x83")) == 0);
+
+    // table-driven case mapping: an upper-lower sequence pair, a mapping
+    // outside the basic multilingual plane (Deseret) and an uncased rune
+    test("case table/upper-lower pair", opa_unicode_to_lower(0x0100) == 0x0101 && opa_unicode_to_upper(0x0101) == 0x0100);
+    test("case table/deseret", opa_unicode_to_lower(0x10400) == 0x10428 && opa_unicode_to_upper(0x10428) == 0x10400);
+    test("case table/uncased", opa_unicode_to_lower(0x3042) == 0x3042 && opa_unicode_to_upper(0x3042) == 0x3042);
+
+    test("equal_fold/_", opa_strings_equal_fold(opa_string_terminated(""), opa_string_terminated("")) == opa_boolean(true));
+    test("equal_fold/ascii", opa_strings_equal_fold(opa_string_terminated("Content-Type"), opa_string_terminated("content-type")) == opa_boolean(true));
+    test("equal_fold/ascii word path", opa_strings_equal_fold(opa_string_terminated("X-Forwarded-For"), opa_string_terminated("x-forwarded-for")) == opa_boolean(true));
+    test("equal_fold/ascii mismatch", opa_strings_equal_fold(opa_string_terminated("X-Forwarded-For"), opa_string_terminated("x-forwarded-fox")) == opa_boolean(false));
+    test("equal_fold/punctuation", opa_strings_equal_fold(opa_string_terminated("a[b"), opa_string_terminated("a{b")) == opa_boolean(false));
+    test("equal_fold/prefix", opa_strings_equal_fold(opa_string_terminated("abc"), opa_string_terminated("abcd")) == opa_boolean(false));
+    test("equal_fold/utf-8", opa_strings_equal_fold(opa_string_terminated("\xc4\x80"), opa_string_terminated("\xc4\x81")) == opa_boolean(true));
+    test("equal_fold/non-string", opa_strings_equal_fold(opa_number_int(1), opa_string_terminated("a")) == NULL);
 }
 
 WASM_EXPORT(test_numbers_range)
@@ -2846,6 +4532,39 @@ void test_to_number(void)
     test("to_number/float", opa_value_compare(opa_to_number(opa_string_terminated("3.5")), opa_number_float(3.5)) == 0);
     test("to_number/bad string", opa_to_number(opa_string_terminated("deadbeef")) == NULL);
     test("to_number/bad value", opa_to_number(opa_array()) == NULL);
+
+    // plain integer strings hit the opa_atoi64 fast path and come back
+    // with int repr; everything else keeps the ref-repr route
+    test("to_number/int repr", opa_cast_number(opa_to_number(opa_string_terminated("123")))->repr == OPA_NUMBER_REPR_INT);
+    test("to_number/negative", opa_value_compare(opa_to_number(opa_string_terminated("-7")), opa_number_int(-7)) == 0);
+    test("to_number/18 digits", opa_value_compare(opa_to_number(opa_string_terminated("999999999999999999")), opa_number_int(999999999999999999LL)) == 0);
+    test("to_number/big stays ref", opa_cast_number(opa_to_number(opa_string_terminated("123456789012345678901234567890")))->repr == OPA_NUMBER_REPR_REF);
+    test("to_number/float stays ref", opa_cast_number(opa_to_number(opa_string_terminated("1.5")))->repr == OPA_NUMBER_REPR_REF);
+    test("to_number/exponent stays ref", opa_cast_number(opa_to_number(opa_string_terminated("1e3")))->repr == OPA_NUMBER_REPR_REF);
+    test("to_number/trailing garbage", opa_to_number(opa_string_terminated("12x")) == NULL);
+}
+
+WASM_EXPORT(test_comparisons)
+void test_comparisons(void)
+{
+    // int/int kernel
+    test("cmp/lt int", opa_value_compare(opa_cmp_lt(opa_number_int(3), opa_number_int(5)), opa_boolean(true)) == 0);
+    test("cmp/gt int", opa_value_compare(opa_cmp_gt(opa_number_int(5), opa_number_int(3)), opa_boolean(true)) == 0);
+    test("cmp/gte equal", opa_value_compare(opa_cmp_gte(opa_number_int(3), opa_number_int(3)), opa_boolean(true)) == 0);
+    test("cmp/lte", opa_value_compare(opa_cmp_lte(opa_number_int(5), opa_number_int(3)), opa_boolean(false)) == 0);
+    test("cmp/eq int", opa_value_compare(opa_cmp_eq(opa_number_int(3), opa_number_int(3)), opa_boolean(true)) == 0);
+    test("cmp/neq int", opa_value_compare(opa_cmp_neq(opa_number_int(3), opa_number_int(5)), opa_boolean(true)) == 0);
+
+    // int/float kernel
+    test("cmp/int lt float", opa_value_compare(opa_cmp_lt(opa_number_int(3), opa_number_float(3.5)), opa_boolean(true)) == 0);
+    test("cmp/float gt int", opa_value_compare(opa_cmp_gt(opa_number_float(3.5), opa_number_int(3)), opa_boolean(true)) == 0);
+    test("cmp/neg float", opa_value_compare(opa_cmp_lt(opa_number_float(-0.5), opa_number_int(0)), opa_boolean(true)) == 0);
+    test("cmp/float neq int", opa_value_compare(opa_cmp_neq(opa_number_float(3.5), opa_number_int(3)), opa_boolean(true)) == 0);
+
+    // general-path fallbacks
+    test("cmp/strings", opa_value_compare(opa_cmp_lt(opa_string_terminated("a"), opa_string_terminated("b")), opa_boolean(true)) == 0);
+    test("cmp/mixed types", opa_value_compare(opa_cmp_lt(opa_number_int(3), opa_string_terminated("a")), opa_boolean(true)) == 0);
+    test("cmp/long decimals", opa_value_compare(opa_cmp_lt(opa_number_ref("1.2500000000000000001", 20), opa_number_ref("1.5", 3)), opa_boolean(true)) == 0);
 }
 
 WASM_EXPORT(test_cidr_contains)
@@ -2870,6 +4589,110 @@ void test_cidr_contains(void)
     test("cidr/contains", opa_value_compare(opa_cidr_intersects(opa_string_terminated("fd1e:5bfe:8af3:9ddc::/64"), opa_string_terminated("2001:4860:4860::8888/32")), opa_boolean(false)) == 0);
     test("cidr/contains", opa_cidr_intersects(opa_string_terminated("not-a-cidr"), opa_string_terminated("192.168.1.0/24")) == NULL);
     test("cidr/contains", opa_cidr_intersects(opa_string_terminated("192.168.1.0/28"), opa_string_terminated("not-a-cidr")) == NULL);
+
+    opa_set_t *nets = opa_cast_set(opa_set());
+    opa_set_add(nets, opa_string_terminated("10.0.0.0/8"));
+    opa_set_add(nets, opa_string_terminated("10.1.0.0/16"));
+    opa_set_add(nets, opa_string_terminated("192.168.0.0/16"));
+
+    opa_value *matches = opa_cidr_contains_matches(&nets->hdr, opa_string_terminated("10.1.2.3"));
+    test("cidr/contains_matches (len)", matches != NULL && opa_value_length(matches) == 2);
+
+    opa_value *expected = opa_array();
+    opa_array_append(opa_cast_array(expected), opa_string_terminated("10.1.0.0/16"));
+    opa_array_append(opa_cast_array(expected), opa_string_terminated("10.1.2.3"));
+    test("cidr/contains_matches", matches != NULL && opa_value_get(matches, expected) != NULL);
+
+    matches = opa_cidr_contains_matches(&nets->hdr, opa_string_terminated("8.8.8.8"));
+    test("cidr/contains_matches (miss)", matches != NULL && opa_value_length(matches) == 0);
+    test("cidr/contains_matches (bad net)", opa_cidr_contains_matches(opa_string_terminated("not-a-cidr"), opa_string_terminated("10.0.0.1")) == NULL);
+}
+
+WASM_EXPORT(test_cidr_expand)
+void test_cidr_expand(void)
+{
+    opa_value *r = opa_cidr_expand(opa_string_terminated("192.168.1.0/30"));
+    test("cidr/expand (len)", r != NULL && opa_value_length(r) == 4);
+    test("cidr/expand (first)", r != NULL && opa_value_get(r, opa_string_terminated("192.168.1.0")) != NULL);
+    test("cidr/expand (last)", r != NULL && opa_value_get(r, opa_string_terminated("192.168.1.3")) != NULL);
+    test("cidr/expand (bounds)", r != NULL && opa_value_get(r, opa_string_terminated("192.168.1.4")) == NULL);
+
+    r = opa_cidr_expand(opa_string_terminated("10.1.2.3/32"));
+    test("cidr/expand (host)", r != NULL && opa_value_length(r) == 1 &&
+         opa_value_get(r, opa_string_terminated("10.1.2.3")) != NULL);
+
+    r = opa_cidr_expand(opa_string_terminated("2001:db8::/126"));
+    test("cidr/expand (v6 len)", r != NULL && opa_value_length(r) == 4);
+    test("cidr/expand (v6 compressed)", r != NULL && opa_value_get(r, opa_string_terminated("2001:db8::3")) != NULL);
+
+    r = opa_cidr_expand(opa_string_terminated("1:2:3:4:5:6:7:8/128"));
+    test("cidr/expand (v6 full)", r != NULL && opa_value_get(r, opa_string_terminated("1:2:3:4:5:6:7:8")) != NULL);
+
+    test("cidr/expand (not cidr)", opa_cidr_expand(opa_string_terminated("10.1.2.3")) == NULL);
+    test("cidr/expand (bad)", opa_cidr_expand(opa_string_terminated("not-a-cidr")) == NULL);
+    test("cidr/expand (too large)", opa_cidr_expand(opa_string_terminated("10.0.0.0/0")) == NULL);
+}
+
+WASM_EXPORT(test_result_accessors)
+void test_result_accessors(void)
+{
+    const char *doc = "{\"allow\":true,\"user\":\"alice\",\"tags\":[\"a\",\"b\"]}";
+    opa_value *v = opa_json_parse(doc, opa_strlen(doc));
+
+    test("result/type", opa_result_type(v) == OPA_OBJECT && opa_result_type(NULL) == 0);
+    test("result/length", opa_result_length(v) == 3);
+    test("result/bool", opa_result_bool(opa_result_get(v, "allow", 5)) == 1);
+    test("result/bool (non-bool)", opa_result_bool(v) == -1);
+
+    opa_value *user = opa_result_get(v, "user", 4);
+    test("result/string", opa_result_string_len(user) == 5 &&
+         opa_strncmp(opa_result_string_ptr(user), "alice", 5) == 0);
+
+    opa_value *tags = opa_result_get(v, "tags", 4);
+    test("result/index", opa_result_string_len(opa_result_get_index(tags, 1)) == 1);
+    test("result/index (oob)", opa_result_get_index(tags, 2) == NULL);
+    test("result/missing composes", opa_result_type(opa_result_get(v, "nope", 4)) == 0);
+
+    size_t keys = 0;
+    for (opa_value *k = opa_result_iter(v, NULL); k != NULL; k = opa_result_iter(v, k))
+    {
+        keys++;
+    }
+    test("result/iter", keys == 3);
+}
+
+WASM_EXPORT(test_result_pagination)
+void test_result_pagination(void)
+{
+    const char *doc = "{\"allow\":true,\"tags\":[\"a\",\"b\"]}";
+    opa_value *v = opa_json_parse(doc, opa_strlen(doc));
+
+    // array pages are the elements themselves
+    opa_value_cursor_t *cur = opa_result_iter_begin(opa_result_get(v, "tags", 4));
+    char *p = opa_result_iter_next(cur);
+    test("result/page (first)", p != NULL && opa_strncmp(p, "\"a\"", 4) == 0);
+    p = opa_result_iter_next(cur);
+    test("result/page (second)", p != NULL && opa_strncmp(p, "\"b\"", 4) == 0);
+    test("result/page (done)", opa_result_iter_next(cur) == NULL);
+    test("result/page (done sticky)", opa_result_iter_next(cur) == NULL);
+
+    // object pages are single-pair objects
+    cur = opa_result_iter_begin(v);
+    size_t pages = 0, saw_allow = 0;
+    for (p = opa_result_iter_next(cur); p != NULL; p = opa_result_iter_next(cur))
+    {
+        pages++;
+        if (opa_strncmp(p, "{\"allow\":true}", 15) == 0)
+        {
+            saw_allow = 1;
+        }
+    }
+    test("result/page (object count)", pages == 2);
+    test("result/page (object form)", saw_allow);
+
+    test("result/page (scalar)", opa_result_iter_begin(opa_result_get(v, "allow", 5)) == NULL);
+    test("result/page (null)", opa_result_iter_begin(NULL) == NULL &&
+         opa_result_iter_next(NULL) == NULL);
 }
 
 opa_value *__new_value_path(int sz, ...)
@@ -2890,6 +4713,59 @@ opa_value *__new_value_path(int sz, ...)
     return path;
 }
 
+WASM_EXPORT(test_opa_value_transitive_closure)
+void test_opa_value_transitive_closure(void)
+{
+    // {"a": {"b": 1}, "c": [10]}
+    opa_value *inner = opa_object();
+    opa_object_insert(opa_cast_object(inner), opa_string_terminated("b"), opa_number_int(1));
+
+    opa_value *arr = opa_array();
+    opa_array_append(opa_cast_array(arr), opa_number_int(10));
+
+    opa_value *doc = opa_object();
+    opa_object_insert(opa_cast_object(doc), opa_string_terminated("a"), inner);
+    opa_object_insert(opa_cast_object(doc), opa_string_terminated("c"), arr);
+
+    opa_value *r = opa_value_transitive_closure(doc);
+    test("walk/count", opa_value_length(r) == 5);
+
+    opa_value *t0 = opa_value_get(r, opa_number_int(0));
+    test("walk/root", opa_value_length(opa_value_get(t0, opa_number_int(0))) == 0 &&
+         opa_value_get(t0, opa_number_int(1)) == doc);
+
+    // every tuple's path resolves to its value
+    for (int i = 0; i < 5; i++)
+    {
+        opa_value *t = opa_value_get(r, opa_number_int(i));
+        opa_value *p = opa_value_get(t, opa_number_int(0));
+        opa_value *cur = doc;
+
+        for (size_t j = 0; j < opa_value_length(p); j++)
+        {
+            cur = opa_value_get(cur, opa_value_get(p, opa_number_int(j)));
+        }
+
+        test("walk/path resolves", cur != NULL && opa_value_compare(cur, opa_value_get(t, opa_number_int(1))) == 0);
+    }
+
+    // paths along a single descent are views over shared storage
+    opa_value *deep = opa_number_int(42);
+    for (int i = 0; i < 8; i++)
+    {
+        opa_value *o = opa_object();
+        opa_object_insert(opa_cast_object(o), opa_string_terminated("k"), deep);
+        deep = o;
+    }
+
+    r = opa_value_transitive_closure(deep);
+    test("walk/deep count", opa_value_length(r) == 9);
+
+    opa_array_t *p1 = opa_cast_array(opa_value_get(opa_value_get(r, opa_number_int(1)), opa_number_int(0)));
+    opa_array_t *p8 = opa_cast_array(opa_value_get(opa_value_get(r, opa_number_int(8)), opa_number_int(0)));
+    test("walk/deep shared", p1->elems == p8->elems && p1->len == 1 && p8->len == 8);
+}
+
 WASM_EXPORT(test_opa_value_add_path)
 void test_opa_value_add_path() {
     opa_value *data = opa_object();
@@ -3231,6 +5107,38 @@ void test_regex(void)
             test_submatch_string(tests[i].text, &tests[i].sequences->sequences[j], opa_value_get(result, opa_number_int(j)));
         }
     }
+
+    opa_set_t *patterns = opa_cast_set(opa_set());
+    opa_set_add(patterns, opa_string_terminated("^abc"));
+    opa_set_add(patterns, opa_string_terminated("def$"));
+    opa_set_add(patterns, opa_string_terminated("xyz"));
+
+    opa_value *matched = opa_regex_match_all(&patterns->hdr, opa_string_terminated("abcdef"));
+    test("regex/match_all (len)", opa_value_length(matched) == 2);
+    test("regex/match_all", opa_value_get(matched, opa_string_terminated("^abc")) != NULL);
+    test("regex/match_all", opa_value_get(matched, opa_string_terminated("def$")) != NULL);
+    test("regex/match_all (miss)", opa_value_length(opa_regex_match_all(&patterns->hdr, opa_string_terminated("nothing"))) == 0);
+    test("regex/match_all (non-string)", opa_regex_match_all(&patterns->hdr, opa_number_int(1)) == NULL);
+
+    opa_value *split = opa_regex_split(opa_string_terminated(","), opa_string_terminated("a,b,,c,"));
+    test("regex/split (len)", opa_value_length(split) == 5);
+    test("regex/split", opa_value_compare(opa_value_get(split, opa_number_int(0)), opa_string_terminated("a")) == 0);
+    test("regex/split", opa_value_compare(opa_value_get(split, opa_number_int(2)), opa_string_terminated("")) == 0);
+    test("regex/split", opa_value_compare(opa_value_get(split, opa_number_int(4)), opa_string_terminated("")) == 0);
+
+    split = opa_regex_split(opa_string_terminated("z+"), opa_string_terminated("zzabzzcdzz"));
+    test("regex/split (len)", opa_value_length(split) == 4);
+    test("regex/split", opa_value_compare(opa_value_get(split, opa_number_int(0)), opa_string_terminated("")) == 0);
+    test("regex/split", opa_value_compare(opa_value_get(split, opa_number_int(1)), opa_string_terminated("ab")) == 0);
+    test("regex/split", opa_value_compare(opa_value_get(split, opa_number_int(2)), opa_string_terminated("cd")) == 0);
+    test("regex/split", opa_value_compare(opa_value_get(split, opa_number_int(3)), opa_string_terminated("")) == 0);
+
+    split = opa_regex_split(opa_string_terminated(","), opa_string_terminated(""));
+    test("regex/split (empty)", opa_value_length(split) == 1);
+    test("regex/split (empty)", opa_value_compare(opa_value_get(split, opa_number_int(0)), opa_string_terminated("")) == 0);
+
+    test("regex/split (no match)", opa_value_length(opa_regex_split(opa_string_terminated(","), opa_string_terminated("abc"))) == 1);
+    test("regex/split (invalid)", opa_regex_split(opa_string_terminated("("), opa_string_terminated("abc")) == NULL);
 }
 
 WASM_EXPORT(test_opa_lookup)
@@ -3270,4 +5178,12 @@ void test_opa_mapping_init(void)
     opa_array_append(path1, opa_string_terminated("foo"));
     opa_array_append(path1, opa_string_terminated("bar"));
     test("opa_mapping_init/opa_lookup_works", opa_mapping_lookup(&path1->hdr) == 123);
+
+    // partial and unknown paths miss the flattened table.
+    opa_array_t *path2 = opa_cast_array(opa_array());
+    opa_array_append(path2, opa_string_terminated("foo"));
+    test("opa_mapping_init/partial_path_misses", opa_mapping_lookup(&path2->hdr) == 0);
+
+    opa_array_append(path2, opa_string_terminated("qux"));
+    test("opa_mapping_init/unknown_path_misses", opa_mapping_lookup(&path2->hdr) == 0);
 }